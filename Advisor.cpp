@@ -0,0 +1,291 @@
+#include "Advisor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "DpSolver.hpp"
+
+namespace {
+
+// Candidate shares like the solver's (DpSolver.cpp), plus the rollout
+// policy's own choice at every level.
+const double kTradeShares[] = {-0.3, -0.15, -0.05, 0.0, 0.05, 0.15, 0.3};
+const double kFeedShares[] = {1.0, 0.85, 0.7, 0.56};
+const double kPlantShares[] = {1.0, 0.75, 0.5};
+
+// Rollouts per leaf visit: enough to keep the lock out of the way.
+constexpr int kRolloutsPerVisit = 8;
+// UCB1 exploration; the objective moves by whole score tiers.
+constexpr double kExploration = 0.5;
+
+bool sameAt(AdvisorStage stage, const Decisions& a, const Decisions& b) {
+    switch (stage) {
+    case AdvisorStage::Trade: return a.acresToBuy == b.acresToBuy && a.acresToSell == b.acresToSell;
+    case AdvisorStage::Feed: return a.bushelsToFeed == b.bushelsToFeed;
+    case AdvisorStage::Plant: return a.acresToPlant == b.acresToPlant;
+    }
+    return false;
+}
+
+void copyStage(AdvisorStage stage, const Decisions& from, Decisions& to) {
+    switch (stage) {
+    case AdvisorStage::Trade:
+        to.acresToBuy = from.acresToBuy;
+        to.acresToSell = from.acresToSell;
+        break;
+    case AdvisorStage::Feed: to.bushelsToFeed = from.bushelsToFeed; break;
+    case AdvisorStage::Plant: to.acresToPlant = from.acresToPlant; break;
+    }
+}
+
+}
+
+Advisor::Advisor(const GameRules& r, const Policy& rollout, const AdvisorOptions& opt)
+    : r_(r), policy_(rollout), seed_(Rng().seed()), budget_(opt.secondsPerYear) {
+    const unsigned n = std::max(1u, opt.threads);
+    for (unsigned i = 0; i < n; ++i) threads_.emplace_back([this] { workerLoop(); });
+}
+
+Advisor::~Advisor() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_) t.join();
+}
+
+void Advisor::start(const GameState& s) {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        ++generation_;
+        state_ = s;
+        nodes_.assign(1, Node{});
+        root_ = 0;
+        searching_ = true;
+        deadline_ = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget_);
+    }
+    wake_.notify_all();
+}
+
+void Advisor::settle(AdvisorStage stage, const Decisions& d) {
+    std::lock_guard<std::mutex> lk(m_);
+    if (nodes_.empty() || nodes_[root_].depth != static_cast<int>(stage)) return;
+    if (!nodes_[root_].expanded) expand(root_);
+
+    std::int32_t child = findChild(root_, stage, d);
+    if (child < 0) {
+        // An answer the search did not consider: it goes on from scratch there.
+        Node n;
+        n.d = nodes_[root_].d;
+        copyStage(stage, d, n.d);
+        n.depth = nodes_[root_].depth + 1;
+        n.parent = root_;
+        child = static_cast<std::int32_t>(nodes_.size());
+        nodes_.push_back(std::move(n));
+        nodes_[root_].children.push_back(child);
+    }
+    root_ = child;
+}
+
+void Advisor::stop() {
+    std::lock_guard<std::mutex> lk(m_);
+    searching_ = false;
+    ++generation_;
+}
+
+AdvisorHint Advisor::hint() const {
+    std::lock_guard<std::mutex> lk(m_);
+    AdvisorHint h;
+    if (nodes_.empty()) return h;
+
+    // The most visited child at every level.
+    std::int32_t n = root_;
+    for (;;) {
+        std::int32_t best = -1;
+        for (std::int32_t c : nodes_[n].children) {
+            if (nodes_[c].visits > 0 && (best < 0 || nodes_[c].visits > nodes_[best].visits)) best = c;
+        }
+        if (best < 0) break;
+        n = best;
+    }
+    const Node& rec = nodes_[n];
+    h.rollouts = rec.visits;
+    h.decisions = rec.depth == 3 ? rec.d : baselineFor(rec.d, rec.depth);
+    if (rec.visits > 0) h.survival = static_cast<double>(rec.completed) / rec.visits;
+    if (rec.completed > 0) {
+        h.meanP = rec.sumP / rec.completed;
+        h.meanL = rec.sumL / rec.completed;
+    }
+
+    // The rollout policy's decisions, as far down as the tree has them.
+    const Decisions base = baselineFor(nodes_[root_].d, nodes_[root_].depth);
+    std::int32_t m = root_;
+    while (nodes_[m].depth < 3) {
+        const std::int32_t c = findChild(m, static_cast<AdvisorStage>(nodes_[m].depth), base);
+        if (c < 0) break;
+        m = c;
+    }
+    const Node& b = nodes_[m];
+    h.baselineRollouts = b.visits;
+    if (b.visits > 0) h.baselineSurvival = static_cast<double>(b.completed) / b.visits;
+    if (b.completed > 0) {
+        h.baselineP = b.sumP / b.completed;
+        h.baselineL = b.sumL / b.completed;
+    }
+    return h;
+}
+
+void Advisor::workerLoop() {
+    std::unique_lock<std::mutex> lk(m_);
+    for (;;) {
+        wake_.wait(lk, [this] { return quit_ || searching_; });
+        if (quit_) return;
+        if (std::chrono::steady_clock::now() >= deadline_) {
+            searching_ = false;
+            continue;
+        }
+
+        const std::int32_t leaf = select();
+        for (std::int32_t i = leaf; i >= 0; i = nodes_[i].parent) nodes_[i].pending += kRolloutsPerVisit;
+        const std::uint64_t generation = generation_;
+        const std::uint64_t first = nextRollout_;
+        nextRollout_ += kRolloutsPerVisit;
+        const GameState s = state_;
+        const Node& node = nodes_[leaf];
+        const Decisions d = node.depth == 3 ? node.d : baselineFor(node.d, node.depth);
+
+        lk.unlock();
+        const Tally t = rollouts(s, d, first, kRolloutsPerVisit);
+        lk.lock();
+
+        // A tree of another year, or none.
+        if (generation != generation_) continue;
+        for (std::int32_t i = leaf; i >= 0; i = nodes_[i].parent) {
+            Node& n = nodes_[i];
+            n.pending -= kRolloutsPerVisit;
+            n.visits += kRolloutsPerVisit;
+            n.valueSum += t.valueSum;
+            n.completed += t.completed;
+            n.sumP += t.sumP;
+            n.sumL += t.sumL;
+        }
+    }
+}
+
+// UCB1 down from the current root, expanding as it goes. Rollouts on their way
+// count as visits, so threads spread over the tree.
+std::int32_t Advisor::select() {
+    std::int32_t n = root_;
+    while (nodes_[n].depth < 3) {
+        if (!nodes_[n].expanded) expand(n);
+        const Node& node = nodes_[n];
+        if (node.children.empty()) break;
+
+        const double logParent = std::log(static_cast<double>(node.visits + node.pending) + 1.0);
+        std::int32_t best = node.children.front();
+        double bestScore = -1e300;
+        for (std::int32_t c : node.children) {
+            const Node& child = nodes_[c];
+            const double seen = static_cast<double>(child.visits + child.pending);
+            if (seen == 0.0) {
+                best = c;
+                break;
+            }
+            const double mean = child.visits > 0 ? child.valueSum / child.visits : kLostObjective;
+            const double score = mean + kExploration * std::sqrt(logParent / seen);
+            if (score > bestScore) {
+                bestScore = score;
+                best = c;
+            }
+        }
+        n = best;
+    }
+    return n;
+}
+
+void Advisor::expand(std::int32_t node) {
+    const Decisions d = nodes_[node].d;
+    const int depth = nodes_[node].depth;
+    const GameState& s = state_;
+    const AdvisorStage stage = static_cast<AdvisorStage>(depth);
+
+    std::vector<Decisions> candidates;
+    candidates.push_back(baselineFor(d, depth));
+    if (stage == AdvisorStage::Trade) {
+        for (double share : kTradeShares) {
+            Decisions c = d;
+            const int acres = static_cast<int>(std::lround(std::fabs(share) * s.landAcres));
+            if (share > 0.0) c.acresToBuy = acres;
+            else c.acresToSell = acres;
+            candidates.push_back(clampDecisions(s, c, r_));
+        }
+    } else if (stage == AdvisorStage::Feed) {
+        const int need = s.population * r_.bushelsPerPersonPerYear;
+        for (double share : kFeedShares) {
+            Decisions c = d;
+            c.bushelsToFeed = static_cast<int>(std::ceil(need * share));
+            candidates.push_back(clampDecisions(s, c, r_));
+        }
+    } else {
+        Decisions most = d;
+        most.acresToPlant = landAfterTrade(s, d) + s.population * r_.acresPerPersonMax; // clamped below
+        most = clampDecisions(s, most, r_);
+        for (double share : kPlantShares) {
+            Decisions c = d;
+            c.acresToPlant = static_cast<int>(most.acresToPlant * share);
+            candidates.push_back(c);
+        }
+    }
+
+    nodes_[node].expanded = true;
+    for (const Decisions& c : candidates) {
+        if (findChild(node, stage, c) >= 0) continue;
+        Node n;
+        n.d = d;
+        copyStage(stage, c, n.d);
+        n.depth = depth + 1;
+        n.parent = node;
+        const auto index = static_cast<std::int32_t>(nodes_.size());
+        nodes_.push_back(std::move(n));
+        nodes_[node].children.push_back(index);
+    }
+}
+
+std::int32_t Advisor::findChild(std::int32_t node, AdvisorStage stage, const Decisions& d) const {
+    for (std::int32_t c : nodes_[node].children) {
+        if (sameAt(stage, nodes_[c].d, d)) return c;
+    }
+    return -1;
+}
+
+// What the rollout policy would do after the first depth stages of settled.
+Decisions Advisor::baselineFor(const Decisions& settled, int depth) const {
+    Decisions d = clampDecisions(state_, policy_.decide(state_, r_), r_);
+    for (int stage = 0; stage < depth; ++stage) copyStage(static_cast<AdvisorStage>(stage), settled, d);
+    return clampDecisions(state_, d, r_);
+}
+
+Advisor::Tally Advisor::rollouts(const GameState& s, const Decisions& d, std::uint64_t first, int n) const {
+    Tally t;
+    for (int k = 0; k < n; ++k) {
+        GameState g = s;
+        Rng rng(seed_, first + static_cast<std::uint64_t>(k));
+        YearOutcome e = resolveYear(g, d, r_, rng);
+        while (e == YearOutcome::Continued && g.year <= r_.totalYears) {
+            beginYear(g, r_, rng);
+            e = resolveYear(g, clampDecisions(g, policy_.decide(g, r_), r_), r_, rng);
+        }
+        if (e != YearOutcome::Continued) {
+            t.valueSum += kLostObjective;
+            continue;
+        }
+        const FinalScore f = computeFinalScore(g, r_);
+        t.valueSum += finalObjective(g, r_);
+        t.completed += 1;
+        t.sumP += f.avgStarvedPercent;
+        t.sumL += f.acresPerCitizen;
+    }
+    return t;
+}
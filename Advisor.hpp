@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "Policy.hpp"
+
+// Background search for the interactive game. While the player reads the
+// report and types, worker threads run Monte Carlo tree search over the year's
+// decisions: land trade, then feeding, then planting. A leaf is scored by
+// playing the game to its end with the rollout policy on the advisor's own
+// random draws (never the game's), by the solver's objective (DpSolver.hpp).
+//
+// The tree lives for one year. Every answer the player enters moves the search
+// below the matching node, so what was learned about it is kept.
+
+enum class AdvisorStage {
+    Trade, // buy or sell
+    Feed,
+    Plant,
+};
+
+struct AdvisorOptions {
+    unsigned threads = 1;
+    double secondsPerYear = 30.0; // the search stops by itself after that
+};
+
+struct AdvisorHint {
+    std::uint64_t rollouts = 0; // behind the recommendation; 0 = nothing to say yet
+    Decisions decisions;        // keeps what the player has entered
+    double survival = 0.0;      // share of rollouts that played all years
+    double meanP = 0.0;         // P and L at the end of those rollouts
+    double meanL = 0.0;
+
+    // The same for the rollout policy's own decisions, to compare with.
+    std::uint64_t baselineRollouts = 0;
+    double baselineSurvival = 0.0;
+    double baselineP = 0.0;
+    double baselineL = 0.0;
+};
+
+class Advisor {
+public:
+    // r and rollout must outlive the advisor.
+    Advisor(const GameRules& r, const Policy& rollout, const AdvisorOptions& opt);
+    ~Advisor();
+
+    Advisor(const Advisor&) = delete;
+    Advisor& operator=(const Advisor&) = delete;
+
+    const Policy& rolloutPolicy() const { return policy_; }
+
+    // Searches the decisions of s, whose land price is drawn. Drops the last tree.
+    void start(const GameState& s);
+    // The player's answer for stage, with the earlier stages' ones, in d.
+    void settle(AdvisorStage stage, const Decisions& d);
+    // Ends the search; returns at once, rollouts in flight are discarded.
+    void stop();
+
+    // A snapshot; never waits for a rollout.
+    AdvisorHint hint() const;
+
+private:
+    struct Node {
+        Decisions d;        // the decisions down to this node
+        int depth = 0;      // 0 the year, 1 trade, 2 feeding, 3 planting
+        std::int32_t parent = -1;
+        std::vector<std::int32_t> children;
+        bool expanded = false;
+        std::uint64_t visits = 0;
+        std::uint64_t pending = 0; // rollouts on their way
+        double valueSum = 0.0;
+        std::uint64_t completed = 0;
+        double sumP = 0.0;
+        double sumL = 0.0;
+    };
+
+    struct Tally {
+        double valueSum = 0.0;
+        std::uint64_t completed = 0;
+        double sumP = 0.0;
+        double sumL = 0.0;
+    };
+
+    void workerLoop();
+    bool searching() const;
+    std::int32_t select();
+    void expand(std::int32_t node);
+    std::int32_t findChild(std::int32_t node, AdvisorStage stage, const Decisions& d) const;
+    Decisions baselineFor(const Decisions& settled, int depth) const;
+    Tally rollouts(const GameState& s, const Decisions& d, std::uint64_t first, int n) const;
+
+    const GameRules& r_;
+    const Policy& policy_;
+    std::uint64_t seed_ = 0;
+
+    mutable std::mutex m_;
+    std::condition_variable wake_;
+    std::vector<std::thread> threads_;
+    bool quit_ = false;
+
+    // Guarded by m_.
+    bool searching_ = false;
+    std::chrono::steady_clock::time_point deadline_;
+    std::chrono::duration<double> budget_;
+    std::uint64_t generation_ = 0;
+    std::uint64_t nextRollout_ = 0;
+    GameState state_;
+    std::vector<Node> nodes_;
+    std::int32_t root_ = 0;
+};
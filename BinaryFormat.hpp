@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// What the binary files of the game and the tools have in common (saves and
+// journals, the session store, value tables, the evaluation cache, score
+// distributions, traces, shard checkpoints, the leaderboard):
+//
+// - Fields are written in native byte order, which is little-endian on every
+//   supported target, packed without padding. Each file's "Layout" comment
+//   lists them in order as name:type; f64 is an IEEE double.
+// - A file starts with an 8-byte magic naming the format and a u32 version
+//   that changes whenever the layout or the meaning of a field does.
+// - Files that are appended to or rewritten in place guard their header and
+//   every record with a CRC-32 (Crc32.hpp) of the bytes in front of it, so a
+//   torn or damaged tail is found record by record.
+//
+// The helpers below copy fields in and out of such buffers; memcpy keeps them
+// free of alignment and aliasing concerns.
+
+// Writes v at p + off and moves off past it.
+template <class T>
+void putRaw(unsigned char* p, std::size_t& off, T v) {
+    std::memcpy(p + off, &v, sizeof v);
+    off += sizeof v;
+}
+
+// Reads a T at p + off and moves off past it.
+template <class T>
+T getRaw(const unsigned char* p, std::size_t& off) {
+    T v;
+    std::memcpy(&v, p + off, sizeof v);
+    off += sizeof v;
+    return v;
+}
+
+template <class T>
+void appendRaw(std::vector<unsigned char>& out, T v) {
+    unsigned char b[sizeof v];
+    std::memcpy(b, &v, sizeof v);
+    out.insert(out.end(), b, b + sizeof v);
+}
+
+template <class T>
+void writeRaw(unsigned char* p, T v) {
+    std::memcpy(p, &v, sizeof v);
+}
+
+template <class T>
+T readRaw(const unsigned char* p) {
+    T v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+// FNV-1a (64-bit), the hash of rule sets, cache keys and checkpoint identities.
+// Feed values field by field so that padding never leaks in.
+class Fnv1a {
+public:
+    static constexpr std::uint64_t kOffsetBasis = 14695981039346656037ull;
+    static constexpr std::uint64_t kPrime = 1099511628211ull;
+
+    constexpr explicit Fnv1a(std::uint64_t basis = kOffsetBasis) : h_(basis) {}
+
+    constexpr void mixByte(unsigned char b) {
+        h_ ^= b;
+        h_ *= kPrime;
+    }
+    void mix(const void* data, std::size_t size) {
+        const unsigned char* b = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; ++i) mixByte(b[i]);
+    }
+    template <class T>
+    void mixValue(T v) {
+        mix(&v, sizeof v);
+    }
+
+    constexpr std::uint64_t value() const { return h_; }
+
+private:
+    std::uint64_t h_;
+};
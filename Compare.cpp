@@ -0,0 +1,109 @@
+#include "Compare.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+struct PairScratch {
+    std::vector<Rng> rngs;
+    std::vector<GameResult> a;
+    std::vector<GameResult> b;
+};
+
+void addPair(CompareReport& out, const GameResult& a, const GameResult& b) {
+    out.a.add(a);
+    out.b.add(b);
+    out.completed.add(static_cast<double>(a.completed()) - static_cast<double>(b.completed()));
+    if (a.completed() && b.completed()) {
+        out.p.add(a.score.avgStarvedPercent - b.score.avgStarvedPercent);
+        out.l.add(a.score.acresPerCitizen - b.score.acresPerCitizen);
+    }
+}
+
+template <class Rules>
+void playPairChunk(Rules rules, const Policy& a, const Policy& b, const EvalConfig& cfg, std::size_t c,
+                   PairScratch& scratch, CompareReport& out) {
+    const std::uint64_t chunk = std::max<std::uint64_t>(1, cfg.chunkGames);
+    const std::uint64_t begin = cfg.firstGame + c * chunk;
+    const std::uint64_t end = cfg.firstGame + std::min<std::uint64_t>(cfg.games, (c + 1) * chunk);
+
+    if (cfg.batchLanes <= 0) {
+        for (std::uint64_t g = begin; g < end; ++g) {
+            Rng rng(cfg.seed, g);
+            const GameResult ra = playGame(rules, a, rng);
+            addPair(out, ra, playGame(rules, b, rng));
+        }
+        return;
+    }
+
+    for (std::uint64_t g = begin; g < end; g += static_cast<std::uint64_t>(cfg.batchLanes)) {
+        const std::uint64_t stop = std::min<std::uint64_t>(end, g + static_cast<std::uint64_t>(cfg.batchLanes));
+        scratch.rngs.clear();
+        for (std::uint64_t i = g; i < stop; ++i) scratch.rngs.emplace_back(cfg.seed, i);
+        playGameBatch(rules, a, scratch.rngs, scratch.a);
+        playGameBatch(rules, b, scratch.rngs, scratch.b);
+        for (std::size_t i = 0; i < scratch.a.size(); ++i) addPair(out, scratch.a[i], scratch.b[i]);
+    }
+}
+
+bool targetMet(const MetricStats& s, double target, double z) {
+    return target <= 0.0 || (s.count > 1 && halfWidth(s, z) <= target);
+}
+
+}
+
+void CompareReport::merge(const CompareReport& o) {
+    a.merge(o.a);
+    b.merge(o.b);
+    p.merge(o.p);
+    l.merge(o.l);
+    completed.merge(o.completed);
+}
+
+double confidenceZ(double confidence) {
+    // erf(z / sqrt(2)) = confidence, by bisection; erf is increasing.
+    double lo = 0.0;
+    double hi = 40.0;
+    for (int i = 0; i < 200 && hi - lo > 1e-12; ++i) {
+        const double mid = 0.5 * (lo + hi);
+        if (std::erf(mid / std::sqrt(2.0)) < confidence) lo = mid;
+        else hi = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+double halfWidth(const MetricStats& s, double z) {
+    return s.count > 1 ? z * std::sqrt(s.variance() / static_cast<double>(s.count)) : 0.0;
+}
+
+CompareReport comparePolicies(const GameRules& r, const Policy& a, const Policy& b, const CompareConfig& cfg,
+                              WorkStealingPool& pool) {
+    const std::size_t chunks = evalChunkCount(cfg.eval);
+    const std::size_t round = std::max<std::size_t>(1, cfg.roundChunks);
+    const bool hasTarget = cfg.pHalfWidth > 0.0 || cfg.lHalfWidth > 0.0;
+    const double z = confidenceZ(cfg.confidence);
+
+    std::vector<CompareReport> partial;
+    std::vector<PairScratch> scratch(pool.size());
+    CompareReport total;
+
+    withRules(r, cfg.eval.rulesPresets, [&](auto rules) {
+        for (std::size_t first = 0; first < chunks; first += round) {
+            // One slot per chunk of the round, written only by the worker that plays it.
+            partial.assign(std::min(round, chunks - first), CompareReport{});
+            pool.run(partial.size(), [&](std::size_t i, unsigned worker) {
+                playPairChunk(rules, a, b, cfg.eval, first + i, scratch[worker], partial[i]);
+            });
+            for (const CompareReport& part : partial) total.merge(part);
+
+            if (hasTarget && total.games() >= cfg.minGames && targetMet(total.p, cfg.pHalfWidth, z) &&
+                targetMet(total.l, cfg.lHalfWidth, z)) {
+                total.targetsReached = true;
+                break;
+            }
+        }
+    });
+    return total;
+}
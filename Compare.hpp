@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Evaluator.hpp"
+
+// Paired comparison of two policies with common random numbers. Game g is
+// played by both policies with Rng(seed, firstGame + g), so both see the same
+// land prices, yields, plague coins and rats shares every year, and the
+// per-game differences of P and L vary far less than either policy's results.
+// A difference is then pinned down with many fewer games than by evaluating
+// the two policies on their own.
+//
+// Games are played in rounds of a fixed number of chunks. After each round the
+// confidence intervals of the mean differences are checked, and the comparison
+// stops once every requested half-width is reached. Chunks are merged in
+// order, so the stopping point and the report are the same at any thread count.
+
+struct CompareConfig {
+    EvalConfig eval;                // seed, first game, chunking, lanes; games is the maximum
+    double confidence = 0.95;       // two-sided, for the stopping rule and the reported intervals
+    double pHalfWidth = 0.0;        // target for the mean P difference; 0 = none
+    double lHalfWidth = 0.0;        // target for the mean L difference; 0 = none
+    std::uint64_t minGames = 16384; // played before the first check
+    std::size_t roundChunks = 16;
+};
+
+struct CompareReport {
+    EvalReport a;           // each policy on its own over the same games
+    EvalReport b;
+    MetricStats p;          // P of A minus P of B, games both completed
+    MetricStats l;          // L of A minus L of B, games both completed
+    MetricStats completed;  // completed(A) minus completed(B), every game
+    bool targetsReached = false;
+
+    std::uint64_t games() const { return a.games; }
+    void merge(const CompareReport& o);
+};
+
+// z of a two-sided interval with the given confidence, in (0; 1).
+double confidenceZ(double confidence);
+// Half-width of the confidence interval of s.mean.
+double halfWidth(const MetricStats& s, double z);
+
+CompareReport comparePolicies(const GameRules& r, const Policy& a, const Policy& b, const CompareConfig& cfg,
+                              WorkStealingPool& pool);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, the zlib one). Pass the previous result as crc to
+// checksum data that arrives in pieces.
+std::uint32_t crc32(const void* data, std::size_t size, std::uint32_t crc = 0);
@@ -0,0 +1,289 @@
+#include "DpSolver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+
+namespace {
+
+// Layout (see BinaryFormat.hpp): magic[8] version:u32 years:u32 pop:u32 grain:u32
+// land:u32 starv:u32 rulesHash:u64 (maxValue:f32)[4] valuesCrc32:u32 crc32:u32,
+// then the values as f32 by year, population, land, starvation and grain.
+constexpr char kTableMagic[8] = {'H', 'M', 'D', 'P', 'T', 'B', 'L', '1'};
+constexpr std::uint32_t kTableVersion = 2;
+constexpr std::size_t kHeaderSize = 64;
+
+constexpr double kLostValue = kLostObjective;
+
+// Rats eat a uniform share of maxRats; two midpoint nodes approximate it.
+constexpr double kRatsNodes[] = {0.25, 0.75};
+
+const double kTradeShares[] = {-0.3, -0.15, -0.05, 0.0, 0.05, 0.15, 0.3};
+const double kFeedShares[] = {1.0, 0.85, 0.7, 0.56};
+
+struct FixedEvents {
+    int yield;
+    double ratsShare;
+    bool plagueHits;
+
+    int yieldPerAcre(const GameRules&) { return yield; }
+    int ratsAte(int maxRats) { return static_cast<int>(std::lround(ratsShare * maxRats)); }
+    bool plague(const GameRules&) { return plagueHits; }
+};
+
+}
+
+double finalObjective(const GameState& s, const GameRules& r) {
+    const FinalScore f = computeFinalScore(s, r);
+    const double lCap = 2.0 * std::max(1, r.lGoodUpper);
+    return static_cast<double>(static_cast<int>(f.tier))
+        + 0.1 * std::min(f.acresPerCitizen, lCap) / lCap
+        - 0.1 * std::min(f.avgStarvedPercent, 100.0) / 100.0;
+}
+
+int DpAxis::index(double v) const {
+    if (n <= 1 || v <= 0.0) return 0;
+    double x = std::sqrt(v / maxValue) * (n - 1);
+    int i = static_cast<int>(x + 0.5);
+    return std::min(i, n - 1);
+}
+
+double DpAxis::value(int i) const {
+    if (n <= 1) return 0.0;
+    double t = static_cast<double>(i) / (n - 1);
+    return maxValue * t * t;
+}
+
+void dpCandidateDecisions(const GameState& s, const GameRules& r, std::vector<Decisions>& out) {
+    out.clear();
+    const int need = s.population * r.bushelsPerPersonPerYear;
+    for (double trade : kTradeShares) {
+        Decisions base;
+        int acres = static_cast<int>(std::lround(std::fabs(trade) * s.landAcres));
+        if (trade > 0.0) base.acresToBuy = acres;
+        else base.acresToSell = acres;
+        base = clampDecisions(s, base, r);
+        if (trade != 0.0 && base.acresToBuy == 0 && base.acresToSell == 0) continue;
+
+        for (double feed : kFeedShares) {
+            Decisions d = base;
+            d.bushelsToFeed = static_cast<int>(std::ceil(need * feed));
+            d.acresToPlant = s.landAcres + s.population * r.acresPerPersonMax; // clamped below
+            out.push_back(clampDecisions(s, d, r));
+        }
+    }
+}
+
+std::size_t DpTable::cell(int year, int p, int l, int st, int g) const {
+    return ((((static_cast<std::size_t>(year - 1) * pop_.n + p) * land_.n + l) * starv_.n + st) * grain_.n) + g;
+}
+
+double DpTable::lookup(int year, const GameState& s) const {
+    if (s.population <= 0) return kLostValue;
+    return values_[cell(year, pop_.index(s.population), land_.index(s.landAcres),
+                        starv_.index(s.starvationPercentSum), grain_.index(s.grainBushels()))];
+}
+
+double DpTable::value(const GameState& s) const {
+    return lookup(std::min(s.year, years_), s);
+}
+
+double DpTable::expectedValue(const GameState& s, const Decisions& d, const GameRules& r) const {
+    const double yieldWeight = 1.0 / (r.yieldPerAcreMax - r.yieldPerAcreMin + 1);
+    const double ratsWeight = 1.0 / (sizeof kRatsNodes / sizeof kRatsNodes[0]);
+    double q = 0.0;
+
+    for (int y = r.yieldPerAcreMin; y <= r.yieldPerAcreMax; ++y) {
+        for (double rats : kRatsNodes) {
+            for (int hit = 0; hit < 2; ++hit) {
+                const double w = yieldWeight * ratsWeight * (hit ? r.plagueProbability : 1.0 - r.plagueProbability);
+                if (w == 0.0) continue;
+                GameState t = s;
+                FixedEvents ev{y, rats, hit != 0};
+                double v = kLostValue;
+                if (resolveYearWith(t, d, r, ev) == YearOutcome::Continued) {
+                    v = (t.year > r.totalYears) ? finalObjective(t, r) : lookup(t.year, t);
+                }
+                q += w * v;
+            }
+        }
+    }
+    return q;
+}
+
+Decisions DpTable::bestDecisions(const GameState& s, const GameRules& r) const {
+    std::vector<Decisions> candidates;
+    dpCandidateDecisions(s, r, candidates);
+    Decisions best;
+    double bestValue = -1e300;
+    for (const Decisions& d : candidates) {
+        double q = expectedValue(s, d, r);
+        if (q > bestValue) {
+            bestValue = q;
+            best = d;
+        }
+    }
+    return best;
+}
+
+void DpTable::solveYear(int year, const GameRules& r, WorkStealingPool& pool) {
+    float* layer = owned_.data();
+    const std::size_t tasks = static_cast<std::size_t>(pop_.n) * land_.n;
+
+    pool.run(tasks, [&](std::size_t task, unsigned) {
+        const int p = static_cast<int>(task / land_.n);
+        const int l = static_cast<int>(task % land_.n);
+        std::vector<Decisions> candidates;
+        const int grainScale = r.grainScale();
+
+        for (int st = 0; st < starv_.n; ++st) {
+            for (int g = 0; g < grain_.n; ++g) {
+                GameState s;
+                s.year = year;
+                s.population = static_cast<int>(std::lround(pop_.value(p)));
+                s.landAcres = static_cast<int>(std::lround(land_.value(l)));
+                s.starvationPercentSum = starv_.value(st);
+                // The grid point rounded to the nearest grain unit.
+                s.grainScale = grainScale;
+                s.grainUnits = std::llround(grain_.value(g) * grainScale);
+                s.yearsCompleted = year - 1;
+                s.awaitingPlayerDecisions = true;
+
+                double v;
+                if (s.population <= 0) {
+                    v = kLostValue;
+                } else if (year > r.totalYears) {
+                    v = finalObjective(s, r);
+                } else {
+                    // Average over the land price of the best response to it.
+                    v = 0.0;
+                    for (int price = r.landPriceMin; price <= r.landPriceMax; ++price) {
+                        s.landPriceThisYear = price;
+                        dpCandidateDecisions(s, r, candidates);
+                        double best = kLostValue;
+                        for (const Decisions& d : candidates) best = std::max(best, expectedValue(s, d, r));
+                        v += best;
+                    }
+                    v /= (r.landPriceMax - r.landPriceMin + 1);
+                }
+                layer[cell(year, p, l, st, g)] = static_cast<float>(v);
+            }
+        }
+    });
+}
+
+bool DpTable::solve(const GameRules& r, const DpGrid& grid, WorkStealingPool& pool) {
+    if (grid.popBuckets < 2 || grid.grainBuckets < 2 || grid.landBuckets < 2 || grid.starvBuckets < 2) {
+        return false;
+    }
+    mapped_.close();
+
+    years_ = r.totalYears + 1;
+    pop_ = {grid.popBuckets, static_cast<float>(r.initialPopulation + r.totalYears * std::max(r.immigrantsMax, 1))};
+    grain_ = {grid.grainBuckets, static_cast<float>(std::max(1.0, r.initialGrainBushels) * 10.0)};
+    land_ = {grid.landBuckets, static_cast<float>(std::max(1, r.initialLandAcres) * 4)};
+    starv_ = {grid.starvBuckets, static_cast<float>(r.totalYears * r.starvationLossFraction * 100.0)};
+    rulesHash_ = r.hash();
+
+    owned_.assign(static_cast<std::size_t>(years_) * pop_.n * land_.n * starv_.n * grain_.n, 0.0f);
+    values_ = owned_.data();
+
+    // Year y only reads year y + 1, so each year is one parallel sweep.
+    for (int year = years_; year >= 1; --year) {
+        solveYear(year, r, pool);
+    }
+    valuesCrc_ = crc32(values_, owned_.size() * sizeof(float));
+    return true;
+}
+
+std::uint64_t DpTable::contentHash() const {
+    if (!ready()) return 0;
+    Fnv1a h;
+    h.mixValue(rulesHash_);
+    for (const DpAxis* a : {&pop_, &grain_, &land_, &starv_}) {
+        h.mixValue(a->n);
+        h.mixValue(a->maxValue);
+    }
+    h.mixValue(years_);
+    h.mixValue(valuesCrc_); // a byte-wise FNV of the values would be several times slower
+    return h.value();
+}
+
+// Written to a new file that then replaces path, so a process that has the
+// old table mapped keeps reading it intact.
+bool DpTable::save(const std::string& path) const {
+    if (!ready()) return false;
+
+    const std::size_t count = static_cast<std::size_t>(years_) * pop_.n * land_.n * starv_.n * grain_.n;
+    std::vector<unsigned char> buf(kHeaderSize + count * sizeof(float));
+    unsigned char* header = buf.data();
+    std::size_t off = 0;
+    std::memcpy(header, kTableMagic, sizeof kTableMagic);
+    off += sizeof kTableMagic;
+    putRaw<std::uint32_t>(header, off, kTableVersion);
+    putRaw<std::uint32_t>(header, off, static_cast<std::uint32_t>(years_));
+    putRaw<std::uint32_t>(header, off, static_cast<std::uint32_t>(pop_.n));
+    putRaw<std::uint32_t>(header, off, static_cast<std::uint32_t>(grain_.n));
+    putRaw<std::uint32_t>(header, off, static_cast<std::uint32_t>(land_.n));
+    putRaw<std::uint32_t>(header, off, static_cast<std::uint32_t>(starv_.n));
+    putRaw<std::uint64_t>(header, off, rulesHash_);
+    putRaw<float>(header, off, pop_.maxValue);
+    putRaw<float>(header, off, grain_.maxValue);
+    putRaw<float>(header, off, land_.maxValue);
+    putRaw<float>(header, off, starv_.maxValue);
+    putRaw<std::uint32_t>(header, off, valuesCrc_);
+    putRaw<std::uint32_t>(header, off, crc32(header, off));
+    std::memcpy(buf.data() + kHeaderSize, values_, count * sizeof(float));
+    return replaceFileAtomically(path, buf.data(), buf.size());
+}
+
+bool DpTable::load(const std::string& path, const GameRules& r) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < kHeaderSize) return false;
+
+    const unsigned char* p = file.data();
+    if (std::memcmp(p, kTableMagic, sizeof kTableMagic) != 0) return false;
+    std::size_t off = sizeof kTableMagic;
+    if (getRaw<std::uint32_t>(p, off) != kTableVersion) return false;
+
+    const int years = static_cast<int>(getRaw<std::uint32_t>(p, off));
+    DpAxis pop{static_cast<int>(getRaw<std::uint32_t>(p, off)), 0.0f};
+    DpAxis grain{static_cast<int>(getRaw<std::uint32_t>(p, off)), 0.0f};
+    DpAxis land{static_cast<int>(getRaw<std::uint32_t>(p, off)), 0.0f};
+    DpAxis starv{static_cast<int>(getRaw<std::uint32_t>(p, off)), 0.0f};
+    const std::uint64_t hash = getRaw<std::uint64_t>(p, off);
+    pop.maxValue = getRaw<float>(p, off);
+    grain.maxValue = getRaw<float>(p, off);
+    land.maxValue = getRaw<float>(p, off);
+    starv.maxValue = getRaw<float>(p, off);
+    const std::uint32_t valuesCrc = getRaw<std::uint32_t>(p, off);
+    if (readRaw<std::uint32_t>(p + off) != crc32(p, off)) return false;
+
+    if (hash != r.hash() || years != r.totalYears + 1) return false;
+    // Every axis has two points at least, as solve() makes them, and the
+    // values fill the rest of the file exactly.
+    std::size_t count = static_cast<std::size_t>(years);
+    for (const DpAxis* a : {&pop, &grain, &land, &starv}) {
+        if (a->n < 2 || count > (file.size() - kHeaderSize) / sizeof(float) / static_cast<std::size_t>(a->n)) {
+            return false;
+        }
+        count *= static_cast<std::size_t>(a->n);
+    }
+    if (file.size() != kHeaderSize + count * sizeof(float)) return false;
+    if (crc32(p + kHeaderSize, count * sizeof(float)) != valuesCrc) return false;
+
+    owned_.clear();
+    years_ = years;
+    pop_ = pop;
+    grain_ = grain;
+    land_ = land;
+    starv_ = starv;
+    rulesHash_ = hash;
+    valuesCrc_ = valuesCrc;
+    mapped_ = std::move(file);
+    values_ = reinterpret_cast<const float*>(mapped_.data() + kHeaderSize);
+    return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "MappedFile.hpp"
+#include "Policy.hpp"
+#include "WorkStealingPool.hpp"
+
+// Backward-induction solver over a discretized state space.
+//
+// A value is stored for every (year, population, land, starvation sum, grain)
+// bucket: the expected objective when the year starts, before its land price is
+// drawn. The price is integrated out while solving and handled exactly when
+// acting, which keeps the table ten times smaller than storing it as an axis.
+//
+// The objective follows printFinalScore: the score tier (terrible 0 ..
+// excellent 3) plus small tie-breaks for a lower P and a higher L; a game that
+// ends early (overthrown, depopulated, plague) is worth -1.
+
+struct DpGrid {
+    int popBuckets = 12;
+    int grainBuckets = 16;
+    int landBuckets = 12;
+    int starvBuckets = 5; // buckets of the running sum of yearly starvation percents
+};
+
+// Bucket i stands for maxValue * (i / (n - 1))^2: dense near zero, where one
+// bushel or citizen matters most.
+struct DpAxis {
+    int n = 1;
+    float maxValue = 0.0f;
+
+    int index(double v) const;
+    double value(int i) const;
+};
+
+class DpTable {
+public:
+    bool solve(const GameRules& r, const DpGrid& grid, WorkStealingPool& pool);
+
+    // Saved tables are mapped back into memory on load, after a CRC check of
+    // the values. A save replaces the file, never rewrites it in place.
+    bool save(const std::string& path) const;
+    bool load(const std::string& path, const GameRules& r);
+
+    bool ready() const { return values_ != nullptr; }
+    std::uint64_t rulesHash() const { return rulesHash_; }
+    // Hash of the grid and every value; reads the whole table.
+    std::uint64_t contentHash() const;
+
+    // Value of starting s.year in state s (price not yet known).
+    double value(const GameState& s) const;
+    // Expected objective of taking d in s with the price already drawn.
+    double expectedValue(const GameState& s, const Decisions& d, const GameRules& r) const;
+    // Best candidate decisions for s, using its actual land price.
+    Decisions bestDecisions(const GameState& s, const GameRules& r) const;
+
+private:
+    std::size_t cell(int year, int p, int l, int st, int g) const;
+    double lookup(int year, const GameState& s) const;
+    void solveYear(int year, const GameRules& r, WorkStealingPool& pool);
+
+    int years_ = 0; // layers for years 1 .. totalYears + 1 (the final score)
+    DpAxis pop_, grain_, land_, starv_;
+    std::uint64_t rulesHash_ = 0;
+    std::uint32_t valuesCrc_ = 0;
+
+    std::vector<float> owned_;
+    MappedFile mapped_;
+    const float* values_ = nullptr;
+};
+
+// The objective of a game that played all its years; a lost one is worth
+// kLostObjective.
+constexpr double kLostObjective = -1.0;
+double finalObjective(const GameState& s, const GameRules& r);
+
+// Decisions the solver considers in a state: a few land trades relative to the
+// current holdings times a few feeding levels, each planting all it can.
+void dpCandidateDecisions(const GameState& s, const GameRules& r, std::vector<Decisions>& out);
+
+// Plays the solved table.
+class OptimalPolicy : public Policy {
+public:
+    explicit OptimalPolicy(std::shared_ptr<const DpTable> table) : table_(std::move(table)) {}
+
+    const char* name() const override { return "optimal"; }
+    Decisions decide(const GameState& s, const GameRules& r) const override {
+        return table_->bestDecisions(s, r);
+    }
+    std::uint64_t contentHash() const override { return table_->contentHash(); }
+
+private:
+    std::shared_ptr<const DpTable> table_;
+};
@@ -0,0 +1,168 @@
+#include "EvalCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+
+namespace {
+
+// Layout (see BinaryFormat.hpp):
+//   header: magic[8] version:u32 crc32:u32
+//   record: key:u64 games:u64 endings:u64[4] tiers:u64[4]
+//           p.count:u64 p.mean:f64 p.m2:f64 l.count:u64 l.mean:f64 l.m2:f64 crc32:u32
+constexpr char kCacheMagic[8] = {'H', 'M', 'E', 'V', 'A', 'L', 'C', '1'};
+constexpr std::uint32_t kCacheVersion = 2; // 2: exact grain under every rule set
+constexpr std::size_t kCacheHeaderSize = 16;
+constexpr std::size_t kRecordSize = 8 * 16 + 4;
+
+void putStats(unsigned char* p, std::size_t& off, const MetricStats& m) {
+    putRaw<std::uint64_t>(p, off, m.count);
+    putRaw<double>(p, off, m.mean);
+    putRaw<double>(p, off, m.m2);
+}
+
+MetricStats getStats(const unsigned char* p, std::size_t& off) {
+    MetricStats m;
+    m.count = getRaw<std::uint64_t>(p, off);
+    m.mean = getRaw<double>(p, off);
+    m.m2 = getRaw<double>(p, off);
+    return m;
+}
+
+void encodeRecord(std::uint64_t key, const EvalReport& r, unsigned char* p) {
+    std::size_t off = 0;
+    putRaw<std::uint64_t>(p, off, key);
+    putRaw<std::uint64_t>(p, off, r.games);
+    for (std::uint64_t v : r.endings) putRaw<std::uint64_t>(p, off, v);
+    for (std::uint64_t v : r.tiers) putRaw<std::uint64_t>(p, off, v);
+    putStats(p, off, r.p);
+    putStats(p, off, r.l);
+    putRaw<std::uint32_t>(p, off, crc32(p, off));
+}
+
+bool decodeRecord(const unsigned char* p, std::uint64_t& key, EvalReport& r) {
+    std::size_t crcOff = kRecordSize - 4;
+    if (getRaw<std::uint32_t>(p, crcOff) != crc32(p, kRecordSize - 4)) return false;
+    std::size_t off = 0;
+    key = getRaw<std::uint64_t>(p, off);
+    r.games = getRaw<std::uint64_t>(p, off);
+    for (std::uint64_t& v : r.endings) v = getRaw<std::uint64_t>(p, off);
+    for (std::uint64_t& v : r.tiers) v = getRaw<std::uint64_t>(p, off);
+    r.p = getStats(p, off);
+    r.l = getStats(p, off);
+    return true;
+}
+
+void encodeHeader(unsigned char* p) {
+    std::size_t off = 0;
+    std::memcpy(p, kCacheMagic, sizeof kCacheMagic);
+    off += sizeof kCacheMagic;
+    putRaw<std::uint32_t>(p, off, kCacheVersion);
+    putRaw<std::uint32_t>(p, off, crc32(p, off));
+}
+
+}
+
+EvalCache::~EvalCache() {
+    close();
+}
+
+bool EvalCache::open(const std::string& path) {
+    close();
+    std::error_code ec;
+    const bool exists = std::filesystem::exists(path, ec);
+
+    if (!exists) {
+        f_ = std::fopen(path.c_str(), "wb");
+        if (!f_) return false;
+        unsigned char header[kCacheHeaderSize];
+        encodeHeader(header);
+        if (std::fwrite(header, 1, sizeof header, f_) != sizeof header || std::fflush(f_) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) return false;
+    unsigned char header[kCacheHeaderSize];
+    unsigned char expected[kCacheHeaderSize];
+    encodeHeader(expected);
+    if (std::fread(header, 1, sizeof header, in) != sizeof header ||
+        std::memcmp(header, expected, sizeof header) != 0) {
+        std::fclose(in);
+        return false;
+    }
+
+    // Records up to the first damaged one; the rest of the file is cut off.
+    std::uintmax_t good = kCacheHeaderSize;
+    std::vector<unsigned char> buf(kRecordSize * 4096);
+    bool damaged = false;
+    for (;;) {
+        const std::size_t got = std::fread(buf.data(), 1, buf.size(), in);
+        std::size_t off = 0;
+        for (; !damaged && off + kRecordSize <= got; off += kRecordSize) {
+            std::uint64_t key = 0;
+            EvalReport r;
+            if (!decodeRecord(buf.data() + off, key, r)) {
+                damaged = true;
+                break;
+            }
+            reports_[key] = r;
+            good += kRecordSize;
+        }
+        if (damaged || off < got || got < buf.size()) {
+            damaged = damaged || off < got; // a torn record at the end
+            break;
+        }
+    }
+    const std::uintmax_t fileSize = std::filesystem::file_size(path, ec);
+    std::fclose(in);
+    if (ec) return false;
+    if (fileSize > good) {
+        dropped_ = static_cast<std::size_t>((fileSize - good + kRecordSize - 1) / kRecordSize);
+        std::filesystem::resize_file(path, good, ec);
+        if (ec) return false;
+    }
+
+    f_ = std::fopen(path.c_str(), "ab");
+    return f_ != nullptr;
+}
+
+void EvalCache::close() {
+    if (f_) std::fclose(f_);
+    f_ = nullptr;
+    reports_.clear();
+    dropped_ = 0;
+}
+
+bool EvalCache::find(std::uint64_t key, EvalReport& report) const {
+    const auto it = reports_.find(key);
+    if (it == reports_.end()) return false;
+    report = it->second;
+    return true;
+}
+
+bool EvalCache::put(std::uint64_t key, const EvalReport& report) {
+    if (!f_) return false;
+    unsigned char rec[kRecordSize];
+    encodeRecord(key, report, rec);
+    if (std::fwrite(rec, 1, sizeof rec, f_) != sizeof rec || std::fflush(f_) != 0) return false;
+    reports_[key] = report;
+    return true;
+}
+
+std::uint64_t evalCacheKey(const GameRules& r, const std::string& policySpec, const EvalConfig& cfg,
+                           std::uint64_t policyContent) {
+    Fnv1a h;
+    const std::uint64_t fields[] = {r.hash(), kRngDrawScheme, cfg.seed, cfg.firstGame, cfg.games, cfg.chunkGames};
+    for (std::uint64_t v : fields) h.mixValue(v);
+    h.mix(policySpec.data(), policySpec.size());
+    // Left out when 0, so the keys of built-in policies stay what they were.
+    if (policyContent != 0) h.mixValue(policyContent);
+    return h.value();
+}
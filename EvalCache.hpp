@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#include "Evaluator.hpp"
+#include "GameRules.hpp"
+
+// Policy evaluations kept on disk, so repeated or overlapping sweeps only
+// play the points they have not seen.
+//
+// The file is a header and an append-only list of records, each an EvalReport
+// (without its distributions) under its key and a CRC. Everything is loaded into memory on open; a record
+// torn by a crash fails its CRC and the file is cut back to the last good one.
+class EvalCache {
+public:
+    EvalCache() = default;
+    ~EvalCache();
+
+    EvalCache(const EvalCache&) = delete;
+    EvalCache& operator=(const EvalCache&) = delete;
+
+    // Creates the file if it does not exist. False if it cannot be created or
+    // is not a cache file.
+    bool open(const std::string& path);
+    void close();
+
+    bool find(std::uint64_t key, EvalReport& report) const;
+    // Appends and flushes the record; a later put of the same key wins.
+    bool put(std::uint64_t key, const EvalReport& report);
+
+    std::size_t size() const { return reports_.size(); }
+    std::size_t droppedRecords() const { return dropped_; }
+
+private:
+    std::FILE* f_ = nullptr;
+    std::unordered_map<std::uint64_t, EvalReport> reports_;
+    std::size_t dropped_ = 0;
+};
+
+// Identifies an evaluatePolicy report: the rules, the policy spec (the name or
+// "optimal:FILE" as given) and what the policy loaded from its file
+// (Policy::contentHash), the Rng draw scheme, the seed and the games played.
+// A file that changes therefore gets new keys. The kernel and the rules
+// presets do not change a report and are left out.
+std::uint64_t evalCacheKey(const GameRules& r, const std::string& policySpec, const EvalConfig& cfg,
+                           std::uint64_t policyContent);
@@ -0,0 +1,112 @@
+#include "Evaluator.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kRoundChunks = 1024;
+
+}
+
+void MetricStats::add(double x) {
+    count += 1;
+    double delta = x - mean;
+    mean += delta / static_cast<double>(count);
+    m2 += delta * (x - mean);
+}
+
+void MetricStats::merge(const MetricStats& o) {
+    if (o.count == 0) return;
+    if (count == 0) {
+        *this = o;
+        return;
+    }
+    const double n = static_cast<double>(count + o.count);
+    const double delta = o.mean - mean;
+    mean += delta * static_cast<double>(o.count) / n;
+    m2 += o.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(o.count) / n;
+    count += o.count;
+}
+
+void EvalReport::add(const GameResult& res) {
+    games += 1;
+    endings[static_cast<int>(res.ending)] += 1;
+    if (res.completed()) {
+        tiers[static_cast<int>(res.score.tier)] += 1;
+        p.add(res.score.avgStarvedPercent);
+        l.add(res.score.acresPerCitizen);
+    }
+}
+
+void EvalReport::merge(const EvalReport& o) {
+    games += o.games;
+    for (int i = 0; i < 4; ++i) {
+        endings[i] += o.endings[i];
+        tiers[i] += o.tiers[i];
+    }
+    p.merge(o.p);
+    l.merge(o.l);
+    dist.merge(o.dist);
+    phases.merge(o.phases);
+}
+
+std::size_t evalChunkCount(const EvalConfig& cfg) {
+    const std::uint64_t chunk = std::max<std::uint64_t>(1, cfg.chunkGames);
+    return static_cast<std::size_t>((cfg.games + chunk - 1) / chunk);
+}
+
+template <class Rules>
+static void playChunk(Rules rules, const Policy& policy, const EvalConfig& cfg, std::size_t c, EvalScratch& scratch,
+                      EvalReport& out) {
+    const std::uint64_t chunk = std::max<std::uint64_t>(1, cfg.chunkGames);
+    const std::uint64_t begin = cfg.firstGame + c * chunk;
+    const std::uint64_t end = cfg.firstGame + std::min<std::uint64_t>(cfg.games, (c + 1) * chunk);
+
+    if (cfg.batchLanes <= 0) {
+        for (std::uint64_t g = begin; g < end; ++g) {
+            Rng rng(cfg.seed, g);
+            const GameResult res = playGame(rules, policy, rng);
+            out.add(res);
+            if (cfg.distributions) out.dist.add(res);
+        }
+        return;
+    }
+
+    for (std::uint64_t g = begin; g < end; g += static_cast<std::uint64_t>(cfg.batchLanes)) {
+        const std::uint64_t stop = std::min<std::uint64_t>(end, g + static_cast<std::uint64_t>(cfg.batchLanes));
+        scratch.rngs.clear();
+        for (std::uint64_t i = g; i < stop; ++i) scratch.rngs.emplace_back(cfg.seed, i);
+        playGameBatch(rules, policy, scratch.rngs, scratch.results, batchKernel(),
+                      cfg.phaseCounters ? &out.phases : nullptr);
+        for (const GameResult& res : scratch.results) {
+            out.add(res);
+            if (cfg.distributions) out.dist.add(res);
+        }
+    }
+}
+
+void evaluateChunk(const GameRules& r, const Policy& policy, const EvalConfig& cfg, std::size_t c,
+                   EvalScratch& scratch, EvalReport& out) {
+    withRules(r, cfg.rulesPresets, [&](auto rules) { playChunk(rules, policy, cfg, c, scratch, out); });
+}
+
+EvalReport evaluatePolicy(const GameRules& r, const Policy& policy, const EvalConfig& cfg,
+                          WorkStealingPool& pool) {
+    const std::size_t chunks = evalChunkCount(cfg);
+    std::vector<EvalReport> partial;
+    std::vector<EvalScratch> scratch(pool.size());
+    EvalReport total;
+
+    withRules(r, cfg.rulesPresets, [&](auto rules) {
+        for (std::size_t first = 0; first < chunks; first += kRoundChunks) {
+            // One slot per chunk of the round, written only by the worker that plays the chunk.
+            partial.assign(std::min(kRoundChunks, chunks - first), EvalReport{});
+            pool.run(partial.size(), [&](std::size_t i, unsigned worker) {
+                playChunk(rules, policy, cfg, first + i, scratch[worker], partial[i]);
+            });
+            for (const EvalReport& part : partial) total.merge(part);
+        }
+    });
+    return total;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PhaseCounters.hpp"
+#include "Policy.hpp"
+#include "ScoreDistributions.hpp"
+#include "Simulation.hpp"
+#include "WorkStealingPool.hpp"
+
+// Monte Carlo scoring of a policy over many games, spread over a
+// WorkStealingPool. Game g always uses Rng(seed, firstGame + g) and the games
+// are cut into fixed-size chunks whose partial results are merged in chunk
+// order, so the report is bit-identical at any thread count. Chunks run in
+// rounds merged as they finish, so memory does not grow with the games.
+
+// Running mean and variance (Welford), mergeable with Chan's formula.
+struct MetricStats {
+    std::uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void add(double x);
+    void merge(const MetricStats& o);
+    double variance() const { return count > 1 ? m2 / static_cast<double>(count - 1) : 0.0; }
+};
+
+struct EvalReport {
+    std::uint64_t games = 0;
+    std::uint64_t endings[4] = {}; // indexed by YearOutcome
+    std::uint64_t tiers[4] = {};   // indexed by ScoreTier, completed games only
+    MetricStats p;                 // average starved percent, completed games
+    MetricStats l;                 // acres per citizen, completed games
+    ScoreDistributions dist;       // filled only with EvalConfig::distributions
+    PhaseCounters phases;          // filled only with EvalConfig::phaseCounters, by batch chunks
+
+    void add(const GameResult& res);
+    void merge(const EvalReport& o);
+};
+
+struct EvalConfig {
+    std::uint64_t seed = 1;
+    std::uint64_t firstGame = 0;
+    std::uint64_t games = 1000000;
+    std::size_t chunkGames = 4096; // part of the result's identity, not a tuning knob per thread
+    int batchLanes = 0;            // > 0: play each chunk through the SoA kernels
+    bool rulesPresets = true;      // run a compiled-in preset's instantiation when the rules match one
+    bool distributions = false;    // also fill EvalReport::dist
+    bool phaseCounters = false;    // also fill EvalReport::phases; the timings are not reproducible
+};
+
+EvalReport evaluatePolicy(const GameRules& r, const Policy& policy, const EvalConfig& cfg,
+                          WorkStealingPool& pool);
+
+// The same one chunk at a time, for callers that schedule chunks of several
+// evaluations on one pool. Merging the chunks of a config in index order gives
+// exactly evaluatePolicy's report.
+struct EvalScratch {
+    std::vector<Rng> rngs;
+    std::vector<GameResult> results;
+};
+
+std::size_t evalChunkCount(const EvalConfig& cfg);
+void evaluateChunk(const GameRules& r, const Policy& policy, const EvalConfig& cfg, std::size_t c,
+                   EvalScratch& scratch, EvalReport& out);
@@ -0,0 +1,314 @@
+#include "GameDialog.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+#include "Advisor.hpp"
+#include "DpSolver.hpp"
+#include "Policy.hpp"
+
+void Console::provide(std::string line) {
+    auto is_ws = [](unsigned char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    std::size_t b = 0;
+    std::size_t e = line.size();
+    while (b < e && is_ws(static_cast<unsigned char>(line[b]))) ++b;
+    while (e > b && is_ws(static_cast<unsigned char>(line[e - 1]))) --e;
+    line_.assign(line, b, e - b);
+
+    std::coroutine_handle<> h = std::exchange(waiting_, {});
+    if (h) h.resume();
+}
+
+std::string formatGrain(std::int64_t units, int scale) {
+    const std::uint64_t u = units < 0 ? 0 - static_cast<std::uint64_t>(units) : static_cast<std::uint64_t>(units);
+    const std::uint64_t den = static_cast<std::uint64_t>(scale);
+    std::string s = units < 0 ? "-" : "";
+    s += std::to_string(u / den);
+    std::uint64_t rest = u % den;
+    if (rest == 0) return s;
+    // Exact when the scale has no prime factors but 2 and 5, cut short otherwise.
+    s += '.';
+    for (int digits = 0; rest != 0 && digits < 6; ++digits) {
+        rest *= 10;
+        s += static_cast<char>('0' + rest / den);
+        rest %= den;
+    }
+    return s;
+}
+
+Task<int> readIntNonNegative(Console& io, const char* prompt, std::function<void()> hint) {
+    for (;;) {
+        io.out << prompt;
+        std::string s = co_await io.readLine();
+        if (hint && s == "hint") {
+            hint();
+            continue;
+        }
+        try {
+            size_t pos = 0;
+            int v = std::stoi(s, &pos, 10);
+            if (pos != s.size()) throw std::invalid_argument("junk");
+            if (v < 0) throw std::out_of_range("negative");
+            co_return v;
+        } catch (...) {
+            io.out << "Please enter an integer >= 0.\n";
+        }
+    }
+}
+
+Task<bool> askYesNo(Console& io, const char* prompt) {
+    for (;;) {
+        io.out << prompt;
+        std::string s = co_await io.readLine();
+        if (s.empty()) continue;
+        char c = static_cast<char>(std::tolower(static_cast<unsigned char>(s[0])));
+        if (c == 'y') co_return true;
+        if (c == 'n') co_return false;
+        io.out << "Please enter Y/N.\n";
+    }
+}
+
+// 
+
+namespace {
+
+void printRoundHeader(std::ostream& out, const GameState& s) {
+    out << "\n========================================\n";
+    out << "Year " << s.year << " of your rule\n";
+    out << "----------------------------------------\n";
+}
+
+}
+
+void printReport(std::ostream& out, const GameState& s) {
+    printRoundHeader(out, s);
+
+    if (s.year == 1) {
+        out << "You have just taken the throne.\n";
+    } else {
+        if (s.starvedLastYear > 0) {
+            out << s.starvedLastYear << " people starved to death last year.\n";
+        }
+        if (s.immigrantsLastYear > 0) {
+            out << s.immigrantsLastYear << " people moved into the city.\n";
+        }
+        if (s.plagueLastYear) {
+            out << "A plague killed half the population!\n";
+        }
+
+        if (s.harvestTotalLastYear > 0) {
+            out << "We harvested " << s.harvestTotalLastYear
+                << " bushels of grain (" << s.yieldPerAcreLastYear
+                << " per acre).\n";
+        }
+        if (s.ratsAteLastYear > 0) {
+            out << "Rats destroyed " << s.ratsAteLastYear << " bushels of grain.\n";
+        }
+    }
+
+    out << "Current population: " << s.population << "\n";
+    out << "Grain in storage: " << formatGrain(s.grainUnits, s.grainScale) << " bushels\n";
+    out << "Land owned: " << s.landAcres << " acres\n";
+    out << "Land price this year: " << s.landPriceThisYear << " bushels per acre\n";
+}
+
+namespace {
+
+// The host has saved the year start already, so quitting needs no writing.
+Task<bool> maybeQuitAtRoundStart(Console& io) {
+    io.out << "\nAt the start of the year you may quit and save your progress.\n";
+    io.out << "Save and quit? (Y/N, empty = N): ";
+    std::string ans = co_await io.readLine();
+    if (ans.empty()) co_return false;
+    char c = static_cast<char>(std::tolower(static_cast<unsigned char>(ans[0])));
+    if (c == 'y') {
+        io.out << "Progress saved. See you!\n";
+        co_return true;
+    }
+    co_return false;
+}
+
+// The advisor, if any, searches on below each answer.
+Task<Decisions> askDecisions(Console& io, const GameState& s, const GameRules& r, std::function<void()> hint,
+                             Advisor* advisor) {
+    io.out << "\nWhat do you wish to do this year?\n";
+
+    Decisions d;
+
+    // 1)  
+    for (;;) {
+        d.acresToBuy = co_await readIntNonNegative(io, "How many acres do you wish to buy? ", hint);
+        if (checkLandPurchase(s, d) == DecisionError::None) break;
+        io.out << "Not enough grain to buy that much land.\n";
+    }
+
+    if (d.acresToBuy == 0) {
+        for (;;) {
+            d.acresToSell = co_await readIntNonNegative(io, "How many acres do you wish to sell? ", hint);
+            if (checkLandSale(s, d) == DecisionError::None) break;
+            io.out << "You don't have that much land.\n";
+        }
+    }
+    if (advisor) advisor->settle(AdvisorStage::Trade, d);
+
+    // 2)  .
+    for (;;) {
+        d.bushelsToFeed =
+            co_await readIntNonNegative(io, "How many bushels of grain do you wish to feed the people? ", hint);
+        if (checkFeeding(s, d) == DecisionError::None) break;
+        io.out << "You have only " << formatGrain(grainAfterTrade(s, d), s.grainScale) << " bushels in storage.\n";
+    }
+    if (advisor) advisor->settle(AdvisorStage::Feed, d);
+
+    // 3) .
+    for (;;) {
+        d.acresToPlant = co_await readIntNonNegative(io, "How many acres do you wish to plant? ", hint);
+        DecisionError e = checkPlanting(s, d, r);
+        if (e == DecisionError::None) break;
+        if (e == DecisionError::NotEnoughLandToPlant) {
+            io.out << "You have only " << landAfterTrade(s, d) << " acres.\n";
+        } else if (e == DecisionError::NotEnoughWorkers) {
+            io.out << "Your people can work at most " << (s.population * r.acresPerPersonMax)
+                   << " acres.\n";
+        } else {
+            io.out << "Not enough grain for seed. Needed "
+                   << formatGrain(d.acresToPlant * r.seedGrainUnits(s.grainScale), s.grainScale)
+                   << ", in storage " << formatGrain(grainAfterFeeding(s, d), s.grainScale) << ".\n";
+        }
+    }
+
+    co_return d;
+}
+
+void printOptimumHint(std::ostream& out, const GameState& s, const GameRules& r, const DpTable& optimum) {
+    const Decisions d = optimum.bestDecisions(s, r);
+    out << "The optimum would buy " << d.acresToBuy << ", sell " << d.acresToSell
+        << ", feed " << d.bushelsToFeed << " and plant " << d.acresToPlant
+        << " (expected score " << optimum.expectedValue(s, d, r) << ").\n";
+}
+
+void printPolicyHint(std::ostream& out, const GameState& s, const GameRules& r, const Policy& policy) {
+    const Decisions d = clampDecisions(s, policy.decide(s, r), r);
+    out << "The " << policy.name() << " policy would buy " << d.acresToBuy << ", sell " << d.acresToSell
+        << ", feed " << d.bushelsToFeed << " and plant " << d.acresToPlant << ".\n";
+}
+
+// x with one decimal; "%+.1f" shows the sign.
+std::string oneDecimal(double x, const char* format = "%.1f") {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, format, x);
+    return buf;
+}
+
+void printAdvisorHint(std::ostream& out, const Advisor& advisor) {
+    const AdvisorHint h = advisor.hint();
+    if (h.rollouts == 0) {
+        out << "The advisor has nothing to suggest yet.\n";
+        return;
+    }
+    const Decisions& d = h.decisions;
+    out << "The advisor would buy " << d.acresToBuy << ", sell " << d.acresToSell
+        << ", feed " << d.bushelsToFeed << " and plant " << d.acresToPlant
+        << " (" << h.rollouts << " games played ahead).\n";
+    out << "Predicted: P " << oneDecimal(h.meanP) << "%, L " << oneDecimal(h.meanL)
+        << ", ruling to the end in " << oneDecimal(100.0 * h.survival) << "% of the games.\n";
+    if (h.baselineRollouts > 0) {
+        out << "Compared with the " << advisor.rolloutPolicy().name() << " policy's choice: P "
+            << oneDecimal(h.meanP - h.baselineP, "%+.1f") << ", L " << oneDecimal(h.meanL - h.baselineL, "%+.1f")
+            << ", ruling to the end " << oneDecimal(100.0 * (h.survival - h.baselineSurvival), "%+.1f")
+            << " points.\n";
+    }
+}
+
+// Returns false when the game is over or the player quit.
+Task<bool> playOneYear(Console& io, GameState& s, const GameRules& r, Rng& rng, const DialogHooks& hooks) {
+    beginYear(s, r, rng);
+    if (hooks.yearStarted && !hooks.yearStarted(s)) {
+        io.out << "Warning: this year could not be saved.\n";
+    }
+
+    printReport(io.out, s);
+    if (hooks.advisor) hooks.advisor->start(s);
+    const bool quit = co_await maybeQuitAtRoundStart(io);
+    if (quit) {
+        if (hooks.advisor) hooks.advisor->stop();
+        co_return false;
+    }
+
+    std::function<void()> hint;
+    if (hooks.optimum || hooks.advisor || hooks.policy) {
+        io.out << "(Type \"hint\" at any prompt to see what the ";
+        if (hooks.optimum) io.out << "optimum would do";
+        else if (hooks.advisor) io.out << "advisor suggests";
+        else io.out << hooks.policy->name() << " policy would do";
+        io.out << ".)\n";
+        hint = [&] {
+            if (hooks.optimum) printOptimumHint(io.out, s, r, *hooks.optimum);
+            if (hooks.policy) printPolicyHint(io.out, s, r, *hooks.policy);
+            if (hooks.advisor) printAdvisorHint(io.out, *hooks.advisor);
+        };
+    }
+    const Decisions d = co_await askDecisions(io, s, r, hint, hooks.advisor);
+    if (hooks.advisor) hooks.advisor->stop();
+    if (hooks.yearDecided && !hooks.yearDecided(d)) {
+        io.out << "Warning: this year could not be saved.\n";
+    }
+
+    switch (resolveYear(s, d, r, rng)) {
+    case YearOutcome::Continued:
+        co_return true;
+    case YearOutcome::Overthrown:
+        io.out << "\nMore than " << static_cast<int>(r.starvationLossFraction * 100)
+               << "% of the population starved. You have been overthrown.\n";
+        co_return false;
+    case YearOutcome::Depopulated:
+        io.out << "\nAll people have died. Game over.\n";
+        co_return false;
+    case YearOutcome::PlagueWipeout:
+        io.out << "\nThe plague wiped everyone out. Game over.\n";
+        co_return false;
+    }
+    co_return false;
+}
+
+}
+
+void printFinalScore(std::ostream& out, const GameState& s, const GameRules& r) {
+    out << "\n========================================\n";
+    out << "Summary of your rule\n";
+    out << "----------------------------------------\n";
+
+    const FinalScore f = computeFinalScore(s, r);
+
+    out << "Average percent starved per year (P): " << f.avgStarvedPercent << "%\n";
+    out << "Acres of land per citizen (L): " << f.acresPerCitizen << "\n\n";
+
+    switch (f.tier) {
+    case ScoreTier::Terrible:
+        out << "Terrible: you were driven out of the city.\n";
+        break;
+    case ScoreTier::Mediocre:
+        out << "Mediocre: your rule was harsh, but the city survived.\n";
+        break;
+    case ScoreTier::Good:
+        out << "Good: you managed the city fairly well.\n";
+        break;
+    case ScoreTier::Excellent:
+        out << "Excellent: outstanding rule!\n";
+        break;
+    }
+}
+
+Task<DialogEnd> playGame(Console& io, GameState& s, const GameRules& r, Rng& rng, const DialogHooks& hooks) {
+    while (s.year <= r.totalYears) {
+        const bool more = co_await playOneYear(io, s, r, rng, hooks);
+        if (!more) {
+            // A lost game no longer waits for decisions; a quit one does.
+            co_return s.awaitingPlayerDecisions ? DialogEnd::SavedAndQuit : DialogEnd::Finished;
+        }
+    }
+    printFinalScore(io.out, s, r);
+    co_return DialogEnd::Finished;
+}
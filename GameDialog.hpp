@@ -0,0 +1,142 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include "GameEngine.hpp"
+#include "SessionArena.hpp"
+
+class Advisor;
+class DpTable;
+class Policy;
+
+// The console of one game: where the dialogue prints and where it waits for
+// the player's next line. The dialogue is a chain of coroutines that suspends
+// in readLine(); whoever hosts the session (main() reading stdin, the server
+// reading a socket) hands the line in with provide(), which runs the game on
+// to its next prompt. Nothing in the dialogue blocks.
+class Console {
+public:
+    explicit Console(std::ostream& out) : out(out) {}
+
+    Console(const Console&) = delete;
+    Console& operator=(const Console&) = delete;
+
+    std::ostream& out;
+
+    bool waitingForLine() const { return static_cast<bool>(waiting_); }
+    // Resumes the dialogue with one line of input (trimmed here).
+    void provide(std::string line);
+
+    struct LineAwaiter {
+        Console& console;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) noexcept { console.waiting_ = h; }
+        std::string await_resume() { return std::move(console.line_); }
+    };
+    LineAwaiter readLine() { return LineAwaiter{*this}; }
+
+private:
+    std::coroutine_handle<> waiting_;
+    std::string line_;
+};
+
+// A lazily started coroutine returning T. Awaiting a Task runs it and resumes
+// the awaiting coroutine when it finishes (symmetric transfer, so deep chains
+// of prompts do not grow the stack). Frames are allocated from the thread's
+// current SessionArena (SessionArena::Use), or the global heap if it has none.
+// Destroying a suspended top-level Task destroys the whole chain.
+// Bind awaited results to a local before testing them: GCC 12 miscompiles a
+// co_await inside an if condition.
+template <class T>
+class Task {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { std::terminate(); }
+
+        static void* operator new(std::size_t n) { return SessionArena::allocateTagged(n); }
+        static void operator delete(void* p, std::size_t n) { SessionArena::releaseTagged(p, n); }
+    };
+
+    Task() = default;
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    // For the top-level task: runs up to the first prompt.
+    void start() { h_.resume(); }
+    bool done() const { return !h_ || h_.done(); }
+    const T& result() const { return *h_.promise().value; }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        h_.promise().continuation = caller;
+        return h_;
+    }
+    T await_resume() { return std::move(*h_.promise().value); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+// How a played game left the dialogue.
+enum class DialogEnd {
+    SavedAndQuit, // the player left at the start of a year; the game can be resumed
+    Finished,     // all years played or the game was lost; nothing to resume
+};
+
+// What the dialogue needs from whoever hosts the game. Hooks may be empty.
+struct DialogHooks {
+    // After the year's land price is rolled, before the report is printed.
+    std::function<bool(const GameState&)> yearStarted;
+    // Write-ahead: the year's decisions before they are resolved.
+    std::function<bool(const Decisions&)> yearDecided;
+    const DpTable* optimum = nullptr; // enables the "hint" command
+    Advisor* advisor = nullptr;       // so does a search started at every report
+    const Policy* policy = nullptr;   // and a policy's own decisions
+};
+
+// Grain units of the given scale as bushels, without rounding.
+std::string formatGrain(std::int64_t units, int scale);
+// The report at the start of a year.
+void printReport(std::ostream& out, const GameState& s);
+void printFinalScore(std::ostream& out, const GameState& s, const GameRules& r);
+
+Task<int> readIntNonNegative(Console& io, const char* prompt, std::function<void()> hint);
+Task<bool> askYesNo(Console& io, const char* prompt);
+
+// Plays s from its current year to the end, the player's quit or a lost game.
+Task<DialogEnd> playGame(Console& io, GameState& s, const GameRules& r, Rng& rng, const DialogHooks& hooks);
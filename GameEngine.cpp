@@ -0,0 +1,95 @@
+#include "GameEngine.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void initNewGame(GameState& s, const GameRules& r) {
+    s.year = 1;
+    s.population = r.initialPopulation;
+    s.grainScale = r.grainScale();
+    s.grainUnits = static_cast<std::int64_t>(std::llround(r.initialGrainBushels * s.grainScale));
+    s.landAcres = r.initialLandAcres;
+
+    s.starvedLastYear = 0;
+    s.immigrantsLastYear = 0;
+    s.plagueLastYear = false;
+    s.yieldPerAcreLastYear = 0;
+    s.harvestTotalLastYear = 0;
+    s.ratsAteLastYear = 0;
+
+    s.landPriceThisYear = 0;
+    s.awaitingPlayerDecisions = false;
+
+    s.yearsCompleted = 0;
+    s.starvationPercentSum = 0.0;
+}
+
+void beginYear(GameState& s, const GameRules& r, Rng& rng) {
+    beginYearFor(s, DynamicRules{r}, rng);
+}
+
+DecisionError checkLandPurchase(const GameState& s, const Decisions& d) {
+    const std::int64_t cost = grainUnitsOf(s, static_cast<std::int64_t>(d.acresToBuy) * s.landPriceThisYear);
+    if (cost > s.grainUnits) return DecisionError::NotEnoughGrainForLand;
+    return DecisionError::None;
+}
+
+DecisionError checkLandSale(const GameState& s, const Decisions& d) {
+    if (d.acresToSell > 0 && d.acresToBuy > 0) return DecisionError::BuyAndSell;
+    if (d.acresToSell > s.landAcres) return DecisionError::NotEnoughLandToSell;
+    return DecisionError::None;
+}
+
+DecisionError checkFeeding(const GameState& s, const Decisions& d) {
+    if (grainUnitsOf(s, d.bushelsToFeed) > grainAfterTrade(s, d)) return DecisionError::NotEnoughGrainToFeed;
+    return DecisionError::None;
+}
+
+DecisionError checkPlanting(const GameState& s, const Decisions& d, const GameRules& r) {
+    if (d.acresToPlant > landAfterTrade(s, d)) return DecisionError::NotEnoughLandToPlant;
+    if (d.acresToPlant > s.population * r.acresPerPersonMax) return DecisionError::NotEnoughWorkers;
+    const std::int64_t seedsNeeded = d.acresToPlant * r.seedGrainUnits(s.grainScale);
+    if (seedsNeeded > grainAfterFeeding(s, d)) return DecisionError::NotEnoughGrainForSeed;
+    return DecisionError::None;
+}
+
+DecisionError checkDecisions(const GameState& s, const Decisions& d, const GameRules& r) {
+    if (d.acresToBuy < 0 || d.acresToSell < 0 || d.bushelsToFeed < 0 || d.acresToPlant < 0) {
+        return DecisionError::NegativeAmount;
+    }
+    DecisionError e = checkLandPurchase(s, d);
+    if (e == DecisionError::None) e = checkLandSale(s, d);
+    if (e == DecisionError::None) e = checkFeeding(s, d);
+    if (e == DecisionError::None) e = checkPlanting(s, d, r);
+    return e;
+}
+
+Decisions clampDecisions(const GameState& s, Decisions d, const GameRules& r) {
+    return clampDecisionsFor(s, d, DynamicRules{r});
+}
+
+YearOutcome resolveYear(GameState& s, const Decisions& d, const GameRules& r, Rng& rng) {
+    RngYearEvents ev{rng, s.year};
+    return resolveYearWith(s, d, r, ev);
+}
+
+FinalScore computeFinalScore(const GameState& s, const GameRules& r) {
+    FinalScore f;
+    f.avgStarvedPercent = (s.yearsCompleted > 0)
+        ? (s.starvationPercentSum / static_cast<double>(s.yearsCompleted))
+        : 0.0;
+    f.acresPerCitizen = (s.population > 0)
+        ? (static_cast<double>(s.landAcres) / static_cast<double>(s.population))
+        : 0.0;
+
+    if (f.avgStarvedPercent > r.pBadLower && f.acresPerCitizen < r.lBadUpper) {
+        f.tier = ScoreTier::Terrible;
+    } else if (f.avgStarvedPercent > r.pOkLower && f.acresPerCitizen < r.lOkUpper) {
+        f.tier = ScoreTier::Mediocre;
+    } else if (f.avgStarvedPercent > r.pGoodLower && f.acresPerCitizen < r.lGoodUpper) {
+        f.tier = ScoreTier::Good;
+    } else {
+        f.tier = ScoreTier::Excellent;
+    }
+    return f;
+}
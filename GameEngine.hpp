@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "GameRules.hpp"
+#include "GameState.hpp"
+#include "Rng.hpp"
+#include "RulesPresets.hpp"
+
+// Headless year resolution. No console I/O here: the interactive game and
+// the batch tools both go through these functions, so their rules cannot drift.
+
+// What the ruler decides during one year.
+struct Decisions {
+    int acresToBuy = 0;
+    int acresToSell = 0;   // only allowed when nothing is bought
+    int bushelsToFeed = 0;
+    int acresToPlant = 0;
+};
+
+enum class DecisionError {
+    None,
+    NegativeAmount,
+    NotEnoughGrainForLand,
+    BuyAndSell,
+    NotEnoughLandToSell,
+    NotEnoughGrainToFeed,
+    NotEnoughLandToPlant,
+    NotEnoughWorkers,
+    NotEnoughGrainForSeed,
+};
+
+enum class YearOutcome {
+    Continued,      // year fully processed, the game goes on
+    Overthrown,     // too many people starved
+    Depopulated,    // everybody starved
+    PlagueWipeout,  // the plague killed the last citizens
+};
+
+enum class ScoreTier {
+    Terrible,
+    Mediocre,
+    Good,
+    Excellent,
+};
+
+struct FinalScore {
+    double avgStarvedPercent = 0.0; // P
+    double acresPerCitizen = 0.0;   // L
+    ScoreTier tier = ScoreTier::Terrible;
+};
+
+void initNewGame(GameState& s, const GameRules& r);
+
+// Rolls the land price unless it was already rolled for this year (resumed save).
+void beginYear(GameState& s, const GameRules& r, Rng& rng);
+
+// Step-by-step checks in the order the decisions are made. Each check sees the
+// effect of the earlier decisions, exactly like the interactive prompts.
+DecisionError checkLandPurchase(const GameState& s, const Decisions& d);
+DecisionError checkLandSale(const GameState& s, const Decisions& d);
+DecisionError checkFeeding(const GameState& s, const Decisions& d);
+DecisionError checkPlanting(const GameState& s, const Decisions& d, const GameRules& r);
+DecisionError checkDecisions(const GameState& s, const Decisions& d, const GameRules& r);
+
+// Intermediate values the prompts need for their messages.
+inline int landAfterTrade(const GameState& s, const Decisions& d) {
+    return s.landAcres + d.acresToBuy - d.acresToSell;
+}
+
+// Grain amounts in the state's grain units.
+inline std::int64_t grainUnitsOf(const GameState& s, std::int64_t bushels) {
+    return bushels * s.grainScale;
+}
+
+inline std::int64_t grainAfterTrade(const GameState& s, const Decisions& d) {
+    return s.grainUnits
+        - grainUnitsOf(s, static_cast<std::int64_t>(d.acresToBuy) * s.landPriceThisYear)
+        + grainUnitsOf(s, static_cast<std::int64_t>(d.acresToSell) * s.landPriceThisYear);
+}
+
+inline std::int64_t grainAfterFeeding(const GameState& s, const Decisions& d) {
+    return grainAfterTrade(s, d) - grainUnitsOf(s, d.bushelsToFeed);
+}
+
+// Cuts arbitrary decisions down to the nearest legal ones (used by policies).
+Decisions clampDecisions(const GameState& s, Decisions d, const GameRules& r);
+
+// Applies legal decisions and all random events of the year.
+YearOutcome resolveYear(GameState& s, const Decisions& d, const GameRules& r, Rng& rng);
+
+// The year rules with the random events supplied by the caller. Events must
+// provide int yieldPerAcre(const GameRules&), int ratsAte(int maxRats) (called
+// only when maxRats > 0, result in [0; maxRats]) and bool plague(const GameRules&).
+// resolveYear draws them from the Rng; solvers feed fixed outcomes.
+template <class Events>
+YearOutcome resolveYearWith(GameState& s, const Decisions& d, const GameRules& r, Events& ev);
+
+// The year loop's steps for a rules source (RulesPresets.hpp). Each source is
+// its own instantiation, so a preset's values are constants in it.
+template <class Rules>
+void beginYearFor(GameState& s, Rules rules, const Rng& rng);
+template <class Rules>
+Decisions clampDecisionsFor(const GameState& s, Decisions d, Rules rules);
+template <class Rules, class Events>
+YearOutcome resolveYearFor(GameState& s, const Decisions& d, Rules rules, Events& ev);
+
+// Draws the random events of a year from the game's Rng, as resolveYear does.
+struct RngYearEvents {
+    const Rng& rng;
+    int year;
+
+    int yieldPerAcre(const GameRules& r) {
+        return rng.intInRange(year, RngEvent::Yield, r.yieldPerAcreMin, r.yieldPerAcreMax);
+    }
+    int ratsAte(int maxRats) { return rng.share(year, RngEvent::Rats, maxRats); }
+    bool plague(const GameRules& r) { return rng.chance(year, RngEvent::Plague, r.plagueProbability); }
+};
+
+FinalScore computeFinalScore(const GameState& s, const GameRules& r);
+
+// The immigration formula before the rules' limits are applied.
+inline int immigrantsBeforeLimits(int starved, int yieldPerAcre, double grain) {
+    return static_cast<int>(
+        (starved / 2.0) + (5.0 - static_cast<double>(yieldPerAcre)) * (grain / 600.0) + 1.0
+    );
+}
+
+// Newcomers of the year; grain is what the rats left. Monotone in grain.
+inline int immigrantsAfterHarvest(int starved, int yieldPerAcre, double grain, const GameRules& r) {
+    return std::clamp(immigrantsBeforeLimits(starved, yieldPerAcre, grain), r.immigrantsMin, r.immigrantsMax);
+}
+
+template <class Rules>
+void beginYearFor(GameState& s, Rules rules, const Rng& rng) {
+    if (s.awaitingPlayerDecisions) return;
+    s.landPriceThisYear = rng.intInRange(s.year, RngEvent::LandPrice, rules().landPriceMin, rules().landPriceMax);
+    s.awaitingPlayerDecisions = true;
+}
+
+template <class Rules>
+Decisions clampDecisionsFor(const GameState& s, Decisions d, Rules rules) {
+    const GameRules& r = rules();
+    d.acresToBuy = std::max(0, d.acresToBuy);
+    d.acresToSell = std::max(0, d.acresToSell);
+    d.bushelsToFeed = std::max(0, d.bushelsToFeed);
+    d.acresToPlant = std::max(0, d.acresToPlant);
+
+    // Grain is never negative here, so the integer divisions are floors.
+    if (s.landPriceThisYear > 0) {
+        const std::int64_t affordable = std::max<std::int64_t>(0, s.grainUnits) / grainUnitsOf(s, s.landPriceThisYear);
+        d.acresToBuy = static_cast<int>(std::min<std::int64_t>(d.acresToBuy, affordable));
+    }
+    if (d.acresToBuy > 0) d.acresToSell = 0;
+    d.acresToSell = std::min(d.acresToSell, s.landAcres);
+
+    const std::int64_t grain = std::max<std::int64_t>(0, grainAfterTrade(s, d));
+    d.bushelsToFeed = static_cast<int>(std::min<std::int64_t>(d.bushelsToFeed, grain / s.grainScale));
+
+    const std::int64_t bySeed = std::max<std::int64_t>(0, grainAfterFeeding(s, d)) / r.seedGrainUnits(s.grainScale);
+    d.acresToPlant = static_cast<int>(std::min<std::int64_t>(
+        std::min({d.acresToPlant, landAfterTrade(s, d), s.population * r.acresPerPersonMax}), bySeed));
+    return d;
+}
+
+template <class Events>
+YearOutcome resolveYearWith(GameState& s, const Decisions& d, const GameRules& r, Events& ev) {
+    return resolveYearFor(s, d, DynamicRules{r}, ev);
+}
+
+// The phases of a year, in the order resolveYearFor runs them. Each is on its
+// own so that it can be timed in isolation (hammurabi_bench).
+
+inline void tradeLand(GameState& s, const Decisions& d) {
+    s.landAcres += d.acresToBuy;
+    s.landAcres -= d.acresToSell;
+
+    s.grainUnits -= grainUnitsOf(s, static_cast<std::int64_t>(d.acresToBuy) * s.landPriceThisYear);
+    s.grainUnits += grainUnitsOf(s, static_cast<std::int64_t>(d.acresToSell) * s.landPriceThisYear);
+}
+
+inline void feedPeople(GameState& s, const Decisions& d) {
+    s.grainUnits -= grainUnitsOf(s, d.bushelsToFeed);
+}
+
+// Takes the seed grain.
+template <class Rules>
+void plantFields(GameState& s, const Decisions& d, Rules rules) {
+    s.grainUnits -= d.acresToPlant * rules().seedGrainUnits(s.grainScale);
+}
+
+// Returns the harvest total.
+inline int harvestFields(GameState& s, const Decisions& d, int yieldPerAcre) {
+    const int harvestTotal = d.acresToPlant * yieldPerAcre;
+    s.grainUnits += grainUnitsOf(s, harvestTotal);
+    return harvestTotal;
+}
+
+// Returns what the rats ate. The bound is a whole number of bushels, so the
+// only floating-point step is the fraction of the grain.
+template <class Rules, class Events>
+int ratsEat(GameState& s, Rules rules, Events& ev) {
+    int maxRats = static_cast<int>(std::floor(s.grainBushels() * rules().ratsMaxFraction));
+    if (maxRats < 0) maxRats = 0;
+    int ratsAte = (maxRats == 0) ? 0 : ev.ratsAte(maxRats);
+    s.grainUnits -= grainUnitsOf(s, ratsAte);
+    if (s.grainUnits < 0) s.grainUnits = 0;
+    return ratsAte;
+}
+
+// People left unfed, and their share of the population in percent.
+template <class Rules>
+int starvedPeople(const GameState& s, const Decisions& d, Rules rules, double& starvedPercent) {
+    const int populationStart = s.population;
+    const int peopleFed = d.bushelsToFeed / rules().bushelsPerPersonPerYear;
+    const int starved = std::max(0, populationStart - peopleFed);
+
+    starvedPercent = (populationStart == 0)
+        ? 0.0
+        : (100.0 * static_cast<double>(starved) / static_cast<double>(populationStart));
+    return starved;
+}
+
+template <class Rules>
+bool overthrownAfter(double starvedPercent, Rules rules) {
+    return starvedPercent > rules().starvationLossFraction * 100.0 + 1e-9;
+}
+
+// Halves the population when the plague strikes.
+template <class Rules, class Events>
+bool plagueStrikes(GameState& s, Rules rules, Events& ev) {
+    const bool plague = ev.plague(rules());
+    if (plague) s.population /= 2; // round down
+    return plague;
+}
+
+template <class Rules, class Events>
+YearOutcome resolveYearFor(GameState& s, const Decisions& d, Rules rules, Events& ev) {
+    const GameRules& r = rules();
+    // 1) Land trade
+    tradeLand(s, d);
+
+    // 2) Grain for food
+    feedPeople(s, d);
+
+    // 3) Planting
+    plantFields(s, d, rules);
+
+    s.awaitingPlayerDecisions = false;
+
+    // Harvest
+    const int yieldPerAcre = ev.yieldPerAcre(r);
+    const int harvestTotal = harvestFields(s, d, yieldPerAcre);
+
+    // Rats
+    const int ratsAte = ratsEat(s, rules, ev);
+
+    // Starvation
+    double starvedPercent = 0.0;
+    const int starved = starvedPeople(s, d, rules, starvedPercent);
+
+    if (overthrownAfter(starvedPercent, rules)) {
+        s.starvedLastYear = starved;
+        s.immigrantsLastYear = 0;
+        s.plagueLastYear = false;
+        s.yieldPerAcreLastYear = yieldPerAcre;
+        s.harvestTotalLastYear = harvestTotal;
+        s.ratsAteLastYear = ratsAte;
+        return YearOutcome::Overthrown;
+    }
+
+    s.population -= starved;
+    if (s.population <= 0) {
+        return YearOutcome::Depopulated;
+    }
+
+    // Immigration
+    const int immigrants = immigrantsAfterHarvest(starved, yieldPerAcre, s.grainBushels(), r);
+    s.population += immigrants;
+
+    // Plague
+    const bool plague = plagueStrikes(s, rules, ev);
+    if (plague && s.population <= 0) {
+        return YearOutcome::PlagueWipeout;
+    }
+
+    s.starvedLastYear = starved;
+    s.immigrantsLastYear = immigrants;
+    s.plagueLastYear = plague;
+    s.yieldPerAcreLastYear = yieldPerAcre;
+    s.harvestTotalLastYear = harvestTotal;
+    s.ratsAteLastYear = ratsAte;
+
+    s.yearsCompleted += 1;
+    s.starvationPercentSum += starvedPercent;
+
+    s.year += 1;
+    return YearOutcome::Continued;
+}
@@ -1,75 +1,209 @@
 #include "GameRules.hpp"
 
+#include <array>
+#include <charconv>
+#include <cmath>
 #include <fstream>
-#include <sstream>
 #include <string>
 
-static double parseDoubleFlexible(const std::string& raw) {
-    std::string s = raw;
-    for (char& c : s) {
-        if (c == ',') c = '.';
-    }
-    return std::stod(s);
+#include "BinaryFormat.hpp"
+#include "GameState.hpp"
+
+// One known key: where its value goes. Keys without a field are accepted and
+// ignored.
+struct RuleKey {
+    std::string_view name;
+    int GameRules::*intField = nullptr;
+    double GameRules::*doubleField = nullptr;
+};
+
+static constexpr RuleKey kRuleKeys[] = {
+    {"initial_population", &GameRules::initialPopulation},
+    {"initial_wheat", nullptr, &GameRules::initialGrainBushels},
+    {"initial_city_size", &GameRules::initialLandAcres},
+    {"land_price_min", &GameRules::landPriceMin},
+    {"land_price_max", &GameRules::landPriceMax},
+    {"resident_consumption", &GameRules::bushelsPerPersonPerYear},
+    {"resident_efficiency", &GameRules::acresPerPersonMax},
+    {"seeds_consumption", nullptr, &GameRules::seedsBushelsPerAcre},
+    {"land_efficiency_min", &GameRules::yieldPerAcreMin},
+    {"land_efficiency_max", &GameRules::yieldPerAcreMax},
+    {"rats_consumption_rate_min"},
+    {"rats_consumption_rate_max", nullptr, &GameRules::ratsMaxFraction},
+    {"plague_probability", nullptr, &GameRules::plagueProbability},
+    {"arrivals_number_min", &GameRules::immigrantsMin},
+    {"arrivals_number_max", &GameRules::immigrantsMax},
+    {"death_percentage_for_loss", nullptr, &GameRules::starvationLossFraction},
+    {"rounds_number", &GameRules::totalYears},
+    {"dead_percentage_lower_limit_bad", &GameRules::pBadLower},
+    {"lands_per_resident_bad", &GameRules::lBadUpper},
+    {"dead_percentage_lower_limit_ok", &GameRules::pOkLower},
+    {"lands_per_resident_ok", &GameRules::lOkUpper},
+    {"dead_percentage_lower_limit_good", &GameRules::pGoodLower},
+    {"lands_per_resident_good", &GameRules::lGoodUpper},
+};
+
+// Keys are found with a perfect hash: FNV-1a with a seed chosen at compile
+// time so that no two keys share a slot, then one compare.
+static constexpr std::size_t kKeySlots = 64;
+
+static constexpr std::size_t keySlot(std::string_view key, std::uint64_t seed) {
+    Fnv1a h(Fnv1a::kOffsetBasis ^ seed);
+    for (char c : key) h.mixByte(static_cast<unsigned char>(c));
+    return static_cast<std::size_t>(h.value() % kKeySlots);
 }
 
-static int parseInt(const std::string& s) {
-    return std::stoi(s);
+static constexpr std::uint64_t findKeySeed() {
+    for (std::uint64_t seed = 0; seed < 4096; ++seed) {
+        std::array<bool, kKeySlots> used{};
+        bool clash = false;
+        for (const RuleKey& k : kRuleKeys) {
+            const std::size_t slot = keySlot(k.name, seed);
+            clash = clash || used[slot];
+            used[slot] = true;
+        }
+        if (!clash) return seed;
+    }
+    return ~0ull;
 }
 
-bool GameRules::loadFromFile(const std::string& filename) {
-    std::ifstream in(filename);
-    if (!in) return false;
+static constexpr std::uint64_t kKeySeed = findKeySeed();
+static_assert(kKeySeed != ~0ull, "no perfect hash for the rule keys; grow kKeySlots");
 
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
+static constexpr std::array<signed char, kKeySlots> makeKeyTable() {
+    std::array<signed char, kKeySlots> t{};
+    for (signed char& v : t) v = -1;
+    for (std::size_t i = 0; i < std::size(kRuleKeys); ++i) {
+        t[keySlot(kRuleKeys[i].name, kKeySeed)] = static_cast<signed char>(i);
+    }
+    return t;
+}
 
-        std::stringstream ss(line);
-        std::string key, value;
-        if (!std::getline(ss, key, '=')) continue;
-        if (!std::getline(ss, value)) continue;
+static constexpr std::array<signed char, kKeySlots> kKeyTable = makeKeyTable();
 
-        while (!key.empty() && (key.back() == ' ' || key.back() == '\t')) key.pop_back();
-        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.pop_back();
-        while (!key.empty() && (key.front() == ' ' || key.front() == '\t')) key.erase(key.begin());
-        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.erase(value.begin());
+static const RuleKey* findRuleKey(std::string_view key) {
+    const int i = kKeyTable[keySlot(key, kKeySeed)];
+    return i >= 0 && kRuleKeys[i].name == key ? &kRuleKeys[i] : nullptr;
+}
 
-        if (key == "initial_population") initialPopulation = parseInt(value);
-        else if (key == "initial_wheat") initialGrainBushels = parseDoubleFlexible(value);
-        else if (key == "initial_city_size") initialLandAcres = parseInt(value);
+static bool parseNumber(std::string_view s, int& v) {
+    const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    return ec == std::errc() && end == s.data() + s.size();
+}
 
-        else if (key == "land_price_min") landPriceMin = parseInt(value);
-        else if (key == "land_price_max") landPriceMax = parseInt(value);
+// Accepts a comma as the decimal separator.
+static bool parseNumber(std::string_view s, double& v) {
+    char buf[64];
+    if (s.empty() || s.size() > sizeof buf) return false;
+    for (std::size_t i = 0; i < s.size(); ++i) buf[i] = s[i] == ',' ? '.' : s[i];
+    const auto [end, ec] = std::from_chars(buf, buf + s.size(), v);
+    return ec == std::errc() && end == buf + s.size();
+}
 
-        else if (key == "resident_consumption") bushelsPerPersonPerYear = parseInt(value);
-        else if (key == "resident_efficiency") acresPerPersonMax = parseInt(value);
+// Walks the lines of a rules file. Key lines go to the rule set returned by
+// enterSection, which is called with an empty name first and then at every
+// "[name]" line; a null target skips the section.
+template <class EnterSection>
+static bool parseRulesText(std::string_view text, EnterSection enterSection) {
+    GameRules* target = enterSection(std::string_view());
+    while (!text.empty()) {
+        const std::size_t nl = text.find('\n');
+        const std::string_view line = trimBlanks(text.substr(0, nl));
+        text.remove_prefix(nl == std::string_view::npos ? text.size() : nl + 1);
+        if (line.empty()) continue;
 
-        else if (key == "seeds_consumption") seedsBushelsPerAcre = parseDoubleFlexible(value);
+        if (line.front() == '[') {
+            if (line.back() != ']') return false;
+            const std::string_view name = trimBlanks(line.substr(1, line.size() - 2));
+            if (name.empty()) return false;
+            target = enterSection(name);
+            continue;
+        }
 
-        else if (key == "land_efficiency_min") yieldPerAcreMin = parseInt(value);
-        else if (key == "land_efficiency_max") yieldPerAcreMax = parseInt(value);
+        const std::size_t eq = line.find('=');
+        if (eq == std::string_view::npos || !target) continue;
+        const RuleKey* key = findRuleKey(trimBlanks(line.substr(0, eq)));
+        if (!key) continue;
+        const std::string_view value = trimBlanks(line.substr(eq + 1));
+        if (key->intField && !parseNumber(value, target->*key->intField)) return false;
+        if (key->doubleField && !parseNumber(value, target->*key->doubleField)) return false;
+    }
+    return true;
+}
+
+bool parseRuleNumber(std::string_view s, double& value) {
+    return parseNumber(trimBlanks(s), value);
+}
 
-        else if (key == "rats_consumption_rate_max") ratsMaxFraction = parseDoubleFlexible(value);
+bool GameRules::setValue(std::string_view key, double value) {
+    const RuleKey* k = findRuleKey(key);
+    if (!k || !std::isfinite(value)) return false;
+    if (k->intField) {
+        if (std::fabs(value) > 2e9) return false;
+        this->*k->intField = static_cast<int>(std::lround(value));
+    }
+    else if (k->doubleField) this->*k->doubleField = value;
+    else return false;
+    return true;
+}
 
-        else if (key == "plague_probability") plagueProbability = parseDoubleFlexible(value);
+bool GameRules::getValue(std::string_view key, double& value) const {
+    const RuleKey* k = findRuleKey(key);
+    if (!k) return false;
+    if (k->intField) value = this->*k->intField;
+    else if (k->doubleField) value = this->*k->doubleField;
+    else return false;
+    return true;
+}
 
-        else if (key == "arrivals_number_min") immigrantsMin = parseInt(value);
-        else if (key == "arrivals_number_max") immigrantsMax = parseInt(value);
+static bool readWholeFile(const std::string& filename, std::string& text) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+    in.seekg(0, std::ios::end);
+    const std::streamoff size = in.tellg();
+    if (size < 0) return false;
+    text.resize(static_cast<std::size_t>(size));
+    in.seekg(0);
+    return static_cast<bool>(in.read(text.data(), size));
+}
 
-        else if (key == "death_percentage_for_loss") starvationLossFraction = parseDoubleFlexible(value);
+bool GameRules::loadFromFile(const std::string& filename, std::string_view profile) {
+    std::string text;
+    return readWholeFile(filename, text) && parse(text, profile);
+}
 
-        else if (key == "rounds_number") totalYears = parseInt(value);
+bool GameRules::parse(std::string_view text, std::string_view profile) {
+    bool found = profile.empty();
+    const bool ok = parseRulesText(text, [&](std::string_view name) -> GameRules* {
+        if (name.empty()) return this;
+        if (name != profile) return nullptr;
+        found = true;
+        return this;
+    });
+    return ok && found && isFilled();
+}
 
-        else if (key == "dead_percentage_lower_limit_bad") pBadLower = parseInt(value);
-        else if (key == "lands_per_resident_bad") lBadUpper = parseInt(value);
-        else if (key == "dead_percentage_lower_limit_ok") pOkLower = parseInt(value);
-        else if (key == "lands_per_resident_ok") lOkUpper = parseInt(value);
-        else if (key == "dead_percentage_lower_limit_good") pGoodLower = parseInt(value);
-        else if (key == "lands_per_resident_good") lGoodUpper = parseInt(value);
+bool loadRulesProfiles(const std::string& filename, std::vector<RulesProfile>& profiles) {
+    std::string text;
+    return readWholeFile(filename, text) && parseRulesProfiles(text, profiles);
+}
 
+bool parseRulesProfiles(std::string_view text, std::vector<RulesProfile>& profiles) {
+    profiles.clear();
+    GameRules shared;
+    bool unique = true;
+    const bool ok = parseRulesText(text, [&](std::string_view name) -> GameRules* {
+        if (name.empty()) return &shared;
+        for (const RulesProfile& p : profiles) unique = unique && p.name != name;
+        profiles.push_back(RulesProfile{std::string(name), shared});
+        return &profiles.back().rules;
+    });
+    if (!ok || !unique) return false;
+    for (const RulesProfile& p : profiles) {
+        if (!p.rules.isFilled()) return false;
     }
-
-    return isFilled();
+    if (shared.isFilled()) profiles.insert(profiles.begin(), RulesProfile{std::string(), shared});
+    return !profiles.empty();
 }
 
 bool GameRules::isFilled() const {
@@ -85,5 +219,44 @@ bool GameRules::isFilled() const {
         totalYears > 0 &&
         pBadLower >= 0 && lBadUpper >= 0 &&
         pOkLower >= 0 && lOkUpper >= 0 &&
-        pGoodLower >= 0 && lGoodUpper >= 0;
+        pGoodLower >= 0 && lGoodUpper >= 0 &&
+        grainScale() > 0;
+}
+
+int GameRules::grainScale() const {
+    if (!(seedsBushelsPerAcre > 0.0) || !(initialGrainBushels >= 0.0)) return 0;
+    if (initialGrainBushels * kMaxGrainScale > 9e15) return 0;
+    const auto whole = [](double x) { return std::fabs(x - std::round(x)) < 1e-6; };
+    for (int scale = 1; scale < kMaxGrainScale; ++scale) {
+        if (whole(seedsBushelsPerAcre * scale) && whole(initialGrainBushels * scale)) return scale;
+    }
+    return kMaxGrainScale;
+}
+
+// The values that make a rule set, in hash order.
+static std::array<int, 17> ruleInts(const GameRules& r) {
+    return {
+        r.initialPopulation, r.initialLandAcres, r.landPriceMin, r.landPriceMax,
+        r.bushelsPerPersonPerYear, r.acresPerPersonMax, r.yieldPerAcreMin, r.yieldPerAcreMax,
+        r.immigrantsMin, r.immigrantsMax, r.totalYears,
+        r.pBadLower, r.lBadUpper, r.pOkLower, r.lOkUpper, r.pGoodLower, r.lGoodUpper,
+    };
+}
+
+static std::array<double, 5> ruleDoubles(const GameRules& r) {
+    return {
+        r.initialGrainBushels, r.seedsBushelsPerAcre, r.ratsMaxFraction, r.plagueProbability,
+        r.starvationLossFraction,
+    };
+}
+
+std::uint64_t GameRules::hash() const {
+    Fnv1a h;
+    for (int v : ruleInts(*this)) h.mixValue(v);
+    for (double v : ruleDoubles(*this)) h.mixValue(v);
+    return h.value();
+}
+
+bool GameRules::sameValues(const GameRules& o) const {
+    return ruleInts(*this) == ruleInts(o) && ruleDoubles(*this) == ruleDoubles(o);
 }
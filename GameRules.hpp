@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 // Reads tunable parameters from a simple key=value file.
-// Keys are compatible with the provided game_rules.txt.
+// Keys are compatible with the provided game_rules.txt. Decimals may use a
+// comma. A line "[name]" starts a named profile: the values before the first
+// profile are shared, and each profile starts from them and overrides some.
 struct GameRules {
     // Initial parameters
     int initialPopulation = -1;
@@ -49,6 +55,55 @@ struct GameRules {
     int pGoodLower = -1;
     int lGoodUpper = -1;
 
-    bool loadFromFile(const std::string& filename);
+    // Loads the shared values and, if named, the profile's. False on a bad
+    // value, a missing profile or an incomplete rule set.
+    bool loadFromFile(const std::string& filename, std::string_view profile = {});
+    bool parse(std::string_view text, std::string_view profile = {});
     bool isFilled() const;
+
+    // One value by its file key; integer fields take the value rounded. False
+    // for an unknown or ignored key.
+    bool setValue(std::string_view key, double value);
+    bool getValue(std::string_view key, double& value) const;
+
+    // Identifies a rule set in files derived from it (solved tables, caches).
+    std::uint64_t hash() const;
+    // Every value equal, where equal hashes only make that likely.
+    bool sameValues(const GameRules& o) const;
+
+    // Grain units per bushel (GameState.hpp): the smallest scale that makes the
+    // seed cost and the initial grain whole, or kMaxGrainScale, to which both
+    // are then rounded, if none below it does. 0 if either is out of range.
+    int grainScale() const;
+    // The seed cost of one acre in grain units of that scale, rounded, and at
+    // least one unit.
+    std::int64_t seedGrainUnits(int scale) const {
+        return std::max<std::int64_t>(1, static_cast<std::int64_t>(seedsBushelsPerAcre * scale + 0.5));
+    }
 };
+
+// A number as the rules file writes it: a comma may be the decimal separator.
+bool parseRuleNumber(std::string_view s, double& value);
+
+// The blanks around keys and values of the rules file, and of the files
+// written like it (sweep specs, policy parameters, optimizer checkpoints).
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline std::string_view trimBlanks(std::string_view s) {
+    while (!s.empty() && isBlank(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isBlank(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+struct RulesProfile {
+    std::string name; // empty for the shared values
+    GameRules rules;
+};
+
+// Every rule set of a file in one pass: the shared values first if they are
+// complete on their own, then each profile in file order. False on a bad
+// value, a repeated name or an incomplete profile.
+bool loadRulesProfiles(const std::string& filename, std::vector<RulesProfile>& profiles);
+bool parseRulesProfiles(std::string_view text, std::vector<RulesProfile>& profiles);
@@ -1,16 +1,24 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+
+// Grain is counted in whole units of 1 / grainScale bushel. All input is
+// integer and only the seed cost can be fractional (0.5 bushels/acre), so with
+// the scale the rules derive from it (GameRules::grainScale) every grain
+// amount is an integer and the year arithmetic is exact. A seed cost that no
+// scale up to kMaxGrainScale makes whole is rounded to 1 / kMaxGrainScale.
+constexpr int kMaxGrainScale = 1000;
 
 // Single source of truth for the whole game progress.
-// All input is integer, but grain can become fractional because 0.5 bushels/acre are spent on seeds.
 struct GameState {
     // Current year (round) to be played. Starts from 1.
     int year = 1;
 
     // Core resources
     int population = 100;
-    double grainBushels = 2800.0;   // grain in granaries
+    std::int64_t grainUnits = 5600; // grain in granaries, in units of 1 / grainScale bushel
+    int grainScale = 2;
     int landAcres = 1000;
 
     // "Last year" report values (for the report at the start of a round)
@@ -28,12 +36,59 @@ struct GameState {
     // Scoring
     int yearsCompleted = 0;            // how many years are fully processed
     double starvationPercentSum = 0.0; // sum of starvation percentages for each completed year
+
+    double grainBushels() const { return static_cast<double>(grainUnits) / grainScale; }
 };
 
+// Sets the grain from bushels at the state's scale, or the smallest finer one
+// that holds the amount exactly. False if none up to kMaxGrainScale does.
+inline bool setGrainBushels(GameState& s, double bushels) {
+    if (!std::isfinite(bushels) || std::fabs(bushels) * kMaxGrainScale > 9e15) return false;
+    for (int scale = s.grainScale; scale <= kMaxGrainScale; scale += s.grainScale) {
+        const double units = std::round(bushels * scale);
+        if (std::fabs(units - bushels * scale) < 1e-6) {
+            s.grainUnits = static_cast<std::int64_t>(units);
+            s.grainScale = scale;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves the grain to a scale that is a multiple of both the current one and
+// scale (the rules' one when a state is resumed under other rules). False if
+// that exceeds kMaxGrainScale.
+inline bool adoptGrainScale(GameState& s, int scale) {
+    int a = s.grainScale;
+    int b = scale;
+    while (b != 0) {
+        const int t = a % b;
+        a = b;
+        b = t;
+    }
+    const long long common = static_cast<long long>(s.grainScale) / a * scale;
+    if (common > kMaxGrainScale) return false;
+    s.grainUnits *= common / s.grainScale;
+    s.grainScale = static_cast<int>(common);
+    return true;
+}
+
 inline bool IsValidSave(const GameState& s) {
     if (s.year < 1) return false;
     if (s.population <= 0) return false;
     if (s.landAcres < 0) return false;
-    if (!std::isfinite(s.grainBushels) || s.grainBushels < 0.0) return false;
+    if (s.grainScale < 1 || s.grainScale > kMaxGrainScale || s.grainUnits < 0) return false;
     return true;
 }
+
+// Field by field, so two games that compare equal continue identically.
+inline bool sameState(const GameState& a, const GameState& b) {
+    return a.year == b.year && a.population == b.population && a.grainUnits == b.grainUnits &&
+        a.grainScale == b.grainScale && a.landAcres == b.landAcres && a.starvedLastYear == b.starvedLastYear &&
+        a.immigrantsLastYear == b.immigrantsLastYear && a.plagueLastYear == b.plagueLastYear &&
+        a.yieldPerAcreLastYear == b.yieldPerAcreLastYear &&
+        a.harvestTotalLastYear == b.harvestTotalLastYear && a.ratsAteLastYear == b.ratsAteLastYear &&
+        a.landPriceThisYear == b.landPriceThisYear &&
+        a.awaitingPlayerDecisions == b.awaitingPlayerDecisions &&
+        a.yearsCompleted == b.yearsCompleted && a.starvationPercentSum == b.starvationPercentSum;
+}
@@ -0,0 +1,541 @@
+#include "GameStateBatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "PhaseCounters.hpp"
+
+#if defined(__AVX2__)
+#define HAMMURABI_SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#define HAMMURABI_SIMD_SSE41 1
+#include <smmintrin.h>
+#endif
+
+void GameStateBatch::resize(std::size_t lanes) {
+    for (auto* v : {&year, &population, &land, &starved, &immigrants, &plague, &yieldPerAcre,
+                    &harvestTotal, &ratsAte, &landPrice, &awaiting, &yearsCompleted, &active, &outcome}) {
+        v->resize(lanes, 0);
+    }
+    grain.resize(lanes, 0);
+    starvationPercentSum.resize(lanes, 0.0);
+}
+
+void GameStateBatch::setLane(std::size_t i, const GameState& s) {
+    year[i] = s.year;
+    population[i] = s.population;
+    grain[i] = static_cast<std::int32_t>(s.grainUnits);
+    grainScale = s.grainScale;
+    land[i] = s.landAcres;
+    starved[i] = s.starvedLastYear;
+    immigrants[i] = s.immigrantsLastYear;
+    plague[i] = s.plagueLastYear ? 1 : 0;
+    yieldPerAcre[i] = s.yieldPerAcreLastYear;
+    harvestTotal[i] = s.harvestTotalLastYear;
+    ratsAte[i] = s.ratsAteLastYear;
+    landPrice[i] = s.landPriceThisYear;
+    awaiting[i] = s.awaitingPlayerDecisions ? 1 : 0;
+    yearsCompleted[i] = s.yearsCompleted;
+    starvationPercentSum[i] = s.starvationPercentSum;
+    active[i] = 1;
+    outcome[i] = static_cast<std::int32_t>(YearOutcome::Continued);
+}
+
+GameState GameStateBatch::lane(std::size_t i) const {
+    GameState s;
+    s.year = year[i];
+    s.population = population[i];
+    s.grainUnits = grain[i];
+    s.grainScale = grainScale;
+    s.landAcres = land[i];
+    s.starvedLastYear = starved[i];
+    s.immigrantsLastYear = immigrants[i];
+    s.plagueLastYear = plague[i] != 0;
+    s.yieldPerAcreLastYear = yieldPerAcre[i];
+    s.harvestTotalLastYear = harvestTotal[i];
+    s.ratsAteLastYear = ratsAte[i];
+    s.landPriceThisYear = landPrice[i];
+    s.awaitingPlayerDecisions = awaiting[i] != 0;
+    s.yearsCompleted = yearsCompleted[i];
+    s.starvationPercentSum = starvationPercentSum[i];
+    return s;
+}
+
+bool grainFitsBatchLane(const GameState& s, const Decisions& d, const GameRules& r) {
+    const std::int64_t sold = static_cast<std::int64_t>(d.acresToSell) * s.landPriceThisYear;
+    const std::int64_t harvest = static_cast<std::int64_t>(d.acresToPlant) * r.yieldPerAcreMax;
+    return s.grainUnits + grainUnitsOf(s, sold + harvest) <= std::numeric_limits<std::int32_t>::max();
+}
+
+void DecisionsBatch::resize(std::size_t lanes) {
+    acresToBuy.resize(lanes, 0);
+    acresToSell.resize(lanes, 0);
+    bushelsToFeed.resize(lanes, 0);
+    acresToPlant.resize(lanes, 0);
+}
+
+void DecisionsBatch::setLane(std::size_t i, const Decisions& d) {
+    acresToBuy[i] = d.acresToBuy;
+    acresToSell[i] = d.acresToSell;
+    bushelsToFeed[i] = d.bushelsToFeed;
+    acresToPlant[i] = d.acresToPlant;
+}
+
+void YearDrawsBatch::resize(std::size_t lanes) {
+    yieldPerAcre.resize(lanes, 0);
+    harvestTotal.resize(lanes, 0);
+    maxRats.resize(lanes, 0);
+    ratsAte.resize(lanes, 0);
+    plague.resize(lanes, 0);
+}
+
+BatchKernel batchKernel() {
+#if defined(HAMMURABI_SIMD_AVX2)
+    return BatchKernel::Avx2;
+#elif defined(HAMMURABI_SIMD_SSE41)
+    return BatchKernel::Sse41;
+#else
+    return BatchKernel::Scalar;
+#endif
+}
+
+const char* batchKernelName(BatchKernel k) {
+    switch (k) {
+    case BatchKernel::Scalar: return "scalar";
+    case BatchKernel::Sse41: return "sse4.1";
+    case BatchKernel::Avx2: return "avx2";
+    }
+    return "?";
+}
+
+// ---------------------------------------------------------------------------
+// Scalar kernels. Same arithmetic, in the same order, as resolveYear().
+
+template <class Rules>
+static void harvestScalar(GameStateBatch& b, const DecisionsBatch& d, YearDrawsBatch& w, Rules rules,
+                          std::size_t from, std::size_t to) {
+    const GameRules& r = rules();
+    const std::int32_t scale = b.grainScale;
+    const std::int32_t seedUnits = static_cast<std::int32_t>(r.seedGrainUnits(scale));
+    for (std::size_t i = from; i < to; ++i) {
+        if (!b.active[i]) continue;
+        b.land[i] += d.acresToBuy[i];
+        b.land[i] -= d.acresToSell[i];
+
+        std::int32_t g = b.grain[i];
+        g -= d.acresToBuy[i] * b.landPrice[i] * scale;
+        g += d.acresToSell[i] * b.landPrice[i] * scale;
+        g -= d.bushelsToFeed[i] * scale;
+        g -= d.acresToPlant[i] * seedUnits;
+
+        w.harvestTotal[i] = d.acresToPlant[i] * w.yieldPerAcre[i];
+        g += w.harvestTotal[i] * scale;
+        b.grain[i] = g;
+
+        int maxRats = static_cast<int>(std::floor(static_cast<double>(g) / scale * r.ratsMaxFraction));
+        w.maxRats[i] = maxRats < 0 ? 0 : maxRats;
+        b.awaiting[i] = 0;
+    }
+}
+
+template <class Rules>
+static void eventsScalar(GameStateBatch& b, const DecisionsBatch& d, const YearDrawsBatch& w, Rules rules,
+                         std::size_t from, std::size_t to) {
+    const GameRules& r = rules();
+    const double lossThreshold = r.starvationLossFraction * 100.0 + 1e-9;
+    const std::int32_t scale = b.grainScale;
+    for (std::size_t i = from; i < to; ++i) {
+        if (!b.active[i]) continue;
+
+        std::int32_t g = b.grain[i] - w.ratsAte[i] * scale;
+        if (g < 0) g = 0;
+        b.grain[i] = g;
+
+        const int populationStart = b.population[i];
+        const int peopleFed = d.bushelsToFeed[i] / r.bushelsPerPersonPerYear;
+        const int starved = std::max(0, populationStart - peopleFed);
+        const double starvedPercent = (populationStart == 0)
+            ? 0.0
+            : (100.0 * static_cast<double>(starved) / static_cast<double>(populationStart));
+
+        if (starvedPercent > lossThreshold) {
+            b.starved[i] = starved;
+            b.immigrants[i] = 0;
+            b.plague[i] = 0;
+            b.yieldPerAcre[i] = w.yieldPerAcre[i];
+            b.harvestTotal[i] = w.harvestTotal[i];
+            b.ratsAte[i] = w.ratsAte[i];
+            b.active[i] = 0;
+            b.outcome[i] = static_cast<std::int32_t>(YearOutcome::Overthrown);
+            continue;
+        }
+
+        int pop = populationStart - starved;
+        if (pop <= 0) {
+            b.population[i] = pop;
+            b.active[i] = 0;
+            b.outcome[i] = static_cast<std::int32_t>(YearOutcome::Depopulated);
+            continue;
+        }
+
+        int immigrants = static_cast<int>(
+            (starved / 2.0) + (5.0 - static_cast<double>(w.yieldPerAcre[i])) * (static_cast<double>(g) / scale / 600.0)
+            + 1.0
+        );
+        immigrants = std::clamp(immigrants, r.immigrantsMin, r.immigrantsMax);
+        pop += immigrants;
+
+        if (w.plague[i]) {
+            pop /= 2;
+            if (pop <= 0) {
+                b.population[i] = pop;
+                b.active[i] = 0;
+                b.outcome[i] = static_cast<std::int32_t>(YearOutcome::PlagueWipeout);
+                continue;
+            }
+        }
+
+        b.population[i] = pop;
+        b.starved[i] = starved;
+        b.immigrants[i] = immigrants;
+        b.plague[i] = w.plague[i] ? 1 : 0;
+        b.yieldPerAcre[i] = w.yieldPerAcre[i];
+        b.harvestTotal[i] = w.harvestTotal[i];
+        b.ratsAte[i] = w.ratsAte[i];
+        b.yearsCompleted[i] += 1;
+        b.starvationPercentSum[i] += starvedPercent;
+        b.year[i] += 1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SIMD kernels, four lanes per step. Integer lanes, grain among them, live in
+// one __m128i; the double lanes in a Vec4d that is one __m256d (AVX2) or two
+// __m128d (SSE4.1). Ended lanes are computed like any other and then blended
+// away.
+
+#if defined(HAMMURABI_SIMD_AVX2) || defined(HAMMURABI_SIMD_SSE41)
+
+namespace {
+
+#if defined(HAMMURABI_SIMD_AVX2)
+
+struct Vec4d {
+    __m256d v;
+};
+
+inline Vec4d load4d(const double* p) { return {_mm256_loadu_pd(p)}; }
+inline void store4d(double* p, Vec4d a) { _mm256_storeu_pd(p, a.v); }
+inline Vec4d set4d(double x) { return {_mm256_set1_pd(x)}; }
+inline Vec4d add(Vec4d a, Vec4d b) { return {_mm256_add_pd(a.v, b.v)}; }
+inline Vec4d sub(Vec4d a, Vec4d b) { return {_mm256_sub_pd(a.v, b.v)}; }
+inline Vec4d mul(Vec4d a, Vec4d b) { return {_mm256_mul_pd(a.v, b.v)}; }
+inline Vec4d div(Vec4d a, Vec4d b) { return {_mm256_div_pd(a.v, b.v)}; }
+inline Vec4d floor4d(Vec4d a) { return {_mm256_floor_pd(a.v)}; }
+inline Vec4d toDouble(__m128i a) { return {_mm256_cvtepi32_pd(a)}; }
+inline __m128i truncToInt(Vec4d a) { return _mm256_cvttpd_epi32(a.v); }
+
+// Double-lane mask widened from / narrowed to 32-bit integer lanes.
+inline Vec4d widenMask(__m128i m) { return {_mm256_castsi256_pd(_mm256_cvtepi32_epi64(m))}; }
+inline __m128i gtMask(Vec4d a, Vec4d b) {
+    __m256 c = _mm256_castpd_ps(_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ));
+    // Take the low 32 bits of every 64-bit lane.
+    __m256 packed = _mm256_permutevar8x32_ps(c, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+    return _mm_castps_si128(_mm256_castps256_ps128(packed));
+}
+inline Vec4d blend(Vec4d a, Vec4d b, Vec4d mask) { return {_mm256_blendv_pd(a.v, b.v, mask.v)}; }
+
+#else
+
+struct Vec4d {
+    __m128d lo, hi;
+};
+
+inline Vec4d load4d(const double* p) { return {_mm_loadu_pd(p), _mm_loadu_pd(p + 2)}; }
+inline void store4d(double* p, Vec4d a) { _mm_storeu_pd(p, a.lo); _mm_storeu_pd(p + 2, a.hi); }
+inline Vec4d set4d(double x) { return {_mm_set1_pd(x), _mm_set1_pd(x)}; }
+inline Vec4d add(Vec4d a, Vec4d b) { return {_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)}; }
+inline Vec4d sub(Vec4d a, Vec4d b) { return {_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)}; }
+inline Vec4d mul(Vec4d a, Vec4d b) { return {_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)}; }
+inline Vec4d div(Vec4d a, Vec4d b) { return {_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)}; }
+inline Vec4d floor4d(Vec4d a) { return {_mm_floor_pd(a.lo), _mm_floor_pd(a.hi)}; }
+inline Vec4d toDouble(__m128i a) {
+    return {_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(_mm_unpackhi_epi64(a, a))};
+}
+inline __m128i truncToInt(Vec4d a) {
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(a.lo), _mm_cvttpd_epi32(a.hi));
+}
+
+inline Vec4d widenMask(__m128i m) {
+    return {_mm_castsi128_pd(_mm_cvtepi32_epi64(m)),
+            _mm_castsi128_pd(_mm_cvtepi32_epi64(_mm_unpackhi_epi64(m, m)))};
+}
+inline __m128i gtMask(Vec4d a, Vec4d b) {
+    __m128 lo = _mm_castpd_ps(_mm_cmpgt_pd(a.lo, b.lo));
+    __m128 hi = _mm_castpd_ps(_mm_cmpgt_pd(a.hi, b.hi));
+    return _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+inline Vec4d blend(Vec4d a, Vec4d b, Vec4d mask) {
+    return {_mm_blendv_pd(a.lo, b.lo, mask.lo), _mm_blendv_pd(a.hi, b.hi, mask.hi)};
+}
+
+#endif
+
+inline __m128i load4i(const std::int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void store4i(std::int32_t* p, __m128i a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+inline __m128i blendi(__m128i a, __m128i b, __m128i mask) { return _mm_blendv_epi8(a, b, mask); }
+inline __m128i activeMask(const std::int32_t* p) {
+    return _mm_cmpgt_epi32(load4i(p), _mm_setzero_si128());
+}
+
+} // namespace
+
+template <class Rules>
+static std::size_t harvestSimd(GameStateBatch& b, const DecisionsBatch& d, YearDrawsBatch& w, Rules rules) {
+    const GameRules& r = rules();
+    const std::size_t n = b.size() & ~std::size_t(3);
+    const __m128i scale = _mm_set1_epi32(b.grainScale);
+    const __m128i seedUnits = _mm_set1_epi32(static_cast<std::int32_t>(r.seedGrainUnits(b.grainScale)));
+    const Vec4d scaleD = set4d(static_cast<double>(b.grainScale));
+    const Vec4d ratsFraction = set4d(r.ratsMaxFraction);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (std::size_t i = 0; i < n; i += 4) {
+        const __m128i act = activeMask(&b.active[i]);
+
+        const __m128i buy = load4i(&d.acresToBuy[i]);
+        const __m128i sell = load4i(&d.acresToSell[i]);
+        const __m128i feed = load4i(&d.bushelsToFeed[i]);
+        const __m128i plant = load4i(&d.acresToPlant[i]);
+        const __m128i price = _mm_mullo_epi32(load4i(&b.landPrice[i]), scale);
+
+        const __m128i land0 = load4i(&b.land[i]);
+        const __m128i land = _mm_sub_epi32(_mm_add_epi32(land0, buy), sell);
+        store4i(&b.land[i], blendi(land0, land, act));
+
+        const __m128i g0 = load4i(&b.grain[i]);
+        __m128i g = _mm_sub_epi32(g0, _mm_mullo_epi32(buy, price));
+        g = _mm_add_epi32(g, _mm_mullo_epi32(sell, price));
+        g = _mm_sub_epi32(g, _mm_mullo_epi32(feed, scale));
+        g = _mm_sub_epi32(g, _mm_mullo_epi32(plant, seedUnits));
+
+        const __m128i harvest = _mm_mullo_epi32(plant, load4i(&w.yieldPerAcre[i]));
+        g = _mm_add_epi32(g, _mm_mullo_epi32(harvest, scale));
+        store4i(&b.grain[i], blendi(g0, g, act));
+        store4i(&w.harvestTotal[i], blendi(load4i(&w.harvestTotal[i]), harvest, act));
+
+        __m128i maxRats = truncToInt(floor4d(mul(div(toDouble(g), scaleD), ratsFraction)));
+        maxRats = _mm_max_epi32(maxRats, zero);
+        store4i(&w.maxRats[i], blendi(load4i(&w.maxRats[i]), maxRats, act));
+
+        store4i(&b.awaiting[i], blendi(load4i(&b.awaiting[i]), zero, act));
+    }
+    return n;
+}
+
+template <class Rules>
+static std::size_t eventsSimd(GameStateBatch& b, const DecisionsBatch& d, const YearDrawsBatch& w, Rules rules) {
+    const GameRules& r = rules();
+    const std::size_t n = b.size() & ~std::size_t(3);
+    const Vec4d zeroD = set4d(0.0);
+    const Vec4d two = set4d(2.0);
+    const Vec4d hundred = set4d(100.0);
+    const Vec4d five = set4d(5.0);
+    const Vec4d sixHundred = set4d(600.0);
+    const Vec4d one = set4d(1.0);
+    const Vec4d lossThreshold = set4d(r.starvationLossFraction * 100.0 + 1e-9);
+    const Vec4d perPerson = set4d(static_cast<double>(r.bushelsPerPersonPerYear));
+    const __m128i scale = _mm_set1_epi32(b.grainScale);
+    const Vec4d scaleD = set4d(static_cast<double>(b.grainScale));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i allOnes = _mm_set1_epi32(-1);
+    const __m128i immMin = _mm_set1_epi32(r.immigrantsMin);
+    const __m128i immMax = _mm_set1_epi32(r.immigrantsMax);
+
+    for (std::size_t i = 0; i < n; i += 4) {
+        const __m128i act = activeMask(&b.active[i]);
+
+        // Rats
+        const __m128i g0 = load4i(&b.grain[i]);
+        const __m128i g = _mm_max_epi32(_mm_sub_epi32(g0, _mm_mullo_epi32(load4i(&w.ratsAte[i]), scale)), zero);
+        store4i(&b.grain[i], blendi(g0, g, act));
+
+        // Starvation. Integer division is exact through doubles for int operands.
+        const __m128i pop0 = load4i(&b.population[i]);
+        const __m128i fed = truncToInt(div(toDouble(load4i(&d.bushelsToFeed[i])), perPerson));
+        const __m128i starved = _mm_max_epi32(_mm_sub_epi32(pop0, fed), zero);
+        const Vec4d starvedD = toDouble(starved);
+        const __m128i popIsZero = _mm_cmpeq_epi32(pop0, zero);
+        Vec4d percent = div(mul(hundred, starvedD), toDouble(pop0));
+        percent = blend(percent, zeroD, widenMask(popIsZero));
+
+        const __m128i over = _mm_and_si128(act, gtMask(percent, lossThreshold));
+        const __m128i rest = _mm_andnot_si128(over, act);
+
+        const __m128i pop1 = _mm_sub_epi32(pop0, starved);
+        const __m128i depop = _mm_andnot_si128(_mm_cmpgt_epi32(pop1, zero), rest);
+        const __m128i alive = _mm_andnot_si128(depop, rest);
+
+        // Immigration
+        const Vec4d yieldD = toDouble(load4i(&w.yieldPerAcre[i]));
+        Vec4d imm = add(div(starvedD, two), mul(sub(five, yieldD), div(div(toDouble(g), scaleD), sixHundred)));
+        imm = add(imm, one);
+        __m128i immigrants = truncToInt(imm);
+        immigrants = _mm_min_epi32(_mm_max_epi32(immigrants, immMin), immMax);
+        const __m128i pop2 = _mm_add_epi32(pop1, immigrants);
+
+        // Plague
+        const __m128i plague = load4i(&w.plague[i]);
+        const __m128i pop3 = blendi(pop2, _mm_srai_epi32(pop2, 1), plague);
+        const __m128i wipe = _mm_and_si128(_mm_and_si128(alive, plague), _mm_cmpgt_epi32(_mm_set1_epi32(1), pop3));
+        const __m128i cont = _mm_andnot_si128(wipe, alive);
+        const __m128i report = _mm_or_si128(over, cont);
+
+        __m128i pop = blendi(pop0, pop1, rest);
+        pop = blendi(pop, pop3, alive);
+        store4i(&b.population[i], pop);
+
+        store4i(&b.starved[i], blendi(load4i(&b.starved[i]), starved, report));
+        store4i(&b.immigrants[i], blendi(load4i(&b.immigrants[i]), _mm_and_si128(immigrants, cont), report));
+        store4i(&b.plague[i], blendi(load4i(&b.plague[i]), _mm_and_si128(_mm_srli_epi32(plague, 31), cont), report));
+        store4i(&b.yieldPerAcre[i], blendi(load4i(&b.yieldPerAcre[i]), load4i(&w.yieldPerAcre[i]), report));
+        store4i(&b.harvestTotal[i], blendi(load4i(&b.harvestTotal[i]), load4i(&w.harvestTotal[i]), report));
+        store4i(&b.ratsAte[i], blendi(load4i(&b.ratsAte[i]), load4i(&w.ratsAte[i]), report));
+
+        store4i(&b.yearsCompleted[i], _mm_sub_epi32(load4i(&b.yearsCompleted[i]), cont));
+        store4i(&b.year[i], _mm_sub_epi32(load4i(&b.year[i]), cont));
+        const Vec4d sum0 = load4d(&b.starvationPercentSum[i]);
+        store4d(&b.starvationPercentSum[i], blend(sum0, add(sum0, percent), widenMask(cont)));
+
+        // Ended lanes: outcome codes follow the YearOutcome enumerator order.
+        __m128i outcome = load4i(&b.outcome[i]);
+        outcome = blendi(outcome, _mm_set1_epi32(static_cast<int>(YearOutcome::Overthrown)), over);
+        outcome = blendi(outcome, _mm_set1_epi32(static_cast<int>(YearOutcome::Depopulated)), depop);
+        outcome = blendi(outcome, _mm_set1_epi32(static_cast<int>(YearOutcome::PlagueWipeout)), wipe);
+        store4i(&b.outcome[i], outcome);
+        const __m128i ended = _mm_andnot_si128(cont, act);
+        store4i(&b.active[i], _mm_and_si128(load4i(&b.active[i]), _mm_xor_si128(ended, allOnes)));
+    }
+    return n;
+}
+
+#endif
+
+template <class Rules>
+void advanceBatchHarvest(GameStateBatch& b, const DecisionsBatch& d, YearDrawsBatch& draws, Rules rules,
+                         BatchKernel k) {
+    std::size_t done = 0;
+#if defined(HAMMURABI_SIMD_AVX2) || defined(HAMMURABI_SIMD_SSE41)
+    if (k != BatchKernel::Scalar) done = harvestSimd(b, d, draws, rules);
+#else
+    (void)k;
+#endif
+    harvestScalar(b, d, draws, rules, done, b.size());
+}
+
+template <class Rules>
+void advanceBatchEvents(GameStateBatch& b, const DecisionsBatch& d, const YearDrawsBatch& draws, Rules rules,
+                        BatchKernel k) {
+    std::size_t done = 0;
+#if defined(HAMMURABI_SIMD_AVX2) || defined(HAMMURABI_SIMD_SSE41)
+    if (k != BatchKernel::Scalar) done = eventsSimd(b, d, draws, rules);
+#else
+    (void)k;
+#endif
+    eventsScalar(b, d, draws, rules, done, b.size());
+}
+
+template <class Rules>
+void beginYearBatch(GameStateBatch& b, Rules rules, std::vector<Rng>& rngs) {
+    const GameRules& r = rules();
+    for (std::size_t i = 0; i < b.size(); ++i) {
+        if (!b.active[i] || b.awaiting[i]) continue;
+        b.landPrice[i] = rngs[i].intInRange(b.year[i], RngEvent::LandPrice, r.landPriceMin, r.landPriceMax);
+        b.awaiting[i] = 1;
+    }
+}
+
+// Counts what a year did to the lanes that were active before it, from the
+// batch after stage 2 and the lanes' population at the start of the year.
+static void countYearEvents(const GameStateBatch& b, const DecisionsBatch& d, const YearDrawsBatch& draws,
+                            const GameRules& r, const std::vector<std::int32_t>& activeBefore,
+                            const std::vector<std::int32_t>& populationBefore, PhaseCounters& c) {
+    for (std::size_t i = 0; i < b.size(); ++i) {
+        if (!activeBefore[i]) continue;
+        c.laneYears += 1;
+
+        const auto outcome = b.active[i] ? YearOutcome::Continued : static_cast<YearOutcome>(b.outcome[i]);
+        if (outcome == YearOutcome::Overthrown) {
+            c.overthrows += 1;
+            continue;
+        }
+        if (outcome == YearOutcome::Depopulated) {
+            c.depopulations += 1;
+            continue;
+        }
+
+        // The lane reached immigration; the grain is what the rats left.
+        const int starved = std::max(0, populationBefore[i] - d.bushelsToFeed[i] / r.bushelsPerPersonPerYear);
+        const double grain = static_cast<double>(b.grain[i]) / b.grainScale;
+        const int immigrants = immigrantsBeforeLimits(starved, draws.yieldPerAcre[i], grain);
+        if (immigrants < r.immigrantsMin) c.immigrantsClampedLow += 1;
+        if (immigrants > r.immigrantsMax) c.immigrantsClampedHigh += 1;
+
+        if (draws.plague[i]) c.plagueHits += 1;
+        if (outcome == YearOutcome::PlagueWipeout) c.plagueWipeouts += 1;
+    }
+}
+
+template <class Rules>
+void resolveYearBatch(GameStateBatch& b, const DecisionsBatch& d, YearDrawsBatch& draws, Rules rules,
+                      std::vector<Rng>& rngs, BatchKernel k, PhaseCounters* counters) {
+    const GameRules& r = rules();
+    const std::size_t n = b.size();
+    draws.resize(n);
+
+    // Stage 1 does not change population or active.
+    std::vector<std::int32_t> activeBefore;
+    std::vector<std::int32_t> populationBefore;
+    if (counters) {
+        activeBefore = b.active;
+        populationBefore = b.population;
+    }
+    std::uint64_t t = counters ? phaseClock() : 0;
+    const auto stamp = [&](BatchPhase p) {
+        if (!counters) return;
+        const std::uint64_t now = phaseClock();
+        counters->add(p, now - t);
+        t = now;
+    };
+
+    const std::vector<std::int32_t> yieldMax(n, r.yieldPerAcreMax);
+    intInRangeLanes(rngs.data(), b.year.data(), RngEvent::Yield, r.yieldPerAcreMin, yieldMax.data(),
+                    b.active.data(), draws.yieldPerAcre.data(), n);
+    stamp(BatchPhase::YieldDraw);
+    advanceBatchHarvest(b, d, draws, rules, k);
+    stamp(BatchPhase::Harvest);
+
+    shareLanes(rngs.data(), b.year.data(), RngEvent::Rats, draws.maxRats.data(), b.active.data(),
+               draws.ratsAte.data(), n);
+    stamp(BatchPhase::RatsDraw);
+    chanceLanes(rngs.data(), b.year.data(), RngEvent::Plague, r.plagueProbability,
+                b.active.data(), draws.plague.data(), n);
+    stamp(BatchPhase::PlagueDraw);
+    advanceBatchEvents(b, d, draws, rules, k);
+    stamp(BatchPhase::Events);
+
+    if (counters) countYearEvents(b, d, draws, r, activeBefore, populationBefore, *counters);
+}
+
+#define HAMMURABI_INSTANTIATE_BATCH(Rules)                                                                   \
+    template void advanceBatchHarvest(GameStateBatch&, const DecisionsBatch&, YearDrawsBatch&, Rules,        \
+                                      BatchKernel);                                                          \
+    template void advanceBatchEvents(GameStateBatch&, const DecisionsBatch&, const YearDrawsBatch&, Rules,   \
+                                     BatchKernel);                                                           \
+    template void beginYearBatch(GameStateBatch&, Rules, std::vector<Rng>&);                                 \
+    template void resolveYearBatch(GameStateBatch&, const DecisionsBatch&, YearDrawsBatch&, Rules,           \
+                                   std::vector<Rng>&, BatchKernel, PhaseCounters*);
+HAMMURABI_FOR_EACH_RULES_SOURCE(HAMMURABI_INSTANTIATE_BATCH)
+#undef HAMMURABI_INSTANTIATE_BATCH
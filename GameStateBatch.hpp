@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "RulesPresets.hpp"
+
+struct PhaseCounters;
+
+// Struct-of-arrays form of many independent GameState values ("lanes"), so one
+// year can be advanced for all of them with SIMD kernels. Field meanings match
+// GameState; `active` is 0 once a lane's game has ended and `outcome` then
+// holds the YearOutcome that ended it. Grain is in units of 1 / grainScale
+// bushel like GameState::grainUnits, narrowed to 32 bits; every lane has the
+// same scale.
+struct GameStateBatch {
+    std::vector<std::int32_t> year;
+    std::vector<std::int32_t> population;
+    std::vector<std::int32_t> grain;
+    std::vector<std::int32_t> land;
+    int grainScale = 2;
+
+    std::vector<std::int32_t> starved;
+    std::vector<std::int32_t> immigrants;
+    std::vector<std::int32_t> plague;
+    std::vector<std::int32_t> yieldPerAcre;
+    std::vector<std::int32_t> harvestTotal;
+    std::vector<std::int32_t> ratsAte;
+
+    std::vector<std::int32_t> landPrice;
+    std::vector<std::int32_t> awaiting;
+
+    std::vector<std::int32_t> yearsCompleted;
+    std::vector<double> starvationPercentSum;
+
+    std::vector<std::int32_t> active;
+    std::vector<std::int32_t> outcome;
+
+    std::size_t size() const { return population.size(); }
+    void resize(std::size_t lanes);
+
+    // The lane takes s.grainScale as the batch's scale.
+    void setLane(std::size_t i, const GameState& s);
+    GameState lane(std::size_t i) const;
+};
+
+// True if no grain amount of the year can leave 32 bits: the grain after
+// selling the land, and the harvest of the most that can be planted at the
+// best yield on top. A lane that fails must be played on in a GameState.
+bool grainFitsBatchLane(const GameState& s, const Decisions& d, const GameRules& r);
+
+struct DecisionsBatch {
+    std::vector<std::int32_t> acresToBuy;
+    std::vector<std::int32_t> acresToSell;
+    std::vector<std::int32_t> bushelsToFeed;
+    std::vector<std::int32_t> acresToPlant;
+
+    void resize(std::size_t lanes);
+    void setLane(std::size_t i, const Decisions& d);
+};
+
+// Per-lane random draws of one year. The rats amount depends on the grain after
+// the harvest, so it is drawn between the two kernel stages from maxRats.
+struct YearDrawsBatch {
+    std::vector<std::int32_t> yieldPerAcre;
+    std::vector<std::int32_t> harvestTotal;
+    std::vector<std::int32_t> maxRats;
+    std::vector<std::int32_t> ratsAte;
+    std::vector<std::int32_t> plague; // 0 or -1 (all bits set), ready for use as a mask
+
+    void resize(std::size_t lanes);
+};
+
+enum class BatchKernel {
+    Scalar,
+    Sse41,
+    Avx2,
+};
+
+// Best kernel this binary was compiled for.
+BatchKernel batchKernel();
+const char* batchKernelName(BatchKernel k);
+
+// The kernels take a rules source (RulesPresets.hpp): DynamicRules{r} for
+// loaded rules, or a preset's FixedRules to run with its values as constants.
+// They are instantiated for every HAMMURABI_FOR_EACH_RULES_SOURCE entry.
+
+// Stage 1: land trade, feeding, planting and harvest for all active lanes.
+// Fills draws.harvestTotal and draws.maxRats.
+template <class Rules>
+void advanceBatchHarvest(GameStateBatch& b, const DecisionsBatch& d, YearDrawsBatch& draws, Rules rules,
+                         BatchKernel k);
+
+// Stage 2: rats, starvation check, immigration and plague. Lanes that end their
+// game are masked out (active = 0) with the same field updates resolveYear makes.
+template <class Rules>
+void advanceBatchEvents(GameStateBatch& b, const DecisionsBatch& d, const YearDrawsBatch& draws, Rules rules,
+                        BatchKernel k);
+
+// Whole-year drivers. rngs holds one generator per lane; the draws are keyed by
+// (game, year, event), so a lane evolves exactly like resolveYear. With
+// counters, resolveYearBatch also times its draws and kernel stages and counts
+// the year's events (PhaseCounters.hpp).
+template <class Rules>
+void beginYearBatch(GameStateBatch& b, Rules rules, std::vector<Rng>& rngs);
+template <class Rules>
+void resolveYearBatch(GameStateBatch& b, const DecisionsBatch& d, YearDrawsBatch& draws, Rules rules,
+                      std::vector<Rng>& rngs, BatchKernel k, PhaseCounters* counters = nullptr);
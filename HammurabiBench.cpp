@@ -0,0 +1,528 @@
+// Microbenchmarks of the engine: every phase of a year on its own, whole years
+// and games on each path, the save formats and the rules parser. Numbers are
+// nanoseconds per operation; --json writes them for comparing builds.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Compare.hpp"
+#include "Evaluator.hpp"
+#include "GameEngine.hpp"
+#include "GameRules.hpp"
+#include "PhaseCounters.hpp"
+#include "Policy.hpp"
+#include "RulesPresets.hpp"
+#include "SaveManager.hpp"
+#include "Simulation.hpp"
+#include "WorkStealingPool.hpp"
+
+namespace {
+
+struct BenchOptions {
+    std::string rulesFile = "game_rules.txt";
+    std::string policy = "trader";
+    std::string filter;      // run only benchmarks whose name contains this
+    double minTime = 0.25;   // seconds per benchmark
+    std::string json;        // also write the results here
+    bool list = false;
+};
+
+struct BenchResult {
+    std::string name;
+    std::uint64_t ops = 0;
+    double seconds = 0.0;
+    std::string note;
+
+    double nsPerOp() const { return ops > 0 ? seconds * 1e9 / static_cast<double>(ops) : 0.0; }
+};
+
+// Results are folded into this so the measured work cannot be optimized away.
+volatile std::uint64_t gSink = 0;
+
+std::uint64_t fold(const GameState& s) {
+    return static_cast<std::uint64_t>(s.population) * 31u + static_cast<std::uint64_t>(s.landAcres) * 7u +
+        static_cast<std::uint64_t>(s.grainUnits);
+}
+
+// A year as the policy met it: the state after the land price was rolled, the
+// clamped decisions and the game's generator.
+struct YearSample {
+    GameState state;
+    Decisions decisions;
+    Rng rng{0};
+};
+
+// The same year advanced through trade, feeding, planting and harvest, with
+// what the later phases read.
+struct HarvestedSample {
+    GameState state;
+    Decisions decisions;
+    Rng rng{0};
+    int yieldPerAcre = 0;
+    int starved = 0;
+};
+
+class Bench {
+public:
+    Bench(const BenchOptions& opt, const GameRules& r, const Policy& policy)
+        : opt_(opt), r_(r), policy_(policy) {}
+
+    // Calls body(reps) with growing reps until one call takes minTime; body
+    // does opsPerRep operations per rep. note is read after the runs, so the
+    // body may fill it in.
+    template <class Body>
+    void run(const std::string& name, std::uint64_t opsPerRep, Body&& body, const std::string& note = {}) {
+        if (opt_.list) {
+            std::cout << name << "\n";
+            return;
+        }
+        if (!opt_.filter.empty() && name.find(opt_.filter) == std::string::npos) return;
+
+        std::uint64_t reps = 1;
+        double secs = 0.0;
+        for (;;) {
+            const auto t0 = std::chrono::steady_clock::now();
+            body(reps);
+            secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if (secs >= opt_.minTime || reps >= (1ull << 40)) break;
+            const double grow = secs > 0.0 ? opt_.minTime * 1.2 / secs : 100.0;
+            reps = static_cast<std::uint64_t>(static_cast<double>(reps) * std::clamp(grow, 2.0, 100.0));
+        }
+
+        BenchResult res{name, reps * opsPerRep, secs, note};
+        std::cout << std::left << std::setw(28) << res.name << std::right << std::setw(14) << std::fixed
+                  << std::setprecision(2) << res.nsPerOp() << " ns/op" << std::setw(14) << res.ops << " ops";
+        if (!res.note.empty()) std::cout << "  " << res.note;
+        std::cout << "\n";
+        results_.push_back(std::move(res));
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+    const GameRules& rules() const { return r_; }
+    const Policy& policy() const { return policy_; }
+
+private:
+    const BenchOptions& opt_;
+    const GameRules& r_;
+    const Policy& policy_;
+    std::vector<BenchResult> results_;
+};
+
+std::vector<YearSample> collectYears(const GameRules& r, const Policy& policy, std::size_t count) {
+    std::vector<YearSample> out;
+    for (std::uint64_t g = 0; out.size() < count; ++g) {
+        Rng rng(1, g);
+        GameState s;
+        initNewGame(s, r);
+        while (s.year <= r.totalYears && out.size() < count) {
+            beginYear(s, r, rng);
+            const Decisions d = clampDecisions(s, policy.decide(s, r), r);
+            out.push_back(YearSample{s, d, rng});
+            if (resolveYear(s, d, r, rng) != YearOutcome::Continued) break;
+        }
+    }
+    return out;
+}
+
+std::vector<HarvestedSample> harvestYears(const GameRules& r, const std::vector<YearSample>& years) {
+    std::vector<HarvestedSample> out;
+    out.reserve(years.size());
+    for (const YearSample& y : years) {
+        HarvestedSample h{y.state, y.decisions, y.rng};
+        RngYearEvents ev{h.rng, h.state.year};
+        tradeLand(h.state, h.decisions);
+        feedPeople(h.state, h.decisions);
+        plantFields(h.state, h.decisions, DynamicRules{r});
+        h.yieldPerAcre = ev.yieldPerAcre(r);
+        harvestFields(h.state, h.decisions, h.yieldPerAcre);
+        ratsEat(h.state, DynamicRules{r}, ev);
+        double starvedPercent = 0.0;
+        h.starved = starvedPeople(h.state, h.decisions, DynamicRules{r}, starvedPercent);
+        out.push_back(h);
+    }
+    return out;
+}
+
+// Every phase of resolveYearFor in isolation; one op is one lane's phase.
+template <class Rules>
+void benchPhases(Bench& bench, Rules rules, const std::vector<YearSample>& years,
+                 const std::vector<HarvestedSample>& harvested) {
+    const GameRules& r = rules();
+    const std::uint64_t n = years.size();
+
+    bench.run("phase/land_trade", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const YearSample& y : years) {
+                GameState t = y.state;
+                tradeLand(t, y.decisions);
+                sum += fold(t);
+            }
+        }
+        gSink = gSink + sum;
+    });
+    bench.run("phase/feeding", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const YearSample& y : years) {
+                GameState t = y.state;
+                feedPeople(t, y.decisions);
+                sum += fold(t);
+            }
+        }
+        gSink = gSink + sum;
+    });
+    bench.run("phase/planting", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const YearSample& y : years) {
+                GameState t = y.state;
+                plantFields(t, y.decisions, rules);
+                sum += fold(t);
+            }
+        }
+        gSink = gSink + sum;
+    });
+    bench.run("phase/harvest", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const YearSample& y : years) {
+                GameState t = y.state;
+                RngYearEvents ev{y.rng, t.year};
+                sum += static_cast<std::uint64_t>(harvestFields(t, y.decisions, ev.yieldPerAcre(r)));
+            }
+        }
+        gSink = gSink + sum;
+    }, "yield draw included");
+    bench.run("phase/rats", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const HarvestedSample& h : harvested) {
+                GameState t = h.state;
+                RngYearEvents ev{h.rng, t.year};
+                sum += static_cast<std::uint64_t>(ratsEat(t, rules, ev));
+            }
+        }
+        gSink = gSink + sum;
+    }, "rats draw included");
+    bench.run("phase/starvation", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const HarvestedSample& h : harvested) {
+                double percent = 0.0;
+                sum += static_cast<std::uint64_t>(starvedPeople(h.state, h.decisions, rules, percent));
+                sum += overthrownAfter(percent, rules) ? 1u : 0u;
+            }
+        }
+        gSink = gSink + sum;
+    });
+    bench.run("phase/immigration", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const HarvestedSample& h : harvested) {
+                sum += static_cast<std::uint64_t>(
+                    immigrantsAfterHarvest(h.starved, h.yieldPerAcre, h.state.grainBushels(), r));
+            }
+        }
+        gSink = gSink + sum;
+    });
+    bench.run("phase/plague", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const HarvestedSample& h : harvested) {
+                GameState t = h.state;
+                RngYearEvents ev{h.rng, t.year};
+                sum += plagueStrikes(t, rules, ev) ? 1u : 0u;
+                sum += static_cast<std::uint64_t>(t.population);
+            }
+        }
+        gSink = gSink + sum;
+    }, "plague draw included");
+}
+
+template <class Rules>
+void benchYears(Bench& bench, Rules rules, const char* suffix, const std::vector<YearSample>& years) {
+    bench.run(std::string("year/resolve_") + suffix, years.size(), [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const YearSample& y : years) {
+                GameState t = y.state;
+                RngYearEvents ev{y.rng, t.year};
+                sum += static_cast<std::uint64_t>(resolveYearFor(t, y.decisions, rules, ev));
+                sum += fold(t);
+            }
+        }
+        gSink = gSink + sum;
+    });
+}
+
+// Whole games; one op is one game.
+template <class Rules>
+void benchGames(Bench& bench, Rules rules, const char* suffix) {
+    constexpr std::uint64_t kGames = 1024;
+    const Policy& policy = bench.policy();
+
+    bench.run(std::string("game/scalar_") + suffix, kGames, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (std::uint64_t g = 0; g < kGames; ++g) {
+                Rng rng(1, g);
+                sum += fold(playGame(rules, policy, rng).finalState);
+            }
+        }
+        gSink = gSink + sum;
+    });
+
+    std::vector<BatchKernel> kernels{BatchKernel::Scalar};
+    if (batchKernel() != BatchKernel::Scalar) kernels.push_back(batchKernel());
+    std::vector<Rng> rngs;
+    std::vector<GameResult> results;
+    for (BatchKernel kernel : kernels) {
+        bench.run(std::string("game/batch_") + batchKernelName(kernel) + "_" + suffix, kGames,
+                  [&](std::uint64_t reps) {
+            std::uint64_t sum = 0;
+            for (std::uint64_t k = 0; k < reps; ++k) {
+                rngs.clear();
+                for (std::uint64_t g = 0; g < kGames; ++g) rngs.emplace_back(1, g);
+                playGameBatch(rules, policy, rngs, results, kernel);
+                for (const GameResult& res : results) sum += fold(res.finalState);
+            }
+            gSink = gSink + sum;
+        });
+    }
+}
+
+void benchSaves(Bench& bench, const std::vector<YearSample>& years) {
+    const GameRules& r = bench.rules();
+    const std::uint64_t n = years.size();
+
+    std::vector<unsigned char> records(n * kGameStateRecordSize);
+    for (std::size_t i = 0; i < years.size(); ++i) encodeGameState(years[i].state, &records[i * kGameStateRecordSize]);
+
+    bench.run("save/encode_state", n, [&](std::uint64_t reps) {
+        unsigned char buf[kGameStateRecordSize];
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (const YearSample& y : years) {
+                encodeGameState(y.state, buf);
+                sum += buf[0] + buf[kGameStateRecordSize - 1];
+            }
+        }
+        gSink = gSink + sum;
+    });
+    bench.run("save/decode_state", n, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            for (std::size_t i = 0; i < years.size(); ++i) sum += fold(decodeGameState(&records[i * kGameStateRecordSize]));
+        }
+        gSink = gSink + sum;
+    });
+
+    std::error_code ec;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "hammurabi_bench";
+    std::filesystem::create_directories(dir, ec);
+    const SaveManager saves((dir / "save.dat").string(), (dir / "save.txt").string(),
+                            (dir / "journal.dat").string());
+
+    bench.run("save/snapshot_save_load", 1, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            GameState loaded;
+            saves.save(years[k % years.size()].state);
+            sum += saves.load(loaded) == SaveStatus::Loaded ? fold(loaded) : 0;
+        }
+        gSink = gSink + sum;
+    }, "to disk, atomic replace");
+
+    // A whole game written as a journal, then replayed from memory.
+    Rng rng(1, 0);
+    GameState s;
+    initNewGame(s, r);
+    saves.startJournal(r, rng);
+    while (s.year <= r.totalYears) {
+        beginYear(s, r, rng);
+        const Decisions d = clampDecisions(s, bench.policy().decide(s, r), r);
+        saves.appendYear(d);
+        if (resolveYear(s, d, r, rng) != YearOutcome::Continued) break;
+    }
+    std::ifstream in(dir / "journal.dat", std::ios::binary);
+    const std::vector<unsigned char> journal{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    const JournalReplay check = SaveManager::replayJournal(journal.data(), journal.size(), r);
+
+    bench.run("save/journal_replay", 1, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            const JournalReplay replay = SaveManager::replayJournal(journal.data(), journal.size(), r);
+            sum += replay.years + fold(replay.state);
+        }
+        gSink = gSink + sum;
+    }, std::to_string(check.years) + " years, " + std::to_string(journal.size()) + " bytes");
+
+    saves.clear();
+    std::filesystem::remove_all(dir, ec);
+}
+
+void benchRulesParsing(Bench& bench, const std::string& rulesFile) {
+    std::ifstream in(rulesFile);
+    std::ostringstream text;
+    text << in.rdbuf();
+    const std::string rulesText = text.str();
+
+    bench.run("rules/parse", 1, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            GameRules parsed;
+            sum += parsed.parse(rulesText) ? static_cast<std::uint64_t>(parsed.totalYears) : 0;
+        }
+        gSink = gSink + sum;
+    }, std::to_string(rulesText.size()) + " bytes");
+    bench.run("rules/parse_profiles", 1, [&](std::uint64_t reps) {
+        std::uint64_t sum = 0;
+        std::vector<RulesProfile> profiles;
+        for (std::uint64_t k = 0; k < reps; ++k) sum += parseRulesProfiles(rulesText, profiles) ? profiles.size() : 0;
+        gSink = gSink + sum;
+    });
+}
+
+// Games needed to resolve the P difference of two policies to a fixed
+// half-width: played on common random numbers against independent games.
+void benchCommonRandomNumbers(Bench& bench) {
+    constexpr double kHalfWidth = 0.02;
+    const GameRules& r = bench.rules();
+    const std::unique_ptr<Policy> other = makePolicy("steady", r);
+    if (!other) return;
+    WorkStealingPool pool(1);
+    const double z = confidenceZ(0.95);
+
+    std::string pairedNote;
+    bench.run("crn/paired_to_target", 1, [&](std::uint64_t reps) {
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            CompareConfig cfg;
+            cfg.eval.games = 1ull << 24;
+            cfg.eval.batchLanes = 1024;
+            cfg.pHalfWidth = kHalfWidth;
+            cfg.minGames = 4096;
+            cfg.roundChunks = 1;
+            const CompareReport rep = comparePolicies(r, bench.policy(), *other, cfg, pool);
+            pairedNote = std::to_string(rep.a.games + rep.b.games) + " games";
+        }
+    }, pairedNote);
+
+    std::string independentNote;
+    bench.run("crn/independent_to_target", 1, [&](std::uint64_t reps) {
+        for (std::uint64_t k = 0; k < reps; ++k) {
+            EvalConfig ca;
+            ca.games = 1ull << 24;
+            ca.batchLanes = 1024;
+            EvalConfig cb = ca;
+            cb.seed = ca.seed + 1;
+            EvalScratch scratch;
+            EvalReport a;
+            EvalReport b;
+            for (std::size_t c = 0; c < evalChunkCount(ca); ++c) {
+                evaluateChunk(r, bench.policy(), ca, c, scratch, a);
+                evaluateChunk(r, *other, cb, c, scratch, b);
+                if (a.p.count < 2 || b.p.count < 2) continue;
+                const double hw = z * std::sqrt(a.p.variance() / static_cast<double>(a.p.count) +
+                                                b.p.variance() / static_cast<double>(b.p.count));
+                if (hw <= kHalfWidth) break;
+            }
+            independentNote = std::to_string(a.games + b.games) + " games";
+        }
+    }, independentNote);
+}
+
+bool writeJson(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    out << std::setprecision(6);
+    out << "{\n  \"kernel\": \"" << batchKernelName(batchKernel()) << "\",\n"
+        << "  \"clock\": \"" << phaseClockName() << "\",\n"
+        << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& res = results[i];
+        out << "    {\"name\": \"" << res.name << "\", \"ns_per_op\": " << res.nsPerOp() << ", \"ops\": " << res.ops
+            << ", \"seconds\": " << res.seconds << ", \"note\": \"" << res.note << "\"}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& o) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const bool hasValue = i + 1 < argc;
+        try {
+            if (a == "--rules" && hasValue) o.rulesFile = argv[++i];
+            else if (a == "--policy" && hasValue) o.policy = argv[++i];
+            else if (a == "--filter" && hasValue) o.filter = argv[++i];
+            else if (a == "--min-time" && hasValue) o.minTime = std::stod(argv[++i]);
+            else if (a == "--json" && hasValue) o.json = argv[++i];
+            else if (a == "--list") o.list = true;
+            else return false;
+        } catch (...) {
+            return false;
+        }
+    }
+    return o.minTime > 0.0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    if (!parseOptions(argc, argv, opt)) {
+        std::cout << "Usage: hammurabi_bench [--rules FILE] [--policy NAME] [--filter TEXT] [--min-time SECONDS]\n"
+                  << "                       [--json FILE] [--list]\n";
+        return 2;
+    }
+
+    GameRules rules;
+    if (!rules.loadFromFile(opt.rulesFile)) {
+        std::cerr << "Cannot load rules from " << opt.rulesFile << "\n";
+        return 1;
+    }
+    const std::unique_ptr<Policy> policy = makePolicy(opt.policy, rules);
+    if (!policy) {
+        std::cerr << "Unknown policy " << opt.policy << "\n";
+        return 2;
+    }
+
+    if (!opt.list) {
+        std::cout << "kernel " << batchKernelName(batchKernel()) << ", rules preset "
+                  << rulesPresetName(findRulesPreset(rules)) << ", policy " << policy->name() << "\n";
+    }
+
+    Bench bench(opt, rules, *policy);
+    const std::vector<YearSample> years = collectYears(rules, *policy, 4096);
+    const std::vector<HarvestedSample> harvested = harvestYears(rules, years);
+
+    benchPhases(bench, DynamicRules{rules}, years, harvested);
+    benchYears(bench, DynamicRules{rules}, "dynamic", years);
+    benchGames(bench, DynamicRules{rules}, "dynamic");
+    if (findRulesPreset(rules) == RulesPreset::Stock) {
+        benchYears(bench, FixedRules<kStockRules>{}, "preset", years);
+        benchGames(bench, FixedRules<kStockRules>{}, "preset");
+    }
+    benchSaves(bench, years);
+    benchRulesParsing(bench, opt.rulesFile);
+    benchCommonRandomNumbers(bench);
+
+    if (!opt.json.empty() && !writeJson(opt.json, bench.results())) {
+        std::cerr << "Cannot write " << opt.json << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,855 @@
+// hammurabi_server: hosts many interactive games in one thread. Each session is
+// the console game's coroutine dialogue; an epoll loop over a Unix socket
+// resumes it whenever a full line arrives and sends whatever it printed.
+// Stored sessions replay their random events from the server seed, so restart
+// the server with the same --seed to resume them; a session resumes only under
+// the rules it was saved with. The rules file is checked
+// every second; new games start with the latest valid rules while running ones
+// keep theirs. With --leaderboard, games played to the end are recorded there,
+// in one batch a second that a thread of its own writes. POSIX only.
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "GameDialog.hpp"
+#include "GameEngine.hpp"
+#include "GameRules.hpp"
+#include "Leaderboard.hpp"
+#include "Policy.hpp"
+#include "SessionArena.hpp"
+#include "SessionStore.hpp"
+
+namespace {
+
+struct ServerOptions {
+    std::string rulesFile = "game_rules.txt";
+    std::string rulesProfile;
+    std::string socketPath = "hammurabi.sock";
+    std::string store;          // session store; enables resuming by session id
+    std::string leaderboard;    // records finished games
+    bool hasSeed = false;
+    std::uint64_t seed = 0;
+    bool useStdin = false;      // one session on stdin/stdout instead of the socket
+    std::string loadTarget;     // run the load-test client against this socket
+    long long clients = 1000;   // concurrent load-test sessions
+    long long games = 10000;    // load-test games in total
+    std::string policy = "steady";
+};
+
+void printUsage() {
+    std::cout << "Usage: hammurabi_server [--socket PATH] [--store FILE] [--leaderboard FILE] [--seed N]\n"
+              << "                        [--rules FILE] [--profile NAME]\n"
+              << "       hammurabi_server --stdin [--store FILE] [--leaderboard FILE] [--seed N] [--rules FILE]\n"
+              << "                        [--profile NAME]\n"
+              << "       hammurabi_server --load SOCKET [--clients N] [--games N] [--policy NAME] [--rules FILE]\n";
+}
+
+bool parseOptions(int argc, char** argv, ServerOptions& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (a == "--rules" && hasValue) o.rulesFile = argv[++i];
+            else if (a == "--profile" && hasValue) o.rulesProfile = argv[++i];
+            else if (a == "--socket" && hasValue) o.socketPath = argv[++i];
+            else if (a == "--store" && hasValue) o.store = argv[++i];
+            else if (a == "--leaderboard" && hasValue) o.leaderboard = argv[++i];
+            else if (a == "--seed" && hasValue) {
+                o.seed = std::stoull(argv[++i]);
+                o.hasSeed = true;
+            }
+            else if (a == "--stdin") o.useStdin = true;
+            else if (a == "--load" && hasValue) o.loadTarget = argv[++i];
+            else if (a == "--clients" && hasValue) o.clients = std::stoll(argv[++i]);
+            else if (a == "--games" && hasValue) o.games = std::stoll(argv[++i]);
+            else if (a == "--policy" && hasValue) o.policy = argv[++i];
+            else return false;
+        } catch (...) {
+            return false;
+        }
+    }
+    return o.clients > 0 && o.games > 0;
+}
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onStopSignal(int) {
+    stopRequested = 1;
+}
+
+// Tens of thousands of sessions need as many descriptors.
+void raiseDescriptorLimit() {
+    rlimit lim{};
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+double cpuSeconds() {
+    rusage u{};
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_utime.tv_sec + u.ru_stime.tv_sec + (u.ru_utime.tv_usec + u.ru_stime.tv_usec) / 1e6;
+}
+
+// Collects what a session prints until the loop sends it.
+class StringSink : public std::streambuf {
+public:
+    std::string data;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) data.push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        data.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+};
+
+// Identifies a version of the rules file without reading it.
+struct FileStamp {
+    std::int64_t mtimeNs = -1;
+    std::int64_t size = -1;
+
+    bool operator==(const FileStamp& o) const { return mtimeNs == o.mtimeNs && size == o.size; }
+    bool operator!=(const FileStamp& o) const { return !(*this == o); }
+};
+
+FileStamp stampOf(const std::string& path) {
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0) return FileStamp{};
+    return FileStamp{static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+                     static_cast<std::int64_t>(st.st_size)};
+}
+
+// Writes finished games to the leaderboard on a thread of its own, so that the
+// event loop never waits for the log's sync or an index rewrite. Games handed
+// over while a write is under way go in the next batch; a batch that cannot be
+// written is tried again with the next one.
+class LeaderboardWriter {
+public:
+    explicit LeaderboardWriter(Leaderboard& board) : board_(board), thread_([this] { writerLoop(); }) {}
+    ~LeaderboardWriter() { finish(); }
+
+    LeaderboardWriter(const LeaderboardWriter&) = delete;
+    LeaderboardWriter& operator=(const LeaderboardWriter&) = delete;
+
+    // Takes the games (and clears them) and starts a write. Reports the games
+    // that a failed write left waiting.
+    void submit(std::vector<LeaderboardEntry>& games, std::ostream& log) {
+        std::lock_guard<std::mutex> lock(m_);
+        if (failed_) {
+            log << "Cannot write the leaderboard; " << queued_.size() + games.size() << " games wait\n";
+            failed_ = false;
+        }
+        queued_.insert(queued_.end(), games.begin(), games.end());
+        games.clear();
+        if (queued_.empty()) return;
+        pending_ = true;
+        wake_.notify_one();
+    }
+
+    // Writes what is queued and stops the thread. False if games were lost.
+    bool finish() {
+        if (!thread_.joinable()) return queued_.empty();
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+            pending_ = !queued_.empty();
+        }
+        wake_.notify_one();
+        thread_.join();
+        return queued_.empty();
+    }
+    std::size_t queued() const {
+        std::lock_guard<std::mutex> lock(m_);
+        return queued_.size();
+    }
+
+private:
+    void writerLoop() {
+        std::unique_lock<std::mutex> lock(m_);
+        for (;;) {
+            wake_.wait(lock, [this] { return pending_ || stop_; });
+            if (pending_) {
+                std::vector<LeaderboardEntry> batch;
+                batch.swap(queued_);
+                pending_ = false;
+                lock.unlock();
+                const bool ok = board_.insert(batch);
+                lock.lock();
+                if (!ok) {
+                    queued_.insert(queued_.begin(), batch.begin(), batch.end());
+                    failed_ = true;
+                }
+            }
+            if (stop_ && !pending_) return;
+        }
+    }
+
+    Leaderboard& board_;
+    mutable std::mutex m_;
+    std::condition_variable wake_;
+    std::vector<LeaderboardEntry> queued_;
+    bool pending_ = false; // queued_ is to be written
+    bool failed_ = false;  // the last write failed and has not been reported
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+// Shared by all sessions of one server.
+struct ServerContext {
+    std::shared_ptr<const GameRules> rules; // for games started from now on
+    std::string rulesFile;
+    std::string rulesProfile;
+    FileStamp rulesStamp;  // of the rules loaded last
+    FileStamp failedStamp; // of the last version reported as not loading
+    std::uint64_t seed = 0;
+    SessionStore* store = nullptr;
+    LeaderboardWriter* leaderboard = nullptr;
+    std::vector<LeaderboardEntry> finished; // not yet handed to the leaderboard
+    std::mt19937_64 ids{std::random_device{}()};
+
+    std::uint64_t newSessionId() {
+        for (;;) {
+            const std::uint64_t id = ids() >> 11; // short enough to type
+            if (id != 0 && !(store && store->contains(id))) return id;
+        }
+    }
+
+    // The stamp is taken before reading, so a write that lands during the
+    // read is picked up by the next check.
+    bool loadRules() {
+        auto r = std::make_shared<GameRules>();
+        const FileStamp stamp = stampOf(rulesFile);
+        if (!r->loadFromFile(rulesFile, rulesProfile)) return false;
+        rulesStamp = stamp;
+        rules = std::move(r);
+        return true;
+    }
+
+    // Reloads the rules if the file changed. Games in progress hold on to the
+    // rules they started with. A file that does not load is tried again every
+    // check, as it may have been caught mid-write, but reported once per
+    // version; the current rules stay.
+    void reloadRulesIfChanged(std::ostream& log) {
+        const FileStamp stamp = stampOf(rulesFile);
+        if (stamp == rulesStamp) return;
+        if (loadRules()) {
+            log << "Reloaded " << rulesFile << "\n";
+        } else if (stamp != failedStamp) {
+            log << "Kept the current rules: " << rulesFile << " does not load\n";
+            failedStamp = stamp;
+        }
+    }
+
+    // Hands the games finished since the last call to the leaderboard's
+    // writer; they wait for the next call if the leaderboard cannot be written.
+    void flushLeaderboard(std::ostream& log) {
+        if (leaderboard) leaderboard->submit(finished, log);
+    }
+
+    // Records what is left before the server exits.
+    void closeLeaderboard(std::ostream& log) {
+        if (!leaderboard) return;
+        leaderboard->submit(finished, log);
+        if (!leaderboard->finish()) log << "Cannot write the leaderboard; " << leaderboard->queued() << " games lost\n";
+    }
+};
+
+// One player's game. The random events are keyed by the session id, so a
+// stored state is all that is needed to resume it.
+struct Session {
+    std::uint64_t id = 0;
+    std::shared_ptr<const GameRules> rules;
+    GameState state;
+    Rng rng{0};
+    DialogHooks hooks;
+};
+
+Task<DialogEnd> serveSession(Console& io, ServerContext& ctx, Session& session) {
+    session.rules = ctx.rules;
+    bool resumed = false;
+    if (ctx.store) {
+        io.out << "Session id to resume (empty = new game): ";
+        const std::string line = co_await io.readLine();
+        const std::uint64_t rulesHash = session.rules->hash();
+        std::uint64_t id = 0;
+        std::uint64_t savedRulesHash = 0;
+        if (!line.empty()) {
+            const auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), id);
+            if (ec != std::errc() || end != line.data() + line.size() ||
+                !ctx.store->get(id, session.state, savedRulesHash)) {
+                io.out << "No such session. Starting a new game.\n";
+            } else if (savedRulesHash != rulesHash && savedRulesHash != 0) {
+                // Its years so far were played under rules that are gone.
+                io.out << "Session " << id << " was played under other rules. Starting a new game.\n";
+            } else {
+                if (savedRulesHash == 0) {
+                    io.out << "Session " << id << " was saved without its rules; resuming under the current ones.\n";
+                }
+                session.id = id;
+                resumed = true;
+            }
+        }
+        session.hooks.yearStarted = [&ctx, &session, rulesHash](const GameState& s) {
+            return ctx.store->put(session.id, s, rulesHash) != 0;
+        };
+    }
+    if (!resumed) {
+        session.id = ctx.newSessionId();
+        initNewGame(session.state, *session.rules);
+    }
+    session.rng = Rng(ctx.seed, session.id);
+    io.out << (resumed ? "Resuming session " : "Session ") << session.id << ".\n";
+
+    const DialogEnd end = co_await playGame(io, session.state, *session.rules, session.rng, session.hooks);
+    if (end == DialogEnd::Finished && ctx.store) ctx.store->erase(session.id);
+    if (end == DialogEnd::Finished && ctx.leaderboard && session.state.year > session.rules->totalYears) {
+        ctx.finished.push_back(leaderboardEntry(session.id, session.state, *session.rules));
+    }
+    co_return end;
+}
+
+// A socket session. Lives in the loop's arena, as do its coroutine frames.
+struct Connection {
+    explicit Connection(int fd) : fd(fd), io(out) {}
+
+    int fd;
+    StringSink sink;
+    std::ostream out{&sink};
+    Console io;
+    Session session;
+    Task<DialogEnd> task;
+    std::string in;        // received bytes not yet ending in a newline
+    std::size_t sent = 0;  // bytes of sink.data already sent
+    std::uint32_t events = 0;
+    std::size_t slot = 0;  // index in the server's list of open connections
+    bool closing = false;  // the game ended: close once the output is sent
+};
+
+constexpr std::size_t kMaxLine = 4096;
+constexpr int kRulesCheckMs = 1000;
+constexpr std::size_t kMaxUnsent = 1 << 16; // stop reading from a client that does not read
+
+class GameServer {
+public:
+    explicit GameServer(ServerContext& ctx) : ctx_(ctx) {}
+    ~GameServer();
+
+    bool listen(const std::string& path);
+    void run();
+    void printStats(std::ostream& out) const;
+
+private:
+    void acceptAll();
+    void onEvents(Connection* c, std::uint32_t events);
+    bool readInput(Connection* c);
+    void feedLines(Connection* c);
+    bool flush(Connection* c);
+    void updateInterest(Connection* c);
+    void closeConnection(Connection* c);
+
+    ServerContext& ctx_;
+    SessionArena arena_;
+    int epoll_ = -1;
+    int listen_ = -1;
+    std::string path_;
+    std::vector<Connection*> open_;
+
+    std::uint64_t accepted_ = 0;
+    std::uint64_t finished_ = 0;
+    std::uint64_t lines_ = 0;
+    std::size_t peakSessions_ = 0;
+    std::size_t peakArenaBytes_ = 0;
+};
+
+GameServer::~GameServer() {
+    for (Connection* c : open_) {
+        ::close(c->fd);
+        arena_.destroy(c);
+    }
+    if (listen_ >= 0) {
+        ::close(listen_);
+        ::unlink(path_.c_str());
+    }
+    if (epoll_ >= 0) ::close(epoll_);
+}
+
+bool GameServer::listen(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof addr.sun_path) return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    listen_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (epoll_ < 0 || listen_ < 0) return false;
+    ::unlink(path.c_str());
+    if (bind(listen_, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(listen_, SOMAXCONN) != 0) {
+        return false;
+    }
+    path_ = path;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // the listening socket
+    return epoll_ctl(epoll_, EPOLL_CTL_ADD, listen_, &ev) == 0;
+}
+
+void GameServer::run() {
+    SessionArena::Use useArena(arena_); // for the sessions' coroutine frames
+    std::vector<epoll_event> events(1024);
+    auto nextRulesCheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(kRulesCheckMs);
+    while (!stopRequested) {
+        const int n = epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), kRulesCheckMs);
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= nextRulesCheck) {
+            ctx_.reloadRulesIfChanged(std::cout);
+            ctx_.flushLeaderboard(std::cout);
+            std::cout.flush();
+            nextRulesCheck = now + std::chrono::milliseconds(kRulesCheckMs);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait: " << std::strerror(errno) << "\n";
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (!events[i].data.ptr) acceptAll();
+            else onEvents(static_cast<Connection*>(events[i].data.ptr), events[i].events);
+        }
+        peakArenaBytes_ = std::max(peakArenaBytes_, arena_.bytesReserved());
+    }
+}
+
+void GameServer::acceptAll() {
+    for (;;) {
+        const int fd = accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) std::cerr << "accept: " << std::strerror(errno) << "\n";
+            return;
+        }
+
+        Connection* c = arena_.create<Connection>(fd);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            ::close(fd);
+            arena_.destroy(c);
+            continue;
+        }
+        c->events = EPOLLIN;
+        c->slot = open_.size();
+        open_.push_back(c);
+        ++accepted_;
+        peakSessions_ = std::max(peakSessions_, open_.size());
+
+        c->task = serveSession(c->io, ctx_, c->session);
+        c->task.start();
+        if (c->task.done()) c->closing = true;
+        if (!flush(c)) closeConnection(c);
+    }
+}
+
+void GameServer::onEvents(Connection* c, std::uint32_t events) {
+    if (events & EPOLLOUT) {
+        if (!flush(c)) {
+            closeConnection(c);
+            return;
+        }
+    }
+    // Lines that arrived with the hangup are still played.
+    const bool peerOpen = !(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) || readInput(c);
+    feedLines(c);
+    if (!flush(c) || !peerOpen) closeConnection(c);
+}
+
+// False when the peer is gone or sent garbage.
+bool GameServer::readInput(Connection* c) {
+    char buf[4096];
+    for (;;) {
+        const ssize_t got = ::read(c->fd, buf, sizeof buf);
+        if (got > 0) {
+            c->in.append(buf, static_cast<std::size_t>(got));
+            if (c->in.size() > kMaxLine && c->in.find('\n') == std::string::npos) return false;
+            if (static_cast<std::size_t>(got) < sizeof buf) return true;
+            continue;
+        }
+        if (got == 0) return false;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+void GameServer::feedLines(Connection* c) {
+    std::size_t begin = 0;
+    while (!c->closing && c->sink.data.size() - c->sent < kMaxUnsent) {
+        const std::size_t nl = c->in.find('\n', begin);
+        if (nl == std::string::npos) break;
+        ++lines_;
+        c->io.provide(c->in.substr(begin, nl - begin));
+        begin = nl + 1;
+        if (c->task.done()) c->closing = true;
+    }
+    c->in.erase(0, begin);
+}
+
+// Sends what the session printed. False when the connection should go.
+bool GameServer::flush(Connection* c) {
+    std::string& out = c->sink.data;
+    while (c->sent < out.size()) {
+        const ssize_t n = ::send(c->fd, out.data() + c->sent, out.size() - c->sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->sent += static_cast<std::size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+    if (c->sent == out.size()) {
+        out.clear();
+        c->sent = 0;
+        if (c->closing) return false;
+    }
+    updateInterest(c);
+    return true;
+}
+
+void GameServer::updateInterest(Connection* c) {
+    std::uint32_t want = 0;
+    if (!c->sink.data.empty()) want |= EPOLLOUT;
+    if (!c->closing && c->sink.data.size() < kMaxUnsent) want |= EPOLLIN;
+    if (want == c->events) return;
+    epoll_event ev{};
+    ev.events = want;
+    ev.data.ptr = c;
+    epoll_ctl(epoll_, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+}
+
+void GameServer::closeConnection(Connection* c) {
+    if (c->task.done()) ++finished_;
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+    open_[c->slot] = open_.back();
+    open_[c->slot]->slot = c->slot;
+    open_.pop_back();
+    arena_.destroy(c); // also destroys a dialogue still waiting for input
+}
+
+void GameServer::printStats(std::ostream& out) const {
+    const double cpu = cpuSeconds();
+    out << accepted_ << " sessions (" << finished_ << " played to the end, peak " << peakSessions_
+        << " at once), " << lines_ << " lines in " << cpu << " CPU s";
+    if (cpu > 0.0) out << " (" << lines_ / cpu << " lines per CPU s)";
+    out << ", arena peak " << peakArenaBytes_ / 1024 << " KiB\n";
+}
+
+int runServer(ServerContext& ctx, const ServerOptions& opt) {
+    raiseDescriptorLimit();
+    std::signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa{};
+    sa.sa_handler = onStopSignal; // no SA_RESTART: epoll_wait returns EINTR
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    GameServer server(ctx);
+    if (!server.listen(opt.socketPath)) {
+        std::cerr << "Cannot listen on " << opt.socketPath << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::cout << "Listening on " << opt.socketPath << " with seed " << ctx.seed << std::endl;
+    server.run();
+    ctx.closeLeaderboard(std::cout);
+    server.printStats(std::cout);
+    return 0;
+}
+
+// The same session on stdin/stdout, for trying the server's dialogue by hand.
+int runStdinSession(ServerContext& ctx) {
+    Console io(std::cout);
+    Session session;
+    Task<DialogEnd> task = serveSession(io, ctx, session);
+    task.start();
+    while (!task.done()) {
+        std::cout.flush();
+        std::string line;
+        if (!std::getline(std::cin, line)) {
+            std::cout << "\nInput ended.\n";
+            return 0;
+        }
+        io.provide(std::move(line));
+    }
+    ctx.closeLeaderboard(std::cerr);
+    return 0;
+}
+
+// Load-test client: keeps --clients sessions open, plays each with a policy by
+// reading the reports the server prints, and measures the time from sending an
+// answer to receiving the next prompt.
+struct Player {
+    int fd = -1;
+    std::string in;
+    GameState seen;             // what the last report said
+    Decisions plan;
+    std::string lastPrompt;
+    bool sawReport = false;
+    bool ruledToTheEnd = false; // got the final summary
+    bool waiting = false;       // an answer is on its way
+    std::chrono::steady_clock::time_point sentAt;
+};
+
+// Reads "label: number" off a report line.
+template <class T>
+bool parseAfter(const std::string& text, const char* label, T& value) {
+    const std::size_t at = text.rfind(label);
+    if (at == std::string::npos) return false;
+    const char* p = text.data() + at + std::strlen(label);
+    const auto [end, ec] = std::from_chars(p, text.data() + text.size(), value);
+    return ec == std::errc() && end != p;
+}
+
+class LoadClient {
+public:
+    LoadClient(const GameRules& r, const Policy& policy, const ServerOptions& opt) : rules_(r), policy_(policy), opt_(opt) {}
+    int run();
+
+private:
+    bool connectOne();
+    bool onReadable(Player& p);
+    std::string answer(Player& p, const std::string& prompt);
+
+    const GameRules& rules_;
+    const Policy& policy_;
+    const ServerOptions& opt_;
+    int epoll_ = -1;
+    long long started_ = 0;
+    long long finished_ = 0;
+    long long ruledToTheEnd_ = 0;
+    long long failed_ = 0;
+    std::vector<std::unique_ptr<Player>> players_;
+    std::vector<std::uint32_t> latencyUs_;
+};
+
+bool LoadClient::connectOne() {
+    sockaddr_un addr{};
+    if (opt_.loadTarget.size() >= sizeof addr.sun_path) return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, opt_.loadTarget.c_str(), opt_.loadTarget.size() + 1);
+
+    // A blocking connect just waits while the server's backlog is full.
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) != 0) {
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    auto p = std::make_unique<Player>();
+    p->fd = fd;
+    p->sentAt = std::chrono::steady_clock::now();
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = p.get();
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        ::close(fd);
+        return false;
+    }
+    players_.push_back(std::move(p));
+    ++started_;
+    return true;
+}
+
+std::string LoadClient::answer(Player& p, const std::string& prompt) {
+    // A repeated question means the last answer was refused; zero is always
+    // accepted.
+    const bool repeated = prompt == p.lastPrompt;
+    p.lastPrompt = prompt;
+    if (prompt.rfind("Session id", 0) == 0) return "";
+    if (prompt.rfind("Save and quit", 0) == 0) return "n";
+    if (repeated) return "0";
+    if (prompt.find("buy") != std::string::npos) {
+        p.plan = clampDecisions(p.seen, policy_.decide(p.seen, rules_), rules_);
+        return std::to_string(p.plan.acresToBuy);
+    }
+    if (prompt.find("sell") != std::string::npos) return std::to_string(p.plan.acresToSell);
+    if (prompt.find("feed") != std::string::npos) return std::to_string(p.plan.bushelsToFeed);
+    if (prompt.find("plant") != std::string::npos) return std::to_string(p.plan.acresToPlant);
+    return "n";
+}
+
+// False when the session is over.
+bool LoadClient::onReadable(Player& p) {
+    char buf[8192];
+    for (;;) {
+        const ssize_t got = ::read(p.fd, buf, sizeof buf);
+        if (got == 0) {
+            p.ruledToTheEnd = p.in.find("Summary of your rule") != std::string::npos;
+            return false;
+        }
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p.in.append(buf, static_cast<std::size_t>(got));
+        // Every message ends in a newline and every prompt in a space.
+        if (!p.in.empty() && p.in.back() == ' ') break;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (p.waiting) {
+        latencyUs_.push_back(static_cast<std::uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - p.sentAt).count()));
+        p.waiting = false;
+    }
+
+    parseAfter(p.in, "Year ", p.seen.year);
+    if (parseAfter(p.in, "Current population: ", p.seen.population)) p.sawReport = true;
+    double grain = 0.0;
+    if (parseAfter(p.in, "Grain in storage: ", grain)) setGrainBushels(p.seen, grain);
+    parseAfter(p.in, "Land owned: ", p.seen.landAcres);
+    parseAfter(p.in, "Land price this year: ", p.seen.landPriceThisYear);
+
+    const std::size_t nl = p.in.rfind('\n');
+    const std::string prompt = nl == std::string::npos ? p.in : p.in.substr(nl + 1);
+    p.in.clear();
+
+    std::string reply = answer(p, prompt);
+    reply.push_back('\n');
+    p.sentAt = std::chrono::steady_clock::now();
+    p.waiting = true;
+    return ::send(p.fd, reply.data(), reply.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(reply.size());
+}
+
+int LoadClient::run() {
+    raiseDescriptorLimit();
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_ < 0) return 1;
+
+    const auto t0 = std::chrono::steady_clock::now();
+    while (started_ < opt_.games && static_cast<long long>(players_.size()) < opt_.clients) {
+        if (!connectOne()) {
+            std::cerr << "Cannot connect to " << opt_.loadTarget << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+    }
+    const std::size_t concurrency = players_.size();
+
+    std::vector<epoll_event> events(1024);
+    while (!players_.empty()) {
+        const int n = epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        for (int i = 0; i < n; ++i) {
+            Player* p = static_cast<Player*>(events[i].data.ptr);
+            if (onReadable(*p)) continue;
+
+            // The server closes the connection when the game is over.
+            if (!p->sawReport) ++failed_;
+            else ++finished_;
+            if (p->ruledToTheEnd) ++ruledToTheEnd_;
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, p->fd, nullptr);
+            ::close(p->fd);
+            auto it = std::find_if(players_.begin(), players_.end(), [p](const auto& q) { return q.get() == p; });
+            *it = std::move(players_.back());
+            players_.pop_back();
+            if (started_ < opt_.games && !connectOne()) ++failed_;
+        }
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    ::close(epoll_);
+
+    std::sort(latencyUs_.begin(), latencyUs_.end());
+    auto pct = [&](double q) {
+        if (latencyUs_.empty()) return std::uint32_t(0);
+        return latencyUs_[static_cast<std::size_t>(q * (latencyUs_.size() - 1))];
+    };
+    std::cout << std::setprecision(6);
+    std::cout << finished_ << " games (" << ruledToTheEnd_ << " ruled to the end, " << failed_ << " failed) by " << concurrency << " concurrent sessions in "
+              << secs << " s, " << latencyUs_.size() << " answers (" << latencyUs_.size() / secs << " per s)\n";
+    std::cout << "prompt latency us: p50 " << pct(0.5) << ", p90 " << pct(0.9) << ", p99 " << pct(0.99)
+              << ", max " << pct(1.0) << "\n";
+    return failed_ == 0 ? 0 : 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    ServerOptions opt;
+    if (!parseOptions(argc, argv, opt)) {
+        printUsage();
+        return 2;
+    }
+
+    ServerContext ctx;
+    ctx.rulesFile = opt.rulesFile;
+    ctx.rulesProfile = opt.rulesProfile;
+    if (!ctx.loadRules()) {
+        std::cerr << "Failed to read " << opt.rulesFile << " or the file contains errors.\n";
+        return 1;
+    }
+
+    if (!opt.loadTarget.empty()) {
+        std::unique_ptr<Policy> policy = makePolicy(opt.policy, *ctx.rules);
+        if (!policy) {
+            std::cerr << "Unknown policy " << opt.policy << "\n";
+            return 2;
+        }
+        LoadClient client(*ctx.rules, *policy, opt);
+        return client.run();
+    }
+
+    ctx.seed = opt.hasSeed ? opt.seed : std::random_device{}();
+    SessionStore store;
+    if (!opt.store.empty()) {
+        if (!store.open(opt.store)) {
+            std::cerr << "Cannot open " << opt.store << " as a session store.\n";
+            return 1;
+        }
+        ctx.store = &store;
+    }
+    Leaderboard leaderboard;
+    std::unique_ptr<LeaderboardWriter> writer;
+    if (!opt.leaderboard.empty()) {
+        if (!leaderboard.open(opt.leaderboard)) {
+            std::cerr << "Cannot open the leaderboard " << opt.leaderboard << ".\n";
+            return 1;
+        }
+        writer = std::make_unique<LeaderboardWriter>(leaderboard);
+        ctx.leaderboard = writer.get();
+    }
+
+    return opt.useStdin ? runStdinSession(ctx) : runServer(ctx, opt);
+}
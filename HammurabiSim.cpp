@@ -0,0 +1,1009 @@
+// hammurabi_sim: plays many full games against a policy without any console I/O
+// in the game loop and prints a summary at the end.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Compare.hpp"
+#include "DpSolver.hpp"
+#include "EvalCache.hpp"
+#include "Evaluator.hpp"
+#include "GameRules.hpp"
+#include "Leaderboard.hpp"
+#include "MappedFile.hpp"
+#include "Policy.hpp"
+#include "PolicyOptimizer.hpp"
+#include "Propagation.hpp"
+#include "Region.hpp"
+#include "RulesPresets.hpp"
+#include "SaveManager.hpp"
+#include "SessionStore.hpp"
+#include "ShardedRun.hpp"
+#include "Simulation.hpp"
+#include "Sweep.hpp"
+#include "Tournament.hpp"
+#include "Trace.hpp"
+
+namespace {
+
+struct SimOptions {
+    std::string rulesFile = "game_rules.txt";
+    std::string rulesProfile;
+    std::string policy = "steady";
+    long long games = 1000000;
+    std::uint64_t seed = 1;
+    int batchLanes = 0;      // 0 = play games one by one
+    bool presets = true;     // use a compiled-in rules preset when the rules match one
+    unsigned threads = 0;    // 0 = all hardware threads
+    bool checkBatch = false; // compare the SoA kernels with resolveYear
+    std::string solveTo;     // solve the rules and write the DpTable here
+    bool exact = false;      // propagate the outcome distribution instead of sampling
+    std::string replay;      // decision journal to replay and verify
+    bool compact = false;    // fold the replayed journal into a snapshot
+    long long repeat = 1;
+    std::string store;       // session store to exercise with --games sessions
+    std::string tournament;  // ranked results of the archives
+    std::vector<std::string> archives;
+    std::string sweep;       // sweep spec to evaluate
+    std::string sweepOut;    // table file; empty = standard output
+    std::string cache = "eval.cache";
+    std::string compare;     // second policy, played on the same draws as --policy
+    double ciP = 0.0;        // stop comparing at this confidence half-width of the P difference
+    double ciL = 0.0;
+    double confidence = 0.95;
+    std::string dist;        // collect result distributions and write them here
+    std::string mergeDist;   // merge the distribution files given as inputs into this one
+    std::string trace;       // write every played year here
+    std::string scan;        // trace to read one column of
+    std::string column = "grain";
+    std::string phases;      // batch phase timings and event counts as JSON; "-" = standard output
+    long long region = 0;    // cities of a region to play instead of separate games
+    double migration = 0.05; // share of a region city's people that moves each year
+    std::string optimize;    // tune a parametric policy and write its file here
+    std::string checkpoint;  // optimizer or sharded run progress
+    int generations = 40;
+    int candidates = 32;
+    long long candidateGames = 20000;
+    bool sharded = false;    // play the games in worker processes, resumably
+    long long shardGames = 1ll << 24;
+    unsigned workers = 0;    // 0 = one per NUMA node
+    std::string leaderboard; // record the games there, or query it
+    long long top = 0;       // print the best entries under the rules
+    bool hasRank = false;    // print the rank of --rank PLAYER
+    std::uint64_t rankPlayer = 0;
+    double epsilon = 1e-9;
+    DpGrid grid;
+};
+
+void printUsage() {
+    std::cout << "Usage: hammurabi_sim [--rules FILE] [--profile NAME] [--policy NAME] [--games N] [--seed S]\n"
+              << "                     [--threads N] [--batch LANES] [--check-batch] [--no-presets]\n"
+              << "       hammurabi_sim --exact [--epsilon E] [--policy NAME] [--rules FILE] [--threads N]\n"
+              << "       hammurabi_sim --solve TABLE [--grid POP,GRAIN,LAND,STARV] [--rules FILE]\n"
+              << "       hammurabi_sim --replay JOURNAL [--repeat N] [--compact] [--rules FILE]\n"
+              << "       hammurabi_sim --store FILE [--games N] [--policy NAME] [--threads N]\n"
+              << "       hammurabi_sim --tournament RESULTS [--seed S] [--threads N] ARCHIVE...\n"
+              << "       hammurabi_sim --sweep SPEC [--out TABLE] [--cache FILE|none] [--games N] [--policy NAME]\n"
+              << "       hammurabi_sim --compare NAME [--policy NAME] [--games MAX] [--ci-p W] [--ci-l W]\n"
+              << "                     [--confidence C] [--seed S] [--threads N] [--batch LANES]\n"
+              << "       hammurabi_sim --merge-dist OUT DIST...\n"
+              << "       hammurabi_sim --trace FILE [--policy NAME] [--games N] [--seed S] [--threads N]\n"
+              << "       hammurabi_sim --scan TRACE [--column NAME]\n"
+              << "       hammurabi_sim --region CITIES [--migration SHARE] [--policy NAME] [--seed S] [--threads N]\n"
+              << "       hammurabi_sim --optimize POLICYFILE [--generations N] [--candidates N] [--candidate-games N]\n"
+              << "                     [--checkpoint FILE] [--seed S] [--threads N] [--batch LANES]\n"
+              << "       hammurabi_sim --sharded [--checkpoint FILE|none] [--shard-games N] [--workers N]\n"
+              << "                     [--policy NAME] [--games N] [--seed S] [--threads PER_WORKER] [--batch LANES]\n"
+              << "       hammurabi_sim --leaderboard FILE [--policy NAME] [--games N] [--seed S] [--threads N]\n"
+              << "       hammurabi_sim --leaderboard FILE --top K | --rank PLAYER [--rules FILE]\n"
+              << "Evaluations write the distributions of their results with --dist FILE, and batch\n"
+              << "evaluations their phase timings and event counts with --phases FILE|- (JSON).\n";
+    std::cout << "Policies:";
+    for (const std::string& n : policyNames()) std::cout << ' ' << n;
+    std::cout << "\n";
+}
+
+bool parseOptions(int argc, char** argv, SimOptions& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (a == "--rules" && hasValue) o.rulesFile = argv[++i];
+            else if (a == "--profile" && hasValue) o.rulesProfile = argv[++i];
+            else if (a == "--policy" && hasValue) o.policy = argv[++i];
+            else if (a == "--games" && hasValue) o.games = std::stoll(argv[++i]);
+            else if (a == "--seed" && hasValue) o.seed = std::stoull(argv[++i]);
+            else if (a == "--batch" && hasValue) o.batchLanes = std::stoi(argv[++i]);
+            else if (a == "--threads" && hasValue) o.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            else if (a == "--check-batch") o.checkBatch = true;
+            else if (a == "--no-presets") o.presets = false;
+            else if (a == "--solve" && hasValue) o.solveTo = argv[++i];
+            else if (a == "--exact") o.exact = true;
+            else if (a == "--epsilon" && hasValue) o.epsilon = std::stod(argv[++i]);
+            else if (a == "--replay" && hasValue) o.replay = argv[++i];
+            else if (a == "--repeat" && hasValue) o.repeat = std::stoll(argv[++i]);
+            else if (a == "--compact") o.compact = true;
+            else if (a == "--store" && hasValue) o.store = argv[++i];
+            else if (a == "--tournament" && hasValue) o.tournament = argv[++i];
+            else if (a == "--sweep" && hasValue) o.sweep = argv[++i];
+            else if (a == "--out" && hasValue) o.sweepOut = argv[++i];
+            else if (a == "--cache" && hasValue) o.cache = argv[++i];
+            else if (a == "--compare" && hasValue) o.compare = argv[++i];
+            else if (a == "--ci-p" && hasValue) o.ciP = std::stod(argv[++i]);
+            else if (a == "--ci-l" && hasValue) o.ciL = std::stod(argv[++i]);
+            else if (a == "--confidence" && hasValue) o.confidence = std::stod(argv[++i]);
+            else if (a == "--dist" && hasValue) o.dist = argv[++i];
+            else if (a == "--merge-dist" && hasValue) o.mergeDist = argv[++i];
+            else if (a == "--trace" && hasValue) o.trace = argv[++i];
+            else if (a == "--scan" && hasValue) o.scan = argv[++i];
+            else if (a == "--column" && hasValue) o.column = argv[++i];
+            else if (a == "--phases" && hasValue) o.phases = argv[++i];
+            else if (a == "--region" && hasValue) o.region = std::stoll(argv[++i]);
+            else if (a == "--migration" && hasValue) o.migration = std::stod(argv[++i]);
+            else if (a == "--optimize" && hasValue) o.optimize = argv[++i];
+            else if (a == "--checkpoint" && hasValue) o.checkpoint = argv[++i];
+            else if (a == "--generations" && hasValue) o.generations = std::stoi(argv[++i]);
+            else if (a == "--candidates" && hasValue) o.candidates = std::stoi(argv[++i]);
+            else if (a == "--candidate-games" && hasValue) o.candidateGames = std::stoll(argv[++i]);
+            else if (a == "--sharded") o.sharded = true;
+            else if (a == "--shard-games" && hasValue) o.shardGames = std::stoll(argv[++i]);
+            else if (a == "--workers" && hasValue) o.workers = static_cast<unsigned>(std::stoul(argv[++i]));
+            else if (a == "--leaderboard" && hasValue) o.leaderboard = argv[++i];
+            else if (a == "--top" && hasValue) o.top = std::stoll(argv[++i]);
+            else if (a == "--rank" && hasValue) {
+                o.rankPlayer = std::stoull(argv[++i]);
+                o.hasRank = true;
+            }
+            else if (a == "--grid" && hasValue) {
+                char comma;
+                std::istringstream in(argv[++i]);
+                in >> o.grid.popBuckets >> comma >> o.grid.grainBuckets >> comma
+                   >> o.grid.landBuckets >> comma >> o.grid.starvBuckets;
+                if (!in) return false;
+            }
+            else if (a == "-" || a[0] != '-') o.archives.push_back(a);
+            else return false;
+        } catch (...) {
+            return false;
+        }
+    }
+    return o.games > 0 && o.batchLanes >= 0 && o.epsilon > 0.0 && o.repeat > 0 &&
+        o.archives.empty() == (o.tournament.empty() && o.mergeDist.empty()) && o.ciP >= 0.0 && o.ciL >= 0.0 &&
+        o.confidence > 0.0 && o.confidence < 1.0 && (o.phases.empty() || o.batchLanes > 0) && o.top >= 0 &&
+        (o.leaderboard.empty() ? o.top == 0 && !o.hasRank : !(o.top > 0 && o.hasRank));
+}
+
+const char* tierName(ScoreTier t) {
+    switch (t) {
+    case ScoreTier::Terrible: return "terrible";
+    case ScoreTier::Mediocre: return "mediocre";
+    case ScoreTier::Good: return "good";
+    case ScoreTier::Excellent: return "excellent";
+    }
+    return "?";
+}
+
+void printReport(const EvalReport& rep, const char* policyName, unsigned threads, double secs) {
+    std::cout << std::setprecision(10);
+    std::cout << "policy " << policyName << ", " << rep.games << " games on " << threads << " threads in "
+              << secs << " s (" << (secs > 0.0 ? static_cast<double>(rep.games) / secs : 0.0) << " games/s)\n";
+    std::cout << "completed " << rep.endings[static_cast<int>(YearOutcome::Continued)]
+              << ", overthrown " << rep.endings[static_cast<int>(YearOutcome::Overthrown)]
+              << ", depopulated " << rep.endings[static_cast<int>(YearOutcome::Depopulated)]
+              << ", plague wipeout " << rep.endings[static_cast<int>(YearOutcome::PlagueWipeout)] << "\n";
+    if (rep.p.count == 0) return;
+
+    std::cout << "P mean " << rep.p.mean << "%, variance " << rep.p.variance() << "\n";
+    std::cout << "L mean " << rep.l.mean << ", variance " << rep.l.variance() << "\n";
+    for (int t = 0; t < 4; ++t) {
+        std::cout << tierName(static_cast<ScoreTier>(t)) << ' ' << rep.tiers[t] << " ("
+                  << 100.0 * static_cast<double>(rep.tiers[t]) / static_cast<double>(rep.p.count) << "%)\n";
+    }
+}
+
+void printScoreDistributions(const ScoreDistributions& d) {
+    static const double kQuantiles[] = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99};
+    std::cout << std::setprecision(6);
+    std::cout << "quantiles of " << d.games << " games (overthrown "
+              << d.endings[static_cast<int>(YearOutcome::Overthrown)] << ", plague wipeout "
+              << d.endings[static_cast<int>(YearOutcome::PlagueWipeout)] << "):";
+    for (double q : kQuantiles) std::cout << ' ' << q;
+    std::cout << "\n";
+    for (int m = 0; m < kScoreMetricCount; ++m) {
+        const QuantileSketch& s = d.sketches[m];
+        if (s.count() == 0) continue;
+        std::cout << scoreMetricName(static_cast<ScoreMetric>(m)) << ':';
+        for (double q : kQuantiles) std::cout << ' ' << s.quantile(q);
+        std::cout << " (" << s.count() << " values, min " << s.min() << ", max " << s.max() << ")\n";
+    }
+}
+
+void printDistribution(const OutcomeDistribution& d, const char* policyName, unsigned threads, double secs) {
+    std::cout << std::setprecision(10);
+    std::cout << "policy " << policyName << ", exact distribution on " << threads << " threads in " << secs
+              << " s, peak " << d.peakStates << " states, pruned mass " << d.pruned << "\n";
+    std::cout << "completed " << d.endings[static_cast<int>(YearOutcome::Continued)]
+              << ", overthrown " << d.endings[static_cast<int>(YearOutcome::Overthrown)]
+              << ", depopulated " << d.endings[static_cast<int>(YearOutcome::Depopulated)]
+              << ", plague wipeout " << d.endings[static_cast<int>(YearOutcome::PlagueWipeout)] << "\n";
+    if (d.finals.empty()) return;
+
+    std::cout << "P mean " << d.meanP << "%, L mean " << d.meanL << ", population mean " << d.meanPopulation
+              << ", grain mean " << d.meanGrain << "\n";
+    for (int t = 0; t < 4; ++t) {
+        std::cout << tierName(static_cast<ScoreTier>(t)) << ' ' << 100.0 * d.tiers[t] << "%\n";
+    }
+    std::cout << d.finals.size() << " distinct final states, most likely:\n";
+    for (std::size_t i = 0; i < d.finals.size() && i < 5; ++i) {
+        const FinalOutcome& f = d.finals[i];
+        std::cout << "  " << f.probability << ": population " << f.population << ", land " << f.landAcres
+                  << ", P " << f.score.avgStarvedPercent << "%, " << tierName(f.score.tier) << "\n";
+    }
+}
+
+int runExact(const GameRules& r, const Policy& policy, const SimOptions& opt) {
+    WorkStealingPool pool(opt.threads);
+    PropagationConfig cfg;
+    cfg.epsilon = opt.epsilon;
+    OutcomeDistribution dist;
+    auto t0 = std::chrono::steady_clock::now();
+    if (!propagateOutcomes(r, policy, cfg, pool, dist)) {
+        std::cerr << "These rules do not keep grain on an exact grid.\n";
+        return 1;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printDistribution(dist, policy.name(), pool.size(), secs);
+    return 0;
+}
+
+const char* endingName(YearOutcome e) {
+    switch (e) {
+    case YearOutcome::Continued: return "in progress";
+    case YearOutcome::Overthrown: return "overthrown";
+    case YearOutcome::Depopulated: return "depopulated";
+    case YearOutcome::PlagueWipeout: return "plague wipeout";
+    }
+    return "?";
+}
+
+// Replays a decision journal (repeatedly from memory, to time it) and prints
+// where it ends.
+int replayJournal(const GameRules& r, const SimOptions& opt) {
+    MappedFile file;
+    if (!file.open(opt.replay)) {
+        std::cerr << "Cannot read " << opt.replay << "\n";
+        return 1;
+    }
+
+    JournalReplay j;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long long i = 0; i < opt.repeat; ++i) {
+        j = SaveManager::replayJournal(file.data(), file.size(), r);
+        if (j.status != SaveStatus::Loaded) break;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    file.close();
+    if (j.status != SaveStatus::Loaded) {
+        std::cerr << opt.replay << " is damaged or does not match the rules.\n";
+        return 1;
+    }
+
+    const GameState& s = j.state;
+    const double years = static_cast<double>(j.years) * static_cast<double>(opt.repeat);
+    std::cout << std::setprecision(10);
+    std::cout << "seed " << j.rng.seed() << ", game " << j.rng.gameId() << (j.hasSnapshot ? ", from a snapshot" : "")
+              << ", " << j.years << " years replayed" << (j.tornTail ? " (torn last record ignored)" : "") << "\n";
+    std::cout << "year " << s.year << ", population " << s.population << ", grain " << s.grainBushels() << ", land "
+              << s.landAcres << ", " << endingName(j.ending) << "\n";
+    if (j.ending == YearOutcome::Continued && s.year > r.totalYears) {
+        const FinalScore f = computeFinalScore(s, r);
+        std::cout << "finished: P " << f.avgStarvedPercent << "%, L " << f.acresPerCitizen << ", "
+                  << tierName(f.tier) << "\n";
+    }
+    std::cout << "replay speed " << (secs > 0.0 ? years / secs : 0.0) << " years/s\n";
+
+    if (opt.compact) {
+        SaveManager saves("", "", opt.replay);
+        if (!saves.compactJournal(r)) {
+            std::cerr << "Failed to compact " << opt.replay << "\n";
+            return 1;
+        }
+        std::cout << "compacted " << opt.replay << "\n";
+    }
+    return 0;
+}
+
+int solveTable(const GameRules& r, const SimOptions& opt) {
+    WorkStealingPool pool(opt.threads);
+    DpTable table;
+    auto t0 = std::chrono::steady_clock::now();
+    if (!table.solve(r, opt.grid, pool)) {
+        std::cerr << "Invalid grid.\n";
+        return 2;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!table.save(opt.solveTo)) {
+        std::cerr << "Failed to write " << opt.solveTo << "\n";
+        return 1;
+    }
+
+    GameState start;
+    initNewGame(start, r);
+    std::cout << "solved in " << secs << " s on " << pool.size() << " threads, value of a new game "
+              << table.value(start) << ", written to " << opt.solveTo << "\n";
+    return 0;
+}
+
+// Plays the same games through resolveYear and through every available batch
+// kernel and compares all lanes field by field after every year. The kernels
+// run with the rules preset when there is one, so its instantiation is checked
+// against the generic resolveYear.
+template <class Rules>
+int checkBatchKernels(Rules rules, const Policy& policy, const SimOptions& opt) {
+    const std::size_t n = static_cast<std::size_t>(std::min<long long>(opt.games, 1 << 16));
+    std::vector<BatchKernel> kernels = {BatchKernel::Scalar};
+    if (batchKernel() != BatchKernel::Scalar) kernels.push_back(batchKernel());
+
+    for (BatchKernel k : kernels) {
+        const BatchCheck check = checkBatchKernel(rules, policy, opt.seed, n, k);
+        if (check.mismatches > 0) {
+            std::cout << "lane " << check.firstLane << " differs after year " << check.firstYear << "\n";
+        }
+        std::cout << batchKernelName(k) << " kernel: " << n << " lanes, " << check.mismatches << " mismatches";
+        if (check.lanesLeft > 0) std::cout << " (" << check.lanesLeft << " lanes left the batch)";
+        std::cout << "\n";
+        if (check.mismatches != 0) return 1;
+    }
+    return 0;
+}
+
+// Plays --games sessions through a SessionStore, saving at every year start and
+// clearing every other finished game, then reopens the store and checks that it
+// holds exactly the kept games.
+int exerciseStore(const GameRules& r, const Policy& policy, const SimOptions& opt) {
+    SessionStore store;
+    if (!store.open(opt.store)) {
+        std::cerr << "Cannot open " << opt.store << " as a session store.\n";
+        return 1;
+    }
+    const SessionStore::Stats before = store.stats();
+    const std::size_t sessions = static_cast<std::size_t>(opt.games);
+    std::vector<GameState> kept(sessions);
+    std::atomic<std::uint64_t> failures{0};
+    WorkStealingPool pool(opt.threads);
+
+    auto t0 = std::chrono::steady_clock::now();
+    pool.run(sessions, [&](std::size_t i, unsigned) {
+        const std::uint64_t id = opt.seed * 0x9E3779B97F4A7C15ull + i;
+        Rng rng(opt.seed, i);
+        GameState s;
+        initNewGame(s, r);
+        while (s.year <= r.totalYears) {
+            beginYear(s, r, rng);
+            if (!store.put(id, s, r.hash())) ++failures;
+            const Decisions d = clampDecisions(s, policy.decide(s, r), r);
+            if (resolveYear(s, d, r, rng) != YearOutcome::Continued) break;
+        }
+        if (i % 2 == 0) {
+            if (!store.erase(id)) ++failures;
+        } else {
+            if (!store.put(id, s, r.hash())) ++failures;
+            kept[i] = s;
+        }
+    });
+    const bool synced = store.sync();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const SessionStore::Stats st = store.stats();
+    store.close();
+
+    std::cout << std::setprecision(10);
+    std::cout << st.writes << " writes in " << secs << " s (" << (secs > 0.0 ? st.writes / secs : 0.0)
+              << " writes/s), " << st.commits << " commits ("
+              << (st.commits ? static_cast<double>(st.writes) / st.commits : 0.0) << " writes per fsync)\n";
+    std::cout << st.sessions << " sessions kept in " << st.slots << " slots, " << before.droppedSlots
+              << " damaged slots dropped on open\n";
+
+    std::size_t mismatches = 0;
+    if (!store.open(opt.store)) {
+        std::cerr << "Cannot reopen " << opt.store << "\n";
+        return 1;
+    }
+    for (std::size_t i = 0; i < sessions; ++i) {
+        const std::uint64_t id = opt.seed * 0x9E3779B97F4A7C15ull + i;
+        GameState s;
+        std::uint64_t rulesHash = 0;
+        const bool found = store.get(id, s, rulesHash);
+        if (found != (i % 2 == 1) || (found && (!sameState(s, kept[i]) || rulesHash != r.hash()))) ++mismatches;
+    }
+    const SessionStore::Stats reopened = store.stats();
+    std::cout << "reopened: " << reopened.sessions << " sessions, " << reopened.droppedSlots << " damaged slots, "
+              << mismatches << " mismatches\n";
+    const bool ok = synced && failures == 0 && mismatches == 0 && reopened.droppedSlots == 0 &&
+        reopened.sessions == before.sessions + sessions / 2;
+    return ok ? 0 : 1;
+}
+
+
+// Scores the archives under one shared seed and writes the ranked results.
+int runTournamentArchives(const GameRules& r, const SimOptions& opt) {
+    TournamentOptions topt;
+    topt.seed = opt.seed;
+    TournamentSummary sum;
+    WorkStealingPool pool(opt.threads);
+
+    auto t0 = std::chrono::steady_clock::now();
+    const bool ok = runTournament(opt.archives, opt.tournament, r, topt, pool, sum);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!ok) {
+        std::cerr << "Tournament failed: cannot read an archive or write " << opt.tournament << "\n";
+        return 1;
+    }
+
+    std::cout << std::setprecision(10);
+    std::cout << sum.entries << " entries (" << sum.bytes << " bytes) on " << pool.size() << " threads in " << secs
+              << " s (" << (secs > 0.0 ? sum.entries / secs : 0.0) << " entries/s), " << sum.runs
+              << " sorted runs\n";
+    std::cout << sum.completed << " completed, " << sum.disqualified << " refused or malformed, " << sum.years
+              << " years played, " << sum.malformedLines << " malformed lines\n";
+    return 0;
+}
+
+// Evaluates the policy at every point of the sweep spec and writes the table.
+int runSweepSpec(const GameRules& base, const SimOptions& opt) {
+    SweepSpec spec;
+    if (!loadSweepSpec(opt.sweep, spec)) {
+        std::cerr << "Cannot use " << opt.sweep << " as a sweep spec.\n";
+        return 1;
+    }
+    EvalCache cache;
+    const bool useCache = opt.cache != "none";
+    if (useCache && !cache.open(opt.cache)) {
+        std::cerr << "Cannot open " << opt.cache << " as an evaluation cache.\n";
+        return 1;
+    }
+
+    EvalConfig cfg;
+    cfg.seed = opt.seed;
+    cfg.games = static_cast<std::uint64_t>(opt.games);
+    cfg.batchLanes = opt.batchLanes;
+    cfg.rulesPresets = opt.presets;
+    WorkStealingPool pool(opt.threads);
+
+    std::vector<SweepPoint> points;
+    SweepSummary sum;
+    auto t0 = std::chrono::steady_clock::now();
+    const bool ok = runSweep(spec, base, opt.policy, cfg, useCache ? &cache : nullptr, pool, points, sum);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!ok) {
+        std::cerr << "Cannot write " << opt.cache << "\n";
+        return 1;
+    }
+
+    if (opt.sweepOut.empty()) {
+        writeSweepTable(std::cout, spec, points);
+    } else {
+        std::ofstream out(opt.sweepOut);
+        writeSweepTable(out, spec, points);
+        if (!out) {
+            std::cerr << "Cannot write " << opt.sweepOut << "\n";
+            return 1;
+        }
+    }
+
+    std::cerr << std::setprecision(10);
+    std::cerr << sum.points << " points (" << sum.computed << " played, " << sum.cached << " cached, " << sum.invalid
+              << " invalid), " << sum.gamesPlayed << " games on " << pool.size() << " threads in " << secs << " s ("
+              << (secs > 0.0 ? static_cast<double>(sum.gamesPlayed) / secs : 0.0) << " games/s)\n";
+    return 0;
+}
+
+// Merges distribution files, from runs on any machines, into one.
+int mergeDistributions(const SimOptions& opt) {
+    ScoreDistributions total;
+    for (const std::string& path : opt.archives) {
+        ScoreDistributions d;
+        if (!loadScoreDistributions(path, d)) {
+            std::cerr << path << " is not a distributions file or is damaged.\n";
+            return 1;
+        }
+        if (!total.merge(d)) {
+            std::cerr << path << " was collected with other histogram bins.\n";
+            return 1;
+        }
+    }
+    if (!saveScoreDistributions(opt.mergeDist, total)) {
+        std::cerr << "Cannot write " << opt.mergeDist << "\n";
+        return 1;
+    }
+    printScoreDistributions(total);
+    return 0;
+}
+
+// Plays the games and writes every year of them to the trace file.
+int writeTraceFile(const GameRules& r, const Policy& policy, const SimOptions& opt) {
+    EvalConfig cfg;
+    cfg.seed = opt.seed;
+    cfg.games = static_cast<std::uint64_t>(opt.games);
+    cfg.rulesPresets = opt.presets;
+    WorkStealingPool pool(opt.threads);
+    TraceSummary sum;
+
+    auto t0 = std::chrono::steady_clock::now();
+    const bool ok = writeTrace(r, policy, cfg, opt.trace, pool, sum);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!ok) {
+        std::cerr << "Cannot write " << opt.trace << "\n";
+        return 1;
+    }
+    std::cout << std::setprecision(6);
+    std::cout << sum.games << " games, " << sum.rows << " years in " << sum.blocks << " blocks, " << sum.bytes
+              << " bytes (" << (sum.rows ? static_cast<double>(sum.bytes) / static_cast<double>(sum.rows) : 0.0)
+              << " bytes/year) on " << pool.size() << " threads in " << secs << " s ("
+              << (secs > 0.0 ? static_cast<double>(sum.rows) / secs : 0.0) << " years/s)";
+    if (sum.stalls > 0) std::cout << ", " << sum.stalls << " blocks waited for the disk";
+    std::cout << "\n";
+    return 0;
+}
+
+// Plays a region year by year, printing its market and totals, then scores
+// its cities like separate games.
+int runRegion(const GameRules& r, const Policy& policy, const SimOptions& opt) {
+    if (opt.region <= 0 || opt.migration < 0.0 || opt.migration >= 1.0) {
+        std::cerr << "A region needs at least one city and a migration share in [0; 1).\n";
+        return 2;
+    }
+    RegionOptions ropt;
+    ropt.cities = static_cast<std::size_t>(opt.region);
+    ropt.seed = opt.seed;
+    ropt.migrationShare = opt.migration;
+    Region region(r, policy, ropt);
+    WorkStealingPool pool(opt.threads);
+
+    std::cout << std::setprecision(10);
+    auto t0 = std::chrono::steady_clock::now();
+    RegionYear y;
+    while (region.playYear(pool, y)) {
+        std::cout << "year " << y.year << ": price " << y.landPrice << ", bid " << y.acresBid << ", offered "
+                  << y.acresOffered << ", traded " << y.acresTraded << ", migrants " << y.migrants << "; "
+                  << y.cities << " cities, population " << y.population << ", grain "
+                  << static_cast<double>(y.grainUnits) / y.grainScale << ", land " << y.land;
+        if (y.overthrown + y.depopulated + y.plagueWipeouts > 0) {
+            std::cout << "; lost " << y.overthrown << " overthrown, " << y.depopulated << " depopulated, "
+                      << y.plagueWipeouts << " to the plague";
+        }
+        std::cout << "\n";
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    EvalReport rep;
+    for (std::size_t i = 0; i < region.size(); ++i) {
+        GameResult res;
+        res.finalState = region.city(i);
+        res.ending = region.ending(i);
+        if (res.completed()) res.score = computeFinalScore(res.finalState, r);
+        rep.add(res);
+    }
+    printReport(rep, policy.name(), pool.size(), secs);
+    return 0;
+}
+
+// Tunes a parametric policy, going on from the checkpoint when there is one
+// for these rules and settings, and writes the mean of the search.
+int runOptimizer(const GameRules& r, const SimOptions& opt) {
+    if (opt.generations < 1 || opt.candidates < 2 || opt.candidateGames < 1) {
+        std::cerr << "The optimizer needs a generation, two candidates and a game per candidate.\n";
+        return 2;
+    }
+    OptimizerConfig cfg;
+    cfg.generations = opt.generations;
+    cfg.candidates = opt.candidates;
+    cfg.seed = opt.seed;
+    cfg.eval.games = static_cast<std::uint64_t>(opt.candidateGames);
+    cfg.eval.batchLanes = opt.batchLanes;
+    cfg.eval.rulesPresets = opt.presets;
+    const std::string checkpoint = opt.checkpoint.empty() ? opt.optimize + ".ckpt" : opt.checkpoint;
+
+    OptimizerState st;
+    if (std::ifstream(checkpoint)) {
+        if (!loadOptimizerCheckpoint(checkpoint, r, cfg, st)) {
+            std::cerr << checkpoint << " is damaged or was made with other rules or settings.\n";
+            return 1;
+        }
+        std::cerr << "Resuming after generation " << st.generation << " from " << checkpoint << "\n";
+    }
+    WorkStealingPool pool(opt.threads);
+
+    std::cout << std::setprecision(6);
+    auto t0 = std::chrono::steady_clock::now();
+    const std::uint64_t gamesBefore = st.gamesPlayed;
+    const bool ok = optimizePolicy(r, cfg, pool, checkpoint, st, [](const OptimizerState& s) {
+        std::cout << "generation " << s.generation << ": mean " << s.meanFitness << ", best " << s.bestFitness
+                  << " |";
+        const PolicyParams p = s.params();
+        for (int k = 0; k < kPolicyParamCount; ++k) {
+            std::cout << ' ' << policyParamRange(static_cast<PolicyParam>(k)).key << ' ' << p.values[k];
+        }
+        std::cout << std::endl;
+    });
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!ok) {
+        std::cerr << "Cannot write " << checkpoint << "\n";
+        return 1;
+    }
+    if (!savePolicyParams(opt.optimize, st.params())) {
+        std::cerr << "Cannot write " << opt.optimize << "\n";
+        return 1;
+    }
+    const std::uint64_t games = st.gamesPlayed - gamesBefore;
+    std::cerr << std::setprecision(10);
+    std::cerr << st.generation << " generations, " << games << " games on " << pool.size() << " threads in " << secs
+              << " s (" << (secs > 0.0 ? static_cast<double>(games) / secs : 0.0) << " games/s); play it with"
+              << " --policy param:" << opt.optimize << "\n";
+    return 0;
+}
+
+void printLeaderboardEntry(std::uint64_t rank, const LeaderboardEntry& e) {
+    std::cout << rank << ". player " << e.player << ": " << tierName(e.tier) << ", P " << e.p << "%, L " << e.l
+              << ", population " << e.population << ", land " << e.land << ", score " << e.score << "\n";
+}
+
+// Plays the games and records those played to the end, the game number being
+// the player, one insert per block of games. A second thread queries the
+// leaderboard all the while, to show what the inserts cost readers.
+int recordLeaderboardGames(const GameRules& r, const Policy& policy, const SimOptions& opt) {
+    Leaderboard board;
+    if (!board.open(opt.leaderboard)) {
+        std::cerr << "Cannot open the leaderboard " << opt.leaderboard << "\n";
+        return 1;
+    }
+    constexpr std::size_t kBlock = 1 << 16;
+    const std::uint64_t rulesHash = r.hash();
+    WorkStealingPool pool(opt.threads);
+    std::vector<GameResult> results;
+    std::vector<LeaderboardEntry> batch;
+
+    std::atomic<bool> recording{true};
+    std::uint64_t queries = 0;
+    double slowestUs = 0.0;
+    std::thread reader([&] {
+        while (recording.load(std::memory_order_relaxed)) {
+            auto q0 = std::chrono::steady_clock::now();
+            const std::vector<LeaderboardEntry> best = board.top(rulesHash, 10);
+            if (!best.empty()) board.rankOf(best.back().player, rulesHash);
+            const double us =
+                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - q0).count();
+            slowestUs = std::max(slowestUs, us);
+            ++queries;
+        }
+    });
+
+    auto t0 = std::chrono::steady_clock::now();
+    double insertSecs = 0.0;
+    std::uint64_t recorded = 0;
+    bool ok = true;
+    const std::uint64_t games = static_cast<std::uint64_t>(opt.games);
+    for (std::uint64_t first = 0; first < games && ok; first += kBlock) {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(kBlock, games - first));
+        results.resize(n);
+        pool.run(n, [&](std::size_t i, unsigned) {
+            Rng rng(opt.seed, first + i);
+            results[i] = playGame(r, policy, rng);
+        });
+        batch.clear();
+        for (std::size_t i = 0; i < n; ++i) {
+            if (results[i].completed()) batch.push_back(leaderboardEntry(first + i, results[i].finalState, r));
+        }
+        auto i0 = std::chrono::steady_clock::now();
+        ok = board.insert(batch);
+        insertSecs += std::chrono::duration<double>(std::chrono::steady_clock::now() - i0).count();
+        if (ok) recorded += batch.size();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    recording = false;
+    reader.join();
+    if (!ok) {
+        std::cerr << "Cannot write the leaderboard " << opt.leaderboard << "\n";
+        return 1;
+    }
+
+    std::cout << std::setprecision(6);
+    std::cout << recorded << " of " << games << " games recorded in " << secs << " s, inserting took " << insertSecs
+              << " s (" << (insertSecs > 0.0 ? static_cast<double>(recorded) / insertSecs : 0.0) << " entries/s)\n";
+    std::cout << queries << " queries meanwhile, the slowest " << slowestUs << " us\n";
+    std::cout << board.count(rulesHash) << " entries under these rules, " << board.size() << " in all\n";
+    const std::vector<LeaderboardEntry> best = board.top(rulesHash, 3);
+    for (std::size_t i = 0; i < best.size(); ++i) printLeaderboardEntry(i + 1, best[i]);
+    return 0;
+}
+
+// Answers --top or --rank about the rules' games, timing the query.
+int queryLeaderboard(const GameRules& r, const SimOptions& opt) {
+    Leaderboard board;
+    if (!std::ifstream(opt.leaderboard) || !board.open(opt.leaderboard)) {
+        std::cerr << "Cannot open the leaderboard " << opt.leaderboard << "\n";
+        return 1;
+    }
+    const std::uint64_t rulesHash = r.hash();
+    std::cout << std::setprecision(6);
+    auto t0 = std::chrono::steady_clock::now();
+    if (opt.top > 0) {
+        const std::vector<LeaderboardEntry> best = board.top(rulesHash, static_cast<std::size_t>(opt.top));
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        for (std::size_t i = 0; i < best.size(); ++i) printLeaderboardEntry(i + 1, best[i]);
+        std::cout << best.size() << " of " << board.count(rulesHash) << " entries in " << us << " us\n";
+        return 0;
+    }
+    LeaderboardEntry best;
+    const std::uint64_t rank = board.rankOf(opt.rankPlayer, rulesHash, &best);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    if (rank == 0) {
+        std::cout << "Player " << opt.rankPlayer << " has no games under these rules.\n";
+        return 1;
+    }
+    printLeaderboardEntry(rank, best);
+    std::cout << "of " << board.count(rulesHash) << " entries, found in " << us << " us\n";
+    return 0;
+}
+
+// Plays the games in worker processes, shard by shard, recording finished
+// shards in the checkpoint so that running it again goes on from there.
+int runShardedEvaluation(const GameRules& r, const Policy& policy, const SimOptions& opt) {
+    if (opt.games < 1 || opt.shardGames < 1) {
+        std::cerr << "A sharded run needs at least one game per shard.\n";
+        return 2;
+    }
+    EvalConfig cfg;
+    cfg.seed = opt.seed;
+    cfg.games = static_cast<std::uint64_t>(opt.games);
+    cfg.batchLanes = opt.batchLanes;
+    cfg.rulesPresets = opt.presets;
+    ShardConfig sc;
+    sc.checkpoint = opt.checkpoint.empty() ? "shards.ckpt" : opt.checkpoint == "none" ? "" : opt.checkpoint;
+    sc.shardGames = static_cast<std::uint64_t>(opt.shardGames);
+    sc.workers = opt.workers;
+    sc.threadsPerWorker = opt.threads;
+
+    const std::vector<NumaNode> nodes = numaNodes();
+    const std::size_t workers = opt.workers != 0 ? opt.workers : nodes.size();
+    unsigned threads = 0;
+    for (std::size_t w = 0; w < workers; ++w) {
+        threads += opt.threads != 0 ? opt.threads : static_cast<unsigned>(nodes[w % nodes.size()].cpus.size());
+    }
+
+    EvalReport rep;
+    auto t0 = std::chrono::steady_clock::now();
+    const ShardStatus st = runSharded(r, policy, opt.policy, cfg, sc, rep, [](const ShardProgress& p) {
+        if (p.done == p.resumed) {
+            if (p.resumed > 0) std::cerr << p.resumed << " of " << p.shards << " shards resumed\n";
+            return;
+        }
+        std::cerr << "shard " << p.done << " of " << p.shards << " done, " << p.games << " games\n";
+    });
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    switch (st) {
+    case ShardStatus::Done: break;
+    case ShardStatus::BadCheckpoint:
+        std::cerr << sc.checkpoint << " is damaged or belongs to another run.\n";
+        return 1;
+    case ShardStatus::CannotWrite:
+        std::cerr << "Cannot write " << sc.checkpoint << "\n";
+        return 1;
+    case ShardStatus::WorkerFailed:
+        std::cerr << "A worker failed; run again to go on from the finished shards.\n";
+        return 1;
+    case ShardStatus::Unsupported:
+        std::cerr << "Sharded runs need Linux.\n";
+        return 1;
+    }
+    printReport(rep, policy.name(), threads, secs);
+    std::cout << "rules preset " << rulesPresetName(opt.presets ? findRulesPreset(r) : RulesPreset::None) << "\n";
+    return 0;
+}
+
+// Reads one column of a trace, block by block, and prints its summary.
+int scanTraceColumn(const SimOptions& opt) {
+    TraceColumn c;
+    if (!findTraceColumn(opt.column, c)) {
+        std::cerr << "Unknown column " << opt.column << "; columns:";
+        for (int i = 0; i < kTraceColumnCount; ++i) std::cerr << ' ' << traceColumnName(static_cast<TraceColumn>(i));
+        std::cerr << "\n";
+        return 2;
+    }
+    TraceReader trace;
+    if (!trace.open(opt.scan)) {
+        std::cerr << opt.scan << " is not a complete trace file.\n";
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    MetricStats stats;
+    double lo = 0.0, hi = 0.0;
+    std::vector<double> values;
+    for (std::size_t b = 0; b < trace.blocks(); ++b) {
+        if (!trace.column(b, c, values)) {
+            std::cerr << "Block " << b << " of " << opt.scan << " is damaged.\n";
+            return 1;
+        }
+        for (double x : values) {
+            lo = stats.count == 0 ? x : std::min(lo, x);
+            hi = stats.count == 0 ? x : std::max(hi, x);
+            stats.add(x);
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << std::setprecision(10);
+    std::cout << opt.column << ": " << stats.count << " values in " << trace.blocks() << " blocks, min " << lo
+              << ", max " << hi << ", mean " << stats.mean << ", variance " << stats.variance() << " ("
+              << (secs > 0.0 ? static_cast<double>(stats.count) / secs : 0.0) << " values/s)\n";
+    return 0;
+}
+
+// Plays --policy and --compare on the same games until the difference is
+// known well enough, and prints it with what independent games would cost.
+int runComparison(const GameRules& r, const Policy& a, const Policy& b, const SimOptions& opt) {
+    CompareConfig cfg;
+    cfg.eval.seed = opt.seed;
+    cfg.eval.games = static_cast<std::uint64_t>(opt.games);
+    cfg.eval.batchLanes = opt.batchLanes;
+    cfg.eval.rulesPresets = opt.presets;
+    cfg.confidence = opt.confidence;
+    cfg.pHalfWidth = opt.ciP;
+    cfg.lHalfWidth = opt.ciL;
+    WorkStealingPool pool(opt.threads);
+
+    auto t0 = std::chrono::steady_clock::now();
+    const CompareReport rep = comparePolicies(r, a, b, cfg, pool);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    const double z = confidenceZ(opt.confidence);
+    const int completed = static_cast<int>(YearOutcome::Continued);
+    std::cout << std::setprecision(6);
+    std::cout << "policy " << a.name() << " vs " << b.name() << ", " << rep.games() << " paired games on "
+              << pool.size() << " threads in " << secs << " s";
+    if (opt.ciP > 0.0 || opt.ciL > 0.0) std::cout << (rep.targetsReached ? ", targets reached" : ", targets not reached");
+    std::cout << "\n";
+    std::cout << "completed " << rep.a.endings[completed] << " vs " << rep.b.endings[completed]
+              << ", difference of shares " << rep.completed.mean << " +- " << halfWidth(rep.completed, z) << "\n";
+    std::cout << rep.p.count << " games completed by both, differences at " << 100.0 * opt.confidence << "%:\n";
+
+    auto difference = [&](const char* name, const MetricStats& d, const MetricStats& sa, const MetricStats& sb) {
+        std::cout << name << ' ' << d.mean << " +- " << halfWidth(d, z);
+        // What the variance of the mean difference would be with independent games.
+        const double paired = d.count > 0 ? d.variance() / static_cast<double>(d.count) : 0.0;
+        const double independent = (sa.count > 0 ? sa.variance() / static_cast<double>(sa.count) : 0.0) +
+            (sb.count > 0 ? sb.variance() / static_cast<double>(sb.count) : 0.0);
+        if (paired > 0.0) std::cout << ", independent games would need " << independent / paired << "x as many";
+        std::cout << "\n";
+    };
+    difference("P", rep.p, rep.a.p, rep.b.p);
+    difference("L", rep.l, rep.a.l, rep.b.l);
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::ios::sync_with_stdio(false);
+
+    SimOptions opt;
+    if (!parseOptions(argc, argv, opt)) {
+        printUsage();
+        return 2;
+    }
+
+    if (!opt.mergeDist.empty()) {
+        return mergeDistributions(opt);
+    }
+    if (!opt.scan.empty()) {
+        return scanTraceColumn(opt);
+    }
+
+    GameRules rules;
+    if (!rules.loadFromFile(opt.rulesFile, opt.rulesProfile)) {
+        std::cerr << "Failed to read " << opt.rulesFile << " or the file contains errors.\n";
+        return 1;
+    }
+
+    if (!opt.solveTo.empty()) {
+        return solveTable(rules, opt);
+    }
+    if (!opt.replay.empty()) {
+        return replayJournal(rules, opt);
+    }
+    if (!opt.tournament.empty()) {
+        return runTournamentArchives(rules, opt);
+    }
+    if (!opt.sweep.empty()) {
+        return runSweepSpec(rules, opt);
+    }
+    if (!opt.optimize.empty()) {
+        return runOptimizer(rules, opt);
+    }
+    if (!opt.leaderboard.empty() && (opt.top > 0 || opt.hasRank)) {
+        return queryLeaderboard(rules, opt);
+    }
+
+    std::unique_ptr<Policy> policy = makePolicy(opt.policy, rules);
+    if (!policy) {
+        std::cerr << "Unknown policy or unusable table: " << opt.policy << "\n";
+        printUsage();
+        return 2;
+    }
+
+    if (!opt.compare.empty()) {
+        std::unique_ptr<Policy> other = makePolicy(opt.compare, rules);
+        if (!other) {
+            std::cerr << "Unknown policy or unusable table: " << opt.compare << "\n";
+            printUsage();
+            return 2;
+        }
+        return runComparison(rules, *policy, *other, opt);
+    }
+    if (!opt.trace.empty()) {
+        return writeTraceFile(rules, *policy, opt);
+    }
+    if (opt.region != 0) {
+        return runRegion(rules, *policy, opt);
+    }
+    if (opt.checkBatch) {
+        return withRules(rules, opt.presets, [&](auto src) { return checkBatchKernels(src, *policy, opt); });
+    }
+    if (opt.exact) {
+        return runExact(rules, *policy, opt);
+    }
+    if (!opt.store.empty()) {
+        return exerciseStore(rules, *policy, opt);
+    }
+    if (opt.sharded) {
+        return runShardedEvaluation(rules, *policy, opt);
+    }
+    if (!opt.leaderboard.empty()) {
+        return recordLeaderboardGames(rules, *policy, opt);
+    }
+
+    EvalConfig cfg;
+    cfg.seed = opt.seed;
+    cfg.games = static_cast<std::uint64_t>(opt.games);
+    cfg.batchLanes = opt.batchLanes;
+    cfg.rulesPresets = opt.presets;
+    cfg.distributions = !opt.dist.empty();
+    cfg.phaseCounters = !opt.phases.empty();
+    WorkStealingPool pool(opt.threads);
+
+    auto t0 = std::chrono::steady_clock::now();
+    const EvalReport rep = evaluatePolicy(rules, *policy, cfg, pool);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    printReport(rep, policy->name(), pool.size(), secs);
+    std::cout << "rules preset " << rulesPresetName(opt.presets ? findRulesPreset(rules) : RulesPreset::None) << "\n";
+    if (cfg.distributions) {
+        printScoreDistributions(rep.dist);
+        if (!saveScoreDistributions(opt.dist, rep.dist)) {
+            std::cerr << "Cannot write " << opt.dist << "\n";
+            return 1;
+        }
+    }
+    if (cfg.phaseCounters) {
+        if (opt.phases == "-") {
+            writePhaseCountersJson(std::cout, rep.phases);
+        } else {
+            std::ofstream out(opt.phases);
+            writePhaseCountersJson(out, rep.phases);
+            if (!out) {
+                std::cerr << "Cannot write " << opt.phases << "\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
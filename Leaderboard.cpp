@@ -0,0 +1,570 @@
+#include "Leaderboard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+#include "DpSolver.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Layouts (see BinaryFormat.hpp).
+// Log: magic[8] version:u32 crc32:u32, then entries of
+//   player:u64 rulesHash:u64 score:f64 p:f64 l:f64 population:i32 land:i32 tier:u32 crc32:u32
+// Index: magic[8] version:u32 pad:u32 indexed:u64 entries:u64 players:u64 crc32:u32 pad:u32,
+// then entries of
+//   player:u64 rulesHash:u64 score:f64 p:f64 l:f64 seq:u64 population:i32 land:i32 tier:u32 pad:u32
+// in rank order, then players of
+//   rulesHash:u64 player:u64 position:u64 (of the player's best entry)
+// ordered by rules hash and player.
+constexpr char kLogMagic[8] = {'H', 'M', 'L', 'B', 'L', 'O', 'G', '1'};
+constexpr char kIndexMagic[8] = {'H', 'M', 'L', 'B', 'I', 'D', 'X', '1'};
+constexpr std::uint32_t kLeaderboardVersion = 1;
+constexpr std::size_t kLogHeaderSize = 16;
+constexpr std::size_t kLogEntrySize = 56;
+constexpr std::size_t kIndexHeaderSize = 48;
+constexpr std::size_t kIndexEntrySize = 64;
+constexpr std::size_t kPlayerEntrySize = 24;
+
+// The tail may hold this many entries, or a share of the index if that is more.
+constexpr std::size_t kMinTail = 1024;
+constexpr std::uint64_t kTailShare = 32;
+
+// Best first; within equal scores the earlier game.
+bool ranksBefore(const LeaderboardEntry& a, const LeaderboardEntry& b) {
+    if (a.rulesHash != b.rulesHash) return a.rulesHash < b.rulesHash;
+    if (a.score != b.score) return a.score > b.score;
+    return a.seq < b.seq;
+}
+
+struct PlayerBest {
+    std::uint64_t rulesHash, player, position;
+};
+
+// Every player's best entry per rules hash in entries that are in rank order,
+// ordered by rules hash and player.
+std::vector<PlayerBest> bestPerPlayer(const std::vector<LeaderboardEntry>& ranked) {
+    std::vector<PlayerBest> best;
+    best.reserve(ranked.size());
+    for (std::size_t i = 0; i < ranked.size(); ++i) best.push_back({ranked[i].rulesHash, ranked[i].player, i});
+    std::sort(best.begin(), best.end(), [](const PlayerBest& a, const PlayerBest& b) {
+        if (a.rulesHash != b.rulesHash) return a.rulesHash < b.rulesHash;
+        if (a.player != b.player) return a.player < b.player;
+        return a.position < b.position;
+    });
+    best.erase(std::unique(best.begin(), best.end(),
+                           [](const PlayerBest& a, const PlayerBest& b) {
+                               return a.rulesHash == b.rulesHash && a.player == b.player;
+                           }),
+               best.end());
+    return best;
+}
+
+void putLogEntry(unsigned char* p, const LeaderboardEntry& e) {
+    std::size_t off = 0;
+    putRaw<std::uint64_t>(p, off, e.player);
+    putRaw<std::uint64_t>(p, off, e.rulesHash);
+    putRaw<double>(p, off, e.score);
+    putRaw<double>(p, off, e.p);
+    putRaw<double>(p, off, e.l);
+    putRaw<std::int32_t>(p, off, e.population);
+    putRaw<std::int32_t>(p, off, e.land);
+    putRaw<std::uint32_t>(p, off, static_cast<std::uint32_t>(e.tier));
+    putRaw<std::uint32_t>(p, off, crc32(p, off));
+}
+
+bool getLogEntry(const unsigned char* p, LeaderboardEntry& e) {
+    std::size_t off = 0;
+    e.player = getRaw<std::uint64_t>(p, off);
+    e.rulesHash = getRaw<std::uint64_t>(p, off);
+    e.score = getRaw<double>(p, off);
+    e.p = getRaw<double>(p, off);
+    e.l = getRaw<double>(p, off);
+    e.population = getRaw<std::int32_t>(p, off);
+    e.land = getRaw<std::int32_t>(p, off);
+    const std::uint32_t tier = getRaw<std::uint32_t>(p, off);
+    e.tier = static_cast<ScoreTier>(tier);
+    return tier < 4 && readRaw<std::uint32_t>(p + off) == crc32(p, off);
+}
+
+void putIndexEntry(unsigned char* p, const LeaderboardEntry& e) {
+    std::size_t off = 0;
+    putRaw<std::uint64_t>(p, off, e.player);
+    putRaw<std::uint64_t>(p, off, e.rulesHash);
+    putRaw<double>(p, off, e.score);
+    putRaw<double>(p, off, e.p);
+    putRaw<double>(p, off, e.l);
+    putRaw<std::uint64_t>(p, off, e.seq);
+    putRaw<std::int32_t>(p, off, e.population);
+    putRaw<std::int32_t>(p, off, e.land);
+    putRaw<std::uint32_t>(p, off, static_cast<std::uint32_t>(e.tier));
+    putRaw<std::uint32_t>(p, off, 0);
+}
+
+LeaderboardEntry getIndexEntry(const unsigned char* p) {
+    LeaderboardEntry e;
+    std::size_t off = 0;
+    e.player = getRaw<std::uint64_t>(p, off);
+    e.rulesHash = getRaw<std::uint64_t>(p, off);
+    e.score = getRaw<double>(p, off);
+    e.p = getRaw<double>(p, off);
+    e.l = getRaw<double>(p, off);
+    e.seq = getRaw<std::uint64_t>(p, off);
+    e.population = getRaw<std::int32_t>(p, off);
+    e.land = getRaw<std::int32_t>(p, off);
+    e.tier = static_cast<ScoreTier>(getRaw<std::uint32_t>(p, off));
+    return e;
+}
+
+// Only the fields ranksBefore looks at.
+LeaderboardEntry indexKey(const unsigned char* p) {
+    LeaderboardEntry e;
+    e.rulesHash = readRaw<std::uint64_t>(p + 8);
+    e.score = readRaw<double>(p + 16);
+    e.seq = readRaw<std::uint64_t>(p + 40);
+    return e;
+}
+
+// Held while a process appends to the log or rewrites it or the index.
+class FileLock {
+public:
+    explicit FileLock(const std::string& path) {
+#ifdef _WIN32
+        h_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        OVERLAPPED ov{};
+        if (h_ != INVALID_HANDLE_VALUE && !LockFileEx(h_, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov)) {
+            CloseHandle(h_);
+            h_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ >= 0 && flock(fd_, LOCK_EX) != 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+#endif
+    }
+    ~FileLock() {
+#ifdef _WIN32
+        if (h_ != INVALID_HANDLE_VALUE) CloseHandle(h_);
+#else
+        if (fd_ >= 0) ::close(fd_);
+#endif
+    }
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+#ifdef _WIN32
+    bool held() const { return h_ != INVALID_HANDLE_VALUE; }
+
+private:
+    HANDLE h_ = INVALID_HANDLE_VALUE;
+#else
+    bool held() const { return fd_ >= 0; }
+
+private:
+    int fd_ = -1;
+#endif
+};
+
+std::uint64_t fileSize(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return in ? static_cast<std::uint64_t>(in.tellg()) : 0;
+}
+
+#ifdef _WIN32
+// Deletes the numbered index files of base other than current; one that is
+// still mapped somewhere goes on a later write.
+void removeOldIndexes(const std::string& base, const std::string& current) {
+    const std::size_t slash = base.find_last_of("/\\");
+    const std::string dir = slash == std::string::npos ? std::string() : base.substr(0, slash + 1);
+    const std::string prefix = base.substr(dir.size()) + ".";
+    WIN32_FIND_DATAA found;
+    HANDLE h = FindFirstFileA((base + ".*").c_str(), &found);
+    if (h == INVALID_HANDLE_VALUE) return;
+    do {
+        const std::string name = found.cFileName;
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.find_first_not_of("0123456789", prefix.size()) != std::string::npos || dir + name == current) {
+            continue;
+        }
+        DeleteFileA((dir + name).c_str());
+    } while (FindNextFileA(h, &found));
+    FindClose(h);
+}
+#endif
+
+// The file the index is in. A mapped file cannot be replaced on Windows, so
+// there every index is written under a new name, base + ".N", and base holds
+// N; elsewhere base is the index and a new one is renamed over it.
+std::string indexFile(const std::string& base) {
+#ifdef _WIN32
+    std::ifstream in(base);
+    std::uint64_t n = 0;
+    return in >> n ? base + "." + std::to_string(n) : std::string();
+#else
+    return base;
+#endif
+}
+
+// Writes an index and makes it the one indexFile names, which file is set to.
+bool replaceIndex(const std::string& base, const std::vector<unsigned char>& buf, std::string& file) {
+#ifdef _WIN32
+    std::uint64_t n = 0;
+    {
+        std::ifstream in(base);
+        in >> n; // 0 if there is no index yet
+    }
+    const std::string next = std::to_string(n + 1);
+    file = base + "." + next;
+    if (!replaceFileAtomically(file, buf.data(), buf.size()) ||
+        !replaceFileAtomically(base, next.data(), next.size())) {
+        return false;
+    }
+    removeOldIndexes(base, file);
+    return true;
+#else
+    file = base;
+    return replaceFileAtomically(base, buf.data(), buf.size());
+#endif
+}
+
+// Cuts the log back to its first size bytes, dropping a torn last entry.
+bool truncateLog(const std::string& path, std::uint64_t size) {
+    std::vector<char> kept(static_cast<std::size_t>(size));
+    std::ifstream in(path, std::ios::binary);
+    if (!in.read(kept.data(), static_cast<std::streamsize>(kept.size()))) return false;
+    in.close();
+    return replaceFileAtomically(path, kept.data(), kept.size());
+}
+
+}
+
+LeaderboardEntry leaderboardEntry(std::uint64_t player, const GameState& s, const GameRules& r) {
+    const FinalScore f = computeFinalScore(s, r);
+    LeaderboardEntry e;
+    e.player = player;
+    e.rulesHash = r.hash();
+    e.score = finalObjective(s, r);
+    e.p = f.avgStarvedPercent;
+    e.l = f.acresPerCitizen;
+    e.population = s.population;
+    e.land = s.landAcres;
+    e.tier = f.tier;
+    return e;
+}
+
+struct Leaderboard::Snapshot {
+    std::shared_ptr<const MappedFile> index; // null when nothing is indexed
+    std::uint64_t indexed = 0;               // the log's first entries, all in the index
+    std::uint64_t players = 0;
+    std::vector<LeaderboardEntry> tail;      // the log's later entries, in rank order
+    std::vector<PlayerBest> tailPlayers;     // positions in tail, as the index's players
+
+    std::uint64_t logged() const { return indexed + tail.size(); }
+    const unsigned char* entry(std::uint64_t i) const {
+        return index->data() + kIndexHeaderSize + i * kIndexEntrySize;
+    }
+    const unsigned char* player(std::uint64_t i) const {
+        return index->data() + kIndexHeaderSize + indexed * kIndexEntrySize + i * kPlayerEntrySize;
+    }
+
+    // Index positions ranking before e.
+    std::uint64_t indexBefore(const LeaderboardEntry& e) const {
+        std::uint64_t lo = 0, hi = indexed;
+        while (lo < hi) {
+            const std::uint64_t mid = lo + (hi - lo) / 2;
+            if (ranksBefore(indexKey(entry(mid)), e)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    std::size_t tailBefore(const LeaderboardEntry& e) const {
+        return static_cast<std::size_t>(std::lower_bound(tail.begin(), tail.end(), e, ranksBefore) - tail.begin());
+    }
+};
+
+std::shared_ptr<const Leaderboard::Snapshot> Leaderboard::snapshot() const {
+    return std::atomic_load(&snap_);
+}
+
+// Reads the log's entries from the from-th on, stopping at the first torn or
+// damaged one; validBytes is where that one starts. False if the log itself is
+// missing or foreign.
+bool Leaderboard::readLog(std::uint64_t from, std::vector<LeaderboardEntry>& out, std::uint64_t& validBytes) const {
+    std::ifstream in(path_, std::ios::binary);
+    unsigned char header[kLogHeaderSize];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof header)) return false;
+    if (std::memcmp(header, kLogMagic, sizeof kLogMagic) != 0 || readRaw<std::uint32_t>(header + 8) != kLeaderboardVersion ||
+        readRaw<std::uint32_t>(header + 12) != crc32(header, 12)) {
+        return false;
+    }
+
+    validBytes = kLogHeaderSize + from * kLogEntrySize;
+    if (!in.seekg(static_cast<std::streamoff>(validBytes))) return false;
+    unsigned char buf[kLogEntrySize];
+    LeaderboardEntry e;
+    while (in.read(reinterpret_cast<char*>(buf), sizeof buf) && getLogEntry(buf, e)) {
+        e.seq = from++;
+        out.push_back(e);
+        validBytes += kLogEntrySize;
+    }
+    return true;
+}
+
+// Writes the index of s's entries and more (in rank order) and maps it.
+bool Leaderboard::writeIndex(const Snapshot& s, std::vector<LeaderboardEntry> more,
+                             std::shared_ptr<const MappedFile>& index, std::uint64_t& indexed) const {
+    std::vector<LeaderboardEntry> all;
+    all.reserve(static_cast<std::size_t>(s.logged()) + more.size());
+    for (std::uint64_t i = 0; i < s.indexed; ++i) all.push_back(getIndexEntry(s.entry(i)));
+    const auto mid = static_cast<std::ptrdiff_t>(all.size());
+    std::vector<LeaderboardEntry> later = s.tail;
+    later.insert(later.end(), more.begin(), more.end());
+    std::sort(later.begin(), later.end(), ranksBefore);
+    all.insert(all.end(), later.begin(), later.end());
+    std::inplace_merge(all.begin(), all.begin() + mid, all.end(), ranksBefore);
+
+    const std::vector<PlayerBest> best = bestPerPlayer(all);
+
+    std::vector<unsigned char> buf(kIndexHeaderSize + all.size() * kIndexEntrySize + best.size() * kPlayerEntrySize);
+    std::size_t off = 0;
+    std::memcpy(buf.data(), kIndexMagic, sizeof kIndexMagic);
+    off += sizeof kIndexMagic;
+    putRaw<std::uint32_t>(buf.data(), off, kLeaderboardVersion);
+    putRaw<std::uint32_t>(buf.data(), off, 0);
+    putRaw<std::uint64_t>(buf.data(), off, all.size());
+    putRaw<std::uint64_t>(buf.data(), off, all.size());
+    putRaw<std::uint64_t>(buf.data(), off, best.size());
+    putRaw<std::uint32_t>(buf.data(), off, crc32(buf.data(), off));
+    putRaw<std::uint32_t>(buf.data(), off, 0);
+    for (const LeaderboardEntry& e : all) {
+        putIndexEntry(buf.data() + off, e);
+        off += kIndexEntrySize;
+    }
+    for (const PlayerBest& b : best) {
+        putRaw<std::uint64_t>(buf.data(), off, b.rulesHash);
+        putRaw<std::uint64_t>(buf.data(), off, b.player);
+        putRaw<std::uint64_t>(buf.data(), off, b.position);
+    }
+    std::string path;
+    if (!replaceIndex(indexPath_, buf, path)) return false;
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path)) return false;
+    index = std::move(file);
+    indexed = all.size();
+    return true;
+}
+
+bool Leaderboard::publish(std::shared_ptr<const MappedFile> index, std::uint64_t indexed,
+                          std::vector<LeaderboardEntry> tail) {
+    auto s = std::make_shared<Snapshot>();
+    s->index = std::move(index);
+    s->indexed = indexed;
+    if (s->index) s->players = readRaw<std::uint64_t>(s->index->data() + 32);
+    s->tail = std::move(tail);
+    s->tailPlayers = bestPerPlayer(s->tail);
+    std::atomic_store(&snap_, std::shared_ptr<const Snapshot>(std::move(s)));
+    return true;
+}
+
+bool Leaderboard::open(const std::string& path) {
+    std::lock_guard<std::mutex> lk(write_);
+    path_ = path;
+    indexPath_ = path + ".idx";
+    lockPath_ = path + ".lock";
+    FileLock lock(lockPath_);
+    if (!lock.held()) return false;
+
+    if (!std::ifstream(path_)) {
+        unsigned char header[kLogHeaderSize];
+        std::size_t off = 0;
+        std::memcpy(header, kLogMagic, sizeof kLogMagic);
+        off += sizeof kLogMagic;
+        putRaw<std::uint32_t>(header, off, kLeaderboardVersion);
+        putRaw<std::uint32_t>(header, off, crc32(header, off));
+        if (!replaceFileAtomically(path_, header, off)) return false;
+    }
+    const std::uint64_t logSize = fileSize(path_);
+
+    // The index counts if it is whole and the log still has what it covers.
+    auto index = std::make_shared<MappedFile>();
+    std::uint64_t indexed = 0;
+    bool indexOk = index->open(indexFile(indexPath_)) && index->size() >= kIndexHeaderSize;
+    if (indexOk) {
+        const unsigned char* h = index->data();
+        indexed = readRaw<std::uint64_t>(h + 16);
+        const std::uint64_t players = readRaw<std::uint64_t>(h + 32);
+        indexOk = std::memcmp(h, kIndexMagic, sizeof kIndexMagic) == 0 &&
+                  readRaw<std::uint32_t>(h + 8) == kLeaderboardVersion && readRaw<std::uint32_t>(h + 40) == crc32(h, 40) &&
+                  readRaw<std::uint64_t>(h + 24) == indexed &&
+                  index->size() == kIndexHeaderSize + indexed * kIndexEntrySize + players * kPlayerEntrySize &&
+                  logSize >= kLogHeaderSize + indexed * kLogEntrySize;
+    }
+    if (!indexOk) indexed = 0;
+
+    std::vector<LeaderboardEntry> tail;
+    std::uint64_t validBytes = 0;
+    if (!readLog(indexed, tail, validBytes)) return false;
+    if (validBytes < logSize && !truncateLog(path_, validBytes)) return false;
+
+    if (indexOk && tail.size() <= std::max<std::uint64_t>(kMinTail, indexed / kTailShare)) {
+        std::sort(tail.begin(), tail.end(), ranksBefore);
+        return publish(std::move(index), indexed, std::move(tail));
+    }
+    std::shared_ptr<const MappedFile> fresh;
+    Snapshot base;
+    if (indexOk) {
+        base.index = std::move(index);
+        base.indexed = indexed;
+    }
+    if (!writeIndex(base, std::move(tail), fresh, indexed)) return false;
+    return publish(std::move(fresh), indexed, {});
+}
+
+bool Leaderboard::insert(std::vector<LeaderboardEntry>& batch) {
+    std::lock_guard<std::mutex> lk(write_);
+    const std::shared_ptr<const Snapshot> s = snapshot();
+    if (!s) return false;
+    FileLock lock(lockPath_);
+    if (!lock.held()) return false;
+
+    // What other processes appended goes first; a torn entry a crashed one
+    // left goes away.
+    std::vector<LeaderboardEntry> more;
+    std::uint64_t validBytes = 0;
+    if (!readLog(s->logged(), more, validBytes)) return false;
+    if (validBytes < fileSize(path_) && !truncateLog(path_, validBytes)) return false;
+
+    std::vector<unsigned char> buf(batch.size() * kLogEntrySize);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        batch[i].seq = s->logged() + more.size() + i;
+        putLogEntry(buf.data() + i * kLogEntrySize, batch[i]);
+    }
+    if (!batch.empty() && !appendToFile(path_, buf.data(), buf.size(), true)) return false;
+    more.insert(more.end(), batch.begin(), batch.end());
+
+    // The entries are in the log now, so the insert has succeeded: failing it
+    // would have the caller log them again. An index that cannot be written
+    // leaves them in the tail, and the next insert or open tries again.
+    if (s->tail.size() + more.size() > std::max<std::uint64_t>(kMinTail, s->indexed / kTailShare)) {
+        std::shared_ptr<const MappedFile> index;
+        std::uint64_t indexed = 0;
+        if (writeIndex(*s, more, index, indexed)) return publish(std::move(index), indexed, {});
+    }
+    std::sort(more.begin(), more.end(), ranksBefore);
+    std::vector<LeaderboardEntry> tail;
+    tail.reserve(s->tail.size() + more.size());
+    std::merge(s->tail.begin(), s->tail.end(), more.begin(), more.end(), std::back_inserter(tail), ranksBefore);
+    return publish(s->index, s->indexed, std::move(tail));
+}
+
+bool Leaderboard::refresh() {
+    std::lock_guard<std::mutex> lk(write_);
+    const std::shared_ptr<const Snapshot> s = snapshot();
+    if (!s) return false;
+    std::vector<LeaderboardEntry> more;
+    std::uint64_t validBytes = 0;
+    if (!readLog(s->logged(), more, validBytes)) return false;
+    if (more.empty()) return true;
+    std::sort(more.begin(), more.end(), ranksBefore);
+    std::vector<LeaderboardEntry> tail;
+    tail.reserve(s->tail.size() + more.size());
+    std::merge(s->tail.begin(), s->tail.end(), more.begin(), more.end(), std::back_inserter(tail), ranksBefore);
+    return publish(s->index, s->indexed, std::move(tail));
+}
+
+std::vector<LeaderboardEntry> Leaderboard::top(std::uint64_t rulesHash, std::size_t k) const {
+    std::vector<LeaderboardEntry> out;
+    const std::shared_ptr<const Snapshot> s = snapshot();
+    if (!s) return out;
+
+    // Both runs from the first entry under these rules, merged.
+    LeaderboardEntry first;
+    first.rulesHash = rulesHash;
+    first.score = 1e300;
+    std::uint64_t i = s->indexBefore(first);
+    std::size_t t = s->tailBefore(first);
+    while (out.size() < k) {
+        const bool fromIndex = i < s->indexed && readRaw<std::uint64_t>(s->entry(i) + 8) == rulesHash;
+        const bool fromTail = t < s->tail.size() && s->tail[t].rulesHash == rulesHash;
+        if (!fromIndex && !fromTail) break;
+        if (fromIndex && (!fromTail || ranksBefore(indexKey(s->entry(i)), s->tail[t]))) {
+            out.push_back(getIndexEntry(s->entry(i++)));
+        } else {
+            out.push_back(s->tail[t++]);
+        }
+    }
+    return out;
+}
+
+std::uint64_t Leaderboard::rankOf(std::uint64_t player, std::uint64_t rulesHash, LeaderboardEntry* best) const {
+    const std::shared_ptr<const Snapshot> s = snapshot();
+    if (!s) return 0;
+
+    bool found = false;
+    LeaderboardEntry b;
+    std::uint64_t lo = 0, hi = s->players;
+    while (lo < hi) {
+        const std::uint64_t mid = lo + (hi - lo) / 2;
+        const unsigned char* p = s->player(mid);
+        const std::uint64_t h = readRaw<std::uint64_t>(p);
+        const std::uint64_t id = readRaw<std::uint64_t>(p + 8);
+        if (h < rulesHash || (h == rulesHash && id < player)) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < s->players && readRaw<std::uint64_t>(s->player(lo)) == rulesHash &&
+        readRaw<std::uint64_t>(s->player(lo) + 8) == player) {
+        b = getIndexEntry(s->entry(readRaw<std::uint64_t>(s->player(lo) + 16)));
+        found = true;
+    }
+    const auto t = std::lower_bound(s->tailPlayers.begin(), s->tailPlayers.end(), PlayerBest{rulesHash, player, 0},
+                                    [](const PlayerBest& a, const PlayerBest& k) {
+                                        return a.rulesHash < k.rulesHash ||
+                                               (a.rulesHash == k.rulesHash && a.player < k.player);
+                                    });
+    if (t != s->tailPlayers.end() && t->rulesHash == rulesHash && t->player == player) {
+        const LeaderboardEntry& e = s->tail[static_cast<std::size_t>(t->position)];
+        if (!found || ranksBefore(e, b)) b = e;
+        found = true;
+    }
+    if (!found) return 0;
+
+    LeaderboardEntry first;
+    first.rulesHash = rulesHash;
+    first.score = 1e300;
+    if (best) *best = b;
+    return (s->indexBefore(b) - s->indexBefore(first)) + (s->tailBefore(b) - s->tailBefore(first)) + 1;
+}
+
+std::uint64_t Leaderboard::count(std::uint64_t rulesHash) const {
+    const std::shared_ptr<const Snapshot> s = snapshot();
+    if (!s) return 0;
+    LeaderboardEntry first, last;
+    first.rulesHash = rulesHash;
+    first.score = 1e300;
+    last.rulesHash = rulesHash;
+    last.score = -1e300;
+    return (s->indexBefore(last) - s->indexBefore(first)) + (s->tailBefore(last) - s->tailBefore(first));
+}
+
+std::uint64_t Leaderboard::size() const {
+    const std::shared_ptr<const Snapshot> s = snapshot();
+    return s ? s->logged() : 0;
+}
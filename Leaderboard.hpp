@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "MappedFile.hpp"
+
+// Finished games, ranked, kept across runs.
+//
+// The log (path) is the record: a header and fixed-size entries with a CRC
+// each, only ever appended to, one synced write per batch. The index
+// (path + ".idx") is a memory-mapped sorted copy of the log's first entries:
+// all of them ordered by rules hash, then score (best first), then log
+// position, followed by every player's best entry per rules hash. Top-K is a
+// binary search and a walk; a rank is a few binary searches.
+//
+// Entries logged after the index was written (the tail) are held in memory,
+// sorted the same way and with the same per-player bests, and merged into
+// every answer. When the tail grows past a share of the index a new index is
+// written next to the old one and renamed over it; the index is never changed
+// in place. (Windows cannot replace a mapped file, so there each index gets a
+// new name, path + ".idx.N", and path + ".idx" holds the current N.)
+//
+// Queries read an immutable snapshot (the mapped index and the tail) that an
+// insert replaces in one atomic step, so readers never wait for an insert.
+// Inserts are serialized, also between processes by a lock file; other
+// processes' entries show up after refresh(). A damaged or missing index is
+// rebuilt from the log, and a torn last entry of the log is cut off on open.
+
+struct LeaderboardEntry {
+    std::uint64_t player = 0;
+    std::uint64_t rulesHash = 0;
+    double score = 0.0; // finalObjective (DpSolver.hpp)
+    double p = 0.0;     // average starved percent
+    double l = 0.0;     // acres per citizen
+    std::int32_t population = 0;
+    std::int32_t land = 0;
+    ScoreTier tier = ScoreTier::Terrible;
+    std::uint64_t seq = 0; // position in the log; set by insert
+};
+
+// The entry of a game played to its end.
+LeaderboardEntry leaderboardEntry(std::uint64_t player, const GameState& s, const GameRules& r);
+
+class Leaderboard {
+public:
+    Leaderboard() = default;
+    Leaderboard(const Leaderboard&) = delete;
+    Leaderboard& operator=(const Leaderboard&) = delete;
+
+    // Opens or creates the log and its index.
+    bool open(const std::string& path);
+
+    // Appends the entries, setting their seq, and makes them visible. True
+    // once they are durably in the log, even if the index could not be
+    // rewritten; false means nothing was logged.
+    bool insert(std::vector<LeaderboardEntry>& batch);
+    // Picks up what other processes appended.
+    bool refresh();
+
+    // The best k entries under these rules, best first.
+    std::vector<LeaderboardEntry> top(std::uint64_t rulesHash, std::size_t k) const;
+    // 1-based rank of the player's best entry under these rules (copied to
+    // best if given); 0 if the player has none.
+    std::uint64_t rankOf(std::uint64_t player, std::uint64_t rulesHash, LeaderboardEntry* best = nullptr) const;
+    // Entries under these rules.
+    std::uint64_t count(std::uint64_t rulesHash) const;
+    std::uint64_t size() const;
+
+private:
+    struct Snapshot;
+
+    std::shared_ptr<const Snapshot> snapshot() const;
+    bool readLog(std::uint64_t from, std::vector<LeaderboardEntry>& out, std::uint64_t& validBytes) const;
+    bool publish(std::shared_ptr<const MappedFile> index, std::uint64_t indexed,
+                 std::vector<LeaderboardEntry> tail);
+    bool writeIndex(const Snapshot& s, std::vector<LeaderboardEntry> more, std::shared_ptr<const MappedFile>& index,
+                    std::uint64_t& indexed) const;
+
+    std::string path_;
+    std::string indexPath_;
+    std::string lockPath_;
+    std::mutex write_; // inserts and refreshes of this process
+    std::shared_ptr<const Snapshot> snap_; // read and replaced with std::atomic_load/atomic_store
+};
@@ -0,0 +1,261 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept {
+    *this = std::move(o);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+    if (this == &o) return *this;
+    close();
+    std::swap(data_, o.data_);
+    std::swap(size_, o.size_);
+#ifdef _WIN32
+    std::swap(file_, o.file_);
+    std::swap(mapping_, o.mapping_);
+#else
+    std::swap(fd_, o.fd_);
+#endif
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, Mode mode) {
+    close();
+    const bool rw = mode == Mode::ReadWrite;
+    HANDLE file = CreateFileA(path.c_str(), rw ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, rw ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, rw ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<unsigned char*>(view);
+    size_ = static_cast<std::size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(static_cast<HANDLE>(mapping_));
+    if (file_) CloseHandle(static_cast<HANDLE>(file_));
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+    size_ = 0;
+}
+
+bool MappedFile::flush(std::size_t offset, std::size_t length) const {
+    if (!data_) return false;
+    if (!FlushViewOfFile(data_ + offset, length)) return false;
+    return FlushFileBuffers(static_cast<HANDLE>(file_)) != 0;
+}
+
+bool MappedFile::resize(std::size_t newSize) {
+    if (!data_ || newSize == 0) return false;
+    HANDLE file = static_cast<HANDLE>(file_);
+    UnmapViewOfFile(data_);
+    CloseHandle(static_cast<HANDLE>(mapping_));
+    data_ = nullptr;
+    mapping_ = nullptr;
+
+    LARGE_INTEGER size;
+    size.QuadPart = static_cast<LONGLONG>(newSize);
+    HANDLE mapping = nullptr;
+    void* view = nullptr;
+    if (SetFilePointerEx(file, size, nullptr, FILE_BEGIN) && SetEndOfFile(file)) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (mapping) view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    }
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        close();
+        return false;
+    }
+    mapping_ = mapping;
+    data_ = static_cast<unsigned char*>(view);
+    size_ = newSize;
+    return true;
+}
+
+bool replaceFileAtomically(const std::string& path, const void* data, std::size_t size) {
+    const std::string tmp = path + ".tmp";
+    HANDLE file = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    const char* p = static_cast<const char*>(data);
+    bool ok = true;
+    while (ok && size > 0) {
+        DWORD chunk = static_cast<DWORD>(size > 0x40000000u ? 0x40000000u : size);
+        DWORD written = 0;
+        ok = WriteFile(file, p, chunk, &written, nullptr) && written == chunk;
+        p += chunk;
+        size -= chunk;
+    }
+    ok = ok && FlushFileBuffers(file);
+    CloseHandle(file);
+    if (ok) ok = MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    if (!ok) DeleteFileA(tmp.c_str());
+    return ok;
+}
+
+bool appendToFile(const std::string& path, const void* data, std::size_t size, bool sync) {
+    HANDLE file = CreateFileA(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    DWORD written = 0;
+    bool ok = WriteFile(file, data, static_cast<DWORD>(size), &written, nullptr) && written == size;
+    if (ok && sync) ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, Mode mode) {
+    close();
+    const bool rw = mode == Mode::ReadWrite;
+    int fd = ::open(path.c_str(), rw ? O_RDWR : O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), rw ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                   MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    data_ = static_cast<unsigned char*>(p);
+    size_ = static_cast<std::size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap(data_, size_);
+    if (fd_ >= 0) ::close(fd_);
+    data_ = nullptr;
+    size_ = 0;
+    fd_ = -1;
+}
+
+bool MappedFile::flush(std::size_t offset, std::size_t length) const {
+    if (!data_) return false;
+    const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t start = offset / page * page;
+    return msync(data_ + start, offset + length - start, MS_SYNC) == 0;
+}
+
+bool MappedFile::resize(std::size_t newSize) {
+    if (!data_ || newSize == 0) return false;
+    munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+
+    void* p = MAP_FAILED;
+    if (ftruncate(fd_, static_cast<off_t>(newSize)) == 0) {
+        p = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    data_ = static_cast<unsigned char*>(p);
+    size_ = newSize;
+    return true;
+}
+
+bool replaceFileAtomically(const std::string& path, const void* data, std::size_t size) {
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    const char* p = static_cast<const char*>(data);
+    bool ok = true;
+    while (ok && size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) {
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable.
+    const std::string::size_type slash = path.find_last_of('/');
+    const std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+    int dfd = ::open(dir.c_str(), O_RDONLY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        ::close(dfd);
+    }
+    return true;
+}
+
+bool appendToFile(const std::string& path, const void* data, std::size_t size, bool sync) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+
+    const char* p = static_cast<const char*>(data);
+    bool ok = true;
+    while (ok && size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) {
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+    if (ok && sync) ok = fsync(fd) == 0;
+    return ::close(fd) == 0 && ok;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only or read-write memory mapping of a whole file.
+class MappedFile {
+public:
+    enum class Mode {
+        ReadOnly,
+        ReadWrite, // the file must already have its final size
+    };
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile&& o) noexcept;
+    MappedFile& operator=(MappedFile&& o) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, Mode mode = Mode::ReadOnly);
+    void close();
+
+    // Writes dirty pages of [offset; offset + length) back to disk.
+    bool flush(std::size_t offset, std::size_t length) const;
+
+    // Grows or shrinks a ReadWrite mapping; data() may move.
+    bool resize(std::size_t newSize);
+
+    bool isOpen() const { return data_ != nullptr; }
+    const unsigned char* data() const { return data_; }
+    unsigned char* mutableData() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Writes data to path + ".tmp", flushes it to disk and renames it over path,
+// so a crash leaves either the old file or the new one, never a torn mix.
+bool replaceFileAtomically(const std::string& path, const void* data, std::size_t size);
+
+// Appends data to path (created if missing) and, with sync, waits until it is
+// on disk.
+bool appendToFile(const std::string& path, const void* data, std::size_t size, bool sync);
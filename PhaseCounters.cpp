@@ -0,0 +1,64 @@
+#include "PhaseCounters.hpp"
+
+#include <iomanip>
+
+const char* batchPhaseName(BatchPhase p) {
+    switch (p) {
+    case BatchPhase::LandPrice: return "land_price";
+    case BatchPhase::Decisions: return "decisions";
+    case BatchPhase::YieldDraw: return "yield_draw";
+    case BatchPhase::Harvest: return "harvest";
+    case BatchPhase::RatsDraw: return "rats_draw";
+    case BatchPhase::PlagueDraw: return "plague_draw";
+    case BatchPhase::Events: return "events";
+    }
+    return "?";
+}
+
+const char* phaseClockName() {
+#if defined(HAMMURABI_PHASE_TSC)
+    return "tsc";
+#else
+    return "steady_clock_ns";
+#endif
+}
+
+void PhaseCounters::merge(const PhaseCounters& o) {
+    for (int i = 0; i < kBatchPhaseCount; ++i) ticks[i] += o.ticks[i];
+    games += o.games;
+    laneYears += o.laneYears;
+    overthrows += o.overthrows;
+    depopulations += o.depopulations;
+    plagueHits += o.plagueHits;
+    plagueWipeouts += o.plagueWipeouts;
+    immigrantsClampedLow += o.immigrantsClampedLow;
+    immigrantsClampedHigh += o.immigrantsClampedHigh;
+}
+
+void writePhaseCountersJson(std::ostream& out, const PhaseCounters& c) {
+    const double laneYears = c.laneYears > 0 ? static_cast<double>(c.laneYears) : 1.0;
+    std::uint64_t total = 0;
+    for (std::uint64_t t : c.ticks) total += t;
+
+    const auto oldPrecision = out.precision(6);
+    out << "{\n  \"clock\": \"" << phaseClockName() << "\",\n"
+        << "  \"games\": " << c.games << ",\n"
+        << "  \"lane_years\": " << c.laneYears << ",\n"
+        << "  \"phases\": {\n";
+    for (int i = 0; i < kBatchPhaseCount; ++i) {
+        out << "    \"" << batchPhaseName(static_cast<BatchPhase>(i)) << "\": {\"ticks\": " << c.ticks[i]
+            << ", \"per_lane_year\": " << static_cast<double>(c.ticks[i]) / laneYears << "},\n";
+    }
+    out << "    \"total\": {\"ticks\": " << total
+        << ", \"per_lane_year\": " << static_cast<double>(total) / laneYears << "}\n"
+        << "  },\n"
+        << "  \"events\": {\n"
+        << "    \"overthrows\": " << c.overthrows << ",\n"
+        << "    \"depopulations\": " << c.depopulations << ",\n"
+        << "    \"plague_hits\": " << c.plagueHits << ",\n"
+        << "    \"plague_wipeouts\": " << c.plagueWipeouts << ",\n"
+        << "    \"immigrants_clamped_low\": " << c.immigrantsClampedLow << ",\n"
+        << "    \"immigrants_clamped_high\": " << c.immigrantsClampedHigh << "\n"
+        << "  }\n}\n";
+    out.precision(oldPrecision);
+}
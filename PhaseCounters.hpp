@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAMMURABI_PHASE_TSC 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAMMURABI_PHASE_TSC 1
+#endif
+
+// Optional instrumentation of the batch driver (playGameBatch): clock ticks
+// spent in each stage of a year and counts of what the years resolved. It is
+// off unless the caller passes a PhaseCounters; the SIMD kernels are never
+// touched, the events are recounted from the lanes after the year.
+
+enum class BatchPhase {
+    LandPrice,  // beginYearBatch
+    Decisions,  // the policy, lane by lane
+    YieldDraw,
+    Harvest,    // kernel stage 1: land trade, feeding, planting, harvest
+    RatsDraw,
+    PlagueDraw,
+    Events,     // kernel stage 2: rats, starvation, immigration, plague
+};
+constexpr int kBatchPhaseCount = 7;
+
+const char* batchPhaseName(BatchPhase p);
+
+// The time stamp counter on x86, steady_clock nanoseconds elsewhere.
+inline std::uint64_t phaseClock() {
+#if defined(HAMMURABI_PHASE_TSC)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+}
+const char* phaseClockName();
+
+struct PhaseCounters {
+    std::uint64_t ticks[kBatchPhaseCount] = {};
+    std::uint64_t games = 0;
+    std::uint64_t laneYears = 0;             // lanes still playing when a year was resolved
+    std::uint64_t overthrows = 0;
+    std::uint64_t depopulations = 0;
+    std::uint64_t plagueHits = 0;            // including the wipeouts
+    std::uint64_t plagueWipeouts = 0;
+    std::uint64_t immigrantsClampedLow = 0;  // the formula gave less than immigrantsMin
+    std::uint64_t immigrantsClampedHigh = 0; // or more than immigrantsMax
+
+    void add(BatchPhase p, std::uint64_t t) { ticks[static_cast<int>(p)] += t; }
+    void merge(const PhaseCounters& o);
+};
+
+// One JSON object: the clock, the ticks of every phase (total and per lane
+// year) and the event counts.
+void writePhaseCountersJson(std::ostream& out, const PhaseCounters& c);
@@ -0,0 +1,167 @@
+#include "Policy.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+#include "BinaryFormat.hpp"
+#include "DpSolver.hpp"
+#include "MappedFile.hpp"
+
+// Whole bushels in an amount of grain units, 0 for a deficit.
+static int wholeBushels(const GameState& s, std::int64_t units) {
+    return static_cast<int>(std::max<std::int64_t>(0, units) / s.grainScale);
+}
+
+static int maxPlantable(const GameState& s, const Decisions& d, const GameRules& r) {
+    const int bySeed = static_cast<int>(std::max<std::int64_t>(0, grainAfterFeeding(s, d)) /
+                                        r.seedGrainUnits(s.grainScale));
+    return std::max(0, std::min({landAfterTrade(s, d), s.population * r.acresPerPersonMax, bySeed}));
+}
+
+Decisions SteadyPolicy::decide(const GameState& s, const GameRules& r) const {
+    Decisions d;
+    d.bushelsToFeed = s.population * r.bushelsPerPersonPerYear;
+    d.bushelsToFeed = std::min(d.bushelsToFeed, wholeBushels(s, s.grainUnits));
+    d.acresToPlant = maxPlantable(s, d, r);
+    return d;
+}
+
+Decisions TraderPolicy::decide(const GameState& s, const GameRules& r) const {
+    Decisions d;
+    const int food = s.population * r.bushelsPerPersonPerYear;
+    const int workable = s.population * r.acresPerPersonMax;
+    const int midPrice = (r.landPriceMin + r.landPriceMax) / 2;
+    const int targetLand = s.population * std::max(r.lGoodUpper, r.acresPerPersonMax);
+
+    if (s.landPriceThisYear <= midPrice && s.landAcres < targetLand) {
+        // Keep enough grain to feed everybody and seed the workable land.
+        double reserve = food + workable * r.seedsBushelsPerAcre;
+        double spare = s.grainBushels() - reserve;
+        if (spare > 0.0) {
+            int affordable = static_cast<int>(spare / s.landPriceThisYear);
+            d.acresToBuy = std::min(affordable, targetLand - s.landAcres);
+        }
+    } else if (s.landPriceThisYear > midPrice && s.landAcres > targetLand) {
+        d.acresToSell = s.landAcres - targetLand;
+    } else if (s.grainBushels() < food) {
+        // Sell land rather than let people starve.
+        int shortfall = static_cast<int>(std::ceil((food - s.grainBushels()) / s.landPriceThisYear));
+        d.acresToSell = std::min(s.landAcres, shortfall);
+    }
+
+    d.bushelsToFeed = std::min(food, wholeBushels(s, grainAfterTrade(s, d)));
+    d.acresToPlant = maxPlantable(s, d, r);
+    return d;
+}
+
+static const PolicyParamRange kParamRanges[kPolicyParamCount] = {
+    {"feed_per_head", 0.5, 1.2, 1.0},
+    {"acres_per_citizen", 1.0, 40.0, 10.0},
+    {"plant_share", 0.0, 1.0, 1.0},
+    {"buy_below", 0.0, 1.0, 0.5},
+    {"sell_above", 0.0, 1.0, 0.5},
+    {"grain_reserve", 0.0, 3.0, 1.0},
+};
+
+const PolicyParamRange& policyParamRange(PolicyParam p) {
+    return kParamRanges[static_cast<int>(p)];
+}
+
+PolicyParams::PolicyParams() {
+    for (int i = 0; i < kPolicyParamCount; ++i) values[i] = kParamRanges[i].stock;
+}
+
+bool loadPolicyParams(const std::string& path, PolicyParams& p) {
+    std::ifstream in(path);
+    if (!in) return false;
+    p = PolicyParams{};
+
+    std::string text;
+    while (std::getline(in, text)) {
+        std::string_view line = text;
+        line = trimBlanks(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        const std::size_t eq = line.find('=');
+        if (eq == std::string_view::npos) return false;
+        const std::string_view key = trimBlanks(line.substr(0, eq));
+
+        int k = 0;
+        while (k < kPolicyParamCount && key != kParamRanges[k].key) ++k;
+        if (k == kPolicyParamCount) return false;
+        double v = 0.0;
+        if (!parseRuleNumber(trimBlanks(line.substr(eq + 1)), v)) return false;
+        if (!(v >= kParamRanges[k].low && v <= kParamRanges[k].high)) return false;
+        p.values[k] = v;
+    }
+    return true;
+}
+
+bool savePolicyParams(const std::string& path, const PolicyParams& p) {
+    std::ostringstream out;
+    out.precision(17);
+    out << "# Parametric policy; play it with --policy param:FILE\n";
+    for (int k = 0; k < kPolicyParamCount; ++k) out << kParamRanges[k].key << " = " << p.values[k] << '\n';
+    const std::string text = out.str();
+    return replaceFileAtomically(path, text.data(), text.size());
+}
+
+std::uint64_t ParametricPolicy::contentHash() const {
+    Fnv1a h;
+    for (double v : p_.values) h.mixValue(v);
+    return h.value();
+}
+
+Decisions ParametricPolicy::decide(const GameState& s, const GameRules& r) const {
+    Decisions d;
+    const int food = s.population * r.bushelsPerPersonPerYear;
+    const int ration = static_cast<int>(std::ceil(food * p_[PolicyParam::FeedPerHead]));
+    const int workable = s.population * r.acresPerPersonMax;
+    const double pricePosition = static_cast<double>(s.landPriceThisYear - r.landPriceMin) /
+                                 std::max(1, r.landPriceMax - r.landPriceMin);
+    const int targetLand = static_cast<int>(std::lround(s.population * p_[PolicyParam::AcresPerCitizen]));
+
+    if (pricePosition <= p_[PolicyParam::BuyBelow] && s.landAcres < targetLand) {
+        double reserve = p_[PolicyParam::GrainReserve] * (ration + workable * r.seedsBushelsPerAcre);
+        double spare = s.grainBushels() - reserve;
+        if (spare > 0.0) {
+            int affordable = static_cast<int>(spare / s.landPriceThisYear);
+            d.acresToBuy = std::min(affordable, targetLand - s.landAcres);
+        }
+    } else if (pricePosition >= p_[PolicyParam::SellAbove] && s.landAcres > targetLand) {
+        d.acresToSell = s.landAcres - targetLand;
+    } else if (s.grainBushels() < ration) {
+        int shortfall = static_cast<int>(std::ceil((ration - s.grainBushels()) / s.landPriceThisYear));
+        d.acresToSell = std::min(s.landAcres, shortfall);
+    }
+
+    d.bushelsToFeed = std::min(ration, wholeBushels(s, grainAfterTrade(s, d)));
+    d.acresToPlant = static_cast<int>(maxPlantable(s, d, r) * p_[PolicyParam::PlantShare]);
+    return d;
+}
+
+std::unique_ptr<Policy> makePolicy(const std::string& spec, const GameRules& r) {
+    if (spec == "steady") return std::make_unique<SteadyPolicy>();
+    if (spec == "trader") return std::make_unique<TraderPolicy>();
+
+    const std::string optimal = "optimal:";
+    if (spec.compare(0, optimal.size(), optimal) == 0) {
+        auto table = std::make_shared<DpTable>();
+        if (!table->load(spec.substr(optimal.size()), r)) return nullptr;
+        return std::make_unique<OptimalPolicy>(std::move(table));
+    }
+
+    const std::string param = "param:";
+    if (spec.compare(0, param.size(), param) == 0) {
+        PolicyParams p;
+        if (!loadPolicyParams(spec.substr(param.size()), p)) return nullptr;
+        return std::make_unique<ParametricPolicy>(p);
+    }
+    return nullptr;
+}
+
+std::vector<std::string> policyNames() {
+    return {"steady", "trader", "optimal:FILE", "param:FILE"};
+}
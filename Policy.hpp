@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GameEngine.hpp"
+
+// A ruler that takes the yearly decisions without asking anybody.
+// Policies must be deterministic and stateless so one instance can be shared
+// by any number of simulated games.
+class Policy {
+public:
+    virtual ~Policy() = default;
+    virtual const char* name() const = 0;
+    // Returned decisions are passed through clampDecisions() by the caller.
+    virtual Decisions decide(const GameState& s, const GameRules& r) const = 0;
+    // What the decisions depend on besides the name, for policies loaded from
+    // a file: a hash of the loaded table or parameters. 0 for policies the
+    // name alone defines. Caches and checkpoints key on it with the spec.
+    virtual std::uint64_t contentHash() const { return 0; }
+};
+
+// Feeds everybody, plants as much as possible, never trades land.
+class SteadyPolicy : public Policy {
+public:
+    const char* name() const override { return "steady"; }
+    Decisions decide(const GameState& s, const GameRules& r) const override;
+};
+
+// Like steady, but buys land when it is cheap and sells it when it is dear,
+// aiming at a target number of acres per citizen.
+class TraderPolicy : public Policy {
+public:
+    const char* name() const override { return "trader"; }
+    Decisions decide(const GameState& s, const GameRules& r) const override;
+};
+
+// The knobs of ParametricPolicy. Each has a range the optimizer searches
+// (PolicyOptimizer.hpp) and a stock value that plays about like trader.
+enum class PolicyParam {
+    FeedPerHead,     // share of the full ration given out
+    AcresPerCitizen, // land the ruler aims at
+    PlantShare,      // of the acres that could be sown
+    BuyBelow,        // buy when the price is at most this far up its range (0 cheapest, 1 dearest)
+    SellAbove,       // sell when it is at least this far up
+    GrainReserve,    // grain kept back when buying, in years of food and seed
+};
+constexpr int kPolicyParamCount = 6;
+
+struct PolicyParamRange {
+    const char* key; // in the policy file
+    double low;
+    double high;
+    double stock;
+};
+const PolicyParamRange& policyParamRange(PolicyParam p);
+
+struct PolicyParams {
+    double values[kPolicyParamCount];
+
+    PolicyParams(); // the stock values
+    double operator[](PolicyParam p) const { return values[static_cast<int>(p)]; }
+    double& operator[](PolicyParam p) { return values[static_cast<int>(p)]; }
+};
+
+// A policy file is lines of "key = value", '#' starts a comment; keys left out
+// keep their stock value. Load fails on an unknown key or a value out of range.
+bool loadPolicyParams(const std::string& path, PolicyParams& p);
+bool savePolicyParams(const std::string& path, const PolicyParams& p);
+
+// Trader with its constants made parameters, for any rules.
+class ParametricPolicy : public Policy {
+public:
+    explicit ParametricPolicy(const PolicyParams& p) : p_(p) {}
+    const char* name() const override { return "param"; }
+    Decisions decide(const GameState& s, const GameRules& r) const override;
+    std::uint64_t contentHash() const override;
+    const PolicyParams& params() const { return p_; }
+
+private:
+    PolicyParams p_;
+};
+
+// Builds a policy from its name. "optimal:FILE" plays a solved DpTable, which
+// must have been solved for the same rules; "param:FILE" a ParametricPolicy
+// from a policy file. Returns nullptr on failure.
+std::unique_ptr<Policy> makePolicy(const std::string& spec, const GameRules& r);
+std::vector<std::string> policyNames();
@@ -0,0 +1,229 @@
+#include "PolicyOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "BinaryFormat.hpp"
+#include "DpSolver.hpp"
+#include "MappedFile.hpp"
+#include "Rng.hpp"
+
+namespace {
+
+constexpr std::size_t kMaxCandidates = 4096;
+constexpr double kStartSpread = 0.3;
+
+// Box-Muller on hand-mapped draws, so the candidates are the same on every
+// standard library.
+double normalDraw(std::mt19937_64& g) {
+    const double u = 1.0 - unitFraction(g()); // (0; 1]
+    const double v = unitFraction(g());
+    return std::sqrt(-2.0 * std::log(u)) * std::cos(6.283185307179586 * v);
+}
+
+double toParam(int k, double x) {
+    const PolicyParamRange& range = policyParamRange(static_cast<PolicyParam>(k));
+    return range.low + (range.high - range.low) * x;
+}
+
+// What the results of a checkpoint depend on; generations may be added later.
+std::uint64_t settingsKey(const GameRules& r, const OptimizerConfig& cfg) {
+    Fnv1a h;
+    const std::uint64_t fields[] = {r.hash(), kRngDrawScheme, cfg.seed, static_cast<std::uint64_t>(cfg.candidates),
+                                    cfg.eval.games, cfg.eval.chunkGames};
+    for (std::uint64_t v : fields) h.mixValue(v);
+    const double shares[] = {cfg.eliteShare, cfg.smoothing, cfg.minSpread};
+    for (double v : shares) h.mixValue(v);
+    return h.value();
+}
+
+bool parseList(std::string_view s, double (&out)[kPolicyParamCount]) {
+    for (double& v : out) {
+        s = trimBlanks(s);
+        const std::size_t n = std::min(s.find(' '), s.size());
+        if (n == 0 || !parseRuleNumber(s.substr(0, n), v)) return false;
+        s.remove_prefix(n);
+    }
+    return trimBlanks(s).empty();
+}
+
+}
+
+OptimizerState::OptimizerState() {
+    for (int k = 0; k < kPolicyParamCount; ++k) {
+        const PolicyParamRange& range = policyParamRange(static_cast<PolicyParam>(k));
+        mean[k] = (range.stock - range.low) / (range.high - range.low);
+        spread[k] = kStartSpread;
+    }
+}
+
+PolicyParams OptimizerState::params() const {
+    PolicyParams p;
+    for (int k = 0; k < kPolicyParamCount; ++k) p.values[k] = toParam(k, mean[k]);
+    return p;
+}
+
+// The objective with the means of P and L over the completed games in place of
+// every game's own.
+double policyFitness(const EvalReport& rep, const GameRules& r) {
+    if (rep.games == 0) return kLostObjective;
+    const double lCap = 2.0 * std::max(1, r.lGoodUpper);
+    const double completed = static_cast<double>(rep.p.count);
+    double sum = kLostObjective * static_cast<double>(rep.games - rep.p.count);
+    for (int t = 0; t < 4; ++t) sum += t * static_cast<double>(rep.tiers[t]);
+    if (rep.p.count > 0) {
+        sum += completed * (0.1 * std::min(rep.l.mean, lCap) / lCap - 0.1 * std::min(rep.p.mean, 100.0) / 100.0);
+    }
+    return sum / static_cast<double>(rep.games);
+}
+
+bool saveOptimizerCheckpoint(const std::string& path, const GameRules& r, const OptimizerConfig& cfg,
+                             const OptimizerState& st) {
+    std::ostringstream out;
+    out.precision(17);
+    out << "# Policy optimizer checkpoint\n"
+        << "settings = " << settingsKey(r, cfg) << '\n'
+        << "generation = " << st.generation << '\n'
+        << "games = " << st.gamesPlayed << '\n'
+        << "mean_fitness = " << st.meanFitness << '\n'
+        << "best_fitness = " << st.bestFitness << '\n';
+    out << "mean =";
+    for (double v : st.mean) out << ' ' << v;
+    out << "\nspread =";
+    for (double v : st.spread) out << ' ' << v;
+    out << '\n';
+    const std::string text = out.str();
+    return replaceFileAtomically(path, text.data(), text.size());
+}
+
+bool loadOptimizerCheckpoint(const std::string& path, const GameRules& r, const OptimizerConfig& cfg,
+                             OptimizerState& st) {
+    std::ifstream in(path);
+    if (!in) return false;
+    OptimizerState loaded;
+    unsigned seen = 0; // one bit per key
+    bool sameSettings = false;
+
+    std::string text;
+    while (std::getline(in, text)) {
+        std::string_view line = text;
+        line = trimBlanks(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        const std::size_t eq = line.find('=');
+        if (eq == std::string_view::npos) return false;
+        const std::string_view key = trimBlanks(line.substr(0, eq));
+        const std::string value(trimBlanks(line.substr(eq + 1)));
+
+        bool ok = true;
+        try {
+            if (key == "settings") {
+                sameSettings = std::stoull(value) == settingsKey(r, cfg);
+                seen |= 1;
+            } else if (key == "generation") {
+                loaded.generation = std::stoi(value);
+                seen |= 2;
+            } else if (key == "games") {
+                loaded.gamesPlayed = std::stoull(value);
+                seen |= 4;
+            } else if (key == "mean_fitness") {
+                ok = parseRuleNumber(value, loaded.meanFitness);
+                seen |= 8;
+            } else if (key == "best_fitness") {
+                ok = parseRuleNumber(value, loaded.bestFitness);
+                seen |= 16;
+            } else if (key == "mean") {
+                ok = parseList(value, loaded.mean);
+                seen |= 32;
+            } else if (key == "spread") {
+                ok = parseList(value, loaded.spread);
+                seen |= 64;
+            } else {
+                ok = false;
+            }
+        } catch (...) {
+            ok = false;
+        }
+        if (!ok) return false;
+    }
+    if (seen != 127 || !sameSettings || loaded.generation < 0) return false;
+    st = loaded;
+    return true;
+}
+
+bool optimizePolicy(const GameRules& r, const OptimizerConfig& cfg, WorkStealingPool& pool,
+                    const std::string& checkpoint, OptimizerState& st,
+                    const std::function<void(const OptimizerState&)>& done) {
+    const std::size_t n = std::clamp<std::size_t>(static_cast<std::size_t>(std::max(1, cfg.candidates)), 1,
+                                                  kMaxCandidates);
+    const std::size_t elite = std::clamp<std::size_t>(
+        static_cast<std::size_t>(std::lround(cfg.eliteShare * static_cast<double>(n))), 1, n);
+    const std::size_t chunks = evalChunkCount(cfg.eval);
+
+    std::vector<std::vector<double>> xs(n, std::vector<double>(kPolicyParamCount));
+    std::vector<ParametricPolicy> policies;
+    policies.reserve(n);
+    std::vector<EvalReport> partial;
+    std::vector<EvalScratch> scratch(pool.size());
+    std::vector<double> fitness(n);
+    std::vector<std::size_t> order(n);
+
+    while (st.generation < cfg.generations) {
+        // The generation's candidates follow from the seed and its number
+        // alone, so a resumed run draws what the first one would have.
+        std::mt19937_64 g(cfg.seed ^ (0x9E3779B97F4A7C15ull * static_cast<std::uint64_t>(st.generation + 1)));
+        policies.clear();
+        for (std::size_t c = 0; c < n; ++c) {
+            PolicyParams p;
+            for (int k = 0; k < kPolicyParamCount; ++k) {
+                const double x = c == 0 ? st.mean[k] : st.mean[k] + st.spread[k] * normalDraw(g);
+                xs[c][k] = std::clamp(x, 0.0, 1.0);
+                p.values[k] = toParam(k, xs[c][k]);
+            }
+            policies.emplace_back(p);
+        }
+
+        EvalConfig ec = cfg.eval;
+        ec.seed = cfg.seed;
+        ec.firstGame = static_cast<std::uint64_t>(st.generation) * cfg.eval.games;
+        ec.distributions = false;
+        ec.phaseCounters = false;
+        partial.assign(n * chunks, EvalReport{});
+        pool.run(n * chunks, [&](std::size_t t, unsigned worker) {
+            evaluateChunk(r, policies[t / chunks], ec, t % chunks, scratch[worker], partial[t]);
+        });
+        for (std::size_t c = 0; c < n; ++c) {
+            EvalReport total;
+            for (std::size_t k = 0; k < chunks; ++k) total.merge(partial[c * chunks + k]);
+            fitness[c] = policyFitness(total, r);
+            st.gamesPlayed += total.games;
+        }
+
+        // Ties go to the lower candidate, the mean first.
+        std::iota(order.begin(), order.end(), std::size_t(0));
+        std::stable_sort(order.begin(), order.end(),
+                         [&](std::size_t a, std::size_t b) { return fitness[a] > fitness[b]; });
+        for (int k = 0; k < kPolicyParamCount; ++k) {
+            double m = 0.0;
+            for (std::size_t e = 0; e < elite; ++e) m += xs[order[e]][k];
+            m /= static_cast<double>(elite);
+            double var = 0.0;
+            for (std::size_t e = 0; e < elite; ++e) var += (xs[order[e]][k] - m) * (xs[order[e]][k] - m);
+            var /= static_cast<double>(elite);
+            st.mean[k] = cfg.smoothing * m + (1.0 - cfg.smoothing) * st.mean[k];
+            st.spread[k] = std::max(cfg.minSpread, cfg.smoothing * std::sqrt(var) + (1.0 - cfg.smoothing) * st.spread[k]);
+        }
+        st.meanFitness = fitness[0];
+        st.bestFitness = fitness[order[0]];
+        st.generation += 1;
+
+        if (!checkpoint.empty() && !saveOptimizerCheckpoint(checkpoint, r, cfg, st)) return false;
+        if (done) done(st);
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "Evaluator.hpp"
+#include "GameRules.hpp"
+#include "Policy.hpp"
+#include "WorkStealingPool.hpp"
+
+// Tunes a ParametricPolicy (Policy.hpp) for one rule set by the cross-entropy
+// method. Every generation draws candidates from a Gaussian over the
+// parameters, each scaled to [0; 1] over its range, plays all of them, and
+// moves the Gaussian towards the best ones (the elite).
+//
+// The candidates of a generation all play the same games, so they are ranked
+// on the same luck; the next generation plays new games. Candidate 0 is always
+// the Gaussian's mean. All candidates' chunks go to the pool as one task list.
+//
+// A candidate scores the solver's objective (DpSolver.hpp) averaged over its
+// games, a lost game counting kLostObjective.
+
+struct OptimizerConfig {
+    int generations = 40;
+    int candidates = 32;      // per generation, the mean included
+    double eliteShare = 0.25; // of the candidates the Gaussian moves towards
+    double smoothing = 0.7;   // weight of the elite in the new mean and spread
+    double minSpread = 0.01;  // keeps every parameter searched a little
+    std::uint64_t seed = 1;
+    EvalConfig eval;          // games per candidate; seed and firstGame are set per generation
+};
+
+// Where the search is; the checkpoint holds exactly this.
+struct OptimizerState {
+    int generation = 0;           // generations done
+    double mean[kPolicyParamCount];
+    double spread[kPolicyParamCount];
+    double meanFitness = 0.0;     // of the mean in the last generation
+    double bestFitness = 0.0;     // of that generation's best candidate
+    std::uint64_t gamesPlayed = 0;
+
+    OptimizerState(); // starts at the stock parameters
+    PolicyParams params() const; // the mean
+};
+
+double policyFitness(const EvalReport& rep, const GameRules& r);
+
+// The checkpoint names the rules and the settings it was made with; loading
+// fails for other ones, or on a damaged file.
+bool saveOptimizerCheckpoint(const std::string& path, const GameRules& r, const OptimizerConfig& cfg,
+                             const OptimizerState& st);
+bool loadOptimizerCheckpoint(const std::string& path, const GameRules& r, const OptimizerConfig& cfg,
+                             OptimizerState& st);
+
+// Runs the generations st has not done yet, writing the checkpoint (if any)
+// after each and calling done. False if the checkpoint cannot be written.
+bool optimizePolicy(const GameRules& r, const OptimizerConfig& cfg, WorkStealingPool& pool,
+                    const std::string& checkpoint, OptimizerState& st,
+                    const std::function<void(const OptimizerState&)>& done);
@@ -0,0 +1,417 @@
+#include "Propagation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Everything of a state except its grain.
+struct GroupKey {
+    int population = 0;
+    int landAcres = 0;
+    std::uint64_t starvBits = 0; // starvationPercentSum, bit for bit
+
+    bool operator==(const GroupKey& o) const {
+        return population == o.population && landAcres == o.landAcres && starvBits == o.starvBits;
+    }
+    bool operator<(const GroupKey& o) const {
+        if (population != o.population) return population < o.population;
+        if (landAcres != o.landAcres) return landAcres < o.landAcres;
+        return starvBits < o.starvBits;
+    }
+};
+
+struct GroupKeyHash {
+    std::size_t operator()(const GroupKey& k) const {
+        std::uint64_t h = k.starvBits * 0x9E3779B97F4A7C15ull;
+        h ^= (static_cast<std::uint64_t>(static_cast<std::uint32_t>(k.population)) << 32)
+            | static_cast<std::uint32_t>(k.landAcres);
+        h *= 0xBF58476D1CE4E5B9ull;
+        return static_cast<std::size_t>(h ^ (h >> 31));
+    }
+};
+
+// A range update that has not been written into the cells yet.
+struct GrainRun {
+    std::int64_t lo = 0;
+    std::int64_t end = 0; // hi + step
+    double w = 0.0;
+};
+
+// Probability per grain value; cell i stands for (base + i) / den bushels.
+// While a group is being built it holds difference arrays: w lands on lo,
+// lo + step, ..., hi once the cells are prefix-summed with the same step.
+// Groups hit by a few range updates only keep them as runs, because most
+// groups of a year are narrow and a dense rats range each would not fit in
+// memory; a group switches to dense cells once the runs cost more.
+struct GrainCells {
+    std::int64_t base = 0;
+    std::vector<double> mass;
+    std::vector<GrainRun> runs;
+    std::int64_t runsLo = 0;
+    std::int64_t runsEnd = 0;
+
+    void cover(std::int64_t lo, std::int64_t hi) {
+        if (mass.empty()) {
+            base = lo;
+            mass.assign(static_cast<std::size_t>(hi - lo + 1), 0.0);
+            return;
+        }
+        const std::int64_t size = static_cast<std::int64_t>(mass.size());
+        if (lo < base) {
+            const std::int64_t grow = std::max(base - lo, size / 2);
+            mass.insert(mass.begin(), static_cast<std::size_t>(grow), 0.0);
+            base -= grow;
+        }
+        const std::int64_t end = base + static_cast<std::int64_t>(mass.size());
+        if (hi >= end) {
+            const std::int64_t grow = std::max(hi - end + 1, static_cast<std::int64_t>(mass.size()) / 2);
+            mass.resize(mass.size() + static_cast<std::size_t>(grow), 0.0);
+        }
+    }
+
+    void apply(const GrainRun& run) {
+        cover(run.lo, run.end);
+        mass[static_cast<std::size_t>(run.lo - base)] += run.w;
+        mass[static_cast<std::size_t>(run.end - base)] -= run.w;
+    }
+
+    void densify() {
+        if (runs.empty()) return;
+        cover(runsLo, runsEnd);
+        for (const GrainRun& run : runs) apply(run);
+        runs.clear();
+        runs.shrink_to_fit();
+    }
+
+    void addRun(const GrainRun& run) {
+        if (!mass.empty()) {
+            apply(run);
+            return;
+        }
+        runsLo = runs.empty() ? run.lo : std::min(runsLo, run.lo);
+        runsEnd = runs.empty() ? run.end : std::max(runsEnd, run.end);
+        runs.push_back(run);
+        if (runs.size() * sizeof(GrainRun) > static_cast<std::size_t>(runsEnd - runsLo + 1) * sizeof(double)) {
+            densify();
+        }
+    }
+
+    void addRange(std::int64_t lo, std::int64_t hi, std::int64_t step, double w) {
+        addRun({lo, hi + step, w});
+    }
+
+    // Adds o's updates after this group's own ones.
+    void addCells(const GrainCells& o) {
+        if (!o.mass.empty()) {
+            densify();
+            cover(o.base, o.base + static_cast<std::int64_t>(o.mass.size()) - 1);
+            const std::size_t off = static_cast<std::size_t>(o.base - base);
+            for (std::size_t i = 0; i < o.mass.size(); ++i) mass[off + i] += o.mass[i];
+        }
+        for (const GrainRun& run : o.runs) addRun(run);
+    }
+};
+
+struct Group {
+    GroupKey key;
+    GrainCells cells;
+};
+
+using GroupMap = std::unordered_map<GroupKey, GrainCells, GroupKeyHash>;
+
+struct ChunkOut {
+    GroupMap groups; // difference arrays
+    double endings[4] = {};
+};
+
+// Cells [begin; end) of the concatenated groups of one year.
+struct Chunk {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+// Yield fixed, rats left to the caller, no plague: the caller splits those.
+struct HarvestEvents {
+    int yield;
+    int maxRats = 0;
+
+    int yieldPerAcre(const GameRules&) { return yield; }
+    int ratsAte(int m) {
+        maxRats = m;
+        return 0;
+    }
+    bool plague(const GameRules&) { return false; }
+};
+
+// One distinct reaction of the policy to the land prices of a year.
+struct PriceOption {
+    Decisions d;
+    int price = 0;
+    double weight = 0.0;
+};
+
+std::uint64_t doubleBits(double v) {
+    std::uint64_t b;
+    std::memcpy(&b, &v, sizeof b);
+    return b;
+}
+
+double bitsDouble(std::uint64_t b) {
+    double v;
+    std::memcpy(&v, &b, sizeof v);
+    return v;
+}
+
+bool sameDecisions(const Decisions& a, const Decisions& b) {
+    return a.acresToBuy == b.acresToBuy && a.acresToSell == b.acresToSell &&
+        a.bushelsToFeed == b.bushelsToFeed && a.acresToPlant == b.acresToPlant;
+}
+
+class Propagator {
+public:
+    Propagator(const GameRules& r, const Policy& policy, int den) : r_(r), policy_(policy), den_(den) {}
+
+    void expandCell(int year, const GroupKey& key, std::int64_t units, double mass, ChunkOut& out) const;
+    void expandChunk(int year, const std::vector<Group>& layer, const std::vector<std::size_t>& offsets,
+                     const Chunk& c, ChunkOut& out) const;
+
+private:
+    const GameRules& r_;
+    const Policy& policy_;
+    const int den_;
+};
+
+void Propagator::expandCell(int year, const GroupKey& key, std::int64_t units, double mass,
+                            ChunkOut& out) const {
+    GameState s;
+    s.year = year;
+    s.population = key.population;
+    s.landAcres = key.landAcres;
+    s.grainScale = den_;
+    s.grainUnits = units;
+    s.starvationPercentSum = bitsDouble(key.starvBits);
+    s.yearsCompleted = year - 1;
+    s.awaitingPlayerDecisions = true;
+
+    // Prices only matter through trades, so every price the policy answers
+    // without trading shares one branch.
+    std::vector<PriceOption> options;
+    const double priceWeight = 1.0 / (r_.landPriceMax - r_.landPriceMin + 1);
+    for (int price = r_.landPriceMin; price <= r_.landPriceMax; ++price) {
+        s.landPriceThisYear = price;
+        const Decisions d = clampDecisions(s, policy_.decide(s, r_), r_);
+        const bool trades = d.acresToBuy != 0 || d.acresToSell != 0;
+        auto same = std::find_if(options.begin(), options.end(), [&](const PriceOption& o) {
+            return o.price == 0 && !trades && sameDecisions(o.d, d);
+        });
+        if (same != options.end()) same->weight += priceWeight;
+        else options.push_back({d, trades ? price : 0, priceWeight});
+    }
+
+    const double yieldWeight = 1.0 / (r_.yieldPerAcreMax - r_.yieldPerAcreMin + 1);
+    const double plagueWeight[2] = {1.0 - r_.plagueProbability, r_.plagueProbability};
+
+    for (const PriceOption& o : options) {
+        for (int y = r_.yieldPerAcreMin; y <= r_.yieldPerAcreMax; ++y) {
+            const double w = mass * o.weight * yieldWeight;
+            GameState t = s;
+            t.landPriceThisYear = o.price;
+            HarvestEvents ev{y};
+            const YearOutcome end = resolveYearWith(t, o.d, r_, ev);
+            if (end != YearOutcome::Continued) {
+                out.endings[static_cast<int>(end)] += w;
+                continue;
+            }
+
+            // t has eaten no rats and had no plague. Every rats amount in
+            // [0; maxRats] is equally likely and only changes the grain, plus
+            // the immigrants in runs: one range update per run and plague case.
+            const std::int64_t harvested = t.grainUnits;
+            const int basePopulation = t.population - t.immigrantsLastYear;
+            const double ratsWeight = w / (ev.maxRats + 1);
+            GroupKey next{0, t.landAcres, doubleBits(t.starvationPercentSum)};
+
+            for (int a = 0; a <= ev.maxRats;) {
+                const int imm = immigrantsAfterHarvest(t.starvedLastYear, y, t.grainBushels() - a, r_);
+                int lo = a, hi = ev.maxRats;
+                while (lo < hi) {
+                    const int mid = lo + (hi - lo + 1) / 2;
+                    if (immigrantsAfterHarvest(t.starvedLastYear, y, t.grainBushels() - mid, r_) == imm) lo = mid;
+                    else hi = mid - 1;
+                }
+                const int b = lo;
+
+                for (int hit = 0; hit < 2; ++hit) {
+                    if (plagueWeight[hit] == 0.0) continue;
+                    const int pop = hit ? (basePopulation + imm) / 2 : basePopulation + imm;
+                    if (pop <= 0) {
+                        out.endings[static_cast<int>(YearOutcome::PlagueWipeout)] +=
+                            ratsWeight * (b - a + 1) * plagueWeight[hit];
+                        continue;
+                    }
+                    next.population = pop;
+                    out.groups[next].addRange(harvested - static_cast<std::int64_t>(b) * den_,
+                                              harvested - static_cast<std::int64_t>(a) * den_, den_,
+                                              ratsWeight * plagueWeight[hit]);
+                }
+                a = b + 1;
+            }
+        }
+    }
+}
+
+void Propagator::expandChunk(int year, const std::vector<Group>& layer, const std::vector<std::size_t>& offsets,
+                             const Chunk& c, ChunkOut& out) const {
+    std::size_t g = static_cast<std::size_t>(std::upper_bound(offsets.begin(), offsets.end(), c.begin) -
+                                             offsets.begin()) - 1;
+    for (std::size_t cell = c.begin; cell < c.end; ++cell) {
+        while (cell >= offsets[g + 1]) ++g;
+        const Group& grp = layer[g];
+        const std::size_t i = cell - offsets[g];
+        const double m = grp.cells.mass[i];
+        if (m <= 0.0) continue;
+        expandCell(year, grp.key, grp.cells.base + static_cast<std::int64_t>(i), m, out);
+    }
+}
+
+// Turns the difference arrays into probabilities, drops cells below epsilon
+// and trims the empty ends. Returns the dropped mass.
+double finishGroup(GrainCells& cells, int den, double epsilon) {
+    cells.densify();
+    std::vector<double>& m = cells.mass;
+    for (std::size_t i = static_cast<std::size_t>(den); i < m.size(); ++i) m[i] += m[i - den];
+
+    double pruned = 0.0;
+    for (double& v : m) {
+        if (v <= epsilon) {
+            pruned += v;
+            v = 0.0;
+        }
+    }
+    auto first = std::find_if(m.begin(), m.end(), [](double v) { return v != 0.0; });
+    if (first == m.end()) {
+        m.clear();
+        return pruned;
+    }
+    auto last = std::find_if(m.rbegin(), m.rend(), [](double v) { return v != 0.0; }).base();
+    cells.base += first - m.begin();
+    m.erase(last, m.end());
+    m.erase(m.begin(), first);
+    return pruned;
+}
+
+}
+
+bool propagateOutcomes(const GameRules& r, const Policy& policy, const PropagationConfig& cfg,
+                       WorkStealingPool& pool, OutcomeDistribution& out) {
+    const int den = r.grainScale();
+    if (r.ratsMaxFraction < 0.0 || r.ratsMaxFraction > 1.0 || cfg.chunkCells == 0) return false;
+
+    out = OutcomeDistribution{};
+    Propagator prop(r, policy, den);
+
+    GameState start;
+    initNewGame(start, r);
+    std::vector<Group> layer(1);
+    layer[0].key = {start.population, start.landAcres, doubleBits(start.starvationPercentSum)};
+    layer[0].cells.base = start.grainUnits;
+    layer[0].cells.mass.assign(1, 1.0);
+
+    for (int year = start.year; year <= r.totalYears && !layer.empty(); ++year) {
+        // Fixed-size chunks over all cells of the year, merged in chunk order,
+        // so the result does not depend on the number of threads.
+        std::vector<std::size_t> offsets(layer.size() + 1, 0);
+        for (std::size_t g = 0; g < layer.size(); ++g) offsets[g + 1] = offsets[g] + layer[g].cells.mass.size();
+        const std::size_t cells = offsets.back();
+        std::vector<Chunk> chunks;
+        for (std::size_t b = 0; b < cells; b += cfg.chunkCells) chunks.push_back({b, std::min(cells, b + cfg.chunkCells)});
+
+        // Chunks run in waves of a few per thread; each wave is folded into
+        // the merged map before the next starts, which bounds the memory.
+        GroupMap merged;
+        const std::size_t wave = 2 * static_cast<std::size_t>(pool.size());
+        for (std::size_t first = 0; first < chunks.size(); first += wave) {
+            std::vector<ChunkOut> parts(std::min(wave, chunks.size() - first));
+            pool.run(parts.size(), [&](std::size_t c, unsigned) {
+                prop.expandChunk(year, layer, offsets, chunks[first + c], parts[c]);
+            });
+            for (ChunkOut& part : parts) {
+                for (int e = 0; e < 4; ++e) out.endings[e] += part.endings[e];
+                for (auto& kv : part.groups) {
+                    auto it = merged.find(kv.first);
+                    if (it == merged.end()) merged.emplace(kv.first, std::move(kv.second));
+                    else it->second.addCells(kv.second);
+                }
+            }
+        }
+
+        std::vector<Group> next;
+        next.reserve(merged.size());
+        for (auto& kv : merged) next.push_back({kv.first, std::move(kv.second)});
+        merged.clear();
+        std::sort(next.begin(), next.end(), [](const Group& a, const Group& b) { return a.key < b.key; });
+
+        std::vector<double> pruned(next.size(), 0.0);
+        pool.run(next.size(), [&](std::size_t g, unsigned) {
+            pruned[g] = finishGroup(next[g].cells, den, cfg.epsilon);
+        });
+        for (double p : pruned) out.pruned += p;
+        next.erase(std::remove_if(next.begin(), next.end(), [](const Group& g) { return g.cells.mass.empty(); }),
+                   next.end());
+
+        std::size_t live = 0;
+        for (const Group& g : next) {
+            live += static_cast<std::size_t>(std::count_if(g.cells.mass.begin(), g.cells.mass.end(),
+                                                           [](double v) { return v > 0.0; }));
+        }
+        out.peakStates = std::max(out.peakStates, live);
+        layer = std::move(next);
+    }
+
+    // Whatever is left has finished the reign.
+    double finished = 0.0;
+    for (const Group& g : layer) {
+        GameState s;
+        s.population = g.key.population;
+        s.landAcres = g.key.landAcres;
+        s.starvationPercentSum = bitsDouble(g.key.starvBits);
+        s.yearsCompleted = r.totalYears;
+
+        FinalOutcome f;
+        f.population = s.population;
+        f.landAcres = s.landAcres;
+        f.score = computeFinalScore(s, r);
+        double grain = 0.0;
+        for (std::size_t i = 0; i < g.cells.mass.size(); ++i) {
+            f.probability += g.cells.mass[i];
+            grain += g.cells.mass[i] * static_cast<double>(g.cells.base + static_cast<std::int64_t>(i)) / den;
+        }
+        if (f.probability <= 0.0) continue;
+        f.meanGrain = grain / f.probability;
+
+        finished += f.probability;
+        out.tiers[static_cast<int>(f.score.tier)] += f.probability;
+        out.meanP += f.probability * f.score.avgStarvedPercent;
+        out.meanL += f.probability * f.score.acresPerCitizen;
+        out.meanPopulation += f.probability * f.population;
+        out.meanGrain += grain;
+        out.finals.push_back(f);
+    }
+
+    out.endings[static_cast<int>(YearOutcome::Continued)] = finished;
+    if (finished > 0.0) {
+        for (double& t : out.tiers) t /= finished;
+        out.meanP /= finished;
+        out.meanL /= finished;
+        out.meanPopulation /= finished;
+        out.meanGrain /= finished;
+    }
+    std::stable_sort(out.finals.begin(), out.finals.end(), [](const FinalOutcome& a, const FinalOutcome& b) {
+        return a.probability > b.probability;
+    });
+    return true;
+}
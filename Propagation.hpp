@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Policy.hpp"
+#include "WorkStealingPool.hpp"
+
+// Exact distribution of game outcomes for a deterministic policy.
+//
+// Instead of sampling games, every reachable state is carried forward with its
+// probability. States that differ only in their grain are kept together as one
+// group holding a probability per grain value, so identical states merge for
+// free and the rats draw (a uniform range of grain values) is added as one
+// range update per run of equal immigrant counts instead of one state per
+// bushel. Probability mass below epsilon is dropped and reported as pruned.
+//
+// The policy sees the core resources, the year and the land price; the "last
+// year" report fields are cleared so states can merge. Every built-in policy
+// decides from the core resources only.
+
+struct PropagationConfig {
+    double epsilon = 1e-9;            // states with less probability are dropped
+    std::size_t chunkCells = 1 << 12;  // part of the result's identity, like EvalConfig::chunkGames
+};
+
+// One final (population, land, P) combination with all its grain values summed.
+struct FinalOutcome {
+    int population = 0;
+    int landAcres = 0;
+    FinalScore score;
+    double probability = 0.0;
+    double meanGrain = 0.0;
+};
+
+struct OutcomeDistribution {
+    double endings[4] = {}; // probability of each YearOutcome, Continued = finished the reign
+    double tiers[4] = {};   // indexed by ScoreTier, finished reigns only
+    double pruned = 0.0;    // mass lost to epsilon
+    double meanP = 0.0;     // conditional on finishing the reign
+    double meanL = 0.0;
+    double meanPopulation = 0.0;
+    double meanGrain = 0.0;
+    std::size_t peakStates = 0; // largest number of (state, grain) cells in one year
+    std::vector<FinalOutcome> finals; // sorted by descending probability
+};
+
+// Grain is propagated exactly, in the rules' grain units (GameState.hpp).
+// Returns false when rats could eat more than the whole store (ratsMaxFraction
+// outside [0; 1]) or cfg.chunkCells is 0.
+bool propagateOutcomes(const GameRules& r, const Policy& policy, const PropagationConfig& cfg,
+                       WorkStealingPool& pool, OutcomeDistribution& out);
@@ -0,0 +1,279 @@
+#include "Region.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Every city's policy is asked at this many prices at most.
+constexpr int kMaxQuotes = 16;
+
+}
+
+Region::Region(const GameRules& r, const Policy& policy, const RegionOptions& opt)
+    : r_(r), policy_(policy), opt_(opt) {
+    const std::size_t n = opt.cities;
+    cities_.resize(n);
+    ending_.assign(n, YearOutcome::Continued);
+    rngs_.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        initNewGame(cities_[i], r);
+        rngs_.emplace_back(opt.seed, i);
+    }
+
+    const int span = r.landPriceMax - r.landPriceMin;
+    const int quotes = std::min(span + 1, kMaxQuotes);
+    for (int q = 0; q < quotes; ++q) {
+        prices_.push_back(quotes == 1 ? r.landPriceMin
+                                      : r.landPriceMin + static_cast<int>(std::lround(
+                                            static_cast<double>(span) * q / (quotes - 1))));
+    }
+    lastPrice_ = (r.landPriceMin + r.landPriceMax) / 2;
+
+    orders_.assign(n * prices_.size(), 0);
+    playing_.assign(n, 0);
+    work_.resize(n);
+}
+
+bool Region::playYear(WorkStealingPool& pool, RegionYear& y) {
+    if (year_ > r_.totalYears || cities_.empty()) return false;
+    std::size_t ruled = 0;
+    for (std::size_t i = 0; i < cities_.size(); ++i) {
+        playing_[i] = ending_[i] == YearOutcome::Continued ? 1 : 0;
+        ruled += static_cast<std::size_t>(playing_[i]);
+    }
+    if (ruled == 0) return false;
+
+    y = RegionYear{};
+    y.year = year_;
+    const std::size_t parts = std::min<std::size_t>(pool.size(), cities_.size());
+    partials_.assign(parts, Partial{});
+    for (Partial& p : partials_) {
+        p.bid.assign(prices_.size(), 0);
+        p.offer.assign(prices_.size(), 0);
+    }
+
+    pool.run(parts, [&](std::size_t part, unsigned) { quoteOrders(part, parts); });
+    clearMarket(y);
+    pool.run(parts, [&](std::size_t part, unsigned) { growCities(part, parts); });
+    assignMigrants(y);
+    pool.run(parts, [&](std::size_t part, unsigned) { settleCities(part, parts); });
+
+    y.grainScale = cities_.front().grainScale;
+    for (const Partial& p : partials_) {
+        y.cities += p.cities;
+        y.population += p.population;
+        y.grainUnits += p.grainUnits;
+        y.land += p.land;
+        y.overthrown += p.overthrown;
+        y.depopulated += p.depopulated;
+        y.plagueWipeouts += p.plagueWipeouts;
+    }
+    ++year_;
+    return true;
+}
+
+void Region::slice(std::size_t part, std::size_t parts, std::size_t& begin, std::size_t& end) const {
+    begin = cities_.size() * part / parts;
+    end = cities_.size() * (part + 1) / parts;
+}
+
+// Pass 1: what every city would trade at every quoted price.
+void Region::quoteOrders(std::size_t part, std::size_t parts) {
+    std::size_t begin, end;
+    slice(part, parts, begin, end);
+    Partial& p = partials_[part];
+    const std::size_t quotes = prices_.size();
+
+    for (std::size_t i = begin; i < end; ++i) {
+        if (!playing_[i]) continue;
+        GameState q = cities_[i];
+        for (std::size_t k = 0; k < quotes; ++k) {
+            q.landPriceThisYear = prices_[k];
+            const Decisions d = clampDecisions(q, policy_.decide(q, r_), r_);
+            orders_[i * quotes + k] = d.acresToBuy - d.acresToSell;
+            p.bid[k] += d.acresToBuy;
+            p.offer[k] += d.acresToSell;
+        }
+    }
+}
+
+// The price where bids and offers come closest, ties going to the one nearest
+// last year's. The short side trades all it asked for; the long side gets its
+// orders cut pro rata, and the acres the rounding leaves go one by one to the
+// cut orders in city order, so exactly as much land is bought as is sold.
+void Region::clearMarket(RegionYear& y) {
+    const std::size_t quotes = prices_.size();
+    std::vector<std::int64_t> bid(quotes, 0);
+    std::vector<std::int64_t> offer(quotes, 0);
+    for (const Partial& p : partials_) {
+        for (std::size_t k = 0; k < quotes; ++k) {
+            bid[k] += p.bid[k];
+            offer[k] += p.offer[k];
+        }
+    }
+
+    std::size_t best = 0;
+    for (std::size_t k = 1; k < quotes; ++k) {
+        const std::int64_t gap = std::llabs(bid[k] - offer[k]);
+        const std::int64_t bestGap = std::llabs(bid[best] - offer[best]);
+        if (gap < bestGap ||
+            (gap == bestGap && std::abs(prices_[k] - lastPrice_) < std::abs(prices_[best] - lastPrice_))) {
+            best = k;
+        }
+    }
+    price_ = prices_[best];
+    lastPrice_ = price_;
+
+    const std::int64_t traded = std::min(bid[best], offer[best]);
+    const bool buyersLong = bid[best] > offer[best];
+    const std::int64_t longTotal = std::max(bid[best], offer[best]);
+    y.landPrice = price_;
+    y.acresBid = bid[best];
+    y.acresOffered = offer[best];
+    y.acresTraded = traded;
+
+    std::int64_t left = traded;
+    for (std::size_t i = 0; i < cities_.size(); ++i) {
+        const std::int32_t order = playing_[i] ? orders_[i * quotes + best] : 0;
+        const bool isLong = buyersLong ? order > 0 : order < 0;
+        if (!isLong || longTotal == 0) {
+            work_[i].fill = isLong ? 0 : order;
+            continue;
+        }
+        const std::int64_t share = std::llabs(order) * traded / longTotal;
+        work_[i].fill = static_cast<std::int32_t>(order > 0 ? share : -share);
+        left -= share;
+    }
+    for (std::size_t i = 0; left > 0 && i < cities_.size(); ++i) {
+        const std::int32_t order = playing_[i] ? orders_[i * quotes + best] : 0;
+        if (std::abs(work_[i].fill) < std::abs(order) && (buyersLong ? order > 0 : order < 0)) {
+            work_[i].fill += order > 0 ? 1 : -1;
+            --left;
+        }
+    }
+}
+
+// Pass 2: the year up to starvation, as resolveYearFor plays it, with the
+// filled trade; then the people who leave and the city's pull.
+void Region::growCities(std::size_t part, std::size_t parts) {
+    std::size_t begin, end;
+    slice(part, parts, begin, end);
+    Partial& p = partials_[part];
+    const DynamicRules rules{r_};
+
+    for (std::size_t i = begin; i < end; ++i) {
+        if (!playing_[i]) continue;
+        GameState& s = cities_[i];
+        CityYear& w = work_[i];
+        s.landPriceThisYear = price_;
+        s.awaitingPlayerDecisions = true;
+
+        Decisions d = policy_.decide(s, r_);
+        d.acresToBuy = std::max(0, w.fill);
+        d.acresToSell = std::max(0, -w.fill);
+        d = clampDecisions(s, d, r_);
+
+        RngYearEvents ev{rngs_[i], s.year};
+        tradeLand(s, d);
+        feedPeople(s, d);
+        plantFields(s, d, rules);
+        s.awaitingPlayerDecisions = false;
+        w.yieldPerAcre = ev.yieldPerAcre(r_);
+        w.harvestTotal = harvestFields(s, d, w.yieldPerAcre);
+        w.ratsAte = ratsEat(s, rules, ev);
+        w.starved = starvedPeople(s, d, rules, w.starvedPercent);
+
+        if (overthrownAfter(w.starvedPercent, rules)) {
+            s.starvedLastYear = w.starved;
+            s.immigrantsLastYear = 0;
+            s.plagueLastYear = false;
+            s.yieldPerAcreLastYear = w.yieldPerAcre;
+            s.harvestTotalLastYear = w.harvestTotal;
+            s.ratsAteLastYear = w.ratsAte;
+            ending_[i] = YearOutcome::Overthrown;
+            p.overthrown += 1;
+            continue;
+        }
+        s.population -= w.starved;
+        if (s.population <= 0) {
+            ending_[i] = YearOutcome::Depopulated;
+            p.depopulated += 1;
+            continue;
+        }
+
+        w.emigrants = static_cast<int>(s.population * opt_.migrationShare);
+        w.pull = std::max(0, immigrantsBeforeLimits(w.starved, w.yieldPerAcre, s.grainBushels()));
+        w.arrivals = 0;
+        p.emigrants += w.emigrants;
+        p.pull += w.pull;
+    }
+}
+
+// Splits the pool by pull, whole people first and the rest one by one in city
+// order. Without any pull nobody leaves.
+void Region::assignMigrants(RegionYear& y) {
+    std::int64_t migrants = 0;
+    std::int64_t pull = 0;
+    for (const Partial& p : partials_) {
+        migrants += p.emigrants;
+        pull += p.pull;
+    }
+    if (pull == 0) {
+        for (CityYear& w : work_) w.emigrants = 0;
+        return;
+    }
+    y.migrants = migrants;
+
+    std::int64_t left = migrants;
+    for (std::size_t i = 0; i < cities_.size(); ++i) {
+        if (!playing_[i] || ending_[i] != YearOutcome::Continued) continue;
+        const std::int64_t share = migrants * work_[i].pull / pull;
+        work_[i].arrivals = static_cast<int>(share);
+        left -= share;
+    }
+    for (std::size_t i = 0; left > 0 && i < cities_.size(); ++i) {
+        if (!playing_[i] || ending_[i] != YearOutcome::Continued || work_[i].pull == 0) continue;
+        work_[i].arrivals += 1;
+        --left;
+    }
+}
+
+// Pass 3: the moves, the plague and the year's report.
+void Region::settleCities(std::size_t part, std::size_t parts) {
+    std::size_t begin, end;
+    slice(part, parts, begin, end);
+    Partial& p = partials_[part];
+    const DynamicRules rules{r_};
+
+    for (std::size_t i = begin; i < end; ++i) {
+        if (!playing_[i] || ending_[i] != YearOutcome::Continued) continue;
+        GameState& s = cities_[i];
+        const CityYear& w = work_[i];
+        s.population += w.arrivals - w.emigrants;
+
+        RngYearEvents ev{rngs_[i], s.year};
+        const bool plague = plagueStrikes(s, rules, ev);
+        if (plague && s.population <= 0) {
+            ending_[i] = YearOutcome::PlagueWipeout;
+            p.plagueWipeouts += 1;
+            continue;
+        }
+
+        s.starvedLastYear = w.starved;
+        s.immigrantsLastYear = w.arrivals;
+        s.plagueLastYear = plague;
+        s.yieldPerAcreLastYear = w.yieldPerAcre;
+        s.harvestTotalLastYear = w.harvestTotal;
+        s.ratsAteLastYear = w.ratsAte;
+        s.yearsCompleted += 1;
+        s.starvationPercentSum += w.starvedPercent;
+        s.year += 1;
+
+        p.cities += 1;
+        p.population += s.population;
+        p.grainUnits += s.grainUnits;
+        p.land += s.landAcres;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "Policy.hpp"
+#include "WorkStealingPool.hpp"
+
+// Many cities under the same rules, played side by side as one region.
+//
+// Every city runs the year phases of resolveYearFor (GameEngine.hpp) with its
+// own random draws, but two things are shared. The land price is no longer
+// drawn: each city's policy is asked what it would trade at a set of quoted
+// prices, and the price where the region's bids and offers come closest
+// clears the market. Land only changes hands between cities; the long side of
+// the market is filled pro rata. And immigration becomes migration: every city
+// sends a share of its people to a common pool, which is split in proportion
+// to the local immigration formula (the city's pull), so people move from
+// city to city instead of appearing.
+//
+// A year runs in three parallel passes over contiguous slices of the cities,
+// one pool task per slice. Between them the market is cleared and the
+// migrants are assigned on one thread. Region totals are 64-bit.
+
+struct RegionOptions {
+    std::size_t cities = 1000;
+    std::uint64_t seed = 1;
+    double migrationShare = 0.05; // of every city's people join the pool each year
+};
+
+// What one year did to the region.
+struct RegionYear {
+    int year = 0;
+    int landPrice = 0;
+    std::int64_t acresBid = 0; // at the clearing price
+    std::int64_t acresOffered = 0;
+    std::int64_t acresTraded = 0;
+    std::int64_t migrants = 0;
+    // After the year, over the cities still ruled.
+    std::size_t cities = 0;
+    std::int64_t population = 0;
+    std::int64_t grainUnits = 0; // in the cities' grain units (GameState.hpp)
+    int grainScale = 1;
+    std::int64_t land = 0;
+    // Cities lost this year.
+    std::size_t overthrown = 0;
+    std::size_t depopulated = 0;
+    std::size_t plagueWipeouts = 0;
+};
+
+class Region {
+public:
+    // r and policy must outlive the region.
+    Region(const GameRules& r, const Policy& policy, const RegionOptions& opt);
+
+    // Plays the next year in every city still ruled. False, without playing, when
+    // all years are played or no city is left.
+    bool playYear(WorkStealingPool& pool, RegionYear& y);
+
+    std::size_t size() const { return cities_.size(); }
+    const GameState& city(std::size_t i) const { return cities_[i]; }
+    // Continued for a city that is still ruled or played all its years.
+    YearOutcome ending(std::size_t i) const { return ending_[i]; }
+
+private:
+    // One slice's share of a pass.
+    struct Partial {
+        std::vector<std::int64_t> bid; // per quoted price
+        std::vector<std::int64_t> offer;
+        std::int64_t emigrants = 0;
+        std::int64_t pull = 0;
+        std::size_t cities = 0;
+        std::int64_t population = 0;
+        std::int64_t grainUnits = 0;
+        std::int64_t land = 0;
+        std::size_t overthrown = 0;
+        std::size_t depopulated = 0;
+        std::size_t plagueWipeouts = 0;
+    };
+
+    // A city's year between the passes.
+    struct CityYear {
+        std::int32_t fill = 0; // acres bought (> 0) or sold (< 0) at the clearing price
+        int yieldPerAcre = 0;
+        int harvestTotal = 0;
+        int ratsAte = 0;
+        int starved = 0;
+        double starvedPercent = 0.0;
+        int emigrants = 0;
+        int arrivals = 0;
+        std::int64_t pull = 0;
+    };
+
+    void slice(std::size_t part, std::size_t parts, std::size_t& begin, std::size_t& end) const;
+    void quoteOrders(std::size_t part, std::size_t parts);
+    void clearMarket(RegionYear& y);
+    void growCities(std::size_t part, std::size_t parts);
+    void assignMigrants(RegionYear& y);
+    void settleCities(std::size_t part, std::size_t parts);
+
+    const GameRules& r_;
+    const Policy& policy_;
+    RegionOptions opt_;
+
+    std::vector<GameState> cities_;
+    std::vector<Rng> rngs_;
+    std::vector<YearOutcome> ending_;
+    int year_ = 1;
+    int lastPrice_ = 0;
+
+    std::vector<int> prices_;          // quoted every year
+    std::vector<std::int32_t> orders_; // city * quotes + quote: acres bought (> 0) or sold (< 0)
+    std::vector<char> playing_;        // ruled when the year started
+    std::vector<CityYear> work_;
+    std::vector<Partial> partials_;
+    int price_ = 0;                    // this year's clearing price
+};
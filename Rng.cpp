@@ -0,0 +1,232 @@
+#include "Rng.hpp"
+
+#include <random>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::uint32_t kPhiloxM0 = 0xD2511F53u;
+constexpr std::uint32_t kPhiloxM1 = 0xCD9E8D57u;
+constexpr std::uint32_t kPhiloxW0 = 0x9E3779B9u;
+constexpr std::uint32_t kPhiloxW1 = 0xBB67AE85u;
+constexpr int kPhiloxRounds = 10;
+
+inline void mulhilo(std::uint32_t a, std::uint32_t b, std::uint32_t& hi, std::uint32_t& lo) {
+    std::uint64_t p = static_cast<std::uint64_t>(a) * b;
+    hi = static_cast<std::uint32_t>(p >> 32);
+    lo = static_cast<std::uint32_t>(p);
+}
+
+PhiloxCounter counterFor(std::uint64_t gameId, int year, RngEvent ev) {
+    return {0u,
+            (static_cast<std::uint32_t>(year) << 8) | static_cast<std::uint32_t>(ev),
+            static_cast<std::uint32_t>(gameId),
+            static_cast<std::uint32_t>(gameId >> 32)};
+}
+
+PhiloxKey keyFor(std::uint64_t seed) {
+    return {static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)};
+}
+
+// Philox over structure-of-arrays counters: block i is
+// (c0[i], c1[i], c2[i], c3[i]) under key (k0[i], k1[i]); results replace the counters.
+void philoxBlocks(std::uint32_t* c0, std::uint32_t* c1, std::uint32_t* c2, std::uint32_t* c3,
+                  const std::uint32_t* k0, const std::uint32_t* k1, std::size_t n) {
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i m0 = _mm256_set1_epi32(static_cast<int>(kPhiloxM0));
+    const __m256i m1 = _mm256_set1_epi32(static_cast<int>(kPhiloxM1));
+    const __m256i w0 = _mm256_set1_epi32(static_cast<int>(kPhiloxW0));
+    const __m256i w1 = _mm256_set1_epi32(static_cast<int>(kPhiloxW1));
+    auto mulhilo8 = [](__m256i x, __m256i m, __m256i& hi, __m256i& lo) {
+        __m256i even = _mm256_mul_epu32(x, m);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+        lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    };
+    auto load = [](const std::uint32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); };
+    auto store = [](std::uint32_t* p, __m256i v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); };
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i x0 = load(c0 + i), x1 = load(c1 + i), x2 = load(c2 + i), x3 = load(c3 + i);
+        __m256i ka = load(k0 + i), kb = load(k1 + i);
+        for (int round = 0; round < kPhiloxRounds; ++round) {
+            if (round > 0) {
+                ka = _mm256_add_epi32(ka, w0);
+                kb = _mm256_add_epi32(kb, w1);
+            }
+            __m256i hi0, lo0, hi1, lo1;
+            mulhilo8(x0, m0, hi0, lo0);
+            mulhilo8(x2, m1, hi1, lo1);
+            x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), ka);
+            x1 = lo1;
+            x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), kb);
+            x3 = lo0;
+        }
+        store(c0 + i, x0);
+        store(c1 + i, x1);
+        store(c2 + i, x2);
+        store(c3 + i, x3);
+    }
+#endif
+    for (; i < n; ++i) {
+        PhiloxCounter out = philox4x32({c0[i], c1[i], c2[i], c3[i]}, {k0[i], k1[i]});
+        c0[i] = out[0];
+        c1[i] = out[1];
+        c2[i] = out[2];
+        c3[i] = out[3];
+    }
+}
+
+// Lemire's multiply-shift; returns false when the word falls in the rejected
+// zone and the caller has to continue with more words.
+inline bool boundedFromWord(std::uint32_t word, std::uint32_t range, std::uint32_t& value) {
+    std::uint64_t m = static_cast<std::uint64_t>(word) * range;
+    std::uint32_t low = static_cast<std::uint32_t>(m);
+    if (low < range) {
+        std::uint32_t threshold = (0u - range) % range;
+        if (low < threshold) return false;
+    }
+    value = static_cast<std::uint32_t>(m >> 32);
+    return true;
+}
+
+inline int shareFromWord(std::uint32_t word, int hi) {
+    const std::uint64_t range = static_cast<std::uint64_t>(static_cast<std::uint32_t>(hi)) + 1u;
+    return static_cast<int>((static_cast<std::uint64_t>(word) * range) >> 32);
+}
+
+inline bool chanceFromWords(std::uint32_t a, std::uint32_t b, double probability) {
+    return unitFraction((static_cast<std::uint64_t>(a) << 32) | b) < probability;
+}
+
+// First block of every lane's stream, in SoA form.
+struct LaneBlocks {
+    std::vector<std::uint32_t> c0, c1, c2, c3, k0, k1;
+
+    LaneBlocks(const Rng* rngs, const std::int32_t* years, RngEvent ev, std::size_t n)
+        : c0(n), c1(n), c2(n), c3(n), k0(n), k1(n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            PhiloxCounter c = counterFor(rngs[i].gameId(), years[i], ev);
+            PhiloxKey k = keyFor(rngs[i].seed());
+            c0[i] = c[0]; c1[i] = c[1]; c2[i] = c[2]; c3[i] = c[3];
+            k0[i] = k[0]; k1[i] = k[1];
+        }
+        philoxBlocks(c0.data(), c1.data(), c2.data(), c3.data(), k0.data(), k1.data(), n);
+    }
+};
+
+}
+
+PhiloxCounter philox4x32(PhiloxCounter ctr, PhiloxKey key) {
+    for (int round = 0; round < kPhiloxRounds; ++round) {
+        if (round > 0) {
+            key[0] += kPhiloxW0;
+            key[1] += kPhiloxW1;
+        }
+        std::uint32_t hi0, lo0, hi1, lo1;
+        mulhilo(kPhiloxM0, ctr[0], hi0, lo0);
+        mulhilo(kPhiloxM1, ctr[2], hi1, lo1);
+        ctr = {hi1 ^ ctr[1] ^ key[0], lo1, hi0 ^ ctr[3] ^ key[1], lo0};
+    }
+    return ctr;
+}
+
+std::uint32_t RngStream::nextU32() {
+    if (used_ == 4) {
+        block_ = philox4x32(ctr_, key_);
+        ctr_[0] += 1;
+        used_ = 0;
+    }
+    return block_[used_++];
+}
+
+int RngStream::intInRange(int lo, int hi) {
+    const std::uint32_t range = static_cast<std::uint32_t>(hi) - static_cast<std::uint32_t>(lo) + 1u;
+    if (range == 0) return static_cast<int>(nextU32()); // the full 32-bit range
+    std::uint32_t v;
+    while (!boundedFromWord(nextU32(), range, v)) {}
+    return static_cast<int>(static_cast<std::uint32_t>(lo) + v);
+}
+
+int RngStream::share(int hi) {
+    return shareFromWord(nextU32(), hi);
+}
+
+bool RngStream::chance(double probability) {
+    std::uint32_t a = nextU32();
+    std::uint32_t b = nextU32();
+    return chanceFromWords(a, b, probability);
+}
+
+void RngStream::fill(std::uint32_t* out, std::size_t n) {
+    while (n > 0 && used_ < 4) {
+        *out++ = block_[used_++];
+        --n;
+    }
+    const std::size_t blocks = n / 4;
+    if (blocks > 0) {
+        std::vector<std::uint32_t> c0(blocks), c1(blocks, ctr_[1]), c2(blocks, ctr_[2]), c3(blocks, ctr_[3]);
+        std::vector<std::uint32_t> k0(blocks, key_[0]), k1(blocks, key_[1]);
+        for (std::size_t b = 0; b < blocks; ++b) c0[b] = ctr_[0] + static_cast<std::uint32_t>(b);
+        philoxBlocks(c0.data(), c1.data(), c2.data(), c3.data(), k0.data(), k1.data(), blocks);
+        for (std::size_t b = 0; b < blocks; ++b) {
+            out[0] = c0[b];
+            out[1] = c1[b];
+            out[2] = c2[b];
+            out[3] = c3[b];
+            out += 4;
+        }
+        ctr_[0] += static_cast<std::uint32_t>(blocks);
+        n -= blocks * 4;
+    }
+    while (n-- > 0) *out++ = nextU32();
+}
+
+Rng::Rng() {
+    std::random_device rd;
+    seed_ = (static_cast<std::uint64_t>(rd()) << 32) | rd();
+    gameId_ = 0;
+}
+
+RngStream Rng::stream(int year, RngEvent ev) const {
+    return RngStream(keyFor(seed_), counterFor(gameId_, year, ev));
+}
+
+void intInRangeLanes(const Rng* rngs, const std::int32_t* years, RngEvent ev, int lo,
+                     const std::int32_t* his, const std::int32_t* active, std::int32_t* out,
+                     std::size_t n) {
+    LaneBlocks blocks(rngs, years, ev, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!active[i]) continue;
+        const std::uint32_t range = static_cast<std::uint32_t>(his[i]) - static_cast<std::uint32_t>(lo) + 1u;
+        std::uint32_t v;
+        if (range != 0 && boundedFromWord(blocks.c0[i], range, v)) {
+            out[i] = static_cast<std::int32_t>(static_cast<std::uint32_t>(lo) + v);
+        } else {
+            // Rare: rejected first word. Replay the lane's stream from the start.
+            out[i] = rngs[i].intInRange(years[i], ev, lo, his[i]);
+        }
+    }
+}
+
+void shareLanes(const Rng* rngs, const std::int32_t* years, RngEvent ev, const std::int32_t* his,
+                const std::int32_t* active, std::int32_t* out, std::size_t n) {
+    LaneBlocks blocks(rngs, years, ev, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (active[i]) out[i] = shareFromWord(blocks.c0[i], his[i]);
+    }
+}
+
+void chanceLanes(const Rng* rngs, const std::int32_t* years, RngEvent ev, double probability,
+                 const std::int32_t* active, std::int32_t* out, std::size_t n) {
+    LaneBlocks blocks(rngs, years, ev, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!active[i]) continue;
+        out[i] = chanceFromWords(blocks.c0[i], blocks.c1[i], probability) ? -1 : 0;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10). Every draw is a pure function
+// of (seed, game id, year, event, draw index), so a simulated game produces the
+// same results no matter which thread or batch lane plays it, and the order in
+// which different events are drawn does not matter.
+
+enum class RngEvent : std::uint32_t {
+    LandPrice,
+    Yield,
+    Rats,
+    Plague,
+    Policy, // free for policies and tools that need their own randomness
+};
+
+// A uniform fraction in [0; 1) from the top 53 bits of a 64-bit word. Raw
+// words of a standard engine are the same on every standard library; its
+// distributions are not, so tools that need portable draws map them with this.
+inline double unitFraction(std::uint64_t word) {
+    return static_cast<double>(word >> 11) * (1.0 / 9007199254740992.0);
+}
+
+using PhiloxCounter = std::array<std::uint32_t, 4>;
+using PhiloxKey = std::array<std::uint32_t, 2>;
+
+PhiloxCounter philox4x32(PhiloxCounter ctr, PhiloxKey key);
+
+// The draws of one event in one year of one game.
+class RngStream {
+public:
+    RngStream(PhiloxKey key, PhiloxCounter base) : key_(key), ctr_(base) {}
+
+    std::uint32_t nextU32();
+    // Uniform integer in [lo; hi], unbiased (multiply-shift with rejection).
+    int intInRange(int lo, int hi);
+    // floor(u * (hi + 1)) for one uniform fraction u in [0; 1) of 32 bits: a draw
+    // in [0; hi] that only scales with hi, so games that differ in hi still get
+    // the same share (bias below (hi + 1) / 2^32). hi >= 0.
+    int share(int hi);
+    // True with the given probability, resolved with 53 random bits.
+    bool chance(double probability);
+    // Bulk fill with the next n words of the stream (vectorized where possible).
+    void fill(std::uint32_t* out, std::size_t n);
+
+private:
+    PhiloxKey key_;
+    PhiloxCounter ctr_;     // ctr_[0] is the block index within the stream
+    PhiloxCounter block_{};
+    unsigned used_ = 4;     // words of block_ already handed out
+};
+
+class Rng {
+public:
+    Rng(); // seeded from std::random_device, for interactive play
+    explicit Rng(std::uint64_t seed, std::uint64_t gameId = 0) : seed_(seed), gameId_(gameId) {}
+
+    std::uint64_t seed() const { return seed_; }
+    std::uint64_t gameId() const { return gameId_; }
+
+    RngStream stream(int year, RngEvent ev) const;
+
+    int intInRange(int year, RngEvent ev, int lo, int hi) const { return stream(year, ev).intInRange(lo, hi); }
+    int share(int year, RngEvent ev, int hi) const { return stream(year, ev).share(hi); }
+    bool chance(int year, RngEvent ev, double probability) const { return stream(year, ev).chance(probability); }
+
+private:
+    std::uint64_t seed_;
+    std::uint64_t gameId_;
+};
+
+// Changes whenever a game's draws change for the same (seed, game id), so that
+// stored results of older draws are not taken for current ones.
+// 2: the rats draw is a share of the maximum instead of intInRange.
+constexpr std::uint32_t kRngDrawScheme = 2;
+
+// Lane-parallel draws for batch simulation: out[i] gets exactly what
+// rngs[i].intInRange(years[i], ev, lo, his[i]) / share(...) / chance(...)
+// would return.
+// chanceLanes stores -1 (all bits set) for true and 0 for false, ready for use
+// as a SIMD mask. Lanes with active[i] == 0 are left untouched.
+void intInRangeLanes(const Rng* rngs, const std::int32_t* years, RngEvent ev, int lo,
+                     const std::int32_t* his, const std::int32_t* active, std::int32_t* out,
+                     std::size_t n);
+void shareLanes(const Rng* rngs, const std::int32_t* years, RngEvent ev, const std::int32_t* his,
+                const std::int32_t* active, std::int32_t* out, std::size_t n);
+void chanceLanes(const Rng* rngs, const std::int32_t* years, RngEvent ev, double probability,
+                 const std::int32_t* active, std::int32_t* out, std::size_t n);
@@ -0,0 +1,14 @@
+#include "RulesPresets.hpp"
+
+RulesPreset findRulesPreset(const GameRules& r) {
+    if (r.sameValues(kStockRules)) return RulesPreset::Stock;
+    return RulesPreset::None;
+}
+
+const char* rulesPresetName(RulesPreset p) {
+    switch (p) {
+    case RulesPreset::None: return "none";
+    case RulesPreset::Stock: return "stock";
+    }
+    return "?";
+}
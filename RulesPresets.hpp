@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GameRules.hpp"
+
+// Rule sets compiled into the binary. Code templated on a rules source reads a
+// preset's values as constants, so the compiler folds them into the year
+// arithmetic (the loss threshold, the seed cost, the division by the ration).
+// Loaded rules that equal a preset run that instantiation; anything else runs
+// the generic one with the values read at run time.
+
+// game_rules.txt as shipped.
+constexpr GameRules stockRules() {
+    GameRules r;
+    r.initialPopulation = 100;
+    r.initialGrainBushels = 2800.0;
+    r.initialLandAcres = 1000;
+    r.landPriceMin = 17;
+    r.landPriceMax = 26;
+    r.bushelsPerPersonPerYear = 20;
+    r.acresPerPersonMax = 10;
+    r.seedsBushelsPerAcre = 0.5;
+    r.yieldPerAcreMin = 1;
+    r.yieldPerAcreMax = 6;
+    r.ratsMaxFraction = 0.07;
+    r.plagueProbability = 0.15;
+    r.immigrantsMin = 0;
+    r.immigrantsMax = 50;
+    r.starvationLossFraction = 0.45;
+    r.totalYears = 10;
+    r.pBadLower = 33;
+    r.lBadUpper = 7;
+    r.pOkLower = 10;
+    r.lOkUpper = 9;
+    r.pGoodLower = 3;
+    r.lGoodUpper = 10;
+    return r;
+}
+
+inline constexpr GameRules kStockRules = stockRules();
+
+// Rules sources: calling one gives the rule values.
+struct DynamicRules {
+    const GameRules& values;
+    const GameRules& operator()() const { return values; }
+};
+
+template <const GameRules& R>
+struct FixedRules {
+    constexpr const GameRules& operator()() const { return R; }
+};
+
+// Every rules source the templated engine code is instantiated for.
+#define HAMMURABI_FOR_EACH_RULES_SOURCE(X) \
+    X(DynamicRules)                        \
+    X(FixedRules<kStockRules>)
+
+enum class RulesPreset {
+    None,
+    Stock,
+};
+
+// The preset with exactly the values of r, or None.
+RulesPreset findRulesPreset(const GameRules& r);
+const char* rulesPresetName(RulesPreset p);
+
+// Calls body with the rules source for r: the matching preset's FixedRules if
+// presets are allowed, DynamicRules otherwise. Dispatch once per bulk job, not
+// per game: matching compares every value.
+template <class Body>
+decltype(auto) withRules(const GameRules& r, bool usePresets, Body&& body) {
+    if (usePresets && findRulesPreset(r) == RulesPreset::Stock) return body(FixedRules<kStockRules>{});
+    return body(DynamicRules{r});
+}
@@ -1,19 +1,107 @@
 #include "SaveManager.hpp"
 
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
-#include <iomanip>
-#include <sstream>
 
-#include "GameState.hpp"
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+#include "MappedFile.hpp"
 
-SaveManager::SaveManager(std::string path) : filePath(std::move(path)) {}
+namespace {
 
-static void writeKV(std::ofstream& out, const std::string& k, const std::string& v) {
-    out << k << '=' << v << '\n';
+// Layout (see BinaryFormat.hpp):
+//   magic[8] version:u32 payloadSize:u32 payload crc32:u32
+// The CRC covers everything before it.
+constexpr char kSaveMagic[8] = {'H', 'M', 'S', 'A', 'V', 'E', 'B', '1'};
+constexpr std::uint32_t kSaveVersion = 2; // 2: grain as integer units and their scale
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kPayloadSize = kGameStateRecordSize;
+constexpr std::size_t kSaveSize = kHeaderSize + kPayloadSize + 4;
+
+// Journal: magic[8] version:u32 snapshotSize:u32 seed:u64 gameId:u64
+// rulesHash:u64 crc32:u32, then the snapshot payload (if any; the CRC covers
+// it too), then the records.
+constexpr char kJournalMagic[8] = {'H', 'M', 'J', 'R', 'N', 'L', 'B', '1'};
+constexpr std::uint32_t kJournalVersion = 2;
+constexpr std::size_t kJournalHeaderSize = 8 + 4 + 4 + 8 + 8 + 8 + 4;
+constexpr std::size_t kMaxRecordSize = 4 * 5 + 1;
+
+// Resuming a journal with more records than this folds them into the snapshot.
+constexpr std::size_t kCompactAfterYears = 64;
+
+void putState(unsigned char* buf, std::size_t& off, const GameState& state) {
+    putRaw<std::int32_t>(buf, off, state.year);
+    putRaw<std::int32_t>(buf, off, state.population);
+    putRaw<std::int32_t>(buf, off, state.landAcres);
+    putRaw<std::int32_t>(buf, off, state.starvedLastYear);
+    putRaw<std::int32_t>(buf, off, state.immigrantsLastYear);
+    putRaw<std::int32_t>(buf, off, state.yieldPerAcreLastYear);
+    putRaw<std::int32_t>(buf, off, state.harvestTotalLastYear);
+    putRaw<std::int32_t>(buf, off, state.ratsAteLastYear);
+    putRaw<std::int32_t>(buf, off, state.landPriceThisYear);
+    putRaw<std::int32_t>(buf, off, state.yearsCompleted);
+    putRaw<std::int64_t>(buf, off, state.grainUnits);
+    putRaw<double>(buf, off, state.starvationPercentSum);
+    putRaw<std::uint8_t>(buf, off, state.plagueLastYear ? 1 : 0);
+    putRaw<std::uint8_t>(buf, off, state.awaitingPlayerDecisions ? 1 : 0);
+    putRaw<std::uint16_t>(buf, off, static_cast<std::uint16_t>(state.grainScale));
+    static_assert(10 * 4 + 2 * 8 + 4 == kGameStateRecordSize, "update kGameStateRecordSize");
+}
+
+GameState getState(const unsigned char* buf, std::size_t& off) {
+    GameState s;
+    s.year = getRaw<std::int32_t>(buf, off);
+    s.population = getRaw<std::int32_t>(buf, off);
+    s.landAcres = getRaw<std::int32_t>(buf, off);
+    s.starvedLastYear = getRaw<std::int32_t>(buf, off);
+    s.immigrantsLastYear = getRaw<std::int32_t>(buf, off);
+    s.yieldPerAcreLastYear = getRaw<std::int32_t>(buf, off);
+    s.harvestTotalLastYear = getRaw<std::int32_t>(buf, off);
+    s.ratsAteLastYear = getRaw<std::int32_t>(buf, off);
+    s.landPriceThisYear = getRaw<std::int32_t>(buf, off);
+    s.yearsCompleted = getRaw<std::int32_t>(buf, off);
+    s.grainUnits = getRaw<std::int64_t>(buf, off);
+    s.starvationPercentSum = getRaw<double>(buf, off);
+    s.plagueLastYear = getRaw<std::uint8_t>(buf, off) != 0;
+    s.awaitingPlayerDecisions = getRaw<std::uint8_t>(buf, off) != 0;
+    s.grainScale = getRaw<std::uint16_t>(buf, off);
+    return s;
+}
+
+void putVarint(unsigned char* buf, std::size_t& off, std::uint32_t v) {
+    while (v >= 0x80) {
+        buf[off++] = static_cast<unsigned char>(v | 0x80);
+        v >>= 7;
+    }
+    buf[off++] = static_cast<unsigned char>(v);
 }
 
-static std::string trimCopy(const std::string& s) {
+// Fails on truncation or on values that do not fit an int.
+bool getVarint(const unsigned char* p, std::size_t size, std::size_t& off, int& out) {
+    std::uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (off >= size) return false;
+        const unsigned char b = p[off++];
+        v |= static_cast<std::uint32_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            if (v > 0x7FFFFFFFu) return false;
+            out = static_cast<int>(v);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fileExists(const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::fclose(f);
+    return true;
+}
+
+std::string trimCopy(const std::string& s) {
     size_t b = 0;
     while (b < s.size() && (s[b] == ' ' || s[b] == '\t' || s[b] == '\r')) ++b;
     size_t e = s.size();
@@ -21,88 +109,224 @@ static std::string trimCopy(const std::string& s) {
     return s.substr(b, e - b);
 }
 
-bool SaveManager::save(const GameState& state) const {
-    std::ofstream out(filePath, std::ios::trunc);
-    if (!out) return false;
+}
 
-    out << std::setprecision(17);
+void encodeGameState(const GameState& s, unsigned char* out) {
+    std::size_t off = 0;
+    putState(out, off, s);
+}
 
-    writeKV(out, "year", std::to_string(state.year));
-    writeKV(out, "population", std::to_string(state.population));
-    writeKV(out, "grain", std::to_string(state.grainBushels));
-    writeKV(out, "land", std::to_string(state.landAcres));
+GameState decodeGameState(const unsigned char* in) {
+    std::size_t off = 0;
+    return getState(in, off);
+}
 
-    writeKV(out, "starvedLastYear", std::to_string(state.starvedLastYear));
-    writeKV(out, "immigrantsLastYear", std::to_string(state.immigrantsLastYear));
-    writeKV(out, "plagueLastYear", state.plagueLastYear ? "1" : "0");
-    writeKV(out, "yieldPerAcreLastYear", std::to_string(state.yieldPerAcreLastYear));
-    writeKV(out, "harvestTotalLastYear", std::to_string(state.harvestTotalLastYear));
-    writeKV(out, "ratsAteLastYear", std::to_string(state.ratsAteLastYear));
+SaveManager::SaveManager(std::string path, std::string textPath, std::string journalPath)
+    : filePath(std::move(path)), textFilePath(std::move(textPath)), journalFilePath(std::move(journalPath)) {}
 
-    writeKV(out, "landPriceThisYear", std::to_string(state.landPriceThisYear));
-    writeKV(out, "awaitingPlayerDecisions", state.awaitingPlayerDecisions ? "1" : "0");
+bool SaveManager::save(const GameState& state) const {
+    unsigned char buf[kSaveSize] = {};
+    std::size_t off = 0;
+    std::memcpy(buf, kSaveMagic, sizeof kSaveMagic);
+    off += sizeof kSaveMagic;
+    putRaw<std::uint32_t>(buf, off, kSaveVersion);
+    putRaw<std::uint32_t>(buf, off, static_cast<std::uint32_t>(kPayloadSize));
 
-    writeKV(out, "yearsCompleted", std::to_string(state.yearsCompleted));
-    writeKV(out, "starvationPercentSum", std::to_string(state.starvationPercentSum));
+    putState(buf, off, state);
 
-    return true;
+    putRaw<std::uint32_t>(buf, off, crc32(buf, off));
+    return replaceFileAtomically(filePath, buf, off);
 }
 
-GameState SaveManager::load() const {
-    GameState state;
+SaveStatus SaveManager::load(GameState& state) const {
+    std::FILE* f = std::fopen(filePath.c_str(), "rb");
+    if (!f) return importText(textFilePath, state);
 
-    std::ifstream in(filePath);
-    if (!in) {
-        state.year = -1;
-        return state;
-    }
+    // One read; a longer file is caught by reading one byte more than a save.
+    unsigned char buf[kSaveSize + 1];
+    const std::size_t n = std::fread(buf, 1, sizeof buf, f);
+    std::fclose(f);
+
+    if (n != kSaveSize || std::memcmp(buf, kSaveMagic, sizeof kSaveMagic) != 0) return SaveStatus::Corrupted;
+    std::size_t off = sizeof kSaveMagic;
+    if (getRaw<std::uint32_t>(buf, off) != kSaveVersion) return SaveStatus::Corrupted;
+    if (getRaw<std::uint32_t>(buf, off) != kPayloadSize) return SaveStatus::Corrupted;
+    std::size_t crcOff = kSaveSize - 4;
+    if (getRaw<std::uint32_t>(buf, crcOff) != crc32(buf, kSaveSize - 4)) return SaveStatus::Corrupted;
+
+    const GameState s = getState(buf, off);
+    if (!IsValidSave(s)) return SaveStatus::Corrupted;
+    state = s;
+    return SaveStatus::Loaded;
+}
+
+SaveStatus SaveManager::importText(const std::string& path, GameState& state) {
+    std::ifstream in(path);
+    if (!in) return SaveStatus::Missing;
 
+    GameState s;
+    bool grainOk = true;
     try {
         std::string line;
         while (std::getline(in, line)) {
-            if (line.empty()) continue;
-            std::stringstream ss(line);
-            std::string key, value;
-            if (!std::getline(ss, key, '=')) continue;
-            if (!std::getline(ss, value)) continue;
-            key = trimCopy(key);
-            value = trimCopy(value);
-
-            if (key == "year") state.year = std::stoi(value);
-            else if (key == "population") state.population = std::stoi(value);
-            else if (key == "grain") state.grainBushels = std::stod(value);
-            else if (key == "land") state.landAcres = std::stoi(value);
-
-            else if (key == "starvedLastYear") state.starvedLastYear = std::stoi(value);
-            else if (key == "immigrantsLastYear") state.immigrantsLastYear = std::stoi(value);
-            else if (key == "plagueLastYear") state.plagueLastYear = (value == "1");
-            else if (key == "yieldPerAcreLastYear") state.yieldPerAcreLastYear = std::stoi(value);
-            else if (key == "harvestTotalLastYear") state.harvestTotalLastYear = std::stoi(value);
-            else if (key == "ratsAteLastYear") state.ratsAteLastYear = std::stoi(value);
-
-            else if (key == "landPriceThisYear") state.landPriceThisYear = std::stoi(value);
-            else if (key == "awaitingPlayerDecisions") state.awaitingPlayerDecisions = (value == "1");
-
-            else if (key == "yearsCompleted") state.yearsCompleted = std::stoi(value);
-            else if (key == "starvationPercentSum") state.starvationPercentSum = std::stod(value);
+            const std::string::size_type eq = line.find('=');
+            if (eq == std::string::npos) continue;
+            const std::string key = trimCopy(line.substr(0, eq));
+            const std::string value = trimCopy(line.substr(eq + 1));
+
+            if (key == "year") s.year = std::stoi(value);
+            else if (key == "population") s.population = std::stoi(value);
+            else if (key == "grain") grainOk = setGrainBushels(s, std::stod(value));
+            else if (key == "land") s.landAcres = std::stoi(value);
+
+            else if (key == "starvedLastYear") s.starvedLastYear = std::stoi(value);
+            else if (key == "immigrantsLastYear") s.immigrantsLastYear = std::stoi(value);
+            else if (key == "plagueLastYear") s.plagueLastYear = (value == "1");
+            else if (key == "yieldPerAcreLastYear") s.yieldPerAcreLastYear = std::stoi(value);
+            else if (key == "harvestTotalLastYear") s.harvestTotalLastYear = std::stoi(value);
+            else if (key == "ratsAteLastYear") s.ratsAteLastYear = std::stoi(value);
+
+            else if (key == "landPriceThisYear") s.landPriceThisYear = std::stoi(value);
+            else if (key == "awaitingPlayerDecisions") s.awaitingPlayerDecisions = (value == "1");
+
+            else if (key == "yearsCompleted") s.yearsCompleted = std::stoi(value);
+            else if (key == "starvationPercentSum") s.starvationPercentSum = std::stod(value);
         }
     } catch (...) {
-        state.year = -1;
-        return state;
+        return SaveStatus::Corrupted;
+    }
+
+    if (!grainOk || !IsValidSave(s)) return SaveStatus::Corrupted;
+    state = s;
+    return SaveStatus::Loaded;
+}
+
+bool SaveManager::clear() const {
+    // Every format is removed, or an older one would be resumed next time.
+    std::remove(textFilePath.c_str());
+    std::remove(journalFilePath.c_str());
+    return !fileExists(filePath) || std::remove(filePath.c_str()) == 0;
+}
+
+bool SaveManager::startJournal(const GameRules& r, const Rng& rng, const GameState* snapshot) const {
+    unsigned char buf[kJournalHeaderSize + kPayloadSize] = {};
+    std::size_t off = 0;
+    std::memcpy(buf, kJournalMagic, sizeof kJournalMagic);
+    off += sizeof kJournalMagic;
+    putRaw<std::uint32_t>(buf, off, kJournalVersion);
+    putRaw<std::uint32_t>(buf, off, snapshot ? static_cast<std::uint32_t>(kPayloadSize) : 0);
+    putRaw<std::uint64_t>(buf, off, rng.seed());
+    putRaw<std::uint64_t>(buf, off, rng.gameId());
+    putRaw<std::uint64_t>(buf, off, r.hash());
+
+    std::size_t crcOff = off;
+    off += 4;
+    if (snapshot) putState(buf, off, *snapshot);
+    std::uint32_t crc = crc32(buf, crcOff);
+    crc = crc32(buf + kJournalHeaderSize, off - kJournalHeaderSize, crc);
+    putRaw<std::uint32_t>(buf, crcOff, crc);
+    return replaceFileAtomically(journalFilePath, buf, off);
+}
+
+bool SaveManager::appendYear(const Decisions& d) const {
+    unsigned char buf[kMaxRecordSize];
+    std::size_t off = 0;
+    putVarint(buf, off, static_cast<std::uint32_t>(d.acresToBuy));
+    putVarint(buf, off, static_cast<std::uint32_t>(d.acresToSell));
+    putVarint(buf, off, static_cast<std::uint32_t>(d.bushelsToFeed));
+    putVarint(buf, off, static_cast<std::uint32_t>(d.acresToPlant));
+    buf[off] = static_cast<unsigned char>(crc32(buf, off));
+    ++off;
+    return appendToFile(journalFilePath, buf, off, true);
+}
+
+JournalReplay SaveManager::replayJournal(const std::string& path, const GameRules& r) {
+    MappedFile file;
+    if (!file.open(path)) {
+        JournalReplay out;
+        if (fileExists(path)) out.status = SaveStatus::Corrupted;
+        return out;
     }
+    return replayJournal(file.data(), file.size(), r);
+}
+
+JournalReplay SaveManager::replayJournal(const unsigned char* p, std::size_t size, const GameRules& r) {
+    JournalReplay out;
+    out.status = SaveStatus::Corrupted;
+    if (size < kJournalHeaderSize || std::memcmp(p, kJournalMagic, sizeof kJournalMagic) != 0) return out;
+    std::size_t off = sizeof kJournalMagic;
+    if (getRaw<std::uint32_t>(p, off) != kJournalVersion) return out;
+    const std::uint32_t snapshotSize = getRaw<std::uint32_t>(p, off);
+    const std::uint64_t seed = getRaw<std::uint64_t>(p, off);
+    const std::uint64_t gameId = getRaw<std::uint64_t>(p, off);
+    const std::uint64_t rulesHash = getRaw<std::uint64_t>(p, off);
+    const std::size_t crcOff = off;
+    const std::uint32_t crc = getRaw<std::uint32_t>(p, off);
 
-    if (!IsValidSave(state)) {
-        state.year = -1;
+    if (snapshotSize != 0 && snapshotSize != kPayloadSize) return out;
+    if (size < kJournalHeaderSize + snapshotSize) return out;
+    if (crc32(p + kJournalHeaderSize, snapshotSize, crc32(p, crcOff)) != crc) return out;
+    if (rulesHash != r.hash()) return out;
+
+    GameState& s = out.state;
+    if (snapshotSize != 0) {
+        s = getState(p, off);
+        if (!IsValidSave(s) || !adoptGrainScale(s, r.grainScale())) return out;
+        out.hasSnapshot = true;
+    } else {
+        initNewGame(s, r);
     }
+    out.rng = Rng(seed, gameId);
+
+    while (off < size) {
+        const std::size_t start = off;
+        Decisions d;
+        if (!getVarint(p, size, off, d.acresToBuy) || !getVarint(p, size, off, d.acresToSell) ||
+            !getVarint(p, size, off, d.bushelsToFeed) || !getVarint(p, size, off, d.acresToPlant) ||
+            off >= size || p[off] != static_cast<unsigned char>(crc32(p + start, off - start))) {
+            // Only the last append can be torn; what follows it is ignored.
+            out.tornTail = true;
+            break;
+        }
+        ++off;
 
-    return state;
+        if (out.ending != YearOutcome::Continued || s.year > r.totalYears) return out;
+        beginYear(s, r, out.rng);
+        if (checkDecisions(s, d, r) != DecisionError::None) return out;
+        out.ending = resolveYear(s, d, r, out.rng);
+        ++out.years;
+    }
+
+    if (out.ending == YearOutcome::Continued && s.year <= r.totalYears) beginYear(s, r, out.rng);
+    out.status = SaveStatus::Loaded;
+    return out;
 }
 
-bool SaveManager::hasValidSave() const {
-    GameState s = load();
-    return IsValidSave(s);
+bool SaveManager::compactJournal(const GameRules& r) const {
+    const JournalReplay j = replayJournal(journalFilePath, r);
+    if (j.status != SaveStatus::Loaded) return false;
+    return startJournal(r, j.rng, &j.state);
 }
 
-bool SaveManager::clear() const {
-    return std::remove(filePath.c_str()) == 0;
+SaveStatus SaveManager::resume(const GameRules& r, GameState& state, Rng& rng) const {
+    const JournalReplay j = replayJournal(journalFilePath, r);
+    if (j.status == SaveStatus::Corrupted) return SaveStatus::Corrupted;
+
+    if (j.status == SaveStatus::Loaded) {
+        // A journal of a finished game has nothing left to play.
+        if (j.ending != YearOutcome::Continued || j.state.year > r.totalYears) return SaveStatus::Missing;
+        if (j.tornTail || j.years >= kCompactAfterYears) startJournal(r, j.rng, &j.state);
+        state = j.state;
+        rng = j.rng;
+        return SaveStatus::Loaded;
+    }
+
+    // Older formats carry no seed: the game goes on with rng from here.
+    GameState loaded;
+    const SaveStatus st = load(loaded);
+    if (st != SaveStatus::Loaded) return st;
+    if (!adoptGrainScale(loaded, r.grainScale())) return SaveStatus::Corrupted;
+    if (!startJournal(r, rng, &loaded)) return SaveStatus::Corrupted;
+    state = loaded;
+    return SaveStatus::Loaded;
 }
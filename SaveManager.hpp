@@ -1,18 +1,73 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
-struct GameState;
+#include "GameEngine.hpp"
 
+enum class SaveStatus {
+    Missing,   // nothing to resume
+    Loaded,
+    Corrupted, // a save exists but is damaged, from another version or invalid
+};
+
+// Fixed binary layout of a GameState shared by every binary save format.
+constexpr std::size_t kGameStateRecordSize = 60;
+void encodeGameState(const GameState& s, unsigned char* out);
+GameState decodeGameState(const unsigned char* in);
+
+// What replaying a decision journal produced.
+struct JournalReplay {
+    SaveStatus status = SaveStatus::Missing;
+    GameState state;         // after the last record, with that year's price rolled
+    Rng rng{0};              // the game's random events
+    std::size_t years = 0;   // records replayed
+    bool tornTail = false;   // a partly written last record was ignored
+    bool hasSnapshot = false;
+    YearOutcome ending = YearOutcome::Continued; // how the last replayed year ended
+};
+
+// The game is kept as an append-only decision journal: a header with the seed,
+// the rules hash and an optional snapshot, then one varint record per played
+// year (buy, sell, feed, plant, check byte), a few bytes each. The current state
+// is rebuilt by replaying the records through resolveYear, which also makes any
+// reported game reproducible bit for bit. compactJournal() folds the records
+// into the snapshot.
+//
+// Snapshots are a small fixed-layout binary record with a CRC, replaced
+// atomically. save()/load() read and write one on its own; the old key=value
+// text save is still imported when nothing newer exists.
 class SaveManager {
 public:
-    explicit SaveManager(std::string path = "game_save.txt");
+    explicit SaveManager(std::string path = "game_save.dat", std::string textPath = "game_save.txt",
+                         std::string journalPath = "game_journal.dat");
 
-    bool hasValidSave() const;
     bool save(const GameState& state) const;
-    GameState load() const;
+    // Reads and validates the save in one pass; state is only written on Loaded.
+    SaveStatus load(GameState& state) const;
     bool clear() const;
 
+    // Starts a new journal for a game played with rng. Without a snapshot the
+    // replay starts from initNewGame().
+    bool startJournal(const GameRules& r, const Rng& rng, const GameState* snapshot = nullptr) const;
+    // Write-ahead: called with the year's decisions before they are resolved.
+    bool appendYear(const Decisions& d) const;
+    bool compactJournal(const GameRules& r) const;
+
+    // Picks up an unfinished game: the journal if there is one (state and rng
+    // are replaced), otherwise a snapshot or text save (rng is left alone).
+    // Long or torn journals are compacted on the way.
+    SaveStatus resume(const GameRules& r, GameState& state, Rng& rng) const;
+
+    static JournalReplay replayJournal(const std::string& path, const GameRules& r);
+    static JournalReplay replayJournal(const unsigned char* data, std::size_t size, const GameRules& r);
+
+    // The legacy text format, kept as an import path.
+    static SaveStatus importText(const std::string& path, GameState& state);
+
 private:
     std::string filePath;
+    std::string textFilePath;
+    std::string journalFilePath;
 };
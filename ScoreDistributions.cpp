@@ -0,0 +1,341 @@
+#include "ScoreDistributions.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+
+namespace {
+
+// Layout (see BinaryFormat.hpp):
+//   magic[8] version:u32 games:u64 endings:u64[4]
+//   per metric: lo:f64 width:f64 bins:u64 below:u64 above:u64 counts:u64[bins]
+//               k:u32 n:u64 min:f64 max:f64 coin:u64 levels:u32 (size:u32 items:f64[size])[levels]
+//   crc32:u32 of everything before it
+constexpr char kDistMagic[8] = {'H', 'M', 'S', 'C', 'O', 'R', 'E', 'S'};
+constexpr std::uint32_t kDistVersion = 1;
+constexpr std::size_t kMaxLevels = 64;
+
+std::uint64_t nextCoin(std::uint64_t x) {
+    // splitmix64
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Bounds-checked reads over a loaded file.
+struct Reader {
+    const unsigned char* p;
+    std::size_t size;
+    std::size_t off = 0;
+
+    template <class T>
+    bool get(T& v) {
+        if (size - off < sizeof v) return false;
+        std::memcpy(&v, p + off, sizeof v);
+        off += sizeof v;
+        return true;
+    }
+};
+
+bool readFile(const std::string& path, std::vector<unsigned char>& data) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    unsigned char buf[1 << 16];
+    std::size_t got;
+    while ((got = std::fread(buf, 1, sizeof buf, f)) > 0) data.insert(data.end(), buf, buf + got);
+    const bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+}
+
+void Histogram::add(double x) {
+    if (bins.empty()) bins.assign(binCount, 0);
+    if (!(x >= lo)) {
+        ++below; // NaN counts as below
+        return;
+    }
+    const double pos = (x - lo) / width;
+    if (pos >= static_cast<double>(binCount)) {
+        ++above;
+        return;
+    }
+    ++bins[static_cast<std::size_t>(pos)];
+}
+
+bool Histogram::merge(const Histogram& o) {
+    if (lo != o.lo || width != o.width || binCount != o.binCount) return false;
+    below += o.below;
+    above += o.above;
+    if (!o.bins.empty()) {
+        if (bins.empty()) bins.assign(binCount, 0);
+        for (std::size_t i = 0; i < binCount; ++i) bins[i] += o.bins[i];
+    }
+    return true;
+}
+
+std::uint64_t Histogram::count() const {
+    std::uint64_t n = below + above;
+    for (std::uint64_t c : bins) n += c;
+    return n;
+}
+
+std::size_t QuantileSketch::capacity(std::size_t level) const {
+    // Levels shrink by 2/3 going down from the top one.
+    const std::size_t depth = levels_.size() - 1 - level;
+    const double cap = std::ceil(static_cast<double>(k_) * std::pow(2.0 / 3.0, static_cast<double>(depth)));
+    return std::max<std::size_t>(2, static_cast<std::size_t>(cap));
+}
+
+void QuantileSketch::updateMaxRetained() {
+    maxRetained_ = 0;
+    for (std::size_t h = 0; h < levels_.size(); ++h) maxRetained_ += capacity(h);
+}
+
+void QuantileSketch::compact(std::size_t level) {
+    if (level + 1 == levels_.size()) {
+        levels_.emplace_back();
+        updateMaxRetained();
+    }
+    std::vector<double>& items = levels_[level];
+    std::vector<double>& up = levels_[level + 1];
+    std::sort(items.begin(), items.end());
+
+    double kept = 0.0;
+    const bool odd = items.size() % 2 != 0;
+    if (odd) {
+        kept = items.back();
+        items.pop_back();
+    }
+    coin_ = nextCoin(coin_);
+    for (std::size_t i = coin_ & 1; i < items.size(); i += 2) up.push_back(items[i]);
+    retained_ -= items.size() / 2;
+    items.clear();
+    if (odd) items.push_back(kept);
+}
+
+void QuantileSketch::compress() {
+    // Lazy KLL: only when the sketch as a whole is full, compact the lowest
+    // full level. Some level is full whenever the whole is.
+    while (retained_ >= maxRetained_) {
+        std::size_t h = 0;
+        while (levels_[h].size() < capacity(h)) ++h;
+        compact(h);
+    }
+}
+
+void QuantileSketch::add(double x) {
+    if (n_ == 0) {
+        min_ = max_ = x;
+    } else {
+        min_ = std::min(min_, x);
+        max_ = std::max(max_, x);
+    }
+    ++n_;
+    if (levels_.empty()) {
+        levels_.emplace_back();
+        updateMaxRetained();
+    }
+    levels_[0].push_back(x);
+    if (++retained_ >= maxRetained_) compress();
+}
+
+void QuantileSketch::merge(const QuantileSketch& o) {
+    if (o.n_ == 0) return;
+    if (n_ == 0) {
+        min_ = o.min_;
+        max_ = o.max_;
+    } else {
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+    }
+    n_ += o.n_;
+    if (levels_.size() < o.levels_.size()) {
+        levels_.resize(o.levels_.size());
+        updateMaxRetained();
+    }
+    for (std::size_t h = 0; h < o.levels_.size(); ++h) {
+        levels_[h].insert(levels_[h].end(), o.levels_[h].begin(), o.levels_[h].end());
+    }
+    retained_ += o.retained_;
+    coin_ = nextCoin(coin_ ^ o.coin_);
+    compress();
+}
+
+double QuantileSketch::quantile(double q) const {
+    if (n_ == 0) return 0.0;
+    if (q <= 0.0) return min_;
+    if (q >= 1.0) return max_;
+
+    std::vector<std::pair<double, std::uint64_t>> items;
+    items.reserve(retained_);
+    for (std::size_t h = 0; h < levels_.size(); ++h) {
+        for (double x : levels_[h]) items.emplace_back(x, std::uint64_t(1) << h);
+    }
+    std::sort(items.begin(), items.end());
+    const double target = q * static_cast<double>(n_);
+    std::uint64_t seen = 0;
+    for (const auto& [x, weight] : items) {
+        seen += weight;
+        if (static_cast<double>(seen) >= target) return x;
+    }
+    return max_;
+}
+
+bool QuantileSketch::assign(int k, std::uint64_t n, double min, double max, std::uint64_t coin,
+                            std::vector<std::vector<double>> levels) {
+    if (k < 8 || levels.size() > kMaxLevels || (n > 0 && !(min <= max))) return false;
+    // Compaction keeps the total weight, so the items must weigh exactly n.
+    std::uint64_t weight = 0;
+    std::size_t retained = 0;
+    for (std::size_t h = 0; h < levels.size(); ++h) {
+        weight += static_cast<std::uint64_t>(levels[h].size()) << h;
+        retained += levels[h].size();
+    }
+    if (weight != n) return false;
+    k_ = k;
+    n_ = n;
+    min_ = min;
+    max_ = max;
+    coin_ = coin;
+    levels_ = std::move(levels);
+    retained_ = retained;
+    updateMaxRetained();
+    return true;
+}
+
+const char* scoreMetricName(ScoreMetric m) {
+    switch (m) {
+    case ScoreMetric::P: return "P";
+    case ScoreMetric::L: return "L";
+    case ScoreMetric::Population: return "population";
+    case ScoreMetric::Grain: return "grain";
+    case ScoreMetric::Years: return "years";
+    }
+    return "?";
+}
+
+ScoreDistributions::ScoreDistributions()
+    : histograms{Histogram(0.0, 1.0, 100), Histogram(0.0, 0.5, 100), Histogram(0.0, 10.0, 200),
+                 Histogram(0.0, 1000.0, 200), Histogram(0.0, 1.0, 64)} {}
+
+void ScoreDistributions::add(const GameResult& res) {
+    games += 1;
+    endings[static_cast<int>(res.ending)] += 1;
+    auto put = [&](ScoreMetric m, double x) {
+        histograms[static_cast<int>(m)].add(x);
+        sketches[static_cast<int>(m)].add(x);
+    };
+    if (res.completed()) {
+        put(ScoreMetric::P, res.score.avgStarvedPercent);
+        put(ScoreMetric::L, res.score.acresPerCitizen);
+    }
+    put(ScoreMetric::Population, res.finalState.population);
+    put(ScoreMetric::Grain, res.finalState.grainBushels());
+    put(ScoreMetric::Years, res.finalState.yearsCompleted);
+}
+
+bool ScoreDistributions::merge(const ScoreDistributions& o) {
+    for (int m = 0; m < kScoreMetricCount; ++m) {
+        const Histogram& a = histograms[m];
+        const Histogram& b = o.histograms[m];
+        if (a.lo != b.lo || a.width != b.width || a.binCount != b.binCount) return false;
+    }
+    games += o.games;
+    for (int i = 0; i < 4; ++i) endings[i] += o.endings[i];
+    for (int m = 0; m < kScoreMetricCount; ++m) {
+        histograms[m].merge(o.histograms[m]);
+        sketches[m].merge(o.sketches[m]);
+    }
+    return true;
+}
+
+bool saveScoreDistributions(const std::string& path, const ScoreDistributions& d) {
+    std::vector<unsigned char> out(kDistMagic, kDistMagic + sizeof kDistMagic);
+    appendRaw<std::uint32_t>(out, kDistVersion);
+    appendRaw<std::uint64_t>(out, d.games);
+    for (std::uint64_t v : d.endings) appendRaw<std::uint64_t>(out, v);
+    for (int m = 0; m < kScoreMetricCount; ++m) {
+        const Histogram& h = d.histograms[m];
+        appendRaw<double>(out, h.lo);
+        appendRaw<double>(out, h.width);
+        appendRaw<std::uint64_t>(out, h.binCount);
+        appendRaw<std::uint64_t>(out, h.below);
+        appendRaw<std::uint64_t>(out, h.above);
+        for (std::size_t i = 0; i < h.binCount; ++i) appendRaw<std::uint64_t>(out, h.bins.empty() ? 0 : h.bins[i]);
+
+        const QuantileSketch& s = d.sketches[m];
+        appendRaw<std::uint32_t>(out, static_cast<std::uint32_t>(s.k()));
+        appendRaw<std::uint64_t>(out, s.count());
+        appendRaw<double>(out, s.min());
+        appendRaw<double>(out, s.max());
+        appendRaw<std::uint64_t>(out, s.coin());
+        appendRaw<std::uint32_t>(out, static_cast<std::uint32_t>(s.levels().size()));
+        for (const std::vector<double>& level : s.levels()) {
+            appendRaw<std::uint32_t>(out, static_cast<std::uint32_t>(level.size()));
+            for (double x : level) appendRaw<double>(out, x);
+        }
+    }
+    appendRaw<std::uint32_t>(out, crc32(out.data(), out.size()));
+
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    const bool ok = std::fwrite(out.data(), 1, out.size(), f) == out.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+bool loadScoreDistributions(const std::string& path, ScoreDistributions& d) {
+    std::vector<unsigned char> data;
+    if (!readFile(path, data) || data.size() < sizeof kDistMagic + 8) return false;
+    const std::size_t body = data.size() - 4;
+    std::uint32_t crc;
+    std::memcpy(&crc, data.data() + body, sizeof crc);
+    if (crc != crc32(data.data(), body) || std::memcmp(data.data(), kDistMagic, sizeof kDistMagic) != 0) {
+        return false;
+    }
+
+    Reader in{data.data(), body, sizeof kDistMagic};
+    std::uint32_t version = 0;
+    ScoreDistributions out;
+    if (!in.get(version) || version != kDistVersion || !in.get(out.games)) return false;
+    for (std::uint64_t& v : out.endings) {
+        if (!in.get(v)) return false;
+    }
+    for (int m = 0; m < kScoreMetricCount; ++m) {
+        Histogram& h = out.histograms[m];
+        std::uint64_t binCount = 0;
+        if (!in.get(h.lo) || !in.get(h.width) || !in.get(binCount) || !in.get(h.below) || !in.get(h.above) ||
+            binCount > (body - in.off) / 8) {
+            return false;
+        }
+        h.binCount = static_cast<std::size_t>(binCount);
+        h.bins.assign(h.binCount, 0);
+        for (std::uint64_t& c : h.bins) in.get(c);
+
+        std::uint32_t k = 0, levelCount = 0;
+        std::uint64_t n = 0, coin = 0;
+        double lo = 0.0, hi = 0.0;
+        if (!in.get(k) || !in.get(n) || !in.get(lo) || !in.get(hi) || !in.get(coin) || !in.get(levelCount) ||
+            levelCount > kMaxLevels) {
+            return false;
+        }
+        std::vector<std::vector<double>> levels(levelCount);
+        for (std::vector<double>& level : levels) {
+            std::uint32_t size = 0;
+            if (!in.get(size) || size > (body - in.off) / 8) return false;
+            level.resize(size);
+            for (double& x : level) in.get(x);
+        }
+        if (!out.sketches[m].assign(static_cast<int>(k), n, lo, hi, coin, std::move(levels))) return false;
+    }
+    if (in.off != body) return false;
+    d = std::move(out);
+    return true;
+}
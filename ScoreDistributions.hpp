@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Simulation.hpp"
+
+// Distributions of game results over any number of games in bounded memory:
+// fixed-bin histograms and quantile sketches, both mergeable, so every thread
+// (or every machine) fills its own and the parts are merged afterwards.
+
+// Equal-width bins over [lo; lo + width * bins) plus the values below and
+// above. Bins are allocated by the first add or merge.
+struct Histogram {
+    double lo = 0.0;
+    double width = 1.0;
+    std::size_t binCount = 0;
+    std::vector<std::uint64_t> bins;
+    std::uint64_t below = 0;
+    std::uint64_t above = 0;
+
+    Histogram() = default;
+    Histogram(double lo, double width, std::size_t binCount) : lo(lo), width(width), binCount(binCount) {}
+
+    void add(double x);
+    // False, and nothing merged, when the bins differ.
+    bool merge(const Histogram& o);
+    std::uint64_t count() const;
+};
+
+// KLL quantile sketch: a stack of compactors where level h holds items of
+// weight 2^h. A full level is sorted and every other item moves up. Rank error
+// is about 1.7 / k and the sketch keeps about 3k items plus a couple per
+// level (log2 of n / k levels). Which half moves up is decided by a
+// deterministic coin, so the same adds and merges in the same order give the
+// same sketch.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(int k = 200) : k_(k < 8 ? 8 : k) {}
+
+    void add(double x);
+    void merge(const QuantileSketch& o);
+
+    std::uint64_t count() const { return n_; }
+    double min() const { return min_; }
+    double max() const { return max_; }
+    // The value at rank q * count(), q in [0; 1]; 0 for an empty sketch.
+    double quantile(double q) const;
+    std::size_t retained() const { return retained_; }
+
+    // Flat form for serialization: the items of each level in turn.
+    int k() const { return k_; }
+    std::uint64_t coin() const { return coin_; }
+    const std::vector<std::vector<double>>& levels() const { return levels_; }
+    // False if the parts cannot come from a sketch.
+    bool assign(int k, std::uint64_t n, double min, double max, std::uint64_t coin,
+                std::vector<std::vector<double>> levels);
+
+private:
+    std::size_t capacity(std::size_t level) const;
+    void updateMaxRetained();
+    void compress();
+    void compact(std::size_t level);
+
+    int k_;
+    std::uint64_t n_ = 0;
+    double min_ = 0.0;
+    double max_ = 0.0;
+    std::uint64_t coin_ = 0x9E3779B97F4A7C15ull;
+    std::vector<std::vector<double>> levels_;
+    std::size_t retained_ = 0;    // items in all levels
+    std::size_t maxRetained_ = 0; // the sum of the level capacities
+};
+
+enum class ScoreMetric {
+    P,          // average starved percent, completed games
+    L,          // acres per citizen, completed games
+    Population, // final population, every game
+    Grain,      // final grain, every game
+    Years,      // years survived, every game
+};
+constexpr int kScoreMetricCount = 5;
+
+const char* scoreMetricName(ScoreMetric m);
+
+struct ScoreDistributions {
+    std::uint64_t games = 0;
+    std::uint64_t endings[4] = {}; // indexed by YearOutcome
+    Histogram histograms[kScoreMetricCount];
+    QuantileSketch sketches[kScoreMetricCount];
+
+    ScoreDistributions(); // the standard bins of every metric
+
+    void add(const GameResult& res);
+    // False if o was collected with other bins; nothing is merged then.
+    bool merge(const ScoreDistributions& o);
+};
+
+// A file with one ScoreDistributions and a CRC. Load fails on a damaged or
+// foreign file.
+bool saveScoreDistributions(const std::string& path, const ScoreDistributions& d);
+bool loadScoreDistributions(const std::string& path, ScoreDistributions& d);
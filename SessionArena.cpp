@@ -0,0 +1,67 @@
+#include "SessionArena.hpp"
+
+namespace {
+
+// Keeps the block behind the tag aligned like operator new would.
+constexpr std::size_t kTagSize = alignof(std::max_align_t) > sizeof(void*) ? alignof(std::max_align_t) : sizeof(void*);
+
+}
+
+thread_local SessionArena* SessionArena::current_ = nullptr;
+
+SessionArena::SessionArena(std::size_t chunkBytes)
+    : chunkBytes_(chunkBytes < kMaxPooled ? kMaxPooled : chunkBytes), free_(kMaxPooled / kGranule + 1, nullptr) {}
+
+SessionArena::~SessionArena() = default;
+
+void* SessionArena::allocate(std::size_t n) {
+    if (n == 0) n = 1;
+    const std::size_t cls = (n + kGranule - 1) / kGranule;
+    const std::size_t size = cls * kGranule;
+    inUse_ += size;
+    if (size > kMaxPooled) return ::operator new(size);
+    if (FreeBlock* b = free_[cls]) {
+        free_[cls] = b->next;
+        return b;
+    }
+    if (bumpLeft_ < size) {
+        // The tail of the old chunk is too small for this block and is abandoned.
+        chunks_.emplace_back(new unsigned char[chunkBytes_]);
+        bump_ = chunks_.back().get();
+        bumpLeft_ = chunkBytes_;
+    }
+    void* p = bump_;
+    bump_ += size;
+    bumpLeft_ -= size;
+    return p;
+}
+
+void SessionArena::release(void* p, std::size_t n) {
+    if (!p) return;
+    if (n == 0) n = 1;
+    const std::size_t cls = (n + kGranule - 1) / kGranule;
+    const std::size_t size = cls * kGranule;
+    inUse_ -= size;
+    if (size > kMaxPooled) {
+        ::operator delete(p);
+        return;
+    }
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = free_[cls];
+    free_[cls] = b;
+}
+
+void* SessionArena::allocateTagged(std::size_t n) {
+    SessionArena* arena = current_;
+    unsigned char* p = static_cast<unsigned char*>(arena ? arena->allocate(n + kTagSize) : ::operator new(n + kTagSize));
+    *reinterpret_cast<SessionArena**>(p) = arena;
+    return p + kTagSize;
+}
+
+void SessionArena::releaseTagged(void* p, std::size_t n) {
+    if (!p) return;
+    unsigned char* block = static_cast<unsigned char*>(p) - kTagSize;
+    SessionArena* arena = *reinterpret_cast<SessionArena**>(block);
+    if (arena) arena->release(block, n + kTagSize);
+    else ::operator delete(block);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocator for per-session objects of a single-threaded event loop: coroutine
+// frames of the game dialogue, connections and their buffers. Blocks are
+// carved from large chunks and recycled through one free list per 16-byte size
+// class, so tens of thousands of sessions cost a few chunks and no trips to
+// the global heap once warmed up. Not thread-safe: one arena per loop thread.
+class SessionArena {
+public:
+    explicit SessionArena(std::size_t chunkBytes = std::size_t(1) << 20);
+    ~SessionArena();
+
+    SessionArena(const SessionArena&) = delete;
+    SessionArena& operator=(const SessionArena&) = delete;
+
+    void* allocate(std::size_t n);
+    void release(void* p, std::size_t n);
+
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+        return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+    template <class T>
+    void destroy(T* p) {
+        if (!p) return;
+        p->~T();
+        release(p, sizeof(T));
+    }
+
+    // Makes an arena the current one of this thread while it lives.
+    class Use {
+    public:
+        explicit Use(SessionArena& arena) : previous_(current_) { current_ = &arena; }
+        ~Use() { current_ = previous_; }
+        Use(const Use&) = delete;
+        Use& operator=(const Use&) = delete;
+
+    private:
+        SessionArena* previous_;
+    };
+
+    // For allocations that cannot be handed an arena and whose size is known
+    // on release (coroutine frames): they come from the thread's current
+    // arena, or the global heap if there is none, and the arena is
+    // remembered in front of the block.
+    static void* allocateTagged(std::size_t n);
+    static void releaseTagged(void* p, std::size_t n);
+
+    std::size_t bytesInUse() const { return inUse_; }
+    std::size_t bytesReserved() const { return chunks_.size() * chunkBytes_; }
+
+private:
+    static constexpr std::size_t kGranule = 16;
+    static constexpr std::size_t kMaxPooled = 4096; // bigger blocks go to the heap
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::size_t chunkBytes_;
+    std::vector<std::unique_ptr<unsigned char[]>> chunks_;
+    unsigned char* bump_ = nullptr; // unused tail of the newest chunk
+    std::size_t bumpLeft_ = 0;
+    std::vector<FreeBlock*> free_;  // per size class
+    std::size_t inUse_ = 0;
+
+    static thread_local SessionArena* current_;
+};
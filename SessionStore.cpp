@@ -0,0 +1,339 @@
+#include "SessionStore.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+#include "SaveManager.hpp"
+
+namespace {
+
+// Layout (see BinaryFormat.hpp):
+// Header: magic[8] version:u32 slotSize:u32 slots:u64 ... crc32:u32 at the end.
+// Slot: session:u64 flags:u32 generation:u32 rulesHash:u64 state[kGameStateRecordSize] crc32:u32
+constexpr char kStoreMagic[8] = {'H', 'M', 'S', 'E', 'S', 'S', 'B', '1'};
+// 2: game state records with integer grain; 3: generations, a session's
+// newest valid slot counts; 4: the hash of the rules the state was saved under.
+constexpr std::uint32_t kStoreVersion = 4;
+constexpr std::size_t kStoreHeaderSize = 64;
+constexpr std::size_t kStateOffset = 8 + 4 + 4 + 8;
+constexpr std::size_t kSlotSize = kStateOffset + kGameStateRecordSize + 4;
+constexpr std::uint32_t kSlotUsed = 1;
+// Versions 2 and 3 slots have no rules hash (and in 2 the generation is 0).
+constexpr std::size_t kLegacyStateOffset = 8 + 4 + 4;
+constexpr std::size_t kLegacySlotSize = kLegacyStateOffset + kGameStateRecordSize + 4;
+
+void writeHeader(unsigned char* p, std::size_t slots) {
+    std::memset(p, 0, kStoreHeaderSize);
+    std::memcpy(p, kStoreMagic, sizeof kStoreMagic);
+    writeRaw<std::uint32_t>(p + 8, kStoreVersion);
+    writeRaw<std::uint32_t>(p + 12, static_cast<std::uint32_t>(kSlotSize));
+    writeRaw<std::uint64_t>(p + 16, slots);
+    writeRaw<std::uint32_t>(p + kStoreHeaderSize - 4, crc32(p, kStoreHeaderSize - 4));
+}
+
+std::size_t slotOffset(std::size_t slot) {
+    return kStoreHeaderSize + slot * kSlotSize;
+}
+
+// The slot count of a valid header of this version and slot size, else 0.
+// A crash while growing can leave the file longer than the header says.
+std::size_t headerSlots(const MappedFile& f, std::uint32_t version, std::size_t slotSize) {
+    const unsigned char* p = f.data();
+    if (f.size() < kStoreHeaderSize || std::memcmp(p, kStoreMagic, sizeof kStoreMagic) != 0 ||
+        readRaw<std::uint32_t>(p + 8) != version || readRaw<std::uint32_t>(p + 12) != slotSize ||
+        readRaw<std::uint32_t>(p + kStoreHeaderSize - 4) != crc32(p, kStoreHeaderSize - 4)) {
+        return 0;
+    }
+    const std::uint64_t slots = readRaw<std::uint64_t>(p + 16);
+    if (slots == 0 || slots > (f.size() - kStoreHeaderSize) / slotSize) return 0;
+    return static_cast<std::size_t>(slots);
+}
+
+// Rewrites a version 2 or 3 store in the current layout, with the rules hash
+// of every session 0: not recorded. Damaged slots keep a CRC that fails, so
+// they are still dropped on open.
+bool upgradeFile(const std::string& path, const unsigned char* p, std::size_t slots) {
+    std::vector<unsigned char> buf(slotOffset(slots), 0);
+    writeHeader(buf.data(), slots);
+    for (std::size_t i = 0; i < slots; ++i) {
+        const unsigned char* from = p + kStoreHeaderSize + i * kLegacySlotSize;
+        if (readRaw<std::uint32_t>(from + 8) != kSlotUsed) continue;
+        unsigned char* to = buf.data() + slotOffset(i);
+        std::memcpy(to, from, kLegacyStateOffset);
+        std::memcpy(to + kStateOffset, from + kLegacyStateOffset, kGameStateRecordSize);
+        if (readRaw<std::uint32_t>(from + kLegacySlotSize - 4) == crc32(from, kLegacySlotSize - 4)) {
+            writeRaw<std::uint32_t>(to + kSlotSize - 4, crc32(to, kSlotSize - 4));
+        }
+    }
+    return replaceFileAtomically(path, buf.data(), buf.size());
+}
+
+// Generations wrap around; a is newer if it is less than half the range ahead.
+bool newerGeneration(std::uint32_t a, std::uint32_t b) {
+    return static_cast<std::int32_t>(a - b) > 0;
+}
+
+}
+
+SessionStore::~SessionStore() {
+    close();
+}
+
+bool SessionStore::createFile(const std::string& path, std::size_t slots) const {
+    std::vector<unsigned char> buf(slotOffset(slots), 0);
+    writeHeader(buf.data(), slots);
+    return replaceFileAtomically(path, buf.data(), buf.size());
+}
+
+bool SessionStore::open(const std::string& path, const Options& opt) {
+    close();
+    opt_ = opt;
+    if (opt_.initialSlots == 0) opt_.initialSlots = 1;
+
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (f) std::fclose(f);
+    else if (!createFile(path, opt_.initialSlots)) return false;
+
+    if (!file_.open(path, MappedFile::Mode::ReadWrite)) return false;
+    std::size_t legacy = headerSlots(file_, 3, kLegacySlotSize);
+    if (legacy == 0) legacy = headerSlots(file_, 2, kLegacySlotSize);
+    if (legacy != 0) {
+        const bool upgraded = upgradeFile(path, file_.data(), legacy);
+        file_.close();
+        if (!upgraded || !file_.open(path, MappedFile::Mode::ReadWrite)) return false;
+    }
+    slots_ = headerSlots(file_, kStoreVersion, kSlotSize);
+    if (slots_ == 0 || !scanSlots()) {
+        file_.close();
+        slots_ = 0;
+        return false;
+    }
+
+    stop_ = false;
+    failed_ = false;
+    lastTicket_ = durableTicket_ = 0;
+    commits_ = 0;
+    committer_ = std::thread([this] { committerLoop(); });
+    return true;
+}
+
+bool SessionStore::scanSlots() {
+    index_.clear();
+    free_.clear();
+    droppedSlots_ = 0;
+    const unsigned char* p = file_.data();
+
+    // Walk backwards so the free list hands out low slots first. Of two
+    // generations of a session (a crash before the older was cleared) the
+    // newer counts and the older is cleared now.
+    std::vector<std::uint32_t> superseded;
+    for (std::size_t i = slots_; i-- > 0;) {
+        const unsigned char* slot = p + slotOffset(i);
+        const bool used = readRaw<std::uint32_t>(slot + 8) == kSlotUsed;
+        if (!used) {
+            free_.push_back(static_cast<std::uint32_t>(i));
+            continue;
+        }
+        if (readRaw<std::uint32_t>(slot + kSlotSize - 4) != crc32(slot, kSlotSize - 4) ||
+            !IsValidSave(decodeGameState(slot + kStateOffset))) {
+            ++droppedSlots_;
+            free_.push_back(static_cast<std::uint32_t>(i));
+            continue;
+        }
+        SessionSlot found{static_cast<std::uint32_t>(i), readRaw<std::uint32_t>(slot + 12)};
+        const auto [it, added] = index_.emplace(readRaw<std::uint64_t>(slot), found);
+        if (added) continue;
+        if (newerGeneration(found.generation, it->second.generation)) std::swap(it->second, found);
+        superseded.push_back(found.slot);
+    }
+    for (std::uint32_t slot : superseded) clearSlot(slot);
+    return true;
+}
+
+void SessionStore::close() {
+    if (committer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        committer_.join();
+    }
+    file_.close();
+    slots_ = 0;
+    index_.clear();
+    free_.clear();
+    retired_.clear();
+    dirtyBegin_ = dirtyEnd_ = 0;
+}
+
+bool SessionStore::grow() {
+    const std::size_t slots = slots_ * 2;
+    {
+        std::unique_lock<std::shared_mutex> lock(remap_);
+        if (!file_.resize(slotOffset(slots))) return false;
+    }
+    writeHeader(file_.mutableData(), slots);
+    dirtyBegin_ = 0;
+    if (dirtyEnd_ < kStoreHeaderSize) dirtyEnd_ = kStoreHeaderSize;
+    for (std::size_t i = slots; i-- > slots_;) free_.push_back(static_cast<std::uint32_t>(i));
+    slots_ = slots;
+    return true;
+}
+
+// A used slot if s is given, else a cleared one.
+void SessionStore::writeSlot(std::size_t slot, std::uint64_t session, std::uint32_t generation,
+                             std::uint64_t rulesHash, const GameState* s) {
+    unsigned char* p = file_.mutableData() + slotOffset(slot);
+    std::memset(p, 0, kSlotSize);
+    writeRaw<std::uint64_t>(p, session);
+    writeRaw<std::uint32_t>(p + 8, s ? kSlotUsed : 0);
+    writeRaw<std::uint32_t>(p + 12, generation);
+    writeRaw<std::uint64_t>(p + 16, rulesHash);
+    if (s) encodeGameState(*s, p + kStateOffset);
+    writeRaw<std::uint32_t>(p + kSlotSize - 4, crc32(p, kSlotSize - 4));
+
+    const std::size_t begin = slotOffset(slot);
+    const std::size_t end = begin + kSlotSize;
+    if (dirtyBegin_ == dirtyEnd_) {
+        dirtyBegin_ = begin;
+        dirtyEnd_ = end;
+    } else {
+        dirtyBegin_ = std::min(dirtyBegin_, begin);
+        dirtyEnd_ = std::max(dirtyEnd_, end);
+    }
+}
+
+void SessionStore::clearSlot(std::uint32_t slot) {
+    writeSlot(slot, 0, 0, 0, nullptr);
+    free_.push_back(slot);
+}
+
+std::uint64_t SessionStore::put(std::uint64_t session, const GameState& s, std::uint64_t rulesHash) {
+    std::lock_guard<std::mutex> lock(m_);
+    if (!file_.isOpen() || failed_) return 0;
+
+    if (free_.empty() && !grow()) {
+        failed_ = true;
+        durable_.notify_all();
+        return 0;
+    }
+    const std::uint32_t slot = free_.back();
+    free_.pop_back();
+    const std::uint64_t ticket = ++lastTicket_;
+    auto it = index_.find(session);
+    if (it != index_.end()) {
+        retired_.push_back({ticket, session, it->second.slot});
+        it->second = {slot, it->second.generation + 1};
+    } else {
+        it = index_.emplace(session, SessionSlot{slot, 0}).first;
+    }
+    writeSlot(slot, session, it->second.generation, rulesHash, &s);
+    wake_.notify_one();
+    return ticket;
+}
+
+std::uint64_t SessionStore::erase(std::uint64_t session) {
+    std::lock_guard<std::mutex> lock(m_);
+    if (!file_.isOpen() || failed_) return 0;
+
+    auto it = index_.find(session);
+    if (it != index_.end()) {
+        // Older generations go with it, so none of them comes back on open.
+        const auto older = std::stable_partition(retired_.begin(), retired_.end(),
+                                                 [session](const Retired& r) { return r.session != session; });
+        for (auto r = older; r != retired_.end(); ++r) clearSlot(r->slot);
+        retired_.erase(older, retired_.end());
+        clearSlot(it->second.slot);
+        index_.erase(it);
+    }
+    wake_.notify_one();
+    return ++lastTicket_;
+}
+
+bool SessionStore::get(std::uint64_t session, GameState& s, std::uint64_t& rulesHash) const {
+    std::lock_guard<std::mutex> lock(m_);
+    auto it = index_.find(session);
+    if (it == index_.end()) return false;
+    const unsigned char* p = file_.data() + slotOffset(it->second.slot);
+    rulesHash = readRaw<std::uint64_t>(p + 16);
+    s = decodeGameState(p + kStateOffset);
+    return true;
+}
+
+bool SessionStore::contains(std::uint64_t session) const {
+    std::lock_guard<std::mutex> lock(m_);
+    return index_.count(session) != 0;
+}
+
+bool SessionStore::waitDurable(std::uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(m_);
+    if (ticket == 0) return false;
+    wake_.notify_one();
+    durable_.wait(lock, [&] { return durableTicket_ >= ticket || failed_; });
+    return durableTicket_ >= ticket;
+}
+
+bool SessionStore::sync() {
+    std::uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        ticket = lastTicket_;
+        if (durableTicket_ >= ticket) return !failed_;
+    }
+    return waitDurable(ticket);
+}
+
+SessionStore::Stats SessionStore::stats() const {
+    std::lock_guard<std::mutex> lock(m_);
+    Stats st;
+    st.sessions = index_.size();
+    st.slots = slots_;
+    st.droppedSlots = droppedSlots_;
+    st.commits = commits_;
+    st.writes = lastTicket_;
+    return st;
+}
+
+void SessionStore::committerLoop() {
+    const auto interval = std::chrono::milliseconds(opt_.commitIntervalMs);
+    std::unique_lock<std::mutex> lock(m_);
+    for (;;) {
+        wake_.wait(lock, [this] { return stop_ || lastTicket_ != durableTicket_ || dirtyBegin_ != dirtyEnd_; });
+        if (lastTicket_ == durableTicket_ && dirtyBegin_ == dirtyEnd_ && stop_) return;
+
+        // Let more writes join this commit, unless we are shutting down.
+        if (!stop_ && interval.count() > 0) wake_.wait_for(lock, interval, [this] { return stop_; });
+
+        const std::uint64_t ticket = lastTicket_;
+        const std::size_t begin = dirtyBegin_;
+        const std::size_t end = dirtyEnd_;
+        dirtyBegin_ = dirtyEnd_ = 0;
+        lock.unlock();
+
+        bool ok = true;
+        if (begin != end) {
+            std::shared_lock<std::shared_mutex> mapped(remap_);
+            ok = file_.flush(begin, end - begin);
+        }
+
+        lock.lock();
+        if (ok) {
+            durableTicket_ = ticket;
+            if (begin != end) ++commits_;
+            // The generations that replaced these are on disk now; their
+            // clearing goes out with the next commit.
+            std::size_t n = 0;
+            while (n < retired_.size() && retired_[n].ticket <= ticket) clearSlot(retired_[n++].slot);
+            retired_.erase(retired_.begin(), retired_.begin() + static_cast<std::ptrdiff_t>(n));
+        } else {
+            failed_ = true;
+        }
+        durable_.notify_all();
+        if (failed_) return;
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "GameState.hpp"
+#include "MappedFile.hpp"
+
+// Saves of many concurrent games in one memory-mapped file.
+//
+// The file is a header and an array of fixed-size slots: session id, a used
+// flag, a generation, the hash of the rules the game is played under, the
+// GameState in the SaveManager binary layout and a CRC of the slot. The id -> slot index and the free list live in memory and are
+// rebuilt from the slots on open; cleared sessions free their slot for the
+// next new one, and the file doubles when it runs out of slots.
+//
+// put() and erase() only write into the mapping. A committer thread flushes
+// everything written since the last commit with one msync (group commit), so
+// thousands of saves cost one fsync; waitDurable() blocks until a given write
+// is on disk. A session's state is never overwritten in place: put() writes
+// the next generation to a free slot, and the previous slot is cleared and
+// freed only once that write is on disk. A slot torn by a crash fails its CRC
+// and is dropped on open, which then falls back to the previous generation.
+class SessionStore {
+public:
+    struct Options {
+        unsigned commitIntervalMs = 5; // how long writes may wait to be batched
+        std::size_t initialSlots = 1024;
+    };
+
+    struct Stats {
+        std::size_t sessions = 0;
+        std::size_t slots = 0;
+        std::size_t droppedSlots = 0; // torn or damaged slots found on open
+        std::uint64_t commits = 0;    // fsyncs done
+        std::uint64_t writes = 0;     // puts and erases
+    };
+
+    SessionStore() = default;
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    // Opens or creates the store and starts the committer thread.
+    bool open(const std::string& path, const Options& opt);
+    bool open(const std::string& path) { return open(path, Options{}); }
+    // Commits what is pending and stops the committer.
+    void close();
+
+    // Each returns a write ticket for waitDurable(), or 0 on failure.
+    std::uint64_t put(std::uint64_t session, const GameState& s, std::uint64_t rulesHash);
+    std::uint64_t erase(std::uint64_t session);
+
+    // rulesHash is the one given to put(), or 0 for a session stored by a
+    // version that did not record it.
+    bool get(std::uint64_t session, GameState& s, std::uint64_t& rulesHash) const;
+    bool contains(std::uint64_t session) const;
+
+    // Waits until the write with this ticket (and all before it) is on disk.
+    bool waitDurable(std::uint64_t ticket);
+    // Waits until everything written so far is on disk.
+    bool sync();
+
+    Stats stats() const;
+
+private:
+    bool createFile(const std::string& path, std::size_t slots) const;
+    bool scanSlots();
+    bool grow();
+    void writeSlot(std::size_t slot, std::uint64_t session, std::uint32_t generation, std::uint64_t rulesHash,
+                   const GameState* s);
+    void clearSlot(std::uint32_t slot);
+    void committerLoop();
+
+    struct SessionSlot {
+        std::uint32_t slot;
+        std::uint32_t generation;
+    };
+    // A slot holding a superseded generation, freed once the write with this
+    // ticket is durable.
+    struct Retired {
+        std::uint64_t ticket;
+        std::uint64_t session;
+        std::uint32_t slot;
+    };
+
+    MappedFile file_;
+    std::size_t slots_ = 0;
+    Options opt_;
+
+    mutable std::mutex m_; // index, free list, dirty range, tickets and slot writes
+    std::unordered_map<std::uint64_t, SessionSlot> index_;
+    std::vector<std::uint32_t> free_;
+    std::vector<Retired> retired_; // in ticket order
+    std::size_t dirtyBegin_ = 0; // byte range written since the last commit
+    std::size_t dirtyEnd_ = 0;
+    std::uint64_t lastTicket_ = 0;
+    std::uint64_t durableTicket_ = 0;
+    bool failed_ = false;
+    std::size_t droppedSlots_ = 0;
+    std::uint64_t commits_ = 0;
+
+    // Held shared while flushing and exclusive while the mapping moves.
+    std::shared_mutex remap_;
+
+    std::thread committer_;
+    std::condition_variable wake_;
+    std::condition_variable durable_;
+    bool stop_ = false;
+};
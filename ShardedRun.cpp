@@ -0,0 +1,426 @@
+#include "ShardedRun.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string_view>
+#include <thread>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+#include "EvalCache.hpp"
+#include "MappedFile.hpp"
+
+#ifdef __linux__
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Checkpoint layout (see BinaryFormat.hpp):
+//   magic[8] version:u32 runKey:u64 shardGames:u64 crc32:u32
+// then one record per finished shard:
+//   shard:u32 chunks:u32 chunks * totals crc32:u32
+// A record's CRC covers the record. Only the last append can be torn; it is
+// cut off when the run starts again.
+constexpr char kShardMagic[8] = {'H', 'M', 'S', 'H', 'R', 'D', 'B', '1'};
+constexpr std::uint32_t kShardVersion = 1;
+constexpr std::size_t kShardHeaderSize = 8 + 4 + 8 + 8 + 4;
+constexpr std::size_t kTotalsSize = 8 + 4 * 8 + 4 * 8 + 2 * (8 + 8 + 8);
+
+// Chunks a worker holds reports for at once, like evaluatePolicy's rounds.
+constexpr std::size_t kRoundChunks = 1024;
+
+// What the report keeps of one chunk; lives in the shared mapping.
+struct ChunkTotals {
+    std::uint64_t games;
+    std::uint64_t endings[4];
+    std::uint64_t tiers[4];
+    MetricStats p;
+    MetricStats l;
+};
+
+ChunkTotals totalsOf(const EvalReport& rep) {
+    ChunkTotals t;
+    t.games = rep.games;
+    std::memcpy(t.endings, rep.endings, sizeof t.endings);
+    std::memcpy(t.tiers, rep.tiers, sizeof t.tiers);
+    t.p = rep.p;
+    t.l = rep.l;
+    return t;
+}
+
+void putStats(std::vector<unsigned char>& buf, const MetricStats& m) {
+    appendRaw<std::uint64_t>(buf, m.count);
+    appendRaw<double>(buf, m.mean);
+    appendRaw<double>(buf, m.m2);
+}
+
+MetricStats getStats(const unsigned char* p, std::size_t& off) {
+    MetricStats m;
+    m.count = getRaw<std::uint64_t>(p, off);
+    m.mean = getRaw<double>(p, off);
+    m.m2 = getRaw<double>(p, off);
+    return m;
+}
+
+// How the run is cut.
+struct ShardPlan {
+    std::uint64_t shardGames = 0;
+    std::size_t shards = 0;
+    std::size_t chunksPerShard = 0;
+    std::size_t chunks = 0;
+
+    std::size_t chunksOf(std::size_t shard) const {
+        return std::min(chunks, (shard + 1) * chunksPerShard) - shard * chunksPerShard;
+    }
+    EvalConfig shardConfig(const EvalConfig& cfg, std::size_t shard) const {
+        EvalConfig sub = cfg;
+        const std::uint64_t skip = shardGames * shard;
+        sub.firstGame = cfg.firstGame + skip;
+        sub.games = std::min(shardGames, cfg.games - skip);
+        sub.distributions = false;
+        sub.phaseCounters = false;
+        return sub;
+    }
+};
+
+std::vector<unsigned char> checkpointHeader(std::uint64_t runKey, std::uint64_t shardGames) {
+    std::vector<unsigned char> buf(kShardMagic, kShardMagic + sizeof kShardMagic);
+    appendRaw<std::uint32_t>(buf, kShardVersion);
+    appendRaw<std::uint64_t>(buf, runKey);
+    appendRaw<std::uint64_t>(buf, shardGames);
+    appendRaw<std::uint32_t>(buf, crc32(buf.data(), buf.size()));
+    return buf;
+}
+
+std::vector<unsigned char> shardRecord(std::uint32_t shard, const ChunkTotals* totals, std::size_t n) {
+    std::vector<unsigned char> buf;
+    buf.reserve(8 + n * kTotalsSize + 4);
+    appendRaw<std::uint32_t>(buf, shard);
+    appendRaw<std::uint32_t>(buf, static_cast<std::uint32_t>(n));
+    for (std::size_t i = 0; i < n; ++i) {
+        const ChunkTotals& t = totals[i];
+        appendRaw<std::uint64_t>(buf, t.games);
+        for (std::uint64_t e : t.endings) appendRaw<std::uint64_t>(buf, e);
+        for (std::uint64_t e : t.tiers) appendRaw<std::uint64_t>(buf, e);
+        putStats(buf, t.p);
+        putStats(buf, t.l);
+    }
+    appendRaw<std::uint32_t>(buf, crc32(buf.data(), buf.size()));
+    return buf;
+}
+
+// Fills the totals and done flags of the shards the checkpoint has, creating
+// it when it is missing.
+ShardStatus loadCheckpoint(const std::string& path, std::uint64_t runKey, const ShardPlan& plan,
+                           ChunkTotals* totals, std::vector<char>& done) {
+    const std::vector<unsigned char> header = checkpointHeader(runKey, plan.shardGames);
+    MappedFile file;
+    if (!file.open(path)) {
+        if (std::ifstream(path)) return ShardStatus::BadCheckpoint;
+        return replaceFileAtomically(path, header.data(), header.size()) ? ShardStatus::Done
+                                                                         : ShardStatus::CannotWrite;
+    }
+    const unsigned char* p = file.data();
+    const std::size_t size = file.size();
+    if (size < kShardHeaderSize || std::memcmp(p, header.data(), kShardHeaderSize) != 0) {
+        return ShardStatus::BadCheckpoint;
+    }
+
+    std::size_t off = kShardHeaderSize;
+    std::size_t valid = off;
+    while (off < size) {
+        const std::size_t start = off;
+        if (size - off < 8) break;
+        const std::uint32_t shard = getRaw<std::uint32_t>(p, off);
+        const std::uint32_t n = getRaw<std::uint32_t>(p, off);
+        if (size - off < static_cast<std::size_t>(n) * kTotalsSize + 4) break;
+        const std::size_t crcOff = off + static_cast<std::size_t>(n) * kTotalsSize;
+        std::size_t at = crcOff;
+        if (getRaw<std::uint32_t>(p, at) != crc32(p + start, crcOff - start)) break;
+        if (shard >= plan.shards || n != plan.chunksOf(shard)) return ShardStatus::BadCheckpoint;
+
+        ChunkTotals* t = totals + shard * plan.chunksPerShard;
+        for (std::uint32_t i = 0; i < n; ++i) {
+            t[i].games = getRaw<std::uint64_t>(p, off);
+            for (std::uint64_t& e : t[i].endings) e = getRaw<std::uint64_t>(p, off);
+            for (std::uint64_t& e : t[i].tiers) e = getRaw<std::uint64_t>(p, off);
+            t[i].p = getStats(p, off);
+            t[i].l = getStats(p, off);
+        }
+        off = valid = at;
+        done[shard] = 1;
+    }
+    if (valid == size) return ShardStatus::Done;
+
+    // A torn last record: keep what is before it, so appends go on from there.
+    const std::vector<unsigned char> kept(p, p + valid);
+    file.close();
+    return replaceFileAtomically(path, kept.data(), kept.size()) ? ShardStatus::Done : ShardStatus::CannotWrite;
+}
+
+void mergeTotals(const ChunkTotals* totals, std::size_t chunks, EvalReport& out) {
+    out = EvalReport{};
+    EvalReport part;
+    for (std::size_t c = 0; c < chunks; ++c) {
+        const ChunkTotals& t = totals[c];
+        part.games = t.games;
+        std::memcpy(part.endings, t.endings, sizeof t.endings);
+        std::memcpy(part.tiers, t.tiers, sizeof t.tiers);
+        part.p = t.p;
+        part.l = t.l;
+        out.merge(part);
+    }
+}
+
+std::vector<int> parseCpuList(std::string_view s) {
+    std::vector<int> out;
+    while (!s.empty()) {
+        const std::size_t comma = std::min(s.find(','), s.size());
+        const std::string item(s.substr(0, comma));
+        s.remove_prefix(std::min(comma + 1, s.size()));
+        int from = 0, to = 0;
+        const std::size_t dash = item.find('-');
+        try {
+            from = std::stoi(item.substr(0, dash));
+            to = dash == std::string::npos ? from : std::stoi(item.substr(dash + 1));
+        } catch (...) {
+            continue;
+        }
+        for (int c = from; c <= to; ++c) out.push_back(c);
+    }
+    return out;
+}
+
+std::string readLine(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+}
+
+#ifdef __linux__
+
+std::vector<NumaNode> numaNodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool masked = sched_getaffinity(0, sizeof allowed, &allowed) == 0;
+    auto usable = [&](int cpu) { return !masked || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)); };
+
+    std::vector<NumaNode> nodes;
+    for (int id : parseCpuList(readLine("/sys/devices/system/node/online"))) {
+        NumaNode n;
+        n.id = id;
+        const std::string list = readLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        for (int cpu : parseCpuList(list)) {
+            if (usable(cpu)) n.cpus.push_back(cpu);
+        }
+        if (!n.cpus.empty()) nodes.push_back(std::move(n));
+    }
+    if (nodes.empty()) {
+        NumaNode n;
+        const int count = masked ? CPU_SETSIZE : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int cpu = 0; cpu < count; ++cpu) {
+            if (usable(cpu)) n.cpus.push_back(cpu);
+        }
+        nodes.push_back(std::move(n));
+    }
+    return nodes;
+}
+
+namespace {
+
+// The shared mapping: the claim counter, a done flag per shard, then the
+// totals of every chunk in chunk order.
+struct SharedRun {
+    std::atomic<std::uint64_t> nextClaim;
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the claim counter must work across processes");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "the done flags must work across processes");
+
+std::size_t alignUp(std::size_t n) {
+    return (n + 63) / 64 * 64;
+}
+
+[[noreturn]] void workerMain(const GameRules& r, const Policy& policy, const EvalConfig& cfg, const ShardPlan& plan,
+                             const std::vector<std::uint32_t>& pending, const NumaNode& node, unsigned threads,
+                             SharedRun* shared, std::atomic<std::uint32_t>* done, ChunkTotals* totals) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node.cpus) CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof set, &set); // the pool's threads inherit it
+    {
+        WorkStealingPool pool(threads != 0 ? threads : static_cast<unsigned>(node.cpus.size()));
+        std::vector<EvalScratch> scratch(pool.size());
+        std::vector<EvalReport> partial;
+        for (;;) {
+            const std::uint64_t i = shared->nextClaim.fetch_add(1);
+            if (i >= pending.size()) break;
+            const std::uint32_t shard = pending[i];
+            const EvalConfig sub = plan.shardConfig(cfg, shard);
+            const std::size_t chunks = plan.chunksOf(shard);
+            ChunkTotals* out = totals + shard * plan.chunksPerShard;
+            for (std::size_t first = 0; first < chunks; first += kRoundChunks) {
+                partial.assign(std::min(kRoundChunks, chunks - first), EvalReport{});
+                pool.run(partial.size(), [&](std::size_t c, unsigned worker) {
+                    evaluateChunk(r, policy, sub, first + c, scratch[worker], partial[c]);
+                });
+                for (std::size_t c = 0; c < partial.size(); ++c) out[first + c] = totalsOf(partial[c]);
+            }
+            done[shard].store(1, std::memory_order_release);
+        }
+    }
+    _exit(0);
+}
+
+}
+
+ShardStatus runSharded(const GameRules& r, const Policy& policy, const std::string& policySpec,
+                       const EvalConfig& cfg, const ShardConfig& sc, EvalReport& out,
+                       const std::function<void(const ShardProgress&)>& progress) {
+    const std::uint64_t chunk = std::max<std::uint64_t>(1, cfg.chunkGames);
+    ShardPlan plan;
+    plan.shardGames = std::max(chunk, (sc.shardGames + chunk - 1) / chunk * chunk);
+    plan.shards = static_cast<std::size_t>((cfg.games + plan.shardGames - 1) / plan.shardGames);
+    plan.chunksPerShard = static_cast<std::size_t>(plan.shardGames / chunk);
+    plan.chunks = evalChunkCount(cfg);
+
+    const std::size_t flagsAt = alignUp(sizeof(SharedRun));
+    const std::size_t totalsAt = alignUp(flagsAt + plan.shards * sizeof(std::atomic<std::uint32_t>));
+    const std::size_t bytes = std::max<std::size_t>(1, totalsAt + plan.chunks * sizeof(ChunkTotals));
+    void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return ShardStatus::Unsupported;
+    unsigned char* base = static_cast<unsigned char*>(mem);
+    SharedRun* shared = new (base) SharedRun{};
+    auto* done = reinterpret_cast<std::atomic<std::uint32_t>*>(base + flagsAt);
+    for (std::size_t k = 0; k < plan.shards; ++k) new (done + k) std::atomic<std::uint32_t>(0);
+    auto* totals = reinterpret_cast<ChunkTotals*>(base + totalsAt);
+    struct Unmap {
+        void* p;
+        std::size_t n;
+        ~Unmap() { munmap(p, n); }
+    } unmap{mem, bytes};
+
+    ShardProgress prog;
+    prog.shards = plan.shards;
+    std::vector<char> recorded(plan.shards, 0);
+    if (!sc.checkpoint.empty()) {
+        const std::uint64_t runKey = evalCacheKey(r, policySpec, cfg, policy.contentHash());
+        const ShardStatus st = loadCheckpoint(sc.checkpoint, runKey, plan, totals, recorded);
+        if (st != ShardStatus::Done) return st;
+    }
+    std::vector<std::uint32_t> pending;
+    for (std::size_t k = 0; k < plan.shards; ++k) {
+        if (!recorded[k]) {
+            pending.push_back(static_cast<std::uint32_t>(k));
+            continue;
+        }
+        ++prog.resumed;
+        ++prog.done;
+        prog.games += plan.shardConfig(cfg, k).games;
+    }
+    if (progress) progress(prog);
+
+    // Appends the newly done shards to the checkpoint, in the order seen.
+    bool writeFailed = false;
+    auto recordDone = [&] {
+        bool any = false;
+        for (std::uint32_t k : pending) {
+            if (recorded[k] || done[k].load(std::memory_order_acquire) == 0) continue;
+            if (!sc.checkpoint.empty()) {
+                const std::vector<unsigned char> rec =
+                    shardRecord(k, totals + k * plan.chunksPerShard, plan.chunksOf(k));
+                if (!appendToFile(sc.checkpoint, rec.data(), rec.size(), true)) {
+                    writeFailed = true;
+                    return any;
+                }
+            }
+            recorded[k] = 1;
+            any = true;
+            ++prog.done;
+            prog.games += plan.shardConfig(cfg, k).games;
+            if (progress) progress(prog);
+        }
+        return any;
+    };
+
+    bool workerFailed = false;
+    if (!pending.empty()) {
+        const std::vector<NumaNode> nodes = numaNodes();
+        const std::size_t workers =
+            std::min<std::size_t>(sc.workers != 0 ? sc.workers : nodes.size(), pending.size());
+        const pid_t coordinator = getpid();
+        std::vector<pid_t> pids;
+
+        // Whatever is buffered would be written again by every child.
+        std::cout.flush();
+        std::cerr.flush();
+        for (std::size_t w = 0; w < workers; ++w) {
+            const pid_t pid = fork();
+            if (pid == 0) {
+                // Workers die with the coordinator instead of playing for nobody.
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                if (getppid() != coordinator) _exit(1);
+                workerMain(r, policy, cfg, plan, pending, nodes[w % nodes.size()], sc.threadsPerWorker, shared,
+                           done, totals);
+            }
+            if (pid < 0) {
+                workerFailed = true;
+                break;
+            }
+            pids.push_back(pid);
+        }
+
+        std::size_t alive = pids.size();
+        bool killed = false;
+        while (alive > 0) {
+            const bool any = !writeFailed && recordDone();
+            if (writeFailed && !killed) {
+                for (pid_t pid : pids) kill(pid, SIGKILL);
+                killed = true;
+            }
+            int status = 0;
+            const pid_t pid = waitpid(-1, &status, WNOHANG);
+            if (pid > 0) {
+                --alive;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) workerFailed = true;
+                continue;
+            }
+            if (!any) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        if (!writeFailed) recordDone();
+    }
+    if (writeFailed) return ShardStatus::CannotWrite;
+    if (workerFailed || prog.done != plan.shards) return ShardStatus::WorkerFailed;
+
+    mergeTotals(totals, plan.chunks, out);
+    return ShardStatus::Done;
+}
+
+#else
+
+std::vector<NumaNode> numaNodes() {
+    NumaNode n;
+    const int count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int cpu = 0; cpu < count; ++cpu) n.cpus.push_back(cpu);
+    return {n};
+}
+
+ShardStatus runSharded(const GameRules&, const Policy&, const std::string&, const EvalConfig&, const ShardConfig&,
+                       EvalReport&, const std::function<void(const ShardProgress&)>&) {
+    return ShardStatus::Unsupported;
+}
+
+#endif
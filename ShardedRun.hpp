@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Evaluator.hpp"
+#include "GameRules.hpp"
+#include "Policy.hpp"
+
+// One evaluation spread over worker processes, resumable after a kill.
+//
+// The games are cut into shards of whole chunks, shard k starting at game
+// firstGame + k * shardGames. Workers are forked processes, by default one per
+// NUMA node, each pinned to its node's CPUs so that what it allocates stays
+// local, and each playing on a pool of its own. They claim shards through a
+// counter in a shared anonymous mapping, write every chunk's totals into the
+// shard's slots there and flag the shard when it is done.
+//
+// The coordinator only watches: every shard flagged done is appended to the
+// checkpoint (synced) before it counts, so a run that is killed starts again
+// from its finished shards. The chunks are merged in order at the end, so the
+// report is evaluatePolicy's to the bit, without distributions and phase
+// counters. Linux only; elsewhere runSharded returns Unsupported.
+
+struct ShardConfig {
+    std::string checkpoint;                      // journal of finished shards; empty = none
+    std::uint64_t shardGames = std::uint64_t(1) << 24; // rounded up to whole chunks
+    unsigned workers = 0;                        // 0 = one per NUMA node
+    unsigned threadsPerWorker = 0;               // 0 = the CPUs of the worker's node
+};
+
+struct ShardProgress {
+    std::size_t shards = 0;
+    std::size_t resumed = 0; // found in the checkpoint
+    std::size_t done = 0;    // resumed ones included
+    std::uint64_t games = 0; // in the done shards
+};
+
+enum class ShardStatus {
+    Done,
+    BadCheckpoint,   // damaged, or made for other rules, policy or games
+    CannotWrite,     // the checkpoint
+    WorkerFailed,    // the finished shards are in the checkpoint; run again to go on
+    Unsupported,
+};
+
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus; // those the process may run on
+};
+
+// The nodes with CPUs this process may use; one node with all of them when the
+// system does not tell.
+std::vector<NumaNode> numaNodes();
+
+// Plays policy; policySpec, the name makePolicy built it from, and what the
+// policy loaded from its file are part of the checkpoint's identity.
+ShardStatus runSharded(const GameRules& r, const Policy& policy, const std::string& policySpec,
+                       const EvalConfig& cfg, const ShardConfig& sc, EvalReport& out,
+                       const std::function<void(const ShardProgress&)>& progress);
@@ -0,0 +1,161 @@
+#include "Simulation.hpp"
+
+#include "PhaseCounters.hpp"
+
+template <class Rules>
+GameResult playGame(Rules rules, const Policy& policy, Rng& rng) {
+    const GameRules& r = rules();
+    GameResult res;
+    GameState& s = res.finalState;
+    initNewGame(s, r);
+
+    while (s.year <= r.totalYears) {
+        beginYearFor(s, rules, rng);
+        const Decisions d = clampDecisionsFor(s, policy.decide(s, r), rules);
+        RngYearEvents ev{rng, s.year};
+        res.ending = resolveYearFor(s, d, rules, ev);
+        if (res.ending != YearOutcome::Continued) return res;
+    }
+
+    res.score = computeFinalScore(s, r);
+    return res;
+}
+
+// The rest of a game whose grain outgrew its batch lane, from the year's
+// decisions on.
+template <class Rules>
+static void finishGameScalar(GameState s, const Decisions& d, Rules rules, const Policy& policy, Rng& rng,
+                             GameResult& res) {
+    const GameRules& r = rules();
+    RngYearEvents ev{rng, s.year};
+    res.ending = resolveYearFor(s, d, rules, ev);
+    while (res.ending == YearOutcome::Continued && s.year <= r.totalYears) {
+        beginYearFor(s, rules, rng);
+        const Decisions next = clampDecisionsFor(s, policy.decide(s, r), rules);
+        RngYearEvents nextEv{rng, s.year};
+        res.ending = resolveYearFor(s, next, rules, nextEv);
+    }
+    res.finalState = s;
+    res.score = res.completed() ? computeFinalScore(s, r) : FinalScore{};
+}
+
+template <class Rules>
+void playGameBatch(Rules rules, const Policy& policy, std::vector<Rng>& rngs, std::vector<GameResult>& results,
+                   BatchKernel k, PhaseCounters* counters) {
+    const GameRules& r = rules();
+    const std::size_t n = rngs.size();
+    GameStateBatch b;
+    DecisionsBatch d;
+    YearDrawsBatch draws;
+    b.resize(n);
+    d.resize(n);
+    results.resize(n);
+    std::vector<char> leftBatch(n, 0);
+
+    GameState start;
+    initNewGame(start, r);
+    for (std::size_t i = 0; i < n; ++i) b.setLane(i, start);
+
+    for (int year = 1; year <= r.totalYears; ++year) {
+        const std::uint64_t t0 = counters ? phaseClock() : 0;
+        beginYearBatch(b, rules, rngs);
+        const std::uint64_t t1 = counters ? phaseClock() : 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (!b.active[i]) continue;
+            const GameState s = b.lane(i);
+            const Decisions dec = clampDecisionsFor(s, policy.decide(s, r), rules);
+            if (!grainFitsBatchLane(s, dec, r)) {
+                finishGameScalar(s, dec, rules, policy, rngs[i], results[i]);
+                leftBatch[i] = 1;
+                b.active[i] = 0;
+                continue;
+            }
+            d.setLane(i, dec);
+        }
+        if (counters) {
+            const std::uint64_t t2 = phaseClock();
+            counters->add(BatchPhase::LandPrice, t1 - t0);
+            counters->add(BatchPhase::Decisions, t2 - t1);
+        }
+        resolveYearBatch(b, d, draws, rules, rngs, k, counters);
+    }
+    if (counters) counters->games += n;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        if (leftBatch[i]) continue;
+        GameResult& res = results[i];
+        res.finalState = b.lane(i);
+        res.ending = static_cast<YearOutcome>(b.outcome[i]);
+        res.score = res.completed() ? computeFinalScore(res.finalState, r) : FinalScore{};
+    }
+}
+
+template <class Rules>
+BatchCheck checkBatchKernel(Rules rules, const Policy& policy, std::uint64_t seed, std::size_t lanes, BatchKernel k) {
+    const GameRules& r = rules();
+    std::vector<Rng> scalarRngs;
+    std::vector<Rng> laneRngs;
+    std::vector<GameState> scalar(lanes);
+    std::vector<YearOutcome> scalarOutcome(lanes, YearOutcome::Continued);
+    std::vector<char> leftBatch(lanes, 0);
+    GameStateBatch b;
+    DecisionsBatch d;
+    YearDrawsBatch draws;
+    b.resize(lanes);
+    d.resize(lanes);
+    for (std::size_t i = 0; i < lanes; ++i) {
+        scalarRngs.emplace_back(seed, i);
+        laneRngs.emplace_back(seed, i);
+        initNewGame(scalar[i], r);
+        b.setLane(i, scalar[i]);
+    }
+
+    BatchCheck check;
+    for (int year = 1; year <= r.totalYears; ++year) {
+        beginYearBatch(b, rules, laneRngs);
+        for (std::size_t i = 0; i < lanes; ++i) {
+            if (scalarOutcome[i] != YearOutcome::Continued) continue;
+            beginYear(scalar[i], r, scalarRngs[i]);
+            const Decisions dec = clampDecisions(scalar[i], policy.decide(scalar[i], r), r);
+            if (!leftBatch[i] && !grainFitsBatchLane(scalar[i], dec, r)) {
+                leftBatch[i] = 1;
+                b.active[i] = 0;
+                ++check.lanesLeft;
+            }
+            d.setLane(i, dec);
+            scalarOutcome[i] = resolveYear(scalar[i], dec, r, scalarRngs[i]);
+        }
+        resolveYearBatch(b, d, draws, rules, laneRngs, k);
+
+        for (std::size_t i = 0; i < lanes; ++i) {
+            if (leftBatch[i]) continue;
+            const bool active = scalarOutcome[i] == YearOutcome::Continued;
+            if (sameState(scalar[i], b.lane(i)) && (b.active[i] != 0) == active &&
+                b.outcome[i] == static_cast<std::int32_t>(scalarOutcome[i])) {
+                continue;
+            }
+            if (check.mismatches++ == 0) {
+                check.firstLane = i;
+                check.firstYear = year;
+            }
+        }
+    }
+    return check;
+}
+
+#define HAMMURABI_INSTANTIATE_SIMULATION(Rules)                                                              \
+    template GameResult playGame(Rules, const Policy&, Rng&);                                                \
+    template void playGameBatch(Rules, const Policy&, std::vector<Rng>&, std::vector<GameResult>&, BatchKernel, \
+                                PhaseCounters*);                                                             \
+    template BatchCheck checkBatchKernel(Rules, const Policy&, std::uint64_t, std::size_t, BatchKernel);
+HAMMURABI_FOR_EACH_RULES_SOURCE(HAMMURABI_INSTANTIATE_SIMULATION)
+#undef HAMMURABI_INSTANTIATE_SIMULATION
+
+GameResult playGame(const GameRules& r, const Policy& policy, Rng& rng) {
+    return playGame(DynamicRules{r}, policy, rng);
+}
+
+void playGameBatch(const GameRules& r, const Policy& policy, std::vector<Rng>& rngs,
+                   std::vector<GameResult>& results, BatchKernel k, PhaseCounters* counters) {
+    playGameBatch(DynamicRules{r}, policy, rngs, results, k, counters);
+}
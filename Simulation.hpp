@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "GameStateBatch.hpp"
+#include "Policy.hpp"
+
+// One complete game played by a policy, with no console traffic.
+struct GameResult {
+    GameState finalState;
+    YearOutcome ending = YearOutcome::Continued; // Continued = all years played
+    FinalScore score;                            // meaningful only if completed()
+
+    bool completed() const { return ending == YearOutcome::Continued; }
+};
+
+GameResult playGame(const GameRules& r, const Policy& policy, Rng& rng);
+
+// Plays rngs.size() games side by side in SoA lanes; lane i ends exactly as
+// playGame() with rngs[i] would. A game whose grain grows past what a 32-bit
+// lane holds is played to its end on the scalar path from that year on.
+// counters, if given, get the phase timings and event counts of these games
+// added (PhaseCounters.hpp); they do not see the years played off the batch.
+void playGameBatch(const GameRules& r, const Policy& policy, std::vector<Rng>& rngs,
+                   std::vector<GameResult>& results, BatchKernel k = batchKernel(),
+                   PhaseCounters* counters = nullptr);
+
+// The same for a rules source (RulesPresets.hpp), instantiated for every
+// HAMMURABI_FOR_EACH_RULES_SOURCE entry. Pick the source once per bulk job
+// with withRules().
+template <class Rules>
+GameResult playGame(Rules rules, const Policy& policy, Rng& rng);
+template <class Rules>
+void playGameBatch(Rules rules, const Policy& policy, std::vector<Rng>& rngs, std::vector<GameResult>& results,
+                   BatchKernel k = batchKernel(), PhaseCounters* counters = nullptr);
+
+struct BatchCheck {
+    std::uint64_t mismatches = 0; // lane-years whose state, active flag or outcome differ
+    std::size_t lanesLeft = 0;    // lanes whose grain outgrew the batch; not compared from then on
+    std::size_t firstLane = 0;    // where the first mismatch was, if any
+    int firstYear = 0;
+};
+
+// Checks kernel k against the year rules: plays games 0..lanes-1 of seed with
+// policy through resolveYear and through the kernel side by side, and compares
+// every lane with its game field by field after every year. Instantiated like
+// playGameBatch.
+template <class Rules>
+BatchCheck checkBatchKernel(Rules rules, const Policy& policy, std::uint64_t seed, std::size_t lanes, BatchKernel k);
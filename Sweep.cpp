@@ -0,0 +1,220 @@
+#include "Sweep.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <string_view>
+
+#include "GameState.hpp"
+#include "Policy.hpp"
+#include "Rng.hpp"
+
+namespace {
+
+constexpr std::size_t kMaxGridPoints = std::size_t(1) << 22;
+constexpr std::size_t kMaxWaveChunks = std::size_t(1) << 16; // chunk reports held at once
+
+// Splits off the next blank-separated word of s.
+std::string_view nextWord(std::string_view& s) {
+    s = trimBlanks(s);
+    std::size_t n = 0;
+    while (n < s.size() && !isBlank(s[n])) ++n;
+    const std::string_view w = s.substr(0, n);
+    s.remove_prefix(n);
+    return w;
+}
+
+template <class T>
+bool parseWhole(std::string_view s, T& v) {
+    const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+bool parseAxis(std::string_view key, std::string_view values, SweepAxis& axis) {
+    GameRules probe;
+    if (!probe.setValue(key, 0.0)) return false;
+    axis.key = std::string(key);
+    axis.count = 0; // given by a grid, optional for a hypercube
+    const std::string_view from = nextWord(values);
+    const std::string_view to = nextWord(values);
+    const std::string_view count = nextWord(values);
+    if (!parseRuleNumber(from, axis.from) || !parseRuleNumber(to, axis.to)) return false;
+    if (!count.empty() && (!parseWhole(count, axis.count) || axis.count < 1)) return false;
+    return trimBlanks(values).empty();
+}
+
+// The seed cost and the initial grain are snapped to 1 / kMaxGrainScale
+// bushel, the finest unit the game keeps grain in, so that a point's rules are
+// the ones its games are played under.
+double axisValue(const SweepAxis& a, double t) {
+    const double x = a.from + (a.to - a.from) * t;
+    if (a.key != "seeds_consumption" && a.key != "initial_wheat") return x;
+    return std::round(x * kMaxGrainScale) / kMaxGrainScale;
+}
+
+}
+
+bool loadSweepSpec(const std::string& path, SweepSpec& spec) {
+    std::ifstream in(path);
+    if (!in) return false;
+    spec = SweepSpec{};
+
+    std::string text;
+    while (std::getline(in, text)) {
+        std::string_view line = text;
+        line = trimBlanks(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        const std::size_t eq = line.find('=');
+        if (eq == std::string_view::npos) return false;
+        const std::string_view key = trimBlanks(line.substr(0, eq));
+        const std::string_view value = trimBlanks(line.substr(eq + 1));
+
+        if (key == "lhs") {
+            if (!parseWhole(value, spec.lhsPoints) || spec.lhsPoints == 0) return false;
+        } else if (key == "seed") {
+            if (!parseWhole(value, spec.lhsSeed)) return false;
+        } else {
+            SweepAxis axis;
+            if (!parseAxis(key, value, axis)) return false;
+            for (const SweepAxis& a : spec.axes) {
+                if (a.key == axis.key) return false;
+            }
+            spec.axes.push_back(axis);
+        }
+    }
+    if (spec.axes.empty()) return false;
+    if (spec.lhsPoints != 0) return spec.lhsPoints <= kMaxGridPoints;
+
+    std::size_t points = 1;
+    for (const SweepAxis& a : spec.axes) {
+        if (a.count < 1) return false;
+        points *= static_cast<std::size_t>(a.count);
+        if (points > kMaxGridPoints) return false;
+    }
+    return true;
+}
+
+std::vector<GameRules> sweepPoints(const SweepSpec& spec, const GameRules& base) {
+    std::vector<GameRules> out;
+    if (spec.lhsPoints != 0) {
+        // Every axis is cut into lhsPoints strata and each stratum is used
+        // once, at a random spot inside it.
+        const std::size_t n = spec.lhsPoints;
+        out.assign(n, base);
+        std::mt19937_64 g(spec.lhsSeed);
+        std::vector<std::size_t> strata(n);
+        for (const SweepAxis& a : spec.axes) {
+            for (std::size_t i = 0; i < n; ++i) strata[i] = i;
+            for (std::size_t i = n; i > 1; --i) std::swap(strata[i - 1], strata[g() % i]);
+            for (std::size_t i = 0; i < n; ++i) {
+                const double t = (static_cast<double>(strata[i]) + unitFraction(g())) / static_cast<double>(n);
+                out[i].setValue(a.key, axisValue(a, t));
+            }
+        }
+        return out;
+    }
+
+    std::size_t n = 1;
+    for (const SweepAxis& a : spec.axes) n *= static_cast<std::size_t>(a.count);
+    out.assign(n, base);
+    for (std::size_t p = 0; p < n; ++p) {
+        std::size_t rest = p;
+        for (std::size_t k = spec.axes.size(); k-- > 0;) {
+            const SweepAxis& a = spec.axes[k];
+            const std::size_t step = rest % static_cast<std::size_t>(a.count);
+            rest /= static_cast<std::size_t>(a.count);
+            const double t = a.count == 1 ? 0.0 : static_cast<double>(step) / static_cast<double>(a.count - 1);
+            out[p].setValue(a.key, axisValue(a, t));
+        }
+    }
+    return out;
+}
+
+bool runSweep(const SweepSpec& spec, const GameRules& base, const std::string& policySpec,
+              const EvalConfig& cfg, EvalCache* cache, WorkStealingPool& pool, std::vector<SweepPoint>& points,
+              SweepSummary& summary) {
+    const std::vector<GameRules> rules = sweepPoints(spec, base);
+    const std::size_t n = rules.size();
+    points.assign(n, SweepPoint{});
+    summary = SweepSummary{};
+    summary.points = n;
+
+    std::vector<std::unique_ptr<Policy>> policies(n);
+    std::vector<std::uint64_t> keys(n, 0);
+    std::vector<std::size_t> pending;
+    for (std::size_t i = 0; i < n; ++i) {
+        SweepPoint& pt = points[i];
+        pt.rules = rules[i];
+        if (pt.rules.isFilled()) policies[i] = makePolicy(policySpec, pt.rules);
+        pt.valid = policies[i] != nullptr;
+        if (!pt.valid) {
+            ++summary.invalid;
+            continue;
+        }
+        keys[i] = evalCacheKey(pt.rules, policySpec, cfg, policies[i]->contentHash());
+        if (cache && cache->find(keys[i], pt.report)) {
+            pt.cached = true;
+            ++summary.cached;
+        } else {
+            pending.push_back(i);
+        }
+    }
+
+    // Pending points go to the pool in waves, every chunk of every point of a
+    // wave as one task list, and each wave is cached before the next starts.
+    const std::size_t chunks = evalChunkCount(cfg);
+    const std::size_t wave = std::max<std::size_t>(1, kMaxWaveChunks / std::max<std::size_t>(1, chunks));
+    std::vector<EvalScratch> scratch(pool.size());
+    std::vector<EvalReport> partial;
+    for (std::size_t w = 0; w < pending.size(); w += wave) {
+        const std::size_t m = std::min(wave, pending.size() - w);
+        partial.assign(m * chunks, EvalReport{});
+        pool.run(m * chunks, [&](std::size_t t, unsigned worker) {
+            const std::size_t i = pending[w + t / chunks];
+            evaluateChunk(points[i].rules, *policies[i], cfg, t % chunks, scratch[worker], partial[t]);
+        });
+
+        for (std::size_t j = 0; j < m; ++j) {
+            const std::size_t i = pending[w + j];
+            EvalReport total;
+            for (std::size_t c = 0; c < chunks; ++c) total.merge(partial[j * chunks + c]);
+            points[i].report = total;
+            ++summary.computed;
+            summary.gamesPlayed += total.games;
+            if (cache && !cache->put(keys[i], total)) return false;
+        }
+    }
+    return true;
+}
+
+void writeSweepTable(std::ostream& out, const SweepSpec& spec, const std::vector<SweepPoint>& points) {
+    for (const SweepAxis& a : spec.axes) out << a.key << '\t';
+    out << "games\tcompleted\toverthrown\tdepopulated\tplague\tP_mean\tP_var\tL_mean\tL_var"
+           "\tterrible\tmediocre\tgood\texcellent\tsource\n";
+
+    const std::streamsize precision = out.precision(6);
+    for (const SweepPoint& pt : points) {
+        for (const SweepAxis& a : spec.axes) {
+            double v = 0.0;
+            pt.rules.getValue(a.key, v);
+            out << v << '\t';
+        }
+        if (!pt.valid) {
+            out << "0\t-\t-\t-\t-\t-\t-\t-\t-\t-\t-\t-\t-\tinvalid\n";
+            continue;
+        }
+        const EvalReport& r = pt.report;
+        const double games = static_cast<double>(std::max<std::uint64_t>(1, r.games));
+        const double completed = static_cast<double>(std::max<std::uint64_t>(1, r.p.count));
+        out << r.games;
+        for (std::uint64_t e : r.endings) out << '\t' << static_cast<double>(e) / games;
+        out << '\t' << r.p.mean << '\t' << r.p.variance() << '\t' << r.l.mean << '\t' << r.l.variance();
+        for (std::uint64_t t : r.tiers) out << '\t' << static_cast<double>(t) / completed;
+        out << '\t' << (pt.cached ? "cached" : "computed") << '\n';
+    }
+    out.precision(precision);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "EvalCache.hpp"
+#include "Evaluator.hpp"
+#include "GameRules.hpp"
+#include "WorkStealingPool.hpp"
+
+// Evaluates a policy over many variants of a rule set.
+//
+// A sweep spec is a text file of lines, '#' starts a comment:
+//   KEY = FROM TO COUNT   an axis over a rules file key, COUNT values from FROM
+//                         to TO inclusive (integer keys are rounded, the
+//                         seed cost and initial grain to 1/1000 bushel)
+//   lhs = N               N Latin hypercube points instead of the full grid;
+//                         axes then only need FROM TO
+//   seed = S              seed of the hypercube sampling
+// Numbers may use a decimal comma, as in the rules file. The grid varies the
+// last axis fastest. Points that do not make a complete rule set (say
+// land_price_min above land_price_max) are reported and skipped.
+
+struct SweepAxis {
+    std::string key;
+    double from = 0.0;
+    double to = 0.0;
+    int count = 1;
+};
+
+struct SweepSpec {
+    std::vector<SweepAxis> axes;
+    std::size_t lhsPoints = 0; // 0 = full grid
+    std::uint64_t lhsSeed = 1;
+};
+
+bool loadSweepSpec(const std::string& path, SweepSpec& spec);
+// The rule sets of the sweep: base with each point's axis values applied.
+std::vector<GameRules> sweepPoints(const SweepSpec& spec, const GameRules& base);
+
+struct SweepPoint {
+    GameRules rules;
+    bool valid = false;  // a complete rule set the policy can play
+    bool cached = false; // the report came from the cache
+    EvalReport report;
+};
+
+struct SweepSummary {
+    std::size_t points = 0;
+    std::size_t invalid = 0;
+    std::size_t cached = 0;
+    std::size_t computed = 0;
+    std::uint64_t gamesPlayed = 0;
+};
+
+// Plays every valid point not found in the cache with cfg's games, all points'
+// chunks on one pool, and stores the new reports in the cache (may be null).
+// False if the cache cannot be written.
+bool runSweep(const SweepSpec& spec, const GameRules& base, const std::string& policySpec,
+              const EvalConfig& cfg, EvalCache* cache, WorkStealingPool& pool, std::vector<SweepPoint>& points,
+              SweepSummary& summary);
+
+// One tab-separated row per point under a header: the axis values, then
+// the ending and tier shares and the P and L moments.
+void writeSweepTable(std::ostream& out, const SweepSpec& spec, const std::vector<SweepPoint>& points);
@@ -0,0 +1,347 @@
+#include "Tournament.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+
+#include "Transcript.hpp"
+
+namespace {
+
+constexpr std::size_t kReadBlock = std::size_t(1) << 20;
+constexpr std::size_t kMergeBuffer = std::size_t(64) << 10; // bytes read ahead per run while merging
+constexpr std::size_t kFlushAt = std::size_t(1) << 16;
+
+struct Entry {
+    TranscriptResult result;
+    std::uint64_t entry = 0;   // position over all archives, from 1
+    std::uint32_t archive = 0;
+};
+
+int rankGroup(TranscriptEnd e) {
+    switch (e) {
+    case TranscriptEnd::Completed: return 0;
+    case TranscriptEnd::Overthrown:
+    case TranscriptEnd::Depopulated:
+    case TranscriptEnd::Plague: return 1;
+    case TranscriptEnd::Unfinished: return 2;
+    case TranscriptEnd::Refused:
+    case TranscriptEnd::Malformed: return 3;
+    }
+    return 3;
+}
+
+bool ranksBefore(const Entry& a, const Entry& b) {
+    const int ga = rankGroup(a.result.end);
+    const int gb = rankGroup(b.result.end);
+    if (ga != gb) return ga < gb;
+    if (ga == 0) {
+        const FinalScore& fa = a.result.score;
+        const FinalScore& fb = b.result.score;
+        if (fa.tier != fb.tier) return fa.tier > fb.tier;
+        if (fa.avgStarvedPercent != fb.avgStarvedPercent) return fa.avgStarvedPercent < fb.avgStarvedPercent;
+        if (fa.acresPerCitizen != fb.acresPerCitizen) return fa.acresPerCitizen > fb.acresPerCitizen;
+    } else if (a.result.years != b.result.years) {
+        return a.result.years > b.result.years;
+    }
+    return a.entry < b.entry;
+}
+
+// Whole games cut from one archive: the work of one pool task.
+struct Batch {
+    std::string text;
+    std::uint32_t archive = 0;
+    std::uint64_t firstLine = 1;
+    std::vector<Entry> entries;
+    std::uint64_t years = 0;
+    std::uint64_t malformedLines = 0;
+};
+
+// Reads an archive block by block and cuts it into batches at game headers.
+class ArchiveReader {
+public:
+    ~ArchiveReader() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        fromStdin_ = path == "-";
+        f_ = fromStdin_ ? stdin : std::fopen(path.c_str(), "rb");
+        pending_.clear();
+        eof_ = false;
+        nextLine_ = 1;
+        return f_ != nullptr;
+    }
+    void close() {
+        if (f_ && !fromStdin_) std::fclose(f_);
+        f_ = nullptr;
+    }
+    bool failed() const { return f_ && std::ferror(f_); }
+    std::uint64_t bytes() const { return bytes_; }
+
+    // Takes at least batchBytes (less at the end), up to the next game header.
+    // False at the end of the archive.
+    bool next(std::size_t batchBytes, Batch& b);
+
+private:
+    bool fill();
+
+    std::FILE* f_ = nullptr;
+    bool fromStdin_ = false;
+    std::string pending_; // read but not yet cut
+    bool eof_ = false;
+    std::uint64_t nextLine_ = 1;
+    std::uint64_t bytes_ = 0;
+};
+
+bool ArchiveReader::fill() {
+    if (eof_) return false;
+    const std::size_t old = pending_.size();
+    pending_.resize(old + kReadBlock);
+    const std::size_t got = std::fread(&pending_[old], 1, kReadBlock, f_);
+    pending_.resize(old + got);
+    bytes_ += got;
+    if (got == 0) eof_ = true;
+    return got > 0;
+}
+
+bool ArchiveReader::next(std::size_t batchBytes, Batch& b) {
+    while (pending_.size() < batchBytes && fill()) {
+    }
+    if (pending_.empty()) return false;
+
+    // Walk the line starts after batchBytes until one is a game header.
+    std::size_t cut = 0;
+    std::size_t from = std::min(batchBytes, pending_.size()) - 1;
+    for (;;) {
+        const std::size_t nl = pending_.find('\n', from);
+        if (nl == std::string::npos) {
+            if (fill()) continue;
+            cut = pending_.size();
+            break;
+        }
+        const std::size_t start = nl + 1;
+        std::size_t end = pending_.find('\n', start);
+        if (end == std::string::npos) {
+            if (fill()) continue;
+            end = pending_.size();
+        }
+        if (start < end && isTranscriptGameHeader(&pending_[start], pending_.data() + end)) {
+            cut = start;
+            break;
+        }
+        if (end == pending_.size()) {
+            cut = end;
+            break;
+        }
+        from = end;
+    }
+
+    b.text.assign(pending_, 0, cut);
+    pending_.erase(0, cut);
+    b.firstLine = nextLine_;
+    nextLine_ += static_cast<std::uint64_t>(std::count(b.text.begin(), b.text.end(), '\n'));
+    return true;
+}
+
+void playBatch(Batch& b, const GameRules& r, const TranscriptOptions& topt) {
+    b.entries.clear();
+    TranscriptPlayer player(r, topt, [&](const TranscriptResult& t) {
+        Entry e;
+        e.result = t;
+        e.result.seed = topt.seed;
+        e.archive = b.archive;
+        b.entries.push_back(e);
+    }, b.firstLine);
+
+    const char* p = b.text.data();
+    const char* end = p + b.text.size();
+    while (p != end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (!nl) {
+            player.line(p, end);
+            break;
+        }
+        player.line(p, nl);
+        p = nl + 1;
+    }
+    player.finish();
+    b.years = player.years();
+    b.malformedLines = player.malformedLines();
+}
+
+std::string runPath(const std::string& resultsPath, std::size_t run) {
+    return resultsPath + ".run" + std::to_string(run);
+}
+
+bool spillRun(std::vector<Entry>& run, const std::string& path) {
+    std::sort(run.begin(), run.end(), ranksBefore);
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    const bool ok = std::fwrite(run.data(), sizeof(Entry), run.size(), f) == run.size();
+    run.clear();
+    return std::fclose(f) == 0 && ok;
+}
+
+// A sorted run being merged.
+struct RunCursor {
+    std::FILE* f = nullptr;
+    std::vector<Entry> buf;
+    std::size_t pos = 0;
+
+    bool refill() {
+        buf.resize(std::max<std::size_t>(1, kMergeBuffer / sizeof(Entry)));
+        buf.resize(std::fread(buf.data(), sizeof(Entry), buf.size(), f));
+        pos = 0;
+        return !buf.empty();
+    }
+    const Entry& head() const { return buf[pos]; }
+};
+
+// Writes the ranked lines, buffered.
+class ResultsWriter {
+public:
+    ResultsWriter(std::FILE* f, const std::vector<std::string>& archives) : f_(f), archives_(archives) {}
+
+    void write(const Entry& e) {
+        ++rank_;
+        text_ += "rank=";
+        putNumber(rank_);
+        text_ += " entry=";
+        putNumber(e.entry);
+        text_ += " archive=";
+        text_ += archives_[e.archive];
+        text_ += " line=";
+        putNumber(e.result.line);
+        text_ += ' ';
+        formatTranscriptResult(e.result, text_);
+        text_ += '\n';
+        if (text_.size() >= kFlushAt) flush();
+    }
+    bool flush() {
+        ok_ = ok_ && std::fwrite(text_.data(), 1, text_.size(), f_) == text_.size();
+        text_.clear();
+        return ok_;
+    }
+
+private:
+    void putNumber(std::uint64_t v) {
+        char buf[24];
+        text_.append(buf, std::to_chars(buf, buf + sizeof buf, v).ptr);
+    }
+
+    std::FILE* f_;
+    const std::vector<std::string>& archives_;
+    std::string text_;
+    std::uint64_t rank_ = 0;
+    bool ok_ = true;
+};
+
+bool mergeRuns(const std::string& resultsPath, std::size_t runs, ResultsWriter& out) {
+    std::vector<RunCursor> cursors(runs);
+    bool ok = true;
+    for (std::size_t i = 0; i < runs; ++i) {
+        cursors[i].f = std::fopen(runPath(resultsPath, i).c_str(), "rb");
+        ok = ok && cursors[i].f;
+    }
+
+    auto after = [&](std::size_t a, std::size_t b) { return ranksBefore(cursors[b].head(), cursors[a].head()); };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(after)> heads(after);
+    for (std::size_t i = 0; ok && i < runs; ++i) {
+        if (cursors[i].refill()) heads.push(i);
+    }
+    while (ok && !heads.empty()) {
+        const std::size_t i = heads.top();
+        heads.pop();
+        out.write(cursors[i].head());
+        if (++cursors[i].pos < cursors[i].buf.size() || cursors[i].refill()) heads.push(i);
+    }
+
+    for (RunCursor& c : cursors) {
+        if (c.f) {
+            ok = ok && !std::ferror(c.f);
+            std::fclose(c.f);
+        }
+    }
+    return ok;
+}
+
+}
+
+bool runTournament(const std::vector<std::string>& archives, const std::string& resultsPath, const GameRules& r,
+                   const TournamentOptions& opt, WorkStealingPool& pool, TournamentSummary& summary) {
+    TranscriptOptions topt;
+    topt.sharedSeed = true;
+    topt.seed = opt.seed;
+
+    std::vector<Batch> batches(static_cast<std::size_t>(pool.size()) * 4);
+    std::vector<Entry> run;
+    run.reserve(opt.runEntries);
+    std::size_t spilled = 0;
+    bool ok = true;
+
+    auto removeRuns = [&] {
+        for (std::size_t i = 0; i < spilled; ++i) std::remove(runPath(resultsPath, i).c_str());
+    };
+
+    ArchiveReader reader;
+    for (std::size_t a = 0; ok && a < archives.size(); ++a) {
+        if (!reader.open(archives[a])) {
+            ok = false;
+            break;
+        }
+        for (bool more = true; ok && more;) {
+            std::size_t n = 0;
+            while (n < batches.size() && (more = reader.next(opt.batchBytes, batches[n]))) {
+                batches[n].archive = static_cast<std::uint32_t>(a);
+                ++n;
+            }
+            pool.run(n, [&](std::size_t i, unsigned) { playBatch(batches[i], r, topt); });
+
+            for (std::size_t i = 0; i < n; ++i) {
+                Batch& b = batches[i];
+                summary.years += b.years;
+                summary.malformedLines += b.malformedLines;
+                for (Entry& e : b.entries) {
+                    e.entry = ++summary.entries;
+                    if (e.result.end == TranscriptEnd::Completed) ++summary.completed;
+                    if (rankGroup(e.result.end) == 3) ++summary.disqualified;
+                    run.push_back(e);
+                    if (run.size() >= opt.runEntries) {
+                        ok = ok && spillRun(run, runPath(resultsPath, spilled++));
+                    }
+                }
+            }
+        }
+        ok = ok && !reader.failed();
+        reader.close();
+    }
+    summary.bytes = reader.bytes();
+    if (!ok) {
+        removeRuns();
+        return false;
+    }
+
+    std::FILE* f = std::fopen(resultsPath.c_str(), "wb");
+    if (!f) {
+        removeRuns();
+        return false;
+    }
+    std::string header = "# seed=" + std::to_string(opt.seed) + " entries=" + std::to_string(summary.entries) +
+        " archives=" + std::to_string(archives.size()) + "\n";
+    std::fwrite(header.data(), 1, header.size(), f);
+
+    ResultsWriter out(f, archives);
+    if (spilled == 0) {
+        std::sort(run.begin(), run.end(), ranksBefore);
+        for (const Entry& e : run) out.write(e);
+    } else {
+        if (!run.empty()) ok = spillRun(run, runPath(resultsPath, spilled++));
+        ok = ok && mergeRuns(resultsPath, spilled, out);
+    }
+    summary.runs = spilled;
+    removeRuns();
+    ok = out.flush() && ok;
+    return std::fclose(f) == 0 && ok;
+}
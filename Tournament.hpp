@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "GameRules.hpp"
+#include "WorkStealingPool.hpp"
+
+// Scores competition archives (transcripts in the Transcript line protocol) on
+// all cores and writes a ranked results file.
+//
+// Every entry plays the same random events, Rng(seed), so entries differ by
+// their decisions only; the seed in a "game" header is ignored and its id
+// names the entry. Decisions are checked with the same limits as the prompts.
+//
+// Archives are read in rounds of batches cut at game headers, each round is
+// played on the pool, and results are sorted into runs spilled next to the
+// results file whenever a run fills up. The ranking is a merge of the runs, so
+// memory stays at one round plus one run however large the archives are.
+//
+// Ranking: completed games by tier, then lower P, then higher L; then lost
+// games, then unfinished transcripts, then refused or malformed ones, each by
+// more years played. Ties keep archive order.
+
+struct TournamentOptions {
+    std::uint64_t seed = 1;
+    std::size_t batchBytes = std::size_t(256) << 10; // transcript text per pool task
+    std::size_t runEntries = std::size_t(1) << 18;   // results held before a sorted run is spilled
+};
+
+struct TournamentSummary {
+    std::uint64_t entries = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t disqualified = 0; // refused or malformed
+    std::uint64_t years = 0;
+    std::uint64_t malformedLines = 0;
+    std::uint64_t bytes = 0;
+    std::size_t runs = 0;
+};
+
+// "-" reads standard input. Returns false if an archive cannot be read or the
+// results cannot be written.
+bool runTournament(const std::vector<std::string>& archives, const std::string& resultsPath, const GameRules& r,
+                   const TournamentOptions& opt, WorkStealingPool& pool, TournamentSummary& summary);
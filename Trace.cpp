@@ -0,0 +1,464 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "BinaryFormat.hpp"
+#include "Crc32.hpp"
+
+namespace {
+
+// Layout (see BinaryFormat.hpp):
+//   header: magic[8] version:u32 columns:u32
+//   block:  rows:u32 columns:u32 (offset:u32 size:u32 crc32:u32)[columns] segments
+//   segment: encoding:u8 width:u8 0:u16 base:i64 first:i64 packed:u64[]
+//   index:  (offset:u64 rows:u32 size:u32)[blocks]
+//   tail:   indexOffset:u64 blocks:u64 rows:u64 indexCrc32:u32 magic[8]
+// Segment offsets are from the start of the block.
+constexpr char kTraceMagic[8] = {'H', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+constexpr char kIndexMagic[8] = {'H', 'M', 'T', 'R', 'I', 'D', 'X', '1'};
+constexpr std::uint32_t kTraceVersion = 2;
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kTailSize = 36;
+constexpr std::size_t kIndexEntrySize = 16;
+constexpr std::size_t kSegmentHeaderSize = 20;
+constexpr std::size_t kBlockHeaderSize = 8 + 12 * kTraceColumnCount;
+
+// Bytes queued for the writer thread beyond which append() waits for it.
+constexpr std::size_t kMaxQueuedBytes = std::size_t(64) << 20;
+
+enum class Encoding : std::uint8_t {
+    FrameOfReference, // value - base
+    Delta,            // value - previous - base, after the first
+};
+
+const char* const kColumnNames[kTraceColumnCount] = {
+    "game", "year", "population", "grain", "grain_scale", "land", "land_price", "buy", "sell", "feed", "plant",
+    "yield_draw", "rats_draw", "plague_draw", "starved", "immigrants", "plague", "yield", "harvest",
+    "rats_ate", "outcome",
+};
+
+unsigned bitWidth(std::uint64_t v) {
+    unsigned w = 0;
+    while (v != 0) {
+        ++w;
+        v >>= 1;
+    }
+    return w;
+}
+
+std::int64_t intValue(const TraceRow& row, TraceColumn c) {
+    const GameState& b = row.before;
+    const GameState& a = row.after;
+    switch (c) {
+    case TraceColumn::Game: return static_cast<std::int64_t>(row.game);
+    case TraceColumn::Year: return b.year;
+    case TraceColumn::Population: return b.population;
+    case TraceColumn::Grain: return b.grainUnits;
+    case TraceColumn::GrainScale: return b.grainScale;
+    case TraceColumn::Land: return b.landAcres;
+    case TraceColumn::LandPrice: return b.landPriceThisYear;
+    case TraceColumn::Buy: return row.decisions.acresToBuy;
+    case TraceColumn::Sell: return row.decisions.acresToSell;
+    case TraceColumn::Feed: return row.decisions.bushelsToFeed;
+    case TraceColumn::Plant: return row.decisions.acresToPlant;
+    case TraceColumn::YieldDraw: return row.yieldDraw;
+    case TraceColumn::RatsDraw: return row.ratsDraw;
+    case TraceColumn::PlagueDraw: return row.plagueDraw;
+    case TraceColumn::Starved: return a.starvedLastYear;
+    case TraceColumn::Immigrants: return a.immigrantsLastYear;
+    case TraceColumn::Plague: return a.plagueLastYear;
+    case TraceColumn::Yield: return a.yieldPerAcreLastYear;
+    case TraceColumn::Harvest: return a.harvestTotalLastYear;
+    case TraceColumn::RatsAte: return a.ratsAteLastYear;
+    case TraceColumn::Outcome: return static_cast<std::int64_t>(row.outcome);
+    }
+    return 0;
+}
+
+// Appends v[0..n) at width bits each, low bits first, in 64-bit words.
+void packBits(const std::vector<std::uint64_t>& v, unsigned width, std::vector<unsigned char>& out) {
+    if (width == 0) return;
+    std::uint64_t acc = 0;
+    unsigned used = 0;
+    for (std::uint64_t x : v) {
+        acc |= x << used;
+        used += width;
+        if (used >= 64) {
+            appendRaw(out, acc);
+            used -= 64;
+            acc = used != 0 ? x >> (width - used) : 0;
+        }
+    }
+    if (used != 0) appendRaw(out, acc);
+}
+
+std::size_t packedBytes(std::size_t n, unsigned width) {
+    return (n * width + 63) / 64 * 8;
+}
+
+// One column of a block, in whichever encoding is smaller.
+void encodeSegment(const std::vector<std::int64_t>& v, std::vector<unsigned char>& out) {
+    const std::size_t n = v.size();
+    std::vector<std::uint64_t> stored(n);
+
+    const auto [lo, hi] = std::minmax_element(v.begin(), v.end());
+    const unsigned forWidth = bitWidth(static_cast<std::uint64_t>(*hi) - static_cast<std::uint64_t>(*lo));
+
+    std::int64_t dlo = 0, dhi = 0;
+    for (std::size_t i = 1; i < n; ++i) {
+        const std::uint64_t step = static_cast<std::uint64_t>(v[i]) - static_cast<std::uint64_t>(v[i - 1]);
+        const auto d = static_cast<std::int64_t>(step);
+        dlo = i == 1 ? d : std::min(dlo, d);
+        dhi = i == 1 ? d : std::max(dhi, d);
+    }
+    const unsigned deltaWidth = bitWidth(static_cast<std::uint64_t>(dhi) - static_cast<std::uint64_t>(dlo));
+    const bool delta = n > 1 && packedBytes(n - 1, deltaWidth) < packedBytes(n, forWidth);
+
+    out.push_back(static_cast<std::uint8_t>(delta ? Encoding::Delta : Encoding::FrameOfReference));
+    out.push_back(static_cast<std::uint8_t>(delta ? deltaWidth : forWidth));
+    out.push_back(0);
+    out.push_back(0);
+    appendRaw<std::int64_t>(out, delta ? dlo : *lo);
+    appendRaw<std::int64_t>(out, v[0]);
+    if (delta) {
+        stored.resize(n - 1);
+        for (std::size_t i = 1; i < n; ++i) {
+            stored[i - 1] = static_cast<std::uint64_t>(v[i]) - static_cast<std::uint64_t>(v[i - 1]) -
+                static_cast<std::uint64_t>(dlo);
+        }
+        packBits(stored, deltaWidth, out);
+    } else {
+        for (std::size_t i = 0; i < n; ++i) {
+            stored[i] = static_cast<std::uint64_t>(v[i]) - static_cast<std::uint64_t>(*lo);
+        }
+        packBits(stored, forWidth, out);
+    }
+}
+
+void encodeBlock(const std::vector<TraceRow>& rows, std::vector<unsigned char>& out) {
+    out.assign(kBlockHeaderSize, 0);
+    writeRaw<std::uint32_t>(out.data(), static_cast<std::uint32_t>(rows.size()));
+    writeRaw<std::uint32_t>(out.data() + 4, static_cast<std::uint32_t>(kTraceColumnCount));
+
+    std::vector<std::int64_t> v(rows.size());
+    for (int c = 0; c < kTraceColumnCount; ++c) {
+        const TraceColumn col = static_cast<TraceColumn>(c);
+        for (std::size_t i = 0; i < rows.size(); ++i) v[i] = intValue(rows[i], col);
+        const std::size_t begin = out.size();
+        encodeSegment(v, out);
+        const std::size_t dir = 8 + 12 * static_cast<std::size_t>(c);
+        writeRaw<std::uint32_t>(out.data() + dir, static_cast<std::uint32_t>(begin));
+        writeRaw<std::uint32_t>(out.data() + dir + 4, static_cast<std::uint32_t>(out.size() - begin));
+        writeRaw<std::uint32_t>(out.data() + dir + 8, crc32(out.data() + begin, out.size() - begin));
+    }
+}
+
+// Decodes a segment of n values.
+bool decodeSegment(const unsigned char* p, std::size_t size, std::size_t n, std::vector<std::int64_t>& out) {
+    if (size < kSegmentHeaderSize || n == 0) return false;
+    const auto enc = static_cast<Encoding>(p[0]);
+    const unsigned width = p[1];
+    const auto base = static_cast<std::uint64_t>(readRaw<std::int64_t>(p + 4));
+    const auto first = static_cast<std::uint64_t>(readRaw<std::int64_t>(p + 12));
+    const bool delta = enc == Encoding::Delta;
+    const std::size_t packed = delta ? n - 1 : n;
+    if (width > 64 || (enc != Encoding::Delta && enc != Encoding::FrameOfReference) ||
+        size != kSegmentHeaderSize + packedBytes(packed, width)) {
+        return false;
+    }
+
+    const unsigned char* words = p + kSegmentHeaderSize;
+    const std::uint64_t mask = width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+    auto stored = [&](std::size_t i) -> std::uint64_t {
+        if (width == 0) return 0;
+        const std::size_t bit = i * width;
+        const unsigned off = static_cast<unsigned>(bit % 64);
+        std::uint64_t x = readRaw<std::uint64_t>(words + bit / 64 * 8) >> off;
+        if (off + width > 64) x |= readRaw<std::uint64_t>(words + bit / 64 * 8 + 8) << (64 - off);
+        return x & mask;
+    };
+
+    out.resize(n);
+    if (delta) {
+        std::uint64_t x = first;
+        out[0] = static_cast<std::int64_t>(x);
+        for (std::size_t i = 1; i < n; ++i) {
+            x += base + stored(i - 1);
+            out[i] = static_cast<std::int64_t>(x);
+        }
+    } else {
+        for (std::size_t i = 0; i < n; ++i) out[i] = static_cast<std::int64_t>(base + stored(i));
+    }
+    return true;
+}
+
+// Events that pass the Rng's draws through and remember them in the row.
+struct RecordingEvents {
+    RngYearEvents draws;
+    TraceRow& row;
+
+    int yieldPerAcre(const GameRules& r) { return row.yieldDraw = draws.yieldPerAcre(r); }
+    int ratsAte(int maxRats) { return row.ratsDraw = draws.ratsAte(maxRats); }
+    bool plague(const GameRules& r) { return row.plagueDraw = draws.plague(r); }
+};
+
+template <class Rules>
+void traceChunk(Rules rules, const Policy& policy, const EvalConfig& cfg, std::size_t c,
+                std::vector<TraceRow>& rows) {
+    const GameRules& r = rules();
+    const std::uint64_t chunk = std::max<std::uint64_t>(1, cfg.chunkGames);
+    const std::uint64_t begin = cfg.firstGame + c * chunk;
+    const std::uint64_t end = cfg.firstGame + std::min<std::uint64_t>(cfg.games, (c + 1) * chunk);
+
+    rows.clear();
+    for (std::uint64_t g = begin; g < end; ++g) {
+        Rng rng(cfg.seed, g);
+        GameState s;
+        initNewGame(s, r);
+        while (s.year <= r.totalYears) {
+            beginYearFor(s, rules, rng);
+            TraceRow row;
+            row.game = g;
+            row.before = s;
+            row.decisions = clampDecisionsFor(s, policy.decide(s, r), rules);
+            RecordingEvents ev{RngYearEvents{rng, s.year}, row};
+            row.outcome = resolveYearFor(s, row.decisions, rules, ev);
+            row.after = s;
+            rows.push_back(row);
+            if (row.outcome != YearOutcome::Continued) break;
+        }
+    }
+}
+
+}
+
+const char* traceColumnName(TraceColumn c) {
+    const int i = static_cast<int>(c);
+    return i >= 0 && i < kTraceColumnCount ? kColumnNames[i] : "?";
+}
+
+bool findTraceColumn(const std::string& name, TraceColumn& c) {
+    for (int i = 0; i < kTraceColumnCount; ++i) {
+        if (name == kColumnNames[i]) {
+            c = static_cast<TraceColumn>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::open(const std::string& path) {
+    close();
+    f_ = std::fopen(path.c_str(), "wb");
+    if (!f_) return false;
+    std::vector<unsigned char> header(kTraceMagic, kTraceMagic + sizeof kTraceMagic);
+    appendRaw<std::uint32_t>(header, kTraceVersion);
+    appendRaw<std::uint32_t>(header, static_cast<std::uint32_t>(kTraceColumnCount));
+    if (std::fwrite(header.data(), 1, header.size(), f_) != header.size()) {
+        std::fclose(f_);
+        f_ = nullptr;
+        return false;
+    }
+    offset_ = header.size();
+    rows_ = 0;
+    index_.clear();
+    closing_ = false;
+    failed_ = false;
+    stalls_ = 0;
+    thread_ = std::thread([this] { writerLoop(); });
+    return true;
+}
+
+void TraceWriter::append(const std::vector<TraceRow>& rows) {
+    if (rows.empty()) return;
+    std::vector<unsigned char> block;
+    encodeBlock(rows, block);
+    {
+        std::unique_lock<std::mutex> lock(m_);
+        // A block always goes into an empty buffer, however large it is.
+        if (!filling_.empty() && filling_.size() + block.size() > kMaxQueuedBytes) {
+            ++stalls_;
+            drained_.wait(lock, [&] { return filling_.empty() || filling_.size() + block.size() <= kMaxQueuedBytes; });
+        }
+        filling_.insert(filling_.end(), block.begin(), block.end());
+        BlockEntry e;
+        e.rows = static_cast<std::uint32_t>(rows.size());
+        e.size = static_cast<std::uint32_t>(block.size());
+        fillingBlocks_.push_back(e);
+    }
+    wake_.notify_one();
+}
+
+void TraceWriter::writerLoop() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            wake_.wait(lock, [this] { return closing_ || !filling_.empty(); });
+            if (filling_.empty()) return; // closing and drained
+            filling_.swap(writing_);
+            fillingBlocks_.swap(writingBlocks_);
+        }
+        drained_.notify_all();
+        const bool ok = std::fwrite(writing_.data(), 1, writing_.size(), f_) == writing_.size();
+        for (BlockEntry e : writingBlocks_) {
+            e.offset = offset_;
+            offset_ += e.size;
+            rows_ += e.rows;
+            index_.push_back(e);
+        }
+        writing_.clear();
+        writingBlocks_.clear();
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(m_);
+            failed_ = true;
+        }
+    }
+}
+
+bool TraceWriter::close() {
+    if (!f_) return false;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        closing_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+
+    std::vector<unsigned char> tail;
+    for (const BlockEntry& e : index_) {
+        appendRaw<std::uint64_t>(tail, e.offset);
+        appendRaw<std::uint32_t>(tail, e.rows);
+        appendRaw<std::uint32_t>(tail, e.size);
+    }
+    const std::uint32_t crc = crc32(tail.data(), tail.size());
+    appendRaw<std::uint64_t>(tail, offset_);
+    appendRaw<std::uint64_t>(tail, index_.size());
+    appendRaw<std::uint64_t>(tail, rows_);
+    appendRaw<std::uint32_t>(tail, crc);
+    tail.insert(tail.end(), kIndexMagic, kIndexMagic + sizeof kIndexMagic);
+
+    const bool ok = !failed_ && std::fwrite(tail.data(), 1, tail.size(), f_) == tail.size();
+    offset_ += tail.size();
+    const bool closed = std::fclose(f_) == 0;
+    f_ = nullptr;
+    filling_.clear();
+    fillingBlocks_.clear();
+    return ok && closed;
+}
+
+bool TraceReader::open(const std::string& path) {
+    close();
+    if (!file_.open(path)) return false;
+    const unsigned char* p = file_.data();
+    const std::size_t size = file_.size();
+    if (size < kHeaderSize + kTailSize || std::memcmp(p, kTraceMagic, sizeof kTraceMagic) != 0 ||
+        readRaw<std::uint32_t>(p + 8) != kTraceVersion ||
+        readRaw<std::uint32_t>(p + 12) != static_cast<std::uint32_t>(kTraceColumnCount) ||
+        std::memcmp(p + size - sizeof kIndexMagic, kIndexMagic, sizeof kIndexMagic) != 0) {
+        close();
+        return false;
+    }
+
+    const unsigned char* tail = p + size - kTailSize;
+    const std::uint64_t indexOffset = readRaw<std::uint64_t>(tail);
+    const std::uint64_t blocks = readRaw<std::uint64_t>(tail + 8);
+    const std::uint64_t rows = readRaw<std::uint64_t>(tail + 16);
+    if (indexOffset < kHeaderSize || blocks > (size - kTailSize - indexOffset) / kIndexEntrySize ||
+        indexOffset + blocks * kIndexEntrySize + kTailSize != size ||
+        readRaw<std::uint32_t>(tail + 24) != crc32(p + indexOffset, blocks * kIndexEntrySize)) {
+        close();
+        return false;
+    }
+
+    std::uint64_t counted = 0;
+    index_.resize(blocks);
+    for (std::size_t b = 0; b < blocks; ++b) {
+        const unsigned char* e = p + indexOffset + b * kIndexEntrySize;
+        BlockEntry& entry = index_[b];
+        entry.offset = readRaw<std::uint64_t>(e);
+        entry.rows = readRaw<std::uint32_t>(e + 8);
+        entry.size = readRaw<std::uint32_t>(e + 12);
+        if (entry.offset < kHeaderSize || entry.size < kBlockHeaderSize || entry.offset > indexOffset ||
+            entry.size > indexOffset - entry.offset || entry.rows == 0 ||
+            readRaw<std::uint32_t>(p + entry.offset) != entry.rows) {
+            close();
+            return false;
+        }
+        counted += entry.rows;
+    }
+    if (counted != rows) {
+        close();
+        return false;
+    }
+    rows_ = rows;
+    return true;
+}
+
+void TraceReader::close() {
+    file_.close();
+    index_.clear();
+    rows_ = 0;
+}
+
+const unsigned char* TraceReader::segment(std::size_t block, TraceColumn c, std::size_t& size) const {
+    const int col = static_cast<int>(c);
+    if (block >= index_.size() || col < 0 || col >= kTraceColumnCount) return nullptr;
+    const BlockEntry& e = index_[block];
+    const unsigned char* b = file_.data() + e.offset;
+    const unsigned char* dir = b + 8 + 12 * static_cast<std::size_t>(col);
+    const std::uint32_t offset = readRaw<std::uint32_t>(dir);
+    size = readRaw<std::uint32_t>(dir + 4);
+    if (offset < kBlockHeaderSize || offset > e.size || size > e.size - offset ||
+        readRaw<std::uint32_t>(dir + 8) != crc32(b + offset, size)) {
+        return nullptr;
+    }
+    return b + offset;
+}
+
+bool TraceReader::column(std::size_t block, TraceColumn c, std::vector<std::int64_t>& out) const {
+    std::size_t size = 0;
+    const unsigned char* p = segment(block, c, size);
+    return p && decodeSegment(p, size, index_[block].rows, out);
+}
+
+bool TraceReader::column(std::size_t block, TraceColumn c, std::vector<double>& out) const {
+    std::vector<std::int64_t> v;
+    std::vector<std::int64_t> scale;
+    if (!column(block, c, v) || (c == TraceColumn::Grain && !column(block, TraceColumn::GrainScale, scale))) {
+        return false;
+    }
+    out.resize(v.size());
+    for (std::size_t i = 0; i < v.size(); ++i) {
+        if (c != TraceColumn::Grain) out[i] = static_cast<double>(v[i]);
+        else if (scale[i] < 1) return false;
+        else out[i] = static_cast<double>(v[i]) / static_cast<double>(scale[i]);
+    }
+    return true;
+}
+
+bool writeTrace(const GameRules& r, const Policy& policy, const EvalConfig& cfg, const std::string& path,
+                WorkStealingPool& pool, TraceSummary& summary) {
+    TraceWriter out;
+    if (!out.open(path)) return false;
+    std::vector<std::vector<TraceRow>> rows(pool.size());
+
+    withRules(r, cfg.rulesPresets, [&](auto rules) {
+        pool.run(evalChunkCount(cfg), [&](std::size_t c, unsigned worker) {
+            traceChunk(rules, policy, cfg, c, rows[worker]);
+            out.append(rows[worker]);
+        });
+    });
+
+    const bool ok = out.close();
+    summary.games = cfg.games;
+    summary.rows = out.rows();
+    summary.bytes = out.bytes();
+    summary.blocks = out.blocks();
+    summary.stalls = out.stalls();
+    return ok;
+}
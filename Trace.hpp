@@ -0,0 +1,164 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Evaluator.hpp"
+#include "MappedFile.hpp"
+
+// Per-year traces of simulated games in a columnar file, for offline analysis.
+//
+// Every played year is a row: the state before the year, the (clamped)
+// decisions, the year's random draws and the report fields the year left in
+// GameState. Rows are stored in blocks of a few ten thousand rows, each column
+// of a block in its own segment: integers as frame-of-reference or delta
+// values bit-packed to the narrowest width. Grain is stored as it is kept, an
+// integer count of units next to the scale of those units.
+// The footer indexes the blocks, so a reader maps the file and decodes one
+// column of one block without touching the rest.
+//
+// Blocks are written in the order they are finished, so rows of different
+// chunks interleave in thread order; every row carries its game id.
+
+enum class TraceColumn {
+    Game,
+    Year,
+    Population,  // before the year
+    Grain,       // in units of 1 / GrainScale bushel
+    GrainScale,
+    Land,
+    LandPrice,
+    Buy,         // decisions
+    Sell,
+    Feed,
+    Plant,
+    YieldDraw,   // random draws; rats and plague are 0 when not drawn
+    RatsDraw,
+    PlagueDraw,
+    Starved,     // report fields after the year; stale after a game-ending year
+    Immigrants,
+    Plague,
+    Yield,
+    Harvest,
+    RatsAte,
+    Outcome,     // YearOutcome
+};
+constexpr int kTraceColumnCount = 21;
+
+const char* traceColumnName(TraceColumn c);
+// False if no column has that name.
+bool findTraceColumn(const std::string& name, TraceColumn& c);
+
+struct TraceRow {
+    std::uint64_t game = 0;
+    GameState before;
+    Decisions decisions;
+    int yieldDraw = 0;
+    int ratsDraw = 0;
+    bool plagueDraw = false;
+    GameState after;
+    YearOutcome outcome = YearOutcome::Continued;
+};
+
+// Appends blocks to a trace file. append() encodes on the calling thread and
+// hands the bytes to a writer thread through two swapped buffers, so
+// simulation threads only wait for a short copy, unless the disk falls
+// behind: once the buffer being filled holds more than a bound while the
+// other is still being written, append() waits for the writer to take it.
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool open(const std::string& path);
+    // One block; thread-safe. Empty rows are ignored.
+    void append(const std::vector<TraceRow>& rows);
+    // Writes what is queued and the index. False if any write failed.
+    bool close();
+
+    // Totals of the written file, after close().
+    std::uint64_t rows() const { return rows_; }
+    std::uint64_t stalls() const { return stalls_; } // appends that waited for the disk
+    std::uint64_t bytes() const { return offset_; }
+    std::size_t blocks() const { return index_.size(); }
+
+private:
+    struct BlockEntry {
+        std::uint64_t offset = 0;
+        std::uint32_t rows = 0;
+        std::uint32_t size = 0;
+    };
+
+    void writerLoop();
+
+    std::FILE* f_ = nullptr;
+    std::thread thread_;
+    std::mutex m_;
+    std::condition_variable wake_;    // the writer: data or closing
+    std::condition_variable drained_; // appenders: the writer took the buffer
+    // Blocks appended since the writer thread last took the buffer.
+    std::vector<unsigned char> filling_;
+    std::vector<BlockEntry> fillingBlocks_;
+    bool closing_ = false;
+    bool failed_ = false;
+    std::uint64_t stalls_ = 0;
+
+    // Writer thread only, until close() joins it.
+    std::vector<unsigned char> writing_;
+    std::vector<BlockEntry> writingBlocks_;
+    std::vector<BlockEntry> index_;
+    std::uint64_t offset_ = 0;
+    std::uint64_t rows_ = 0;
+};
+
+// A finished trace file, memory-mapped.
+class TraceReader {
+public:
+    // False if the file is not a complete trace (no index, damaged index).
+    bool open(const std::string& path);
+    void close();
+
+    std::size_t blocks() const { return index_.size(); }
+    std::uint64_t rows() const { return rows_; }
+    std::size_t blockRows(std::size_t block) const { return index_[block].rows; }
+
+    // Decodes one column of one block after checking the segment's CRC.
+    bool column(std::size_t block, TraceColumn c, std::vector<std::int64_t>& out) const;
+    // The same as doubles, with Grain in bushels.
+    bool column(std::size_t block, TraceColumn c, std::vector<double>& out) const;
+
+private:
+    struct BlockEntry {
+        std::uint64_t offset = 0;
+        std::uint32_t rows = 0;
+        std::uint32_t size = 0;
+    };
+
+    const unsigned char* segment(std::size_t block, TraceColumn c, std::size_t& size) const;
+
+    MappedFile file_;
+    std::vector<BlockEntry> index_;
+    std::uint64_t rows_ = 0;
+};
+
+struct TraceSummary {
+    std::uint64_t games = 0;
+    std::uint64_t rows = 0;
+    std::uint64_t bytes = 0;
+    std::size_t blocks = 0;
+    std::uint64_t stalls = 0; // blocks that waited for the disk
+};
+
+// Plays cfg's games (one block per chunk, batchLanes is ignored) and writes
+// every year to path. False if the file cannot be written.
+bool writeTrace(const GameRules& r, const Policy& policy, const EvalConfig& cfg, const std::string& path,
+                WorkStealingPool& pool, TraceSummary& summary);
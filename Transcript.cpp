@@ -0,0 +1,221 @@
+#include "Transcript.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+#include "GameRules.hpp"
+
+namespace {
+
+constexpr std::size_t kReadChunk = std::size_t(1) << 20;
+constexpr std::size_t kFlushAt = std::size_t(1) << 16;
+
+bool onlyBlanks(const char* p, const char* end) {
+    while (p != end && isBlank(*p)) ++p;
+    return p == end;
+}
+
+// Parses the next field of [p; end) and moves p past it.
+template <class T>
+bool nextField(const char*& p, const char* end, T& v) {
+    while (p != end && isBlank(*p)) ++p;
+    const auto [q, ec] = std::from_chars(p, end, v);
+    if (ec != std::errc() || q == p || (q != end && !isBlank(*q))) return false;
+    p = q;
+    return true;
+}
+
+template <class T>
+void putNumber(std::string& out, T v) {
+    char buf[32];
+    const auto res = std::to_chars(buf, buf + sizeof buf, v);
+    out.append(buf, res.ptr);
+}
+
+}
+
+const char* transcriptEndName(TranscriptEnd e) {
+    switch (e) {
+    case TranscriptEnd::Unfinished: return "unfinished";
+    case TranscriptEnd::Completed: return "completed";
+    case TranscriptEnd::Overthrown: return "overthrown";
+    case TranscriptEnd::Depopulated: return "depopulated";
+    case TranscriptEnd::Plague: return "plague";
+    case TranscriptEnd::Refused: return "refused";
+    case TranscriptEnd::Malformed: return "malformed";
+    }
+    return "?";
+}
+
+const char* scoreTierName(ScoreTier t) {
+    switch (t) {
+    case ScoreTier::Terrible: return "terrible";
+    case ScoreTier::Mediocre: return "mediocre";
+    case ScoreTier::Good: return "good";
+    case ScoreTier::Excellent: return "excellent";
+    }
+    return "?";
+}
+
+void formatTranscriptResult(const TranscriptResult& t, std::string& out) {
+    out += "seed=";
+    putNumber(out, t.seed);
+    out += " id=";
+    putNumber(out, t.id);
+    out += " end=";
+    out += transcriptEndName(t.end);
+    out += " years=";
+    putNumber(out, t.years);
+    if (t.end == TranscriptEnd::Completed) {
+        out += " P=";
+        putNumber(out, t.score.avgStarvedPercent);
+        out += " L=";
+        putNumber(out, t.score.acresPerCitizen);
+        out += " tier=";
+        out += scoreTierName(t.score.tier);
+    }
+    if (t.end != TranscriptEnd::Malformed) {
+        out += " population=";
+        putNumber(out, t.population);
+        out += " land=";
+        putNumber(out, t.landAcres);
+        out += " grain=";
+        putNumber(out, t.grainBushels);
+    }
+    if (t.end == TranscriptEnd::Refused || t.end == TranscriptEnd::Malformed) {
+        out += " line=";
+        putNumber(out, t.badLine);
+    }
+}
+
+bool isTranscriptGameHeader(const char* p, const char* end) {
+    while (p != end && isBlank(*p)) ++p;
+    return end - p >= 4 && std::memcmp(p, "game", 4) == 0 && (p + 4 == end || isBlank(p[4]) || p[4] == '#');
+}
+
+TranscriptPlayer::TranscriptPlayer(const GameRules& r, const TranscriptOptions& opt, Sink sink,
+                                   std::uint64_t firstLine)
+    : r_(r), opt_(opt), sink_(std::move(sink)), nextLine_(firstLine) {}
+
+void TranscriptPlayer::line(const char* p, const char* end) {
+    const std::uint64_t lineNo = nextLine_++;
+    if (const void* hash = std::memchr(p, '#', static_cast<std::size_t>(end - p))) {
+        end = static_cast<const char*>(hash);
+    }
+    while (p != end && isBlank(*p)) ++p;
+    if (p == end) return;
+
+    if (isTranscriptGameHeader(p, end)) {
+        finish();
+        game_ = TranscriptResult{};
+        game_.line = lineNo;
+        startGame(p + 4, end);
+    } else if (!open_) {
+        ++malformedLines_; // decisions before the first game
+    } else if (game_.end == TranscriptEnd::Unfinished) {
+        playYear(p, end);
+    }
+}
+
+void TranscriptPlayer::startGame(const char* p, const char* end) {
+    open_ = true;
+    if (!nextField(p, end, game_.seed) || (!onlyBlanks(p, end) && !nextField(p, end, game_.id)) ||
+        !onlyBlanks(p, end)) {
+        ++malformedLines_;
+        game_.end = TranscriptEnd::Malformed;
+        game_.badLine = game_.line;
+        return;
+    }
+    initNewGame(s_, r_);
+    rng_ = opt_.sharedSeed ? Rng(opt_.seed) : Rng(game_.seed, game_.id);
+}
+
+void TranscriptPlayer::playYear(const char* p, const char* end) {
+    Decisions d;
+    if (!nextField(p, end, d.acresToBuy) || !nextField(p, end, d.acresToSell) ||
+        !nextField(p, end, d.bushelsToFeed) || !nextField(p, end, d.acresToPlant) || !onlyBlanks(p, end)) {
+        ++malformedLines_;
+        game_.end = TranscriptEnd::Malformed;
+        game_.badLine = nextLine_ - 1;
+        return;
+    }
+
+    beginYear(s_, r_, rng_);
+    if (opt_.render) opt_.render(s_, d);
+    if (checkDecisions(s_, d, r_) != DecisionError::None) {
+        game_.end = TranscriptEnd::Refused;
+        game_.badLine = nextLine_ - 1;
+        return;
+    }
+
+    ++game_.years;
+    ++years_;
+    switch (resolveYear(s_, d, r_, rng_)) {
+    case YearOutcome::Continued:
+        if (s_.year > r_.totalYears) game_.end = TranscriptEnd::Completed;
+        break;
+    case YearOutcome::Overthrown: game_.end = TranscriptEnd::Overthrown; break;
+    case YearOutcome::Depopulated: game_.end = TranscriptEnd::Depopulated; break;
+    case YearOutcome::PlagueWipeout: game_.end = TranscriptEnd::Plague; break;
+    }
+}
+
+void TranscriptPlayer::finish() {
+    if (!open_) return;
+    open_ = false;
+    if (game_.end == TranscriptEnd::Completed) game_.score = computeFinalScore(s_, r_);
+    if (game_.end != TranscriptEnd::Malformed) {
+        game_.population = s_.population;
+        game_.landAcres = s_.landAcres;
+        game_.grainBushels = s_.grainBushels();
+    }
+    sink_(game_);
+}
+
+bool runTranscripts(std::FILE* in, const GameRules& r, std::ostream& out, const TranscriptOptions& opt,
+                    TranscriptStats& stats) {
+    std::string results; // result lines not yet written
+    auto flush = [&] {
+        out.write(results.data(), static_cast<std::streamsize>(results.size()));
+        results.clear();
+    };
+    TranscriptPlayer player(r, opt, [&](const TranscriptResult& t) {
+        ++stats.games;
+        results += "game=";
+        putNumber(results, stats.games);
+        results += ' ';
+        formatTranscriptResult(t, results);
+        results += '\n';
+        // Keep the result after the game's reports.
+        if (opt.render || results.size() >= kFlushAt) flush();
+    });
+
+    std::vector<char> buf(kReadChunk);
+    std::size_t have = 0;
+    for (;;) {
+        if (have == buf.size()) buf.resize(buf.size() * 2); // a line longer than the buffer
+        const std::size_t got = std::fread(buf.data() + have, 1, buf.size() - have, in);
+        if (got == 0) break;
+        have += got;
+
+        const char* p = buf.data();
+        const char* end = p + have;
+        for (;;) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+            if (!nl) break;
+            player.line(p, nl);
+            p = nl + 1;
+        }
+        have = static_cast<std::size_t>(end - p);
+        std::memmove(buf.data(), p, have);
+    }
+    if (have > 0) player.line(buf.data(), buf.data() + have);
+    player.finish();
+    flush();
+    out.flush();
+
+    stats.years = player.years();
+    stats.malformedLines = player.malformedLines();
+    return !std::ferror(in);
+}
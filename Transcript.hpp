@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "GameEngine.hpp"
+
+// Recorded games scored without the dialogue.
+//
+// Line protocol, fields separated by spaces or tabs, '#' starts a comment:
+//   game SEED [GAME_ID]       a new game played with Rng(SEED, GAME_ID)
+//   BUY SELL FEED PLANT       one year's decisions, in prompt order
+// A game runs to the next "game" line or the end of the input, and gives one
+// result line:
+//   game=1 seed=7 id=0 end=completed years=10 P=2.5 L=9.8 tier=good population=98 land=960 grain=3120.5
+// end is completed, overthrown, depopulated, plague, unfinished (the
+// transcript stops before the last year), refused (a decision the prompts
+// would not accept) or malformed; the last two add line=N. P, L and tier are
+// only scored for completed games. Decisions after the end are ignored.
+
+enum class TranscriptEnd {
+    Unfinished,
+    Completed,
+    Overthrown,
+    Depopulated,
+    Plague,
+    Refused,
+    Malformed,
+};
+
+// How one recorded game went. Plain data, so results can be spilled to disk.
+struct TranscriptResult {
+    std::uint64_t seed = 0;
+    std::uint64_t id = 0;
+    std::uint64_t line = 0;    // of the "game" header
+    std::uint64_t badLine = 0; // the refused or malformed line
+    TranscriptEnd end = TranscriptEnd::Unfinished;
+    int years = 0;             // accepted years
+    FinalScore score;          // completed games only
+    int population = 0;
+    int landAcres = 0;
+    double grainBushels = 0.0;
+};
+
+const char* transcriptEndName(TranscriptEnd e);
+const char* scoreTierName(ScoreTier t);
+// Appends the fields of a result line after "game=N ", without a newline.
+void formatTranscriptResult(const TranscriptResult& t, std::string& out);
+
+struct TranscriptOptions {
+    bool sharedSeed = false; // play every game with Rng(seed), whatever its header says
+    std::uint64_t seed = 0;
+    // Called before each year is checked, with the land price rolled.
+    std::function<void(const GameState&, const Decisions&)> render;
+};
+
+// Plays transcripts fed to it line by line and hands each finished game to
+// the sink.
+class TranscriptPlayer {
+public:
+    using Sink = std::function<void(const TranscriptResult&)>;
+
+    TranscriptPlayer(const GameRules& r, const TranscriptOptions& opt, Sink sink, std::uint64_t firstLine = 1);
+
+    // One line without its newline.
+    void line(const char* p, const char* end);
+    // Reports the game still open at the end of the input.
+    void finish();
+
+    std::uint64_t years() const { return years_; }
+    std::uint64_t malformedLines() const { return malformedLines_; }
+
+private:
+    void startGame(const char* p, const char* end);
+    void playYear(const char* p, const char* end);
+
+    const GameRules& r_;
+    TranscriptOptions opt_;
+    Sink sink_;
+    std::uint64_t nextLine_;
+    std::uint64_t years_ = 0;
+    std::uint64_t malformedLines_ = 0;
+
+    bool open_ = false;
+    TranscriptResult game_;
+    GameState s_;
+    Rng rng_{0};
+};
+
+// True for a "game" header line: where an archive may be cut between games.
+bool isTranscriptGameHeader(const char* p, const char* end);
+
+struct TranscriptStats {
+    std::uint64_t games = 0;
+    std::uint64_t years = 0;
+    std::uint64_t malformedLines = 0;
+};
+
+// Plays every game of the input and writes one result line per game to out.
+// Results are written in large blocks, or after every game when opt.render
+// is set so that they follow the game's reports.
+// Returns false on a read error.
+bool runTranscripts(std::FILE* in, const GameRules& r, std::ostream& out, const TranscriptOptions& opt,
+                    TranscriptStats& stats);
@@ -0,0 +1,104 @@
+#include "WorkStealingPool.hpp"
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    for (unsigned i = 0; i < threads; ++i) slices_.push_back(std::make_unique<Slice>());
+    for (unsigned i = 0; i < threads; ++i) threads_.emplace_back([this, i] { workerLoop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_) t.join();
+}
+
+void WorkStealingPool::run(std::size_t tasks, const Body& body) {
+    if (tasks == 0) return;
+
+    const std::size_t n = slices_.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        std::lock_guard<std::mutex> lock(slices_[i]->m);
+        slices_[i]->begin = tasks * i / n;
+        slices_[i]->end = tasks * (i + 1) / n;
+    }
+
+    std::unique_lock<std::mutex> lock(m_);
+    body_ = &body;
+    busy_ = static_cast<unsigned>(n);
+    ++generation_;
+    wake_.notify_all();
+    done_.wait(lock, [this] { return busy_ == 0; });
+    body_ = nullptr;
+}
+
+bool WorkStealingPool::takeOwn(unsigned worker, std::size_t& task) {
+    Slice& s = *slices_[worker];
+    std::lock_guard<std::mutex> lock(s.m);
+    if (s.begin == s.end) return false;
+    task = s.begin++;
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned worker, std::size_t& task) {
+    for (;;) {
+        // Pick the victim with the most work left.
+        unsigned victim = worker;
+        std::size_t most = 0;
+        for (unsigned i = 0; i < slices_.size(); ++i) {
+            if (i == worker) continue;
+            std::lock_guard<std::mutex> lock(slices_[i]->m);
+            std::size_t left = slices_[i]->end - slices_[i]->begin;
+            if (left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim == worker) return false;
+
+        std::size_t from, to;
+        {
+            Slice& v = *slices_[victim];
+            std::lock_guard<std::mutex> lock(v.m);
+            std::size_t left = v.end - v.begin;
+            if (left == 0) continue; // emptied meanwhile, look again
+            std::size_t half = (left + 1) / 2;
+            to = v.end;
+            from = v.end - half;
+            v.end = from;
+        }
+
+        Slice& own = *slices_[worker];
+        std::lock_guard<std::mutex> lock(own.m);
+        task = from;
+        own.begin = from + 1;
+        own.end = to;
+        return true;
+    }
+}
+
+void WorkStealingPool::workerLoop(unsigned worker) {
+    unsigned long long seen = 0;
+    for (;;) {
+        const Body* body;
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+            body = body_;
+        }
+
+        std::size_t task;
+        while (takeOwn(worker, task) || steal(worker, task)) {
+            (*body)(task, worker);
+        }
+
+        std::lock_guard<std::mutex> lock(m_);
+        if (--busy_ == 0) done_.notify_one();
+    }
+}
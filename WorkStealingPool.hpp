@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops over task indices.
+// Every worker starts with a contiguous slice of the tasks and takes them from
+// the front; a worker that runs dry steals the back half of the fullest other
+// slice. Locks are taken once per task, never inside a task.
+class WorkStealingPool {
+public:
+    using Body = std::function<void(std::size_t task, unsigned worker)>;
+
+    explicit WorkStealingPool(unsigned threads = 0); // 0 = all hardware threads
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(slices_.size()); }
+
+    // Calls body(task, worker) for every task in [0; tasks) and waits for all of
+    // them. worker is in [0; size()) and stable for the duration of the call.
+    void run(std::size_t tasks, const Body& body);
+
+private:
+    struct Slice {
+        std::mutex m;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    void workerLoop(unsigned worker);
+    bool takeOwn(unsigned worker, std::size_t& task);
+    bool steal(unsigned worker, std::size_t& task);
+
+    std::vector<std::unique_ptr<Slice>> slices_;
+    std::vector<std::thread> threads_;
+
+    std::mutex m_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const Body* body_ = nullptr;
+    unsigned long long generation_ = 0;
+    unsigned busy_ = 0;
+    bool stop_ = false;
+};
@@ -1,380 +1,216 @@
 #include <algorithm>
-#include <cstdlib>
-#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
-#include <limits>
-#include <random>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "Advisor.hpp"
+#include "DpSolver.hpp"
+#include "GameDialog.hpp"
+#include "GameEngine.hpp"
 #include "GameRules.hpp"
 #include "GameState.hpp"
+#include "Leaderboard.hpp"
+#include "Policy.hpp"
 #include "SaveManager.hpp"
+#include "Transcript.hpp"
 
 namespace {
 
-class Rng {
-public:
-    Rng() : engine_(std::random_device{}()) {}
-
-    int intInRange(int lo, int hi) {
-        std::uniform_int_distribution<int> dist(lo, hi);
-        return dist(engine_);
-    }
-
-    bool chance(double probability) {
-        std::bernoulli_distribution dist(probability);
-        return dist(engine_);
-    }
-
-private:
-    std::mt19937 engine_;
+struct GameOptions {
+    bool hasSeed = false;
+    std::uint64_t seed = 0; // --seed N makes the random events reproducible
+    std::string optimumTable; // --optimal TABLE enables the "hint" command
+    bool advisor = false;     // --advisor: so does a search while the player types
+    std::string policy;       // --policy SPEC: and that policy, which the advisor then plays on like
+    std::string script;       // --script FILE scores recorded games ("-" = stdin)
+    std::string leaderboard;  // --leaderboard FILE records a game played to its end
+    std::uint64_t player = 0; // --player ID: as this player's
+    bool render = false;      // print the year reports of scripted games
 };
 
-std::string readLineTrimmed() {
-    std::string line;
-    if (!std::getline(std::cin, line)) {
-        std::cout << "\nInput ended.\n";
-        std::exit(0);
-    }
-    auto is_ws = [](unsigned char c) { return c == ' ' || c == '\t' || c == '\r'; };
-    while (!line.empty() && is_ws(static_cast<unsigned char>(line.front()))) line.erase(line.begin());
-    while (!line.empty() && is_ws(static_cast<unsigned char>(line.back()))) line.pop_back();
-    return line;
-}
-
-int readIntNonNegative(const std::string& prompt) {
-    for (;;) {
-        std::cout << prompt;
-        std::string s = readLineTrimmed();
+bool parseOptions(int argc, char** argv, GameOptions& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
         try {
-            size_t pos = 0;
-            int v = std::stoi(s, &pos, 10);
-            if (pos != s.size()) throw std::invalid_argument("junk");
-            if (v < 0) throw std::out_of_range("negative");
-            return v;
+            if (a == "--seed" && i + 1 < argc) {
+                o.seed = std::stoull(argv[++i]);
+                o.hasSeed = true;
+            } else if (a == "--optimal" && i + 1 < argc) {
+                o.optimumTable = argv[++i];
+            } else if (a == "--advisor") {
+                o.advisor = true;
+            } else if (a == "--policy" && i + 1 < argc) {
+                o.policy = argv[++i];
+            } else if (a == "--leaderboard" && i + 1 < argc) {
+                o.leaderboard = argv[++i];
+            } else if (a == "--player" && i + 1 < argc) {
+                o.player = std::stoull(argv[++i]);
+            } else if (a == "--script" && i + 1 < argc) {
+                o.script = argv[++i];
+            } else if (a == "--batch") {
+                o.script = "-";
+            } else if (a == "--render") {
+                o.render = true;
+            } else {
+                return false;
+            }
         } catch (...) {
-            std::cout << "Please enter an integer >= 0.\n";
-        }
-    }
-}
-
-bool askYesNo(const std::string& prompt) {
-    for (;;) {
-        std::cout << prompt;
-        std::string s = readLineTrimmed();
-        if (s.empty()) continue;
-        char c = static_cast<char>(std::tolower(static_cast<unsigned char>(s[0])));
-        if (c == 'y') return true;
-        if (c == 'n') return false;
-        std::cout << "Please enter Y/N.\n";
-    }
-}
-
-std::string formatGrain(double bushels) {
-    double rounded = std::round(bushels * 2.0) / 2.0;
-    if (std::fabs(rounded - std::round(rounded)) < 1e-9) {
-        return std::to_string(static_cast<long long>(std::llround(rounded)));
-    }
-    std::string s = std::to_string(rounded);
-    while (!s.empty() && s.back() == '0') s.pop_back();
-    if (!s.empty() && s.back() == '.') s.pop_back();
-    return s;
-}
-
-// 
-
-void initNewGame(GameState& s, const GameRules& r) {
-    s.year = 1;
-    s.population = r.initialPopulation;
-    s.grainBushels = r.initialGrainBushels;
-    s.landAcres = r.initialLandAcres;
-
-    s.starvedLastYear = 0;
-    s.immigrantsLastYear = 0;
-    s.plagueLastYear = false;
-    s.yieldPerAcreLastYear = 0;
-    s.harvestTotalLastYear = 0;
-    s.ratsAteLastYear = 0;
-
-    s.landPriceThisYear = 0;
-    s.awaitingPlayerDecisions = false;
-
-    s.yearsCompleted = 0;
-    s.starvationPercentSum = 0.0;
-}
-
-void printRoundHeader(const GameState& s) {
-    std::cout << "\n========================================\n";
-    std::cout << "Year " << s.year << " of your rule\n";
-    std::cout << "----------------------------------------\n";
-}
-
-void printReport(const GameState& s) {
-    printRoundHeader(s);
-
-    if (s.year == 1) {
-        std::cout << "You have just taken the throne.\n";
-    } else {
-        if (s.starvedLastYear > 0) {
-            std::cout << s.starvedLastYear << " people starved to death last year.\n";
-        }
-        if (s.immigrantsLastYear > 0) {
-            std::cout << s.immigrantsLastYear << " people moved into the city.\n";
-        }
-        if (s.plagueLastYear) {
-            std::cout << "A plague killed half the population!\n";
-        }
-
-        if (s.harvestTotalLastYear > 0) {
-            std::cout << "We harvested " << s.harvestTotalLastYear
-                      << " bushels of grain (" << s.yieldPerAcreLastYear
-                      << " per acre).\n";
-        }
-        if (s.ratsAteLastYear > 0) {
-            std::cout << "Rats destroyed " << s.ratsAteLastYear << " bushels of grain.\n";
+            return false;
         }
     }
-
-    std::cout << "Current population: " << s.population << "\n";
-    std::cout << "Grain in storage: " << formatGrain(s.grainBushels) << " bushels\n";
-    std::cout << "Land owned: " << s.landAcres << " acres\n";
-    std::cout << "Land price this year: " << s.landPriceThisYear << " bushels per acre\n";
-}
-
-bool maybeSaveAndQuitAtRoundStart(const SaveManager& saves, const GameState& s) {
-    std::cout << "\nAt the start of the year you may quit and save your progress.\n";
-    std::cout << "Save and quit? (Y/N, empty = N): ";
-    std::string ans = readLineTrimmed();
-    if (ans.empty()) return false;
-    char c = static_cast<char>(std::tolower(static_cast<unsigned char>(ans[0])));
-    if (c == 'y') {
-        saves.save(s);
-        std::cout << "Progress saved. See you!\n";
-        return true;
-    }
-    return false;
+    return true;
 }
 
-bool playOneYear(GameState& s, const GameRules& r, Rng& rng, const SaveManager& saves) {
-    if (!s.awaitingPlayerDecisions) {
-        s.landPriceThisYear = rng.intInRange(r.landPriceMin, r.landPriceMax);
-        s.awaitingPlayerDecisions = true;
-    }
-
-    printReport(s);
-    if (maybeSaveAndQuitAtRoundStart(saves, s)) {
-        return false;
-    }
-
-    std::cout << "\nWhat do you wish to do this year?\n";
-
-    // 1)  
-    int acresToBuy = 0;
-    int acresToSell = 0;
-
-    for (;;) {
-        acresToBuy = readIntNonNegative("How many acres do you wish to buy? ");
-        double cost = static_cast<double>(acresToBuy) * s.landPriceThisYear;
-        if (cost <= s.grainBushels + 1e-9) break;
-        std::cout << "Not enough grain to buy that much land.\n";
-    }
+// Offers the saved game if there is one, then plays. Every played year goes to
+// the journal before it is resolved.
+Task<DialogEnd> runGame(Console& io, const GameRules& rules, const SaveManager& saves, GameState& state, Rng& rng,
+                        const DialogHooks& hooks) {
+    bool loaded = false;
 
-    if (acresToBuy == 0) {
-        for (;;) {
-            acresToSell = readIntNonNegative("How many acres do you wish to sell? ");
-            if (acresToSell <= s.landAcres) break;
-            std::cout << "You don't have that much land.\n";
+    GameState saved;
+    Rng savedRng = rng;
+    const SaveStatus status = saves.resume(rules, saved, savedRng);
+    if (status == SaveStatus::Loaded) {
+        loaded = co_await askYesNo(io, "A saved game was found. Continue? (Y/N): ");
+        if (loaded) {
+            state = saved;
+            rng = savedRng;
         }
+    } else if (status == SaveStatus::Corrupted) {
+        io.out << "The save file is corrupted. Starting a new game.\n";
     }
 
-    s.landAcres += acresToBuy;
-    s.landAcres -= acresToSell;
-
-    s.grainBushels -= static_cast<double>(acresToBuy) * s.landPriceThisYear;
-    s.grainBushels += static_cast<double>(acresToSell) * s.landPriceThisYear;
-
-    // 2)  .
-    int bushelsToFeed = 0;
-    for (;;) {
-        bushelsToFeed = readIntNonNegative("How many bushels of grain do you wish to feed the people? ");
-        if (bushelsToFeed <= s.grainBushels + 1e-9) break;
-        std::cout << "You have only " << formatGrain(s.grainBushels) << " bushels in storage.\n";
-    }
-    s.grainBushels -= bushelsToFeed;
-
-    // 3) .
-    int acresToPlant = 0;
-    for (;;) {
-        acresToPlant = readIntNonNegative("How many acres do you wish to plant? ");
-        if (acresToPlant > s.landAcres) {
-            std::cout << "You have only " << s.landAcres << " acres.\n";
-            continue;
-        }
-        if (acresToPlant > s.population * r.acresPerPersonMax) {
-            std::cout << "Your people can work at most " << (s.population * r.acresPerPersonMax)
-                      << " acres.\n";
-            continue;
-        }
-        double seedsNeeded = acresToPlant * r.seedsBushelsPerAcre;
-        if (seedsNeeded > s.grainBushels + 1e-9) {
-            std::cout << "Not enough grain for seed. Needed " << formatGrain(seedsNeeded)
-                      << ", in storage " << formatGrain(s.grainBushels) << ".\n";
-            continue;
+    if (!loaded) {
+        initNewGame(state, rules);
+        beginYear(state, rules, rng);
+        if (!saves.startJournal(rules, rng)) {
+            io.out << "Warning: the game cannot be saved.\n";
         }
-        s.grainBushels -= seedsNeeded;
-        break;
     }
 
-    s.awaitingPlayerDecisions = false;
-
-    // 
-    const int yieldPerAcre = rng.intInRange(r.yieldPerAcreMin, r.yieldPerAcreMax);
-    const int harvestTotal = acresToPlant * yieldPerAcre;
-    s.grainBushels += harvestTotal;
-
-    // 
-    int maxRats = static_cast<int>(std::floor(s.grainBushels * r.ratsMaxFraction));
-    if (maxRats < 0) maxRats = 0;
-    int ratsAte = (maxRats == 0) ? 0 : rng.intInRange(0, maxRats);
-    s.grainBushels -= ratsAte;
-    if (s.grainBushels < 0.0) s.grainBushels = 0.0;
-
-    // 
-    const int populationStart = s.population;
-    const int peopleFed = bushelsToFeed / r.bushelsPerPersonPerYear;
-    const int starved = std::max(0, populationStart - peopleFed);
-
-    const double starvedPercent = (populationStart == 0)
-        ? 0.0
-        : (100.0 * static_cast<double>(starved) / static_cast<double>(populationStart));
-
-    if (starvedPercent > r.starvationLossFraction * 100.0 + 1e-9) {
-        s.starvedLastYear = starved;
-        s.immigrantsLastYear = 0;
-        s.plagueLastYear = false;
-        s.yieldPerAcreLastYear = yieldPerAcre;
-        s.harvestTotalLastYear = harvestTotal;
-        s.ratsAteLastYear = ratsAte;
-
-        std::cout << "\nMore than " << static_cast<int>(r.starvationLossFraction * 100)
-                  << "% of the population starved. You have been overthrown.\n";
-        return false;
-    }
+    const DialogEnd end = co_await playGame(io, state, rules, rng, hooks);
+    co_return end;
+}
 
-    s.population -= starved;
-    if (s.population <= 0) {
-        std::cout << "\nAll people have died. Game over.\n";
-        return false;
+// Scores recorded games instead of asking anybody: one result line per game.
+int runScript(const GameRules& rules, const GameOptions& opt) {
+    std::FILE* in = opt.script == "-" ? stdin : std::fopen(opt.script.c_str(), "rb");
+    if (!in) {
+        std::cerr << "Cannot read " << opt.script << "\n";
+        return 1;
     }
-
-    // 
-    int immigrants = static_cast<int>(
-        (starved / 2.0) + (5.0 - static_cast<double>(yieldPerAcre)) * (s.grainBushels / 600.0) + 1.0
-    );
-    immigrants = std::clamp(immigrants, r.immigrantsMin, r.immigrantsMax);
-    s.population += immigrants;
-
-    // 
-    bool plague = rng.chance(r.plagueProbability);
-    if (plague) {
-        s.population /= 2; // round down
-        if (s.population <= 0) {
-            std::cout << "\nThe plague wiped everyone out. Game over.\n";
-            return false;
-        }
+    TranscriptOptions topt;
+    if (opt.render) {
+        topt.render = [](const GameState& s, const Decisions& d) {
+            printReport(std::cout, s);
+            std::cout << "> buy " << d.acresToBuy << ", sell " << d.acresToSell << ", feed " << d.bushelsToFeed
+                      << ", plant " << d.acresToPlant << "\n";
+        };
+    }
+    TranscriptStats stats;
+    const bool ok = runTranscripts(in, rules, std::cout, topt, stats);
+    if (in != stdin) std::fclose(in);
+    if (!ok) {
+        std::cerr << "Error reading " << opt.script << "\n";
+        return 1;
     }
-
-    s.starvedLastYear = starved;
-    s.immigrantsLastYear = immigrants;
-    s.plagueLastYear = plague;
-    s.yieldPerAcreLastYear = yieldPerAcre;
-    s.harvestTotalLastYear = harvestTotal;
-    s.ratsAteLastYear = ratsAte;
-
-    s.yearsCompleted += 1;
-    s.starvationPercentSum += starvedPercent;
-
-    s.year += 1;
-    return true;
-}
-
-void printFinalScore(const GameState& s, const GameRules& r) {
-    std::cout << "\n========================================\n";
-    std::cout << "Summary of your rule\n";
-    std::cout << "----------------------------------------\n";
-
-    const double avgStarvedPercent = (s.yearsCompleted > 0)
-        ? (s.starvationPercentSum / static_cast<double>(s.yearsCompleted))
-        : 0.0;
-    const double acresPerCitizen = (s.population > 0)
-        ? (static_cast<double>(s.landAcres) / static_cast<double>(s.population))
-        : 0.0;
-
-    std::cout << "Average percent starved per year (P): " << avgStarvedPercent << "%\n";
-    std::cout << "Acres of land per citizen (L): " << acresPerCitizen << "\n\n";
-
-    if (avgStarvedPercent > r.pBadLower && acresPerCitizen < r.lBadUpper) {
-        std::cout << "Terrible: you were driven out of the city.\n";
-    } else if (avgStarvedPercent > r.pOkLower && acresPerCitizen < r.lOkUpper) {
-        std::cout << "Mediocre: your rule was harsh, but the city survived.\n";
-    } else if (avgStarvedPercent > r.pGoodLower && acresPerCitizen < r.lGoodUpper) {
-        std::cout << "Good: you managed the city fairly well.\n";
-    } else {
-        std::cout << "Excellent: outstanding rule!\n";
+    if (stats.malformedLines > 0) {
+        std::cerr << stats.malformedLines << " malformed lines in " << opt.script << "\n";
+        return 1;
     }
+    return 0;
 }
 
 } 
 
-int main() {
+int main(int argc, char** argv) {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
 
+    GameOptions opt;
+    if (!parseOptions(argc, argv, opt)) {
+        std::cerr << "Usage: Hammurabi [--seed N] [--optimal TABLE] [--advisor] [--policy NAME]\n"
+                  << "                 [--leaderboard FILE [--player ID]]\n"
+                  << "       Hammurabi --script FILE | --batch [--render]\n";
+        return 2;
+    }
+
     GameRules rules;
     if (!rules.loadFromFile("game_rules.txt")) {
         std::cerr << "Failed to read game_rules.txt or the file contains errors.\n";
         return 1;
     }
 
-    SaveManager saves("game_save.txt");
-    GameState state;
-    bool loaded = false;
+    if (!opt.script.empty()) {
+        return runScript(rules, opt);
+    }
 
-    if (saves.hasValidSave()) {
-        bool cont = askYesNo("A saved game was found. Continue? (Y/N): ");
-        if (cont) {
-            state = saves.load();
-            loaded = IsValidSave(state);
-            if (!loaded) {
-                std::cout << "The save file is corrupted. Starting a new game.\n";
-            }
-        }
+    Leaderboard board;
+    if (!opt.leaderboard.empty() && !board.open(opt.leaderboard)) {
+        std::cerr << "Cannot open the leaderboard " << opt.leaderboard << ".\n";
+        return 1;
     }
 
-    if (!loaded) {
-        initNewGame(state, rules);
-        Rng rng;
-        state.landPriceThisYear = rng.intInRange(rules.landPriceMin, rules.landPriceMax);
-        state.awaitingPlayerDecisions = true;
-        saves.save(state);
+    DpTable optimum;
+    if (!opt.optimumTable.empty() && !optimum.load(opt.optimumTable, rules)) {
+        std::cerr << "Cannot use " << opt.optimumTable << ": missing, damaged or solved for other rules.\n";
+        return 1;
     }
 
-    Rng rng;
+    SaveManager saves;
+    GameState state;
+    Rng rng = opt.hasSeed ? Rng(opt.seed) : Rng();
 
-    while (state.year <= rules.totalYears) {
-        bool ok = playOneYear(state, rules, rng, saves);
+    std::unique_ptr<Policy> policy;
+    if (!opt.policy.empty() && !(policy = makePolicy(opt.policy, rules))) {
+        std::cerr << "Unknown policy or unusable file: " << opt.policy << "\n";
+        return 1;
+    }
 
-        if (!ok) {
-            if (!state.awaitingPlayerDecisions) {
-                saves.clear();
-            }
+    // Rollouts play on like --policy or else the trader; one core is left to the game.
+    TraderPolicy trader;
+    std::unique_ptr<Advisor> advisor;
+    if (opt.advisor) {
+        AdvisorOptions aopt;
+        aopt.threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        advisor = std::make_unique<Advisor>(rules, policy ? *policy : static_cast<const Policy&>(trader), aopt);
+    }
+
+    DialogHooks hooks;
+    hooks.yearDecided = [&](const Decisions& d) { return saves.appendYear(d); };
+    hooks.optimum = optimum.ready() ? &optimum : nullptr;
+    hooks.advisor = advisor.get();
+    hooks.policy = policy.get();
+
+    // The stdin host of the dialogue: one line per resume.
+    Console io(std::cout);
+    Task<DialogEnd> game = runGame(io, rules, saves, state, rng, hooks);
+    game.start();
+    while (!game.done()) {
+        std::cout.flush();
+        std::string line;
+        if (!std::getline(std::cin, line)) {
+            std::cout << "\nInput ended.\n";
             return 0;
         }
-
-        saves.save(state);
+        io.provide(std::move(line));
     }
 
-    printFinalScore(state, rules);
-    saves.clear(); 
+    if (game.result() == DialogEnd::Finished) {
+        if (!opt.leaderboard.empty() && state.year > rules.totalYears) {
+            std::vector<LeaderboardEntry> entry{leaderboardEntry(opt.player, state, rules)};
+            if (board.insert(entry)) {
+                std::cout << "Leaderboard: place " << board.rankOf(opt.player, rules.hash()) << " of "
+                          << board.count(rules.hash()) << " under these rules.\n";
+            } else {
+                std::cerr << "Cannot write the leaderboard " << opt.leaderboard << ".\n";
+            }
+        }
+        saves.clear();
+    }
     return 0;
 }
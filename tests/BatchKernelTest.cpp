@@ -0,0 +1,121 @@
+// Checks the batch kernels lane by lane against the year rules: every game is
+// played through resolveYear and through a kernel side by side and compared
+// field by field after every year (checkBatchKernel). The tree builds this once
+// per instruction set GameStateBatch.cpp has kernels for; --kernel names the
+// one the build must have, and a CPU without it skips the test. --no-presets
+// runs the stock rules through the generic instantiation instead of theirs.
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GameRules.hpp"
+#include "Policy.hpp"
+#include "RulesPresets.hpp"
+#include "Simulation.hpp"
+
+namespace {
+
+constexpr int kSkipped = 77; // SKIP_RETURN_CODE of the CTest cases
+
+bool cpuHas(BatchKernel k) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (k == BatchKernel::Avx2) return __builtin_cpu_supports("avx2");
+    if (k == BatchKernel::Sse41) return __builtin_cpu_supports("sse4.1");
+#endif
+    (void)k;
+    return true;
+}
+
+struct NamedRules {
+    const char* name;
+    GameRules rules;
+};
+
+// The stock rules and variants that take other paths through the year: a seed
+// cost with a finer grain scale, frequent rats, plague and starvation losses,
+// and games long enough for grain to outgrow a lane.
+std::vector<NamedRules> ruleSets() {
+    std::vector<NamedRules> sets = {{"stock", kStockRules}};
+    GameRules fine = kStockRules;
+    fine.seedsBushelsPerAcre = 0.3;
+    fine.initialGrainBushels = 2800.7;
+    sets.push_back({"fine grain", fine});
+    GameRules harsh = kStockRules;
+    harsh.ratsMaxFraction = 0.4;
+    harsh.plagueProbability = 0.5;
+    harsh.starvationLossFraction = 0.2;
+    harsh.immigrantsMax = 200;
+    sets.push_back({"harsh", harsh});
+    GameRules rich = kStockRules;
+    rich.initialPopulation = 5000;
+    rich.initialGrainBushels = 200000.0;
+    rich.initialLandAcres = 50000;
+    rich.yieldPerAcreMin = 5000;
+    rich.yieldPerAcreMax = 10000;
+    rich.totalYears = 40;
+    sets.push_back({"long and rich", rich});
+    return sets;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::string kernel = batchKernelName(batchKernel());
+    bool presets = true;
+    std::size_t lanes = 4096;
+    std::uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (a == "--kernel" && hasValue) kernel = argv[++i];
+        else if (a == "--no-presets") presets = false;
+        else if (a == "--lanes" && hasValue) lanes = std::stoul(argv[++i]);
+        else if (a == "--seed" && hasValue) seed = std::stoull(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--kernel NAME] [--no-presets] [--lanes N] [--seed S]\n";
+            return 2;
+        }
+    }
+    if (kernel != batchKernelName(batchKernel())) {
+        std::cerr << "built with the " << batchKernelName(batchKernel()) << " kernel, not " << kernel << "\n";
+        return 1;
+    }
+    if (!cpuHas(batchKernel())) {
+        std::cout << "this CPU has no " << kernel << "; skipped\n";
+        return kSkipped;
+    }
+
+    std::vector<BatchKernel> kernels = {BatchKernel::Scalar};
+    if (batchKernel() != BatchKernel::Scalar) kernels.push_back(batchKernel());
+    int failed = 0;
+    for (const NamedRules& set : ruleSets()) {
+        if (!set.rules.isFilled()) {
+            std::cerr << set.name << " rules are incomplete\n";
+            return 1;
+        }
+        for (const char* policyName : {"steady", "trader"}) {
+            const std::unique_ptr<Policy> policy = makePolicy(policyName, set.rules);
+            if (!policy) {
+                std::cerr << "no " << policyName << " policy\n";
+                return 1;
+            }
+            for (BatchKernel k : kernels) {
+                const BatchCheck check = withRules(set.rules, presets, [&](auto rules) {
+                    return checkBatchKernel(rules, *policy, seed, lanes, k);
+                });
+                std::cout << batchKernelName(k) << " kernel, " << set.name << " rules, " << policyName << ": "
+                          << check.mismatches << " mismatches in " << lanes << " lanes";
+                if (check.lanesLeft > 0) std::cout << " (" << check.lanesLeft << " left the batch)";
+                if (check.mismatches > 0) {
+                    std::cout << ", first lane " << check.firstLane << " after year " << check.firstYear;
+                    ++failed;
+                }
+                std::cout << "\n";
+            }
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+// Writes games to each persistent format and reads them back: snapshot saves,
+// decision journals, the session store and the leaderboard. The argument picks
+// the format; files go to the working directory and are removed first. Each
+// case also damages what it wrote the way a crash would and checks that what
+// was committed before survives.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "GameEngine.hpp"
+#include "Leaderboard.hpp"
+#include "Policy.hpp"
+#include "RulesPresets.hpp"
+#include "SaveManager.hpp"
+#include "SessionStore.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::cout << "FAILED: " << what << "\n";
+    ++failures;
+}
+
+std::vector<unsigned char> readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::vector<unsigned char>& data, bool append = false) {
+    std::ofstream out(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+}
+
+// The states at the start of every year of a game, decisions made.
+struct PlayedYear {
+    GameState state;
+    Decisions decisions;
+};
+
+std::vector<PlayedYear> playYears(const GameRules& r, const Policy& policy, Rng& rng) {
+    std::vector<PlayedYear> years;
+    GameState s;
+    initNewGame(s, r);
+    while (s.year <= r.totalYears) {
+        beginYear(s, r, rng);
+        const Decisions d = clampDecisions(s, policy.decide(s, r), r);
+        years.push_back({s, d});
+        if (resolveYear(s, d, r, rng) != YearOutcome::Continued) break;
+    }
+    return years;
+}
+
+int testSave(const GameRules& r, const Policy& policy) {
+    const std::string path = "roundtrip_save.dat";
+    const std::string textPath = "roundtrip_save.txt";
+    std::remove(path.c_str());
+    std::remove(textPath.c_str());
+    SaveManager saves(path, textPath, "roundtrip_save_journal.dat");
+
+    GameState loaded;
+    check(saves.load(loaded) == SaveStatus::Missing, "no save before the first one");
+    for (std::uint64_t game = 0; game < 50; ++game) {
+        Rng rng(7, game);
+        for (const PlayedYear& y : playYears(r, policy, rng)) {
+            GameState back;
+            check(saves.save(y.state) && saves.load(back) == SaveStatus::Loaded && sameState(back, y.state),
+                  "game " + std::to_string(game) + " year " + std::to_string(y.state.year) + " saved and loaded");
+        }
+    }
+
+    const std::vector<unsigned char> good = readFile(path);
+    for (std::size_t i = 0; i < good.size(); i += 7) {
+        std::vector<unsigned char> bad = good;
+        bad[i] ^= 0x40;
+        writeFile(path, bad);
+        check(saves.load(loaded) == SaveStatus::Corrupted, "byte " + std::to_string(i) + " damaged");
+    }
+    writeFile(path, std::vector<unsigned char>(good.begin(), good.end() - 1));
+    check(saves.load(loaded) == SaveStatus::Corrupted, "a short save");
+    check(saves.clear() && saves.load(loaded) == SaveStatus::Missing, "no save after clear");
+    return failures == 0 ? 0 : 1;
+}
+
+int testJournal(const GameRules& r, const Policy& policy) {
+    const std::string path = "roundtrip_journal.dat";
+    SaveManager saves("roundtrip_journal_save.dat", "roundtrip_journal_save.txt", path);
+
+    for (std::uint64_t game = 0; game < 50; ++game) {
+        const std::string name = "game " + std::to_string(game);
+        Rng rng(11, game);
+        check(saves.startJournal(r, rng), name + " journal started");
+        GameState s;
+        initNewGame(s, r);
+        std::size_t years = 0;
+        while (s.year <= r.totalYears) {
+            beginYear(s, r, rng);
+            const Decisions d = clampDecisions(s, policy.decide(s, r), r);
+            check(saves.appendYear(d), name + " year appended");
+            const YearOutcome ending = resolveYear(s, d, r, rng);
+            ++years;
+
+            // The replay ends with the next year's price rolled.
+            GameState expected = s;
+            Rng next = rng;
+            if (ending == YearOutcome::Continued && s.year <= r.totalYears) beginYear(expected, r, next);
+            const JournalReplay j = SaveManager::replayJournal(path, r);
+            check(j.status == SaveStatus::Loaded && j.years == years && !j.tornTail && j.ending == ending &&
+                      sameState(j.state, expected),
+                  name + " replayed after year " + std::to_string(years));
+            if (ending != YearOutcome::Continued) break;
+        }
+
+        const JournalReplay full = SaveManager::replayJournal(path, r);
+        writeFile(path, {0x05, 0x03}, true);
+        const JournalReplay torn = SaveManager::replayJournal(path, r);
+        check(torn.status == SaveStatus::Loaded && torn.tornTail && torn.years == full.years &&
+                  sameState(torn.state, full.state),
+              name + " with a torn last record");
+
+        // A snapshot holds no ending; like resume(), compact only games in play.
+        if (full.ending != YearOutcome::Continued) continue;
+        check(saves.compactJournal(r), name + " compacted");
+        const JournalReplay compacted = SaveManager::replayJournal(path, r);
+        check(compacted.status == SaveStatus::Loaded && compacted.hasSnapshot && compacted.years == 0 &&
+                  sameState(compacted.state, full.state),
+              name + " replayed from its snapshot");
+    }
+
+    GameRules other = r;
+    other.landPriceMax += 1;
+    check(SaveManager::replayJournal(path, other).status == SaveStatus::Corrupted, "a journal of other rules");
+    return failures == 0 ? 0 : 1;
+}
+
+int testStore(const GameRules& r, const Policy& policy) {
+    const std::string path = "roundtrip_store.dat";
+    std::remove(path.c_str());
+    const std::uint64_t rulesHash = r.hash();
+    constexpr std::uint64_t kSessions = 3000; // more than the initial slots, so the file grows
+    const auto sessionId = [](std::uint64_t i) { return 0x9E3779B97F4A7C15ull * (i + 1); };
+
+    std::vector<GameState> kept(kSessions);
+    {
+        SessionStore store;
+        check(store.open(path), "store created");
+        for (std::uint64_t i = 0; i < kSessions; ++i) {
+            Rng rng(13, i);
+            for (const PlayedYear& y : playYears(r, policy, rng)) {
+                check(store.put(sessionId(i), y.state, rulesHash) != 0, "put");
+                kept[i] = y.state;
+            }
+            if (i % 3 == 0) check(store.erase(sessionId(i)) != 0, "erase");
+        }
+        check(store.sync(), "store synced");
+        check(store.stats().sessions == kSessions - (kSessions + 2) / 3, "sessions before reopening");
+    }
+
+    // A slot torn by a crash: damage one session's state.
+    std::vector<unsigned char> file = readFile(path);
+    const std::uint64_t torn = sessionId(1);
+    unsigned char idBytes[sizeof torn];
+    std::memcpy(idBytes, &torn, sizeof torn);
+    const auto at = std::search(file.begin(), file.end(), std::begin(idBytes), std::end(idBytes));
+    check(at != file.end() && file.end() - at > 40, "the damaged session is in the file");
+    if (at != file.end() && file.end() - at > 40) {
+        at[32] ^= 0x40;
+        writeFile(path, file);
+    }
+
+    SessionStore store;
+    check(store.open(path), "store reopened");
+    const SessionStore::Stats st = store.stats();
+    check(st.droppedSlots == 1, "one damaged slot dropped");
+    for (std::uint64_t i = 0; i < kSessions; ++i) {
+        GameState s;
+        std::uint64_t hash = 0;
+        const bool found = store.get(sessionId(i), s, hash);
+        const bool expected = i % 3 != 0 && sessionId(i) != torn;
+        check(found == expected && store.contains(sessionId(i)) == expected,
+              "session " + std::to_string(i) + (expected ? " kept" : " gone"));
+        if (found) check(sameState(s, kept[i]) && hash == rulesHash, "session " + std::to_string(i) + " read back");
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// Ranks the entries of one rules hash like the board: best score first, then
+// log position.
+std::vector<LeaderboardEntry> ranked(const std::vector<LeaderboardEntry>& all, std::uint64_t rulesHash) {
+    std::vector<LeaderboardEntry> out;
+    for (const LeaderboardEntry& e : all) {
+        if (e.rulesHash == rulesHash) out.push_back(e);
+    }
+    std::sort(out.begin(), out.end(), [](const LeaderboardEntry& a, const LeaderboardEntry& b) {
+        return a.score != b.score ? a.score > b.score : a.seq < b.seq;
+    });
+    return out;
+}
+
+void checkBoard(const Leaderboard& board, const std::vector<LeaderboardEntry>& all, const std::string& when) {
+    check(board.size() == all.size(), when + ": size");
+    for (std::uint64_t rulesHash : {1ull, 2ull}) {
+        const std::vector<LeaderboardEntry> expected = ranked(all, rulesHash);
+        check(board.count(rulesHash) == expected.size(), when + ": count");
+        const std::vector<LeaderboardEntry> top = board.top(rulesHash, 100);
+        bool same = top.size() == std::min<std::size_t>(100, expected.size());
+        for (std::size_t i = 0; same && i < top.size(); ++i) same = top[i].seq == expected[i].seq;
+        check(same, when + ": top 100");
+
+        std::vector<char> seen(200, 0);
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            const std::uint64_t player = expected[i].player;
+            if (seen[player]) continue;
+            seen[player] = 1;
+            LeaderboardEntry best;
+            check(board.rankOf(player, rulesHash, &best) == i + 1 && best.seq == expected[i].seq,
+                  when + ": rank of player " + std::to_string(player));
+        }
+        for (std::uint64_t player = 0; player < seen.size(); ++player) {
+            if (!seen[player]) check(board.rankOf(player, rulesHash) == 0, when + ": no rank");
+        }
+    }
+}
+
+int testLeaderboard() {
+    const std::string path = "roundtrip_leaderboard.dat";
+    for (const char* suffix : {"", ".idx", ".lock"}) std::remove((path + suffix).c_str());
+
+    // Few distinct scores, so ties are ranked by log position.
+    std::vector<LeaderboardEntry> all;
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int> player(0, 199);
+    std::uniform_int_distribution<int> quarter(0, 3);
+    std::uniform_int_distribution<int> score(0, 500);
+    const auto makeBatch = [&](std::size_t n) {
+        std::vector<LeaderboardEntry> batch(n);
+        for (LeaderboardEntry& e : batch) {
+            e.player = static_cast<std::uint64_t>(player(rng));
+            e.rulesHash = quarter(rng) == 0 ? 2 : 1;
+            e.score = score(rng) / 4.0;
+        }
+        return batch;
+    };
+
+    for (std::size_t round = 0; round < 4; ++round) {
+        Leaderboard board;
+        check(board.open(path), "leaderboard opened");
+        checkBoard(board, all, "reopened " + std::to_string(round));
+        for (std::size_t n : {1000, 10, 300, 1}) {
+            std::vector<LeaderboardEntry> batch = makeBatch(n);
+            check(board.insert(batch), "batch inserted");
+            all.insert(all.end(), batch.begin(), batch.end());
+            checkBoard(board, all, "after " + std::to_string(all.size()) + " entries");
+        }
+    }
+
+    // A torn last entry is cut off and a missing index is rebuilt.
+    writeFile(path, {1, 2, 3, 4, 5}, true);
+    std::remove((path + ".idx").c_str());
+    Leaderboard board;
+    check(board.open(path), "leaderboard opened with a torn tail and no index");
+    checkBoard(board, all, "rebuilt");
+    return failures == 0 ? 0 : 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+    const std::string what = argc == 2 ? argv[1] : "";
+    const GameRules& r = kStockRules;
+    const std::unique_ptr<Policy> policy = makePolicy("trader", r);
+    if (what == "save") return testSave(r, *policy);
+    if (what == "journal") return testJournal(r, *policy);
+    if (what == "store") return testStore(r, *policy);
+    if (what == "leaderboard") return testLeaderboard();
+    std::cerr << "Usage: " << argv[0] << " save|journal|store|leaderboard\n";
+    return 2;
+}